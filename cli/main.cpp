@@ -0,0 +1,354 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#include <CObservationTree.h>
+#include <CProfiler.h>
+#include <CMemoryMonitor.h>
+#include <calib_solvers/CCalibFromPlanes.h>
+#include <calib_solvers/CCalibFromLines.h>
+
+#include <mrpt/config/CConfigFile.h>
+#include <mrpt/system/filesystem.h>
+#include <mrpt/system/string_utils.h>
+#include <pcl/console/parse.h>
+
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/** The time taken by each stage of a run, in the order they ran. */
+typedef vector<pair<string,double>> TStageTimes;
+
+/** The results of a calibration run, written out as JSON. */
+struct TCalibrationResult
+{
+	string method;
+	string rawlog_path;
+	vector<string> sensor_labels;
+	size_t num_sets = 0;
+
+	/** The number of features extracted from the synchronized observations of each sensor. */
+	vector<size_t> num_features;
+
+	/** The number of correspondences found between each pair of sensors, as (sensor_i, sensor_j, count). */
+	vector<array<size_t,3>> num_matches;
+
+	bool solved = false;
+	double initial_error = 0;
+	double final_error = 0;
+
+	vector<Eigen::Matrix4f> initial_poses;
+	vector<Eigen::Matrix4f> estimated_poses;
+
+	TStageTimes times;
+
+	/** The peak memory of each stage, in the order they ran. */
+	vector<CMemoryMonitor::TStageMemory> memory;
+};
+
+void print_help(char ** argv)
+{
+	cout << "\nThis program calibrates the extrinsics of the sensors of a rawlog without a display, and writes the results as JSON.\n";
+	cout << "  usage: " <<  argv[0] << " <config_file> [rawlog_file] [-m planes|lines] [-o output_file] [-p trace_file]\n";
+	cout << "            <config_file> path to the app configuration file (see config_files/app_config.ini)\n";
+	cout << "            [rawlog_file] path to the rawlog, [rawlog] path of the configuration file if not given\n";
+	cout << "            -m the features to calibrate from, planes by default\n";
+	cout << "            -o the file the results are written to, the standard output if not given\n";
+	cout << "            -p the file the timings and counters of the stages are written to as a Chrome trace\n";
+	cout << argv[0] << " -h | --help : shows this help" << endl;
+}
+
+/** Counts the features of each sensor, and the correspondences between each pair of sensors, leaving out the placeholders of the sets without features. */
+void countFeatures(const CFeatureStore &features, const map<int,map<int,vector<array<int,3>>>> &correspondences, TCalibrationResult &result)
+{
+	result.num_features.assign(result.sensor_labels.size(), 0);
+	for(size_t sensor_id = 0; sensor_id < features.getNumberOfSensors() && sensor_id < result.num_features.size(); sensor_id++)
+		result.num_features[sensor_id] = features.size(sensor_id);
+
+	result.num_matches.clear();
+	for(const auto &sensor_i : correspondences)
+		for(const auto &sensor_j : sensor_i.second)
+		{
+			size_t count = 0;
+			for(const array<int,3> &match : sensor_j.second)
+				if(match[0] >= 0)
+					count++;
+
+			result.num_matches.push_back({static_cast<size_t>(sensor_i.first), static_cast<size_t>(sensor_j.first), count});
+		}
+}
+
+string escapeJson(const string &text)
+{
+	string escaped;
+	for(const char &c : text)
+	{
+		if(c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+
+	return escaped;
+}
+
+void writePose(ostream &out, const Eigen::Matrix4f &pose)
+{
+	out << "[";
+	for(int r = 0; r < 4; r++)
+	{
+		out << (r ? ", [" : "[");
+		for(int c = 0; c < 4; c++)
+			out << (c ? ", " : "") << pose(r,c);
+		out << "]";
+	}
+	out << "]";
+}
+
+void writeResult(ostream &out, const TCalibrationResult &result)
+{
+	out.precision(numeric_limits<float>::max_digits10);
+
+	out << "{\n";
+	out << "  \"method\": \"" << result.method << "\",\n";
+	out << "  \"rawlog\": \"" << escapeJson(result.rawlog_path) << "\",\n";
+	out << "  \"num_sets\": " << result.num_sets << ",\n";
+
+	out << "  \"sensors\": [";
+	for(size_t i = 0; i < result.sensor_labels.size(); i++)
+	{
+		out << (i ? ",\n" : "\n") << "    {\"label\": \"" << escapeJson(result.sensor_labels[i]) << "\"";
+		out << ", \"num_features\": " << (i < result.num_features.size() ? result.num_features[i] : 0);
+		out << ",\n     \"initial_pose\": ";
+		writePose(out, result.initial_poses[i]);
+		out << ",\n     \"pose\": ";
+		writePose(out, result.solved ? result.estimated_poses[i] : result.initial_poses[i]);
+		out << "}";
+	}
+	out << "\n  ],\n";
+
+	out << "  \"matches\": [";
+	for(size_t i = 0; i < result.num_matches.size(); i++)
+		out << (i ? ", " : "") << "{\"sensor_i\": " << result.num_matches[i][0] << ", \"sensor_j\": " << result.num_matches[i][1]
+		    << ", \"count\": " << result.num_matches[i][2] << "}";
+	out << "],\n";
+
+	out << "  \"solved\": " << (result.solved ? "true" : "false") << ",\n";
+	out << "  \"initial_error\": " << result.initial_error << ",\n";
+	out << "  \"final_error\": " << result.final_error << ",\n";
+
+	double total = 0;
+	out << "  \"times\": {";
+	for(size_t i = 0; i < result.times.size(); i++)
+	{
+		out << (i ? ", " : "") << "\"" << result.times[i].first << "\": " << result.times[i].second;
+		total += result.times[i].second;
+	}
+	out << (result.times.empty() ? "" : ", ") << "\"total\": " << total << "},\n";
+
+	// the peak memory of each stage, of each subsystem and of the whole process, in megabytes
+	const double mb = 1024.0 * 1024.0;
+	out << "  \"peak_memory_mb\": {";
+	for(size_t i = 0; i < result.memory.size(); i++)
+	{
+		const CMemoryMonitor::TStageMemory &stage = result.memory[i];
+		out << (i ? ",\n    " : "\n    ") << "\"" << stage.name << "\": {";
+		for(int j = 0; j < CMemoryMonitor::NUM_SUBSYSTEMS; j++)
+			out << "\"" << CMemoryMonitor::subsystemName(static_cast<CMemoryMonitor::Subsystem>(j)) << "\": " << stage.peak_bytes[j] / mb << ", ";
+		out << "\"process\": " << stage.peak_resident_bytes / mb << "}";
+	}
+	out << (result.memory.empty() ? "" : "\n  ") << "}\n";
+	out << "}" << endl;
+}
+
+/** Runs a stage of a calibration, recording its time in the results and in the profile under its name, and its peak memory. */
+template <typename Stage>
+void runStage(const char *name, TCalibrationResult &result, const Stage &stage)
+{
+	CMemoryMonitor::instance().beginStage(name);
+	CScopedTimer timer(name);
+	stage();
+	result.times.push_back(make_pair(name, timer.stop()));
+	CMemoryMonitor::instance().endStage();
+}
+
+/** Runs the stages of a calibration from planes on a synchronized model. Returns false if some observations could not be read. */
+bool calibrateFromPlanes(CObservationTree &sync_model, const mrpt::config::CConfigFile &config_file, TCalibrationResult &result)
+{
+	TCalibFromPlanesParams params;
+	params.load(config_file);
+
+	CCalibFromPlanes calib(&sync_model);
+
+	runStage("extract", result, [&]() { calib.extractPlanes(params.seg); });
+	if(calib.getUnreadObservationCount() > 0)
+	{
+		cerr << "Error. " << calib.getUnreadObservationCount() << " observations could not be read from the rawlog" << endl;
+		return false;
+	}
+
+	runStage("match", result, [&]() { calib.matchPlanes(params.match); });
+
+	countFeatures(calib.getPlaneStore(), calib.mmv_plane_corresp, result);
+
+	string stats;
+	runStage("solve", result, [&]() { result.final_error = calib.computeRotation(params.solver, result.initial_poses, stats); });
+
+	result.initial_error = calib.computeRotationResidual(result.initial_poses);
+	result.estimated_poses.assign(calib.m_calibration.begin(), calib.m_calibration.end());
+	result.solved = result.estimated_poses.size() == result.initial_poses.size();
+
+	cerr << stats << endl;
+	return true;
+}
+
+/** Runs the stages of a calibration from lines on a synchronized model. Returns false if some observations could not be read. */
+bool calibrateFromLines(CObservationTree &sync_model, const mrpt::config::CConfigFile &config_file, TCalibrationResult &result)
+{
+	TCalibFromLinesParams params;
+	params.load(config_file);
+
+	CCalibFromLines calib(&sync_model);
+
+	runStage("extract", result, [&]() { calib.extractLines(params.seg); });
+	if(calib.getUnreadObservationCount() > 0)
+	{
+		cerr << "Error. " << calib.getUnreadObservationCount() << " observations could not be read from the rawlog" << endl;
+		return false;
+	}
+
+	runStage("match", result, [&]() { calib.matchLines(params.match); });
+
+	countFeatures(calib.getLineStore(), calib.mmv_line_corresp, result);
+
+	// the solver of the calibration from lines is not implemented yet, so the initial poses are reported
+	cerr << "The solver of the calibration from lines is not available yet, reporting the initial calibration" << endl;
+	return true;
+}
+
+/*! This program loads a rawlog, synchronizes its observations, and calibrates the extrinsics of its sensors without a display. */
+int main (int argc, char ** argv)
+{
+	try
+	{
+		if(argc < 2 || pcl::console::find_switch(argc, argv, "-h") || pcl::console::find_switch(argc, argv, "--help"))
+		{
+			print_help(argv);
+			return 0;
+		}
+
+		string config_path = argv[1];
+		if(!mrpt::system::fileExists(config_path))
+		{
+			cerr << "Config file " << config_path << " not found" << endl;
+			return 1;
+		}
+
+		mrpt::config::CConfigFile config_file(config_path);
+
+		string rawlog_path = config_file.read_string("rawlog", "path", "");
+		if(argc > 2 && argv[2][0] != '-')
+			rawlog_path = argv[2];
+
+		string method = "planes", output_path, trace_path;
+		pcl::console::parse_argument(argc, argv, "-m", method);
+		pcl::console::parse_argument(argc, argv, "-o", output_path);
+		pcl::console::parse_argument(argc, argv, "-p", trace_path);
+
+		if(method != "planes" && method != "lines")
+		{
+			cerr << "Unknown method " << method << ", expected planes or lines" << endl;
+			return 1;
+		}
+
+		if(!mrpt::system::fileExists(rawlog_path))
+		{
+			cerr << "Rawlog file " << rawlog_path << " not found" << endl;
+			return 1;
+		}
+
+		TCalibrationResult result;
+		result.method = method;
+		result.rawlog_path = rawlog_path;
+
+		TRawlogLoadParams load_params;
+		mrpt::system::tokenize(config_file.read_string("rawlog", "sensor_labels", ""), " ,", load_params.sensor_labels);
+		load_params.start_time = config_file.read_double("rawlog", "start_time", 0);
+		load_params.end_time = config_file.read_double("rawlog", "end_time", -1);
+
+		CObservationTree model(rawlog_path, config_file);
+		bool loaded = false;
+		runStage("load", result, [&]() { loaded = model.loadTree(load_params); });
+		if(!loaded)
+			return 1;
+
+		cerr << model.getObsCount() << " observations loaded from " << model.getNumberOfSensors() << " sensor(s)" << endl;
+
+		if(model.getNumberOfSensors() < 2)
+		{
+			cerr << "Error. At least two sensors are needed for calibration" << endl;
+			return 1;
+		}
+
+		// all the sensors loaded are calibrated together
+		runStage("sync", result, [&]() { model.syncObservations(model.getSensorLabels(), config_file.read_int("grouping_observations", "max_delay", 30)); });
+
+		result.sensor_labels = model.getSensorLabels();
+		result.initial_poses = model.getSensorPoses();
+		result.num_sets = model.getRootItem()->childCount();
+
+		cerr << result.num_sets << " synchronized observation sets found" << endl;
+
+		if(result.num_sets == 0)
+		{
+			cerr << "Error. No synchronized observation sets to calibrate from, try increasing [grouping_observations] max_delay" << endl;
+			return 1;
+		}
+
+		bool calibrated = (method == "planes") ? calibrateFromPlanes(model, config_file, result) : calibrateFromLines(model, config_file, result);
+		if(!calibrated)
+			return 1;
+
+		cerr << "\n" << CProfiler::instance().summary() << endl;
+		cerr << CMemoryMonitor::instance().report() << endl;
+		result.memory = CMemoryMonitor::instance().getStages();
+
+		if(!trace_path.empty() && !CProfiler::instance().exportChromeTrace(trace_path))
+			cerr << "Could not write the profiling trace to " << trace_path << endl;
+
+		if(output_path.empty())
+			writeResult(cout, result);
+
+		else
+		{
+			ofstream output(output_path);
+			writeResult(output, result);
+
+			if(!output)
+			{
+				cerr << "Could not write the results to " << output_path << endl;
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	catch(exception &e)
+	{
+		cerr << "Exception caught: " << e.what() << endl;
+		return 1;
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * Bounded, closeable FIFO queue used to hand work between the threads of a pipeline.
+ * Producers block while the queue is full and consumers block while it is empty,
+ * until the queue is closed.
+ */
+
+template <typename T>
+class CBlockingQueue
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param capacity the maximum number of items the queue holds before push() blocks.
+		 */
+	    explicit CBlockingQueue(size_t capacity) : m_capacity(capacity > 0 ? capacity : 1)
+		{}
+
+		/** Appends an item, blocking while the queue is full.
+		 * \return false if the queue was closed, in which case the item is dropped.
+		 */
+		bool push(T item)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_not_full.wait(lock, [this]{ return m_closed || m_items.size() < m_capacity; });
+
+			if(m_closed)
+				return false;
+
+			m_items.push_back(std::move(item));
+			lock.unlock();
+			m_not_empty.notify_one();
+			return true;
+		}
+
+		/** Removes the oldest item, blocking while the queue is empty.
+		 * \return false once the queue is closed and all the remaining items have been consumed.
+		 */
+		bool pop(T &item)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_not_empty.wait(lock, [this]{ return m_closed || !m_items.empty(); });
+
+			if(m_items.empty())
+				return false;
+
+			item = std::move(m_items.front());
+			m_items.pop_front();
+			lock.unlock();
+			m_not_full.notify_one();
+			return true;
+		}
+
+		/** Closes the queue, waking up all the blocked producers and consumers.
+		 * Items already in the queue can still be popped.
+		 */
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_closed = true;
+			}
+
+			m_not_full.notify_all();
+			m_not_empty.notify_all();
+		}
+
+	private:
+
+		/** The maximum number of items held at a time. */
+		size_t m_capacity;
+
+		/** Whether the queue has been closed. */
+		bool m_closed = false;
+
+		/** The queued items. */
+		std::deque<T> m_items;
+
+		std::mutex m_mutex;
+		std::condition_variable m_not_full;
+		std::condition_variable m_not_empty;
+};
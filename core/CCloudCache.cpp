@@ -0,0 +1,124 @@
+#include "CCloudCache.h"
+
+#include <mrpt/obs/CObservation3DRangeScan.h>
+
+using namespace mrpt::obs;
+
+CCloudCache::CCloudCache(const std::shared_ptr<CObservationStore> &store, const size_t &memory_budget)
+{
+	m_store = store;
+	m_memory_budget = memory_budget;
+}
+
+CCloudCache::~CCloudCache()
+{
+}
+
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr CCloudCache::get(const uint64_t &offset, const ProjectionMode &mode)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_cache_mutex);
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud = find(key(offset, mode));
+
+		if(!cloud && mode == COORDINATES)
+			cloud = find(key(offset, COLOURED));
+
+		if(cloud)
+		{
+			m_hits++;
+			return cloud;
+		}
+
+		m_misses++;
+	}
+
+	CObservation3DRangeScan::Ptr obs = std::dynamic_pointer_cast<CObservation3DRangeScan>(m_store->get(offset));
+	if(!obs)
+		return nullptr;
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+	m_projector.project(*obs, *cloud, mode == COLOURED);
+	insert(key(offset, mode), cloud);
+
+	return cloud;
+}
+
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr CCloudCache::find(const uint64_t &key)
+{
+	auto iter = m_cache.find(key);
+	if(iter == m_cache.end())
+		return nullptr;
+
+	m_lru.splice(m_lru.begin(), m_lru, iter->second.lru_pos);
+	return iter->second.cloud;
+}
+
+void CCloudCache::insert(const uint64_t &key, const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud)
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+
+	// another thread may have projected the same cloud in the meantime
+	if(m_cache.count(key))
+		return;
+
+	m_lru.push_front(key);
+
+	TCacheEntry &entry = m_cache[key];
+	entry.cloud = cloud;
+	entry.bytes = sizeof(pcl::PointCloud<pcl::PointXYZRGBA>) + cloud->points.capacity() * sizeof(pcl::PointXYZRGBA);
+	entry.lru_pos = m_lru.begin();
+	m_memory_usage += entry.bytes;
+
+	evict();
+}
+
+void CCloudCache::evict()
+{
+	// the most recently used cloud is always kept, even if it alone exceeds the budget
+	while(m_memory_budget > 0 && m_memory_usage > m_memory_budget && m_lru.size() > 1)
+	{
+		auto iter = m_cache.find(m_lru.back());
+		m_memory_usage -= iter->second.bytes;
+		m_cache.erase(iter);
+		m_lru.pop_back();
+	}
+
+	m_memory_account.set(m_memory_usage);
+}
+
+uint64_t CCloudCache::key(const uint64_t &offset, const ProjectionMode &mode)
+{
+	// offsets are far below 2^63, leaving the low bit for the mode
+	return (offset << 1) | static_cast<uint64_t>(mode);
+}
+
+void CCloudCache::setMemoryBudget(const size_t &memory_budget)
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	m_memory_budget = memory_budget;
+	evict();
+}
+
+size_t CCloudCache::getMemoryBudget() const
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_memory_budget;
+}
+
+size_t CCloudCache::getMemoryUsage() const
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_memory_usage;
+}
+
+size_t CCloudCache::getHits() const
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_hits;
+}
+
+size_t CCloudCache::getMisses() const
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_misses;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "CObservationStore.h"
+#include "CDepthProjector.h"
+#include "CMemoryMonitor.h"
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * Gives access to the organized clouds the observations of a rawlog project into, by the byte offset of the observation.
+ * Shared by the trees built from the same rawlog, so that the viewers and the plane segmentation reuse each other's clouds.
+ * Clouds are kept in a least-recently-used cache bounded by a memory budget, and are projected again from the
+ * observation store after being evicted. The cached clouds are shared and must not be modified.
+ */
+
+class CCloudCache
+{
+	public:
+
+	    /** The ways an observation can be projected into a cloud. */
+	    enum ProjectionMode
+		{
+			/** The coordinates and the colour of the points, for display. */
+			COLOURED,
+			/** The coordinates of the points only, for segmentation. */
+			COORDINATES
+		};
+
+	    /**
+		 * Constructor
+		 * \param store the store the observations are read from.
+		 * \param memory_budget the maximum number of bytes of clouds kept in memory, 0 for no limit.
+		 */
+	    CCloudCache(const std::shared_ptr<CObservationStore> &store, const size_t &memory_budget = 0);
+
+		~CCloudCache();
+
+		/**
+		 * \brief Returns the cloud of the observation stored at an offset of the rawlog, projecting it if it is not cached.
+		 * A cached coloured cloud also serves a request for the coordinates only.
+		 * \param offset the byte offset of the observation in the uncompressed rawlog stream.
+		 * \param mode how the observation is projected.
+		 * \return the organized cloud, or a null pointer if the observation could not be read or is not a 3D range scan.
+		 */
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr get(const uint64_t &offset, const ProjectionMode &mode);
+
+		/** Sets the maximum number of bytes of clouds kept in memory (0 for no limit), evicting clouds as needed. */
+		void setMemoryBudget(const size_t &memory_budget);
+
+		/** Returns the maximum number of bytes of clouds kept in memory. */
+		size_t getMemoryBudget() const;
+
+		/** Returns the number of bytes of clouds currently cached. */
+		size_t getMemoryUsage() const;
+
+		/** Returns the number of clouds found in the cache, and projected, respectively. */
+		size_t getHits() const;
+		size_t getMisses() const;
+
+	private:
+
+		/** Returns the cached cloud of a key, if any, and marks it as the most recently used. Expects m_cache_mutex to be held. */
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr find(const uint64_t &key);
+
+		/** Adds a projected cloud to the cache. */
+		void insert(const uint64_t &key, const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud);
+
+		/** Evicts the least recently used clouds until the cache fits in the budget. Expects m_cache_mutex to be held. */
+		void evict();
+
+		/** Returns the cache key of the cloud of the observation at an offset, projected in a mode. */
+		static uint64_t key(const uint64_t &offset, const ProjectionMode &mode);
+
+		/** A cached cloud. */
+		struct TCacheEntry
+		{
+			pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+			size_t bytes;
+
+			/** Position of the entry in m_lru. */
+			std::list<uint64_t>::iterator lru_pos;
+		};
+
+		/** The store the observations are read from. */
+		std::shared_ptr<CObservationStore> m_store;
+
+		CDepthProjector m_projector;
+
+		/** The cached clouds, by key. */
+		std::unordered_map<uint64_t, TCacheEntry> m_cache;
+
+		/** The keys of the cached clouds, from the most to the least recently used. */
+		std::list<uint64_t> m_lru;
+
+		size_t m_memory_budget;
+		size_t m_memory_usage = 0;
+
+		/** The memory of the cached clouds, as attributed to the memory monitor. */
+		CMemoryAccount m_memory_account{CMemoryMonitor::CLOUD_CACHE};
+		size_t m_hits = 0;
+		size_t m_misses = 0;
+
+		/** Protects the cache; the projection itself runs without holding it. */
+		mutable std::mutex m_cache_mutex;
+};
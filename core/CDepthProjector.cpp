@@ -0,0 +1,125 @@
+#include "CDepthProjector.h"
+
+#include <limits>
+#include <type_traits>
+
+using namespace mrpt::obs;
+
+void CDepthProjector::project(const CObservation3DRangeScan &obs, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const bool &with_colour)
+{
+	if(with_colour && obs.hasIntensityImage && !(obs.doDepthAndIntensityCamerasCoincide()
+	                                             && obs.intensityImage.getWidth() == obs.rangeImage.cols()
+	                                             && obs.intensityImage.getHeight() == obs.rangeImage.rows()))
+	{
+		// the colour of each point has to be looked up through the intensity camera, which mrpt does
+		// (project3DPointsFromDepthImageInto is not const, although it does not modify the observation)
+		T3DPointsProjectionParams projection_params;
+		projection_params.MAKE_DENSE = false;
+		projection_params.MAKE_ORGANIZED = true;
+
+		const_cast<CObservation3DRangeScan&>(obs).project3DPointsFromDepthImageInto(cloud, projection_params);
+		cloud.is_dense = false;
+		return;
+	}
+
+	projectPoints(obs, cloud);
+
+	if(!with_colour || !obs.hasIntensityImage)
+		return;
+
+	const size_t channels = obs.intensityImage.isColor() ? 3 : 1;
+
+	for(size_t r = 0; r < cloud.height; r++)
+	{
+		const unsigned char *pixel = obs.intensityImage.get_unsafe(0, r, 0);
+		pcl::PointXYZRGBA *point = &cloud.points[r * cloud.width];
+
+		for(size_t c = 0; c < cloud.width; c++, pixel += channels, point++)
+		{
+			// mrpt images are stored as BGR
+			point->b = pixel[0];
+			point->g = pixel[channels == 3 ? 1 : 0];
+			point->r = pixel[channels == 3 ? 2 : 0];
+			point->a = 255;
+		}
+	}
+}
+
+void CDepthProjector::project(const CObservation3DRangeScan &obs, pcl::PointCloud<pcl::PointXYZ> &cloud)
+{
+	projectPoints(obs, cloud);
+}
+
+size_t CDepthProjector::getRayTableCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_ray_table_count;
+}
+
+std::shared_ptr<const CDepthProjector::TRayTable> CDepthProjector::rayTable(const CObservation3DRangeScan &obs)
+{
+	const mrpt::img::TCamera &camera = obs.cameraParams;
+	size_t width = obs.rangeImage.cols(), height = obs.rangeImage.rows();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::shared_ptr<const TRayTable> &table = m_ray_tables[obs.sensorLabel];
+	if(table && table->width == width && table->height == height && table->range_is_depth == obs.range_is_depth
+	        && table->fx == camera.fx() && table->fy == camera.fy() && table->cx == camera.cx() && table->cy == camera.cy())
+		return table;
+
+	std::shared_ptr<TRayTable> new_table(new TRayTable);
+	new_table->width = width;
+	new_table->height = height;
+	new_table->fx = camera.fx();
+	new_table->fy = camera.fy();
+	new_table->cx = camera.cx();
+	new_table->cy = camera.cy();
+	new_table->range_is_depth = obs.range_is_depth;
+	new_table->rays.resize(width * height);
+
+	for(size_t r = 0; r < height; r++)
+		for(size_t c = 0; c < width; c++)
+		{
+			Eigen::Array4f ray(1.f, (camera.cx() - c) / camera.fx(), (camera.cy() - r) / camera.fy(), 0.f);
+
+			// a range measured along the ray scales the unit ray instead
+			if(!obs.range_is_depth)
+				ray /= ray.matrix().norm();
+
+			new_table->rays[r * width + c] = ray;
+		}
+
+	table = new_table;
+	m_ray_table_count++;
+
+	return table;
+}
+
+template<typename PointT>
+void CDepthProjector::projectPoints(const CObservation3DRangeScan &obs, pcl::PointCloud<PointT> &cloud)
+{
+	static_assert(std::remove_reference<decltype(obs.rangeImage)>::type::IsRowMajor, "the range image is read as a row-major array");
+
+	std::shared_ptr<const TRayTable> table = rayTable(obs);
+	const size_t num_points = table->width * table->height;
+
+	cloud.points.resize(num_points);
+	cloud.width = table->width;
+	cloud.height = table->height;
+	cloud.is_dense = false;
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const Eigen::Array4f invalid(nan, nan, nan, 1.f), homogeneous(0.f, 0.f, 0.f, 1.f);
+	const float *range = obs.rangeImage.data();
+	const Eigen::Array4f *ray = table->rays.data();
+
+	// the first four floats of the pcl point types are the aligned homogeneous coordinates, written with a single vector store
+	for(size_t i = 0; i < num_points; i++)
+	{
+		if(range[i] > 0)
+			cloud.points[i].getArray4fMap() = ray[i] * range[i] + homogeneous;
+		else
+			cloud.points[i].getArray4fMap() = invalid;
+	}
+}
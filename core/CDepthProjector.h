@@ -0,0 +1,65 @@
+#pragma once
+
+#include <mrpt/obs/CObservation3DRangeScan.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Projects the range images of 3D scans into organized point clouds.
+ * The back-projection ray of every pixel is computed once per sensor from its intrinsics, so that projecting a frame
+ * is a single multiply of each ray by its range. The points follow the convention of CObservation3DRangeScan
+ * (x forward, y left, z up), with NaN coordinates for the pixels without a valid range.
+ * The projector is thread-safe, and is meant to be shared by all the threads projecting frames.
+ */
+
+class CDepthProjector
+{
+	public:
+
+	    /**
+		 * \brief Projects the range image of an observation into an organized cloud of the same width and height.
+		 * \param obs the observation.
+		 * \param cloud the output cloud, resized only when the resolution changes.
+		 * \param with_colour whether to fill in the colour of the points from the intensity image.
+		 * If false, only the coordinates are written, which is all the plane segmentation needs.
+		 */
+	    void project(const mrpt::obs::CObservation3DRangeScan &obs, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const bool &with_colour = true);
+
+		/** \brief Projects the range image of an observation into an organized cloud of coordinates only. */
+		void project(const mrpt::obs::CObservation3DRangeScan &obs, pcl::PointCloud<pcl::PointXYZ> &cloud);
+
+		/** Returns the number of ray tables built so far, one per sensor unless its intrinsics change. */
+		size_t getRayTableCount() const;
+
+	private:
+
+		/** The back-projection rays of the pixels of a sensor, stored row-major, as (x, y, z, 0). */
+		struct TRayTable
+		{
+			size_t width, height;
+			double fx, fy, cx, cy;
+			bool range_is_depth;
+			std::vector<Eigen::Array4f, Eigen::aligned_allocator<Eigen::Array4f>> rays;
+		};
+
+		/** Returns the ray table of the sensor of obs, building it if its intrinsics or resolution are new. */
+		std::shared_ptr<const TRayTable> rayTable(const mrpt::obs::CObservation3DRangeScan &obs);
+
+		/** Writes the coordinates of the points, common to all point types. */
+		template<typename PointT>
+		void projectPoints(const mrpt::obs::CObservation3DRangeScan &obs, pcl::PointCloud<PointT> &cloud);
+
+		/** The ray tables, indexed by sensor label. */
+		std::map<std::string, std::shared_ptr<const TRayTable>> m_ray_tables;
+		size_t m_ray_table_count = 0;
+
+		mutable std::mutex m_mutex;
+};
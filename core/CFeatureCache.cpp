@@ -0,0 +1,381 @@
+#include "CFeatureCache.h"
+#include "Utils.h"
+
+#include <mrpt/system/filesystem.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	/** Identifies the entry files, and the version of their format. */
+	const uint32_t entry_magic = 0x48434641; // "AFCH"
+	const uint32_t entry_version = 3;
+
+	/** Upper bound of the element counts read from an entry, to reject corrupt files before allocating. */
+	const uint32_t max_count = 1u << 26;
+
+	template <typename T>
+	void write(std::ostream &out, const T &value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	void read(std::istream &in, T &value)
+	{
+		in.read(reinterpret_cast<char*>(&value), sizeof(T));
+	}
+
+	/** Writes the coefficients of an Eigen matrix, whose size the reader must know beforehand. */
+	template <typename Derived>
+	void writeMatrix(std::ostream &out, const Eigen::MatrixBase<Derived> &matrix)
+	{
+		out.write(reinterpret_cast<const char*>(matrix.derived().data()), sizeof(typename Derived::Scalar) * matrix.size());
+	}
+
+	template <typename Derived>
+	void readMatrix(std::istream &in, Eigen::MatrixBase<Derived> &matrix)
+	{
+		in.read(reinterpret_cast<char*>(matrix.derived().data()), sizeof(typename Derived::Scalar) * matrix.size());
+	}
+
+	/** Writes a vector of plain values, preceded by its size. */
+	template <typename S, typename T>
+	void writeVector(std::ostream &out, const std::vector<T> &vec)
+	{
+		write(out, static_cast<uint32_t>(vec.size()));
+		for(const T &value : vec)
+			write(out, static_cast<S>(value));
+	}
+
+	template <typename S, typename T>
+	bool readVector(std::istream &in, std::vector<T> &vec)
+	{
+		uint32_t size = 0;
+		read(in, size);
+		if(!in || size > max_count)
+			return false;
+
+		vec.resize(size);
+		for(T &value : vec)
+		{
+			S stored;
+			read(in, stored);
+			value = static_cast<T>(stored);
+		}
+
+		return static_cast<bool>(in);
+	}
+
+	/** Writes the header of an entry. */
+	void writeHeader(std::ostream &out, const uint64_t &obs_hash, const uint64_t &params_hash, const size_t &count)
+	{
+		write(out, entry_magic);
+		write(out, entry_version);
+		write(out, obs_hash);
+		write(out, params_hash);
+		write(out, static_cast<uint32_t>(count));
+	}
+
+	/** Reads the header of an entry, and returns the number of features it holds, or -1 if it does not match the keys. */
+	int64_t readHeader(std::istream &in, const uint64_t &obs_hash, const uint64_t &params_hash)
+	{
+		uint32_t magic = 0, version = 0, count = 0;
+		uint64_t stored_obs_hash = 0, stored_params_hash = 0;
+
+		read(in, magic);
+		read(in, version);
+		read(in, stored_obs_hash);
+		read(in, stored_params_hash);
+		read(in, count);
+
+		if(!in || magic != entry_magic || version != entry_version || stored_obs_hash != obs_hash
+		        || stored_params_hash != params_hash || count > max_count)
+			return -1;
+
+		return count;
+	}
+
+	/** Writes the contents of a stream to a file, through a temporary file renamed over it. */
+	bool writeFile(const std::string &path, const std::string &contents)
+	{
+		std::stringstream tmp_path;
+		tmp_path << path << ".tmp" << std::this_thread::get_id();
+
+		{
+			std::ofstream file(tmp_path.str(), std::ios::binary | std::ios::trunc);
+			file.write(contents.data(), contents.size());
+			if(!file)
+			{
+				std::remove(tmp_path.str().c_str());
+				return false;
+			}
+		}
+
+		if(std::rename(tmp_path.str().c_str(), path.c_str()) != 0)
+		{
+			std::remove(tmp_path.str().c_str());
+			return false;
+		}
+
+		return true;
+	}
+}
+
+CFeatureCache::CFeatureCache(const std::string &cache_dir, const std::string &rawlog_path)
+{
+	m_cache_dir = cache_dir;
+	if(!m_cache_dir.empty() && !mrpt::system::directoryExists(m_cache_dir) && !mrpt::system::createDirectory(m_cache_dir))
+		m_cache_dir.clear();
+
+	// the path, size and modification time of the rawlog tell apart the logs recorded with the same sensors, and a log
+	// recorded again in place, without reading them (as for the freshness of its index, see CRawlogIndex)
+	m_rawlog_hash = utils::hash_seed;
+	utils::hashCombine(m_rawlog_hash, rawlog_path);
+	utils::hashCombine(m_rawlog_hash, static_cast<uint64_t>(mrpt::system::getFileSize(rawlog_path)));
+	utils::hashCombine(m_rawlog_hash, static_cast<int64_t>(mrpt::system::getFileModificationTime(rawlog_path)));
+}
+
+bool CFeatureCache::isEnabled() const
+{
+	return !m_cache_dir.empty();
+}
+
+uint64_t CFeatureCache::hashParams(const TPlaneSegmentationParams &params)
+{
+	// num_threads does not change the planes
+	uint64_t hash = utils::hash_seed;
+	utils::hashCombine(hash, params.normal_estimation_method);
+	utils::hashCombine(hash, params.depth_dependent_smoothing);
+	utils::hashCombine(hash, params.max_depth_change_factor);
+	utils::hashCombine(hash, params.normal_smoothing_size);
+	utils::hashCombine(hash, params.angle_threshold);
+	utils::hashCombine(hash, params.dist_threshold);
+	utils::hashCombine(hash, params.min_inliers_frac);
+	utils::hashCombine(hash, params.max_curvature);
+
+	return hash;
+}
+
+uint64_t CFeatureCache::hashParams(const TLineSegmentationParams &params)
+{
+	// num_threads does not change the lines
+	uint64_t hash = utils::hash_seed;
+	utils::hashCombine(hash, params.clow_threshold);
+	utils::hashCombine(hash, params.chigh_to_low_ratio);
+	utils::hashCombine(hash, params.ckernel_size);
+	utils::hashCombine(hash, params.detector);
+	utils::hashCombine(hash, params.hthreshold);
+	utils::hashCombine(hash, params.min_line_length);
+	utils::hashCombine(hash, params.max_line_gap);
+	utils::hashCombine(hash, params.max_line_deviation);
+
+	return hash;
+}
+
+uint64_t CFeatureCache::observationHash(const TObservationInfo &info) const
+{
+	uint64_t hash = m_rawlog_hash;
+	utils::hashCombine(hash, info.offset);
+	utils::hashCombine(hash, static_cast<uint64_t>(info.timestamp));
+	utils::hashCombine(hash, info.sensor_label);
+
+	return hash;
+}
+
+std::string CFeatureCache::entryPath(const uint64_t &obs_hash, const uint64_t &params_hash, const std::string &extension) const
+{
+	char name[64];
+	std::snprintf(name, sizeof(name), "%016llx_%016llx", static_cast<unsigned long long>(obs_hash), static_cast<unsigned long long>(params_hash));
+
+	return m_cache_dir + "/" + name + extension;
+}
+
+bool CFeatureCache::loadPlanes(const TObservationInfo &info, const uint64_t &params_hash, std::vector<CPlaneCHull> &planes)
+{
+	if(!isEnabled())
+		return false;
+
+	uint64_t obs_hash = observationHash(info);
+	std::ifstream file(entryPath(obs_hash, params_hash, ".planes"), std::ios::binary);
+	int64_t count = file ? readHeader(file, obs_hash, params_hash) : -1;
+
+	if(count < 0)
+	{
+		m_misses++;
+		return false;
+	}
+
+	planes.assign(count, CPlaneCHull());
+
+	for(CPlaneCHull &plane : planes)
+	{
+		readMatrix(file, plane.v3center);
+		readMatrix(file, plane.v3normal);
+		read(file, plane.d);
+		readMatrix(file, plane.covariance);
+		read(file, plane.curvature);
+		read(file, plane.area);
+
+		uint64_t n_inliers = 0;
+		read(file, n_inliers);
+		plane.n_inliers = n_inliers;
+
+		uint32_t hull_size = 0;
+		read(file, hull_size);
+		if(!file || hull_size > max_count)
+		{
+			file.setstate(std::ios::failbit);
+			break;
+		}
+
+		plane.ConvexHullPtr.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+		plane.ConvexHullPtr->points.resize(hull_size);
+		for(pcl::PointXYZRGBA &point : plane.ConvexHullPtr->points)
+		{
+			read(file, point.x);
+			read(file, point.y);
+			read(file, point.z);
+			read(file, point.rgba);
+		}
+
+		plane.ConvexHullPtr->width = hull_size;
+		plane.ConvexHullPtr->height = 1;
+
+		if(!readVector<uint32_t>(file, plane.v_hull_indices) || !readVector<int32_t>(file, plane.v_inliers))
+		{
+			file.setstate(std::ios::failbit);
+			break;
+		}
+	}
+
+	if(!file)
+	{
+		planes.clear();
+		m_misses++;
+		return false;
+	}
+
+	m_hits++;
+	return true;
+}
+
+bool CFeatureCache::storePlanes(const TObservationInfo &info, const uint64_t &params_hash, const std::vector<CPlaneCHull> &planes)
+{
+	if(!isEnabled())
+		return false;
+
+	uint64_t obs_hash = observationHash(info);
+	std::ostringstream out(std::ios::binary);
+	writeHeader(out, obs_hash, params_hash, planes.size());
+
+	for(const CPlaneCHull &plane : planes)
+	{
+		writeMatrix(out, plane.v3center);
+		writeMatrix(out, plane.v3normal);
+		write(out, plane.d);
+		writeMatrix(out, plane.covariance);
+		write(out, plane.curvature);
+		write(out, plane.area);
+		write(out, static_cast<uint64_t>(plane.n_inliers));
+
+		uint32_t hull_size = plane.ConvexHullPtr ? plane.ConvexHullPtr->points.size() : 0;
+		write(out, hull_size);
+		for(size_t i = 0; i < hull_size; i++)
+		{
+			const pcl::PointXYZRGBA &point = plane.ConvexHullPtr->points[i];
+			write(out, point.x);
+			write(out, point.y);
+			write(out, point.z);
+			write(out, point.rgba);
+		}
+
+		writeVector<uint32_t>(out, plane.v_hull_indices);
+		writeVector<int32_t>(out, plane.v_inliers);
+	}
+
+	return writeFile(entryPath(obs_hash, params_hash, ".planes"), out.str());
+}
+
+bool CFeatureCache::loadLines(const TObservationInfo &info, const uint64_t &params_hash, TLineBatch &lines)
+{
+	if(!isEnabled())
+		return false;
+
+	uint64_t obs_hash = observationHash(info);
+	std::ifstream file(entryPath(obs_hash, params_hash, ".lines"), std::ios::binary);
+	int64_t count = file ? readHeader(file, obs_hash, params_hash) : -1;
+
+	if(count < 0)
+	{
+		m_misses++;
+		return false;
+	}
+
+	// the arrays of the batch are stored one after the other, as they are laid out in memory
+	lines.resize(count);
+	readMatrix(file, lines.rho);
+	readMatrix(file, lines.theta);
+	readMatrix(file, lines.m);
+	readMatrix(file, lines.c);
+	readMatrix(file, lines.end_points[0]);
+	readMatrix(file, lines.end_points[1]);
+	readMatrix(file, lines.end_points3D[0]);
+	readMatrix(file, lines.end_points3D[1]);
+	readMatrix(file, lines.mean_points);
+	readMatrix(file, lines.l);
+	readMatrix(file, lines.rays);
+	readMatrix(file, lines.normals);
+	readMatrix(file, lines.points);
+	readMatrix(file, lines.directions);
+
+	if(!file)
+	{
+		lines.resize(0);
+		m_misses++;
+		return false;
+	}
+
+	m_hits++;
+	return true;
+}
+
+bool CFeatureCache::storeLines(const TObservationInfo &info, const uint64_t &params_hash, const TLineBatch &lines)
+{
+	if(!isEnabled())
+		return false;
+
+	uint64_t obs_hash = observationHash(info);
+	std::ostringstream out(std::ios::binary);
+	writeHeader(out, obs_hash, params_hash, lines.size());
+
+	writeMatrix(out, lines.rho);
+	writeMatrix(out, lines.theta);
+	writeMatrix(out, lines.m);
+	writeMatrix(out, lines.c);
+	writeMatrix(out, lines.end_points[0]);
+	writeMatrix(out, lines.end_points[1]);
+	writeMatrix(out, lines.end_points3D[0]);
+	writeMatrix(out, lines.end_points3D[1]);
+	writeMatrix(out, lines.mean_points);
+	writeMatrix(out, lines.l);
+	writeMatrix(out, lines.rays);
+	writeMatrix(out, lines.normals);
+	writeMatrix(out, lines.points);
+	writeMatrix(out, lines.directions);
+
+	return writeFile(entryPath(obs_hash, params_hash, ".lines"), out.str());
+}
+
+size_t CFeatureCache::getHits() const
+{
+	return m_hits;
+}
+
+size_t CFeatureCache::getMisses() const
+{
+	return m_misses;
+}
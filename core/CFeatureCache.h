@@ -0,0 +1,81 @@
+#pragma once
+
+#include "CObservationTreeItem.h"
+#include "CPlane.h"
+#include "CLine.h"
+#include <calib_solvers/TCalibFromPlanesParams.h>
+#include <calib_solvers/TCalibFromLinesParams.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Persists the planes and lines segmented from the observations of a rawlog in a directory, so that re-running a calibration
+ * with the same segmentation parameters skips the segmentation.
+ * Each entry is a file named after the hash of the observation identity (the path, size and modification time of the rawlog,
+ * and the offset, timestamp and sensor label of the observation) and the hash of the segmentation parameters, so that the cache never needs to be
+ * invalidated: changing the parameters or the rawlog just addresses other entries.
+ * The entries are written in a compact binary format, in the byte order of the host.
+ * Loading and storing entries is thread-safe; an entry is written to a temporary file and renamed, so readers never see it partially.
+ */
+
+class CFeatureCache
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param cache_dir the directory the entries are kept in, created if needed. Empty disables the cache.
+		 * \param rawlog_path the path of the rawlog the observations are read from.
+		 */
+	    CFeatureCache(const std::string &cache_dir, const std::string &rawlog_path);
+
+		/** Returns whether the cache has a directory to keep its entries in. */
+		bool isEnabled() const;
+
+		/** Returns the hash of the parameters the planes of an observation depend on. */
+		static uint64_t hashParams(const TPlaneSegmentationParams &params);
+
+		/** Returns the hash of the parameters the lines of an observation depend on. */
+		static uint64_t hashParams(const TLineSegmentationParams &params);
+
+		/**
+		 * \brief Loads the planes segmented from an observation with the parameters of a hash, if they were stored.
+		 * \return true if the entry was found and read.
+		 */
+		bool loadPlanes(const TObservationInfo &info, const uint64_t &params_hash, std::vector<CPlaneCHull> &planes);
+
+		/** Stores the planes segmented from an observation with the parameters of a hash. Returns false if they could not be written. */
+		bool storePlanes(const TObservationInfo &info, const uint64_t &params_hash, const std::vector<CPlaneCHull> &planes);
+
+		/**
+		 * \brief Loads the batch of lines segmented from an observation with the parameters of a hash, if they were stored.
+		 * \return true if the entry was found and read.
+		 */
+		bool loadLines(const TObservationInfo &info, const uint64_t &params_hash, TLineBatch &lines);
+
+		/** Stores the lines segmented from an observation with the parameters of a hash. Returns false if they could not be written. */
+		bool storeLines(const TObservationInfo &info, const uint64_t &params_hash, const TLineBatch &lines);
+
+		/** Returns the number of entries found in the cache, and not found, respectively. */
+		size_t getHits() const;
+		size_t getMisses() const;
+
+	private:
+
+		/** Returns the hash identifying an observation of the rawlog. */
+		uint64_t observationHash(const TObservationInfo &info) const;
+
+		/** Returns the path of the entry of an observation hash and parameters hash. */
+		std::string entryPath(const uint64_t &obs_hash, const uint64_t &params_hash, const std::string &extension) const;
+
+		std::string m_cache_dir;
+
+		/** Identifies the rawlog, seeding the hash of the observations. */
+		uint64_t m_rawlog_hash;
+
+		std::atomic<size_t> m_hits{0};
+		std::atomic<size_t> m_misses{0};
+};
@@ -0,0 +1,235 @@
+#include "CFeatureStore.h"
+
+namespace
+{
+	template <typename Derived>
+	size_t matrixBytes(const Eigen::DenseBase<Derived> &matrix)
+	{
+		return matrix.size() * sizeof(typename Derived::Scalar);
+	}
+}
+
+size_t CFeatureStore::getNumberOfSensors() const
+{
+	return m_offsets.size();
+}
+
+size_t CFeatureStore::getNumberOfObservations(const int &sensor_id) const
+{
+	return m_offsets[sensor_id].size() - 1;
+}
+
+size_t CFeatureStore::begin(const int &sensor_id, const int &obs_id) const
+{
+	return m_offsets[sensor_id][obs_id];
+}
+
+size_t CFeatureStore::count(const int &sensor_id, const int &obs_id) const
+{
+	return m_offsets[sensor_id][obs_id + 1] - m_offsets[sensor_id][obs_id];
+}
+
+size_t CFeatureStore::index(const int &sensor_id, const int &obs_id, const int &feature_id) const
+{
+	return m_offsets[sensor_id][obs_id] + feature_id;
+}
+
+size_t CFeatureStore::size(const int &sensor_id) const
+{
+	return m_offsets[sensor_id].back();
+}
+
+size_t CFeatureStore::size() const
+{
+	size_t total = 0;
+	for(size_t sensor_id = 0; sensor_id < m_offsets.size(); sensor_id++)
+		total += m_offsets[sensor_id].back();
+
+	return total;
+}
+
+void CFeatureStore::setOffsets(const int &sensor_id, const std::vector<size_t> &counts)
+{
+	if(m_offsets.size() <= static_cast<size_t>(sensor_id))
+		m_offsets.resize(sensor_id + 1, std::vector<size_t>(1, 0));
+
+	std::vector<size_t> &offsets = m_offsets[sensor_id];
+	offsets.resize(counts.size() + 1);
+	offsets[0] = 0;
+	for(size_t obs_id = 0; obs_id < counts.size(); obs_id++)
+		offsets[obs_id + 1] = offsets[obs_id] + counts[obs_id];
+}
+
+size_t CFeatureStore::offsetBytes() const
+{
+	size_t bytes = 0;
+	for(const std::vector<size_t> &offsets : m_offsets)
+		bytes += sizeof(offsets) + offsets.capacity() * sizeof(size_t);
+
+	return bytes;
+}
+
+void CPlaneStore::assign(std::vector<std::vector<std::vector<CPlaneCHull>>> &planes)
+{
+	clear();
+	m_planes.resize(planes.size());
+	m_hulls.resize(planes.size());
+
+	for(size_t sensor_id = 0; sensor_id < planes.size(); sensor_id++)
+	{
+		std::vector<size_t> counts(planes[sensor_id].size());
+		for(size_t obs_id = 0; obs_id < planes[sensor_id].size(); obs_id++)
+			counts[obs_id] = planes[sensor_id][obs_id].size();
+
+		setOffsets(sensor_id, counts);
+		m_planes[sensor_id].resize(size(sensor_id));
+		m_hulls[sensor_id].resize(size(sensor_id));
+
+		for(size_t obs_id = 0; obs_id < planes[sensor_id].size(); obs_id++)
+		{
+			for(size_t plane_id = 0; plane_id < planes[sensor_id][obs_id].size(); plane_id++)
+			{
+				CPlaneCHull &plane = planes[sensor_id][obs_id][plane_id];
+				size_t i = index(sensor_id, obs_id, plane_id);
+
+				m_planes[sensor_id].set(i, plane);
+
+				TPlaneHull &hull = m_hulls[sensor_id][i];
+				hull.ConvexHullPtr = std::move(plane.ConvexHullPtr);
+				hull.v_hull_indices = std::move(plane.v_hull_indices);
+				hull.v_inliers = std::move(plane.v_inliers);
+				hull.covariance = plane.covariance;
+				hull.area = plane.area;
+				hull.n_inliers = plane.n_inliers;
+			}
+		}
+	}
+}
+
+void CPlaneStore::clear()
+{
+	m_offsets.clear();
+	m_planes.clear();
+	m_hulls.clear();
+}
+
+const TPlaneBatch &CPlaneStore::getPlanes(const int &sensor_id) const
+{
+	return m_planes[sensor_id];
+}
+
+const TPlaneHull &CPlaneStore::getHull(const int &sensor_id, const size_t &index) const
+{
+	return m_hulls[sensor_id][index];
+}
+
+CPlaneCHull CPlaneStore::getPlane(const int &sensor_id, const int &obs_id, const int &plane_id) const
+{
+	size_t i = index(sensor_id, obs_id, plane_id);
+	const TPlaneBatch &planes = m_planes[sensor_id];
+	const TPlaneHull &hull = m_hulls[sensor_id][i];
+
+	CPlaneCHull plane;
+	plane.v3normal = planes.normals.col(i);
+	plane.v3center = planes.centers.col(i);
+	plane.d = planes.d[i];
+	plane.curvature = planes.curvature[i];
+	plane.covariance = hull.covariance;
+	plane.area = hull.area;
+	plane.n_inliers = hull.n_inliers;
+	plane.ConvexHullPtr = hull.ConvexHullPtr;
+	plane.v_hull_indices = hull.v_hull_indices;
+	plane.v_inliers = hull.v_inliers;
+
+	return plane;
+}
+
+std::vector<CPlaneCHull> CPlaneStore::getObservationPlanes(const int &sensor_id, const int &obs_id) const
+{
+	std::vector<CPlaneCHull> planes;
+	for(size_t plane_id = 0; plane_id < count(sensor_id, obs_id); plane_id++)
+		planes.push_back(getPlane(sensor_id, obs_id, plane_id));
+
+	return planes;
+}
+
+size_t CPlaneStore::estimateBytes() const
+{
+	size_t bytes = offsetBytes();
+
+	for(size_t sensor_id = 0; sensor_id < m_planes.size(); sensor_id++)
+	{
+		const TPlaneBatch &planes = m_planes[sensor_id];
+		bytes += sizeof(planes) + matrixBytes(planes.normals) + matrixBytes(planes.centers) + matrixBytes(planes.d) + matrixBytes(planes.curvature);
+
+		bytes += m_hulls[sensor_id].capacity() * sizeof(TPlaneHull);
+		for(const TPlaneHull &hull : m_hulls[sensor_id])
+		{
+			bytes += hull.v_hull_indices.capacity() * sizeof(size_t) + hull.v_inliers.capacity() * sizeof(int);
+			if(hull.ConvexHullPtr)
+				bytes += sizeof(pcl::PointCloud<pcl::PointXYZRGBA>) + hull.ConvexHullPtr->points.capacity() * sizeof(pcl::PointXYZRGBA);
+		}
+	}
+
+	return bytes;
+}
+
+void CLineStore::assign(const std::vector<std::vector<TLineBatch>> &lines)
+{
+	clear();
+	m_lines.resize(lines.size());
+
+	for(size_t sensor_id = 0; sensor_id < lines.size(); sensor_id++)
+	{
+		std::vector<size_t> counts(lines[sensor_id].size());
+		for(size_t obs_id = 0; obs_id < lines[sensor_id].size(); obs_id++)
+			counts[obs_id] = lines[sensor_id][obs_id].size();
+
+		setOffsets(sensor_id, counts);
+		m_lines[sensor_id].resize(size(sensor_id));
+
+		for(size_t obs_id = 0; obs_id < lines[sensor_id].size(); obs_id++)
+			m_lines[sensor_id].setColumns(begin(sensor_id, obs_id), lines[sensor_id][obs_id]);
+	}
+}
+
+void CLineStore::clear()
+{
+	m_offsets.clear();
+	m_lines.clear();
+}
+
+const TLineBatch &CLineStore::getLines(const int &sensor_id) const
+{
+	return m_lines[sensor_id];
+}
+
+CLine CLineStore::getLine(const int &sensor_id, const int &obs_id, const int &line_id) const
+{
+	return m_lines[sensor_id].line(index(sensor_id, obs_id, line_id));
+}
+
+std::vector<CLine> CLineStore::getObservationLines(const int &sensor_id, const int &obs_id) const
+{
+	std::vector<CLine> lines;
+	for(size_t line_id = 0; line_id < count(sensor_id, obs_id); line_id++)
+		lines.push_back(getLine(sensor_id, obs_id, line_id));
+
+	return lines;
+}
+
+size_t CLineStore::estimateBytes() const
+{
+	size_t bytes = offsetBytes();
+
+	for(const TLineBatch &lines : m_lines)
+	{
+		bytes += sizeof(lines) + matrixBytes(lines.rho) + matrixBytes(lines.theta) + matrixBytes(lines.m) + matrixBytes(lines.c);
+		bytes += matrixBytes(lines.end_points[0]) + matrixBytes(lines.end_points[1]);
+		bytes += matrixBytes(lines.end_points3D[0]) + matrixBytes(lines.end_points3D[1]);
+		bytes += matrixBytes(lines.mean_points) + matrixBytes(lines.l);
+		bytes += matrixBytes(lines.rays) + matrixBytes(lines.normals) + matrixBytes(lines.points) + matrixBytes(lines.directions);
+	}
+
+	return bytes;
+}
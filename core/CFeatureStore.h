@@ -0,0 +1,119 @@
+#pragma once
+
+#include "CPlane.h"
+#include "CLine.h"
+
+#include <Eigen/StdVector>
+#include <vector>
+
+/**
+ * Indexes the features of the observations of each sensor, which are stored one after the other in arrays per sensor:
+ * the features of an observation are the columns [begin(sensor_id, obs_id), begin(sensor_id, obs_id + 1)) of the arrays of
+ * its sensor, as in the compressed sparse row format. obs_id is with respect to the synchronized model.
+ */
+
+class CFeatureStore
+{
+	public:
+
+		size_t getNumberOfSensors() const;
+
+		size_t getNumberOfObservations(const int &sensor_id) const;
+
+		/** Returns the column of the first feature of an observation in the arrays of its sensor. */
+		size_t begin(const int &sensor_id, const int &obs_id) const;
+
+		/** Returns the number of features of an observation. */
+		size_t count(const int &sensor_id, const int &obs_id) const;
+
+		/** Returns the column of a feature of an observation in the arrays of its sensor. */
+		size_t index(const int &sensor_id, const int &obs_id, const int &feature_id) const;
+
+		/** Returns the number of features of all the observations of a sensor. */
+		size_t size(const int &sensor_id) const;
+
+		/** Returns the number of features of all the observations of all the sensors. */
+		size_t size() const;
+
+	protected:
+
+		/** Sets the offsets of the observations of a sensor from their number of features, growing the sensors if needed. */
+		void setOffsets(const int &sensor_id, const std::vector<size_t> &counts);
+
+		/** Returns the memory taken by the offsets, in bytes. */
+		size_t offsetBytes() const;
+
+		/** The offsets of the observations of each sensor, with one more at the end for the total. */
+		std::vector<std::vector<size_t>> m_offsets;
+};
+
+/**
+ * The planes segmented from the observations of each sensor. The characteristics matching and solving read (normals, d,
+ * centers and curvature) are kept in contiguous arrays per sensor, and the convex hulls and inliers in a side table, so that
+ * matching and solving never touch them.
+ */
+
+class CPlaneStore : public CFeatureStore
+{
+	public:
+
+		/**
+		 * \brief Replaces the planes of the store.
+		 * \param planes the planes of every observation of every sensor, indexed as [sensor_id][obs_id][plane_id].
+		 * Their convex hulls and inliers are moved to the side table, leaving them empty.
+		 */
+		void assign(std::vector<std::vector<std::vector<CPlaneCHull>>> &planes);
+
+		void clear();
+
+		/** Returns the characteristics of the planes of all the observations of a sensor. */
+		const TPlaneBatch &getPlanes(const int &sensor_id) const;
+
+		/** Returns the convex hull and inliers of a plane, given its column in the arrays of its sensor. */
+		const TPlaneHull &getHull(const int &sensor_id, const size_t &index) const;
+
+		/** Returns a plane of an observation with all its data, e.g. to display it. */
+		CPlaneCHull getPlane(const int &sensor_id, const int &obs_id, const int &plane_id) const;
+
+		/** Returns the planes of an observation with all their data, e.g. to display them. */
+		std::vector<CPlaneCHull> getObservationPlanes(const int &sensor_id, const int &obs_id) const;
+
+		/** Returns an estimate of the memory taken by the planes, with their convex hulls and inliers, in bytes. */
+		size_t estimateBytes() const;
+
+	private:
+
+		std::vector<TPlaneBatch> m_planes;
+		std::vector<std::vector<TPlaneHull,Eigen::aligned_allocator<TPlaneHull>>> m_hulls;
+};
+
+/** The lines segmented from the observations of each sensor, kept in contiguous arrays per sensor. */
+
+class CLineStore : public CFeatureStore
+{
+	public:
+
+		/**
+		 * \brief Replaces the lines of the store.
+		 * \param lines the batch of lines of every observation of every sensor, indexed as [sensor_id][obs_id], copied column block by column block.
+		 */
+		void assign(const std::vector<std::vector<TLineBatch>> &lines);
+
+		void clear();
+
+		/** Returns the lines of all the observations of a sensor. */
+		const TLineBatch &getLines(const int &sensor_id) const;
+
+		/** Returns a line of an observation as a CLine, e.g. to display it. */
+		CLine getLine(const int &sensor_id, const int &obs_id, const int &line_id) const;
+
+		/** Returns the lines of an observation as CLines, e.g. to display them. */
+		std::vector<CLine> getObservationLines(const int &sensor_id, const int &obs_id) const;
+
+		/** Returns an estimate of the memory taken by the lines, in bytes. */
+		size_t estimateBytes() const;
+
+	private:
+
+		std::vector<TLineBatch> m_lines;
+};
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <array>
+#include <vector>
 #include <Eigen/Core>
 
 typedef float Scalar;
@@ -43,3 +44,113 @@ public:
 	/** 3D direction vector of the line. */
 	Eigen::Vector3f v;
 };
+
+/**
+ * The lines of a frame as a structure of arrays, with one column per line holding the fields of a CLine,
+ * so that the lines of a frame are built and read in batches rather than line by line.
+ */
+
+struct TLineBatch
+{
+	Eigen::Matrix<Scalar,1,Eigen::Dynamic> rho;
+	Eigen::Matrix<Scalar,1,Eigen::Dynamic> theta;
+
+	Eigen::Matrix<Scalar,1,Eigen::Dynamic> m;
+	Eigen::Matrix<Scalar,1,Eigen::Dynamic> c;
+
+	std::array<Eigen::Matrix2Xi,2> end_points;
+	std::array<Eigen::Matrix3Xf,2> end_points3D;
+	Eigen::Matrix2Xi mean_points;
+
+	/** The 2D direction vectors, [lx ly] (the third coordinate of CLine::l is always 0). */
+	Eigen::Matrix2Xi l;
+
+	Eigen::Matrix3Xf rays;
+	Eigen::Matrix3Xf normals;
+	Eigen::Matrix3Xf points;
+	Eigen::Matrix3Xf directions;
+
+	size_t size() const
+	{
+		return rho.cols();
+	}
+
+	void resize(const size_t &num_lines)
+	{
+		rho.resize(num_lines);
+		theta.resize(num_lines);
+		m.resize(num_lines);
+		c.resize(num_lines);
+		end_points[0].resize(2, num_lines);
+		end_points[1].resize(2, num_lines);
+		end_points3D[0].resize(3, num_lines);
+		end_points3D[1].resize(3, num_lines);
+		mean_points.resize(2, num_lines);
+		l.resize(2, num_lines);
+		rays.resize(3, num_lines);
+		normals.resize(3, num_lines);
+		points.resize(3, num_lines);
+		directions.resize(3, num_lines);
+	}
+
+	/** Sets a column of the batch to the fields of a line. */
+	void set(const size_t &i, const CLine &line)
+	{
+		rho[i] = line.rho;
+		theta[i] = line.theta;
+		m[i] = line.m;
+		c[i] = line.c;
+		end_points[0].col(i) = line.end_points[0];
+		end_points[1].col(i) = line.end_points[1];
+		end_points3D[0].col(i) = line.end_points3D[0];
+		end_points3D[1].col(i) = line.end_points3D[1];
+		mean_points.col(i) = line.mean_point;
+		l.col(i) = line.l.head<2>();
+		rays.col(i) = line.ray;
+		normals.col(i) = line.normal;
+		points.col(i) = line.p;
+		directions.col(i) = line.v;
+	}
+
+	/** Returns a line of the batch as a CLine. */
+	CLine line(const size_t &i) const
+	{
+		CLine line;
+		line.rho = rho[i];
+		line.theta = theta[i];
+		line.m = m[i];
+		line.c = c[i];
+		line.end_points[0] = end_points[0].col(i);
+		line.end_points[1] = end_points[1].col(i);
+		line.end_points3D[0] = end_points3D[0].col(i);
+		line.end_points3D[1] = end_points3D[1].col(i);
+		line.mean_point = mean_points.col(i);
+		line.l = Eigen::Vector3i(l(0,i), l(1,i), 0);
+		line.ray = rays.col(i);
+		line.normal = normals.col(i);
+		line.p = points.col(i);
+		line.v = directions.col(i);
+
+		return line;
+	}
+
+	/** Sets the columns of the batch from a first one to the lines of another batch, e.g. to gather the batches of several frames. */
+	void setColumns(const size_t &first, const TLineBatch &lines)
+	{
+		const size_t num_lines = lines.size();
+		rho.segment(first, num_lines) = lines.rho;
+		theta.segment(first, num_lines) = lines.theta;
+		m.segment(first, num_lines) = lines.m;
+		c.segment(first, num_lines) = lines.c;
+		end_points[0].middleCols(first, num_lines) = lines.end_points[0];
+		end_points[1].middleCols(first, num_lines) = lines.end_points[1];
+		end_points3D[0].middleCols(first, num_lines) = lines.end_points3D[0];
+		end_points3D[1].middleCols(first, num_lines) = lines.end_points3D[1];
+		mean_points.middleCols(first, num_lines) = lines.mean_points;
+		l.middleCols(first, num_lines) = lines.l;
+		rays.middleCols(first, num_lines) = lines.rays;
+		normals.middleCols(first, num_lines) = lines.normals;
+		points.middleCols(first, num_lines) = lines.points;
+		directions.middleCols(first, num_lines) = lines.directions;
+	}
+};
@@ -0,0 +1,149 @@
+#include "CLogSink.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+CLogSink::CLogSink(const size_t &capacity, const LogLevel &min_level) : m_min_level(min_level)
+{
+	size_t size = 2;
+	while(size < capacity)
+		size <<= 1;
+
+	m_cells.reset(new TCell[size]);
+	m_mask = size - 1;
+
+	for(size_t i = 0; i < size; i++)
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool CLogSink::log(const std::string &text, const LogLevel &level)
+{
+	if(level < m_min_level.load(std::memory_order_relaxed))
+		return false;
+
+	TCell *cell;
+	size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+	while(true)
+	{
+		cell = &m_cells[pos & m_mask];
+		size_t seq = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+		if(diff == 0)
+		{
+			// the cell is free for this position, claim it
+			if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+
+		else if(diff < 0)
+		{
+			// the cell still holds the message of the previous lap: the ring is full
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		else
+			pos = m_enqueue_pos.load(std::memory_order_relaxed);
+	}
+
+	cell->message.level = level;
+	cell->message.text = text;
+	cell->sequence.store(pos + 1, std::memory_order_release);
+
+	return true;
+}
+
+size_t CLogSink::drain(std::vector<TLogMessage> &messages, const size_t &max_count)
+{
+	size_t count = 0;
+
+	while(count < max_count)
+	{
+		TCell *cell;
+		size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+		while(true)
+		{
+			cell = &m_cells[pos & m_mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+			if(diff == 0)
+			{
+				if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+
+			else if(diff < 0)
+				return count; // the ring is empty
+
+			else
+				pos = m_dequeue_pos.load(std::memory_order_relaxed);
+		}
+
+		messages.push_back(std::move(cell->message));
+
+		// frees the cell for the producer of the next lap
+		cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+		count++;
+	}
+
+	return count;
+}
+
+void CLogSink::setMinLevel(const LogLevel &min_level)
+{
+	m_min_level.store(min_level, std::memory_order_relaxed);
+}
+
+CLogSink::LogLevel CLogSink::getMinLevel() const
+{
+	return static_cast<LogLevel>(m_min_level.load(std::memory_order_relaxed));
+}
+
+size_t CLogSink::takeDropped()
+{
+	return m_dropped.exchange(0, std::memory_order_relaxed);
+}
+
+size_t CLogSink::getCapacity() const
+{
+	return m_mask + 1;
+}
+
+CLogSink::LogLevel CLogSink::levelFromString(const std::string &name, const LogLevel &default_level)
+{
+	std::string lower(name);
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+
+	if(lower == "debug")
+		return LOG_DEBUG;
+	if(lower == "info")
+		return LOG_INFO;
+	if(lower == "warning")
+		return LOG_WARNING;
+	if(lower == "error")
+		return LOG_ERROR;
+
+	return default_level;
+}
+
+const char *CLogSink::levelName(const LogLevel &level)
+{
+	switch(level)
+	{
+	case LOG_DEBUG:
+		return "DEBUG";
+	case LOG_INFO:
+		return "INFO";
+	case LOG_WARNING:
+		return "WARNING";
+	case LOG_ERROR:
+		return "ERROR";
+	}
+
+	return "";
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Collects the log messages published from any number of threads into a bounded lock-free ring buffer, to be drained in
+ * batches by a single consumer (e.g. the UI thread, on a timer), so that the producers never wait on a lock or on the consumer.
+ * Messages below the minimum level are discarded before being queued; messages published while the ring is full are dropped
+ * and counted instead of blocking the producer.
+ * The ring follows the bounded multi-producer multi-consumer queue of D. Vyukov: each cell carries a sequence number telling
+ * whether it is free for the producer of a position, or filled for its consumer.
+ */
+
+class CLogSink
+{
+	public:
+
+		enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR };
+
+		struct TLogMessage
+		{
+			LogLevel level;
+			std::string text;
+		};
+
+	    /**
+		 * Constructor
+		 * \param capacity the number of messages the ring holds, rounded up to a power of two.
+		 * \param min_level the level below which messages are discarded.
+		 */
+	    explicit CLogSink(const size_t &capacity = 4096, const LogLevel &min_level = LOG_INFO);
+
+		/**
+		 * \brief Queues a message. Can be called from any thread, and never blocks.
+		 * \param text the message.
+		 * \param level the level of the message.
+		 * \return true if the message was queued, false if it was filtered out or dropped because the ring is full.
+		 */
+		bool log(const std::string &text, const LogLevel &level = LOG_INFO);
+
+		/**
+		 * \brief Moves the queued messages, in order and up to a maximum count, to the end of a vector.
+		 * \param messages the vector the messages are appended to.
+		 * \param max_count the maximum number of messages to dequeue.
+		 * \return the number of messages dequeued.
+		 */
+		size_t drain(std::vector<TLogMessage> &messages, const size_t &max_count);
+
+		/** Sets the level below which messages are discarded. Can be called from any thread. */
+		void setMinLevel(const LogLevel &min_level);
+
+		LogLevel getMinLevel() const;
+
+		/** Returns the number of messages dropped because the ring was full since the last call, and resets it. */
+		size_t takeDropped();
+
+		/** Returns the number of messages the ring holds. */
+		size_t getCapacity() const;
+
+		/** Returns the level named by a string (debug, info, warning, error, case insensitive), or a default one if it is not a level name. */
+		static LogLevel levelFromString(const std::string &name, const LogLevel &default_level = LOG_INFO);
+
+		/** Returns the name of a level, in capitals. */
+		static const char *levelName(const LogLevel &level);
+
+	private:
+
+		struct TCell
+		{
+			/** The position the cell is free for when equal to it, or filled for when equal to it plus one. */
+			std::atomic<size_t> sequence;
+
+			TLogMessage message;
+		};
+
+		std::unique_ptr<TCell[]> m_cells;
+
+		/** The capacity minus one, masking a position into the index of its cell. */
+		size_t m_mask;
+
+		/** The positions of the next message to enqueue and dequeue, on separate cache lines as they are written by different threads. */
+		alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+		alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+
+		alignas(64) std::atomic<int> m_min_level;
+		std::atomic<size_t> m_dropped{0};
+};
@@ -0,0 +1,228 @@
+#include "CMemoryMonitor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include <sys/resource.h>
+
+namespace
+{
+	/** Returns the size of a field of /proc/self/status (e.g. VmRSS), in bytes, or 0 if it is not there. */
+	size_t readStatusField(const std::string &field)
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+
+		while(std::getline(status, line))
+		{
+			if(line.compare(0, field.size() + 1, field + ":") != 0)
+				continue;
+
+			std::istringstream value(line.substr(field.size() + 1));
+			size_t kilobytes = 0;
+			value >> kilobytes;
+			return kilobytes * 1024;
+		}
+
+		return 0;
+	}
+}
+
+CMemoryMonitor &CMemoryMonitor::instance()
+{
+	static CMemoryMonitor monitor;
+	return monitor;
+}
+
+CMemoryMonitor::CMemoryMonitor()
+{
+	for(int i = 0; i < NUM_SUBSYSTEMS; i++)
+	{
+		m_bytes[i] = 0;
+		m_peak_bytes[i] = 0;
+		m_stage_peak_bytes[i] = 0;
+	}
+}
+
+void CMemoryMonitor::raise(std::atomic<int64_t> &peak, const int64_t &value)
+{
+	int64_t current = peak.load();
+	while(value > current && !peak.compare_exchange_weak(current, value))
+	{}
+}
+
+void CMemoryMonitor::add(const Subsystem &subsystem, const int64_t &bytes)
+{
+	int64_t total = m_bytes[subsystem].fetch_add(bytes) + bytes;
+	raise(m_peak_bytes[subsystem], total);
+	raise(m_stage_peak_bytes[subsystem], total);
+}
+
+size_t CMemoryMonitor::getBytes(const Subsystem &subsystem) const
+{
+	return std::max<int64_t>(m_bytes[subsystem].load(), 0);
+}
+
+size_t CMemoryMonitor::getPeakBytes(const Subsystem &subsystem) const
+{
+	return m_peak_bytes[subsystem].load();
+}
+
+void CMemoryMonitor::beginStage(const std::string &name)
+{
+	endStage();
+
+	std::lock_guard<std::mutex> lock(m_stages_mutex);
+	m_stage_name = name;
+
+	// the peaks of the stage start from the memory already taken when it begins
+	for(int i = 0; i < NUM_SUBSYSTEMS; i++)
+		m_stage_peak_bytes[i] = m_bytes[i].load();
+
+	resetPeakResident();
+}
+
+void CMemoryMonitor::endStage()
+{
+	std::lock_guard<std::mutex> lock(m_stages_mutex);
+	if(m_stage_name.empty())
+		return;
+
+	TStageMemory stage;
+	stage.name = m_stage_name;
+	stage.peak_resident_bytes = peakResidentBytes();
+	for(int i = 0; i < NUM_SUBSYSTEMS; i++)
+		stage.peak_bytes[i] = std::max<int64_t>(m_stage_peak_bytes[i].load(), 0);
+
+	m_stages.push_back(stage);
+	m_stage_name.clear();
+}
+
+std::vector<CMemoryMonitor::TStageMemory> CMemoryMonitor::getStages() const
+{
+	std::lock_guard<std::mutex> lock(m_stages_mutex);
+	return m_stages;
+}
+
+void CMemoryMonitor::clearStages()
+{
+	std::lock_guard<std::mutex> lock(m_stages_mutex);
+	m_stages.clear();
+}
+
+std::string CMemoryMonitor::report() const
+{
+	const double mb = 1024.0 * 1024.0;
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+	out << std::left << std::setw(24) << "subsystem" << std::right << std::setw(14) << "current (MB)" << std::setw(12) << "peak (MB)" << "\n";
+
+	for(int i = 0; i < NUM_SUBSYSTEMS; i++)
+	{
+		Subsystem subsystem = static_cast<Subsystem>(i);
+		out << std::left << std::setw(24) << subsystemName(subsystem) << std::right << std::setw(14) << getBytes(subsystem) / mb
+		    << std::setw(12) << getPeakBytes(subsystem) / mb << "\n";
+	}
+
+	out << std::left << std::setw(24) << "process (resident)" << std::right << std::setw(14) << currentResidentBytes() / mb
+	    << std::setw(12) << peakResidentBytes() / mb << "\n";
+
+	std::vector<TStageMemory> stages = getStages();
+	if(!stages.empty())
+	{
+		// the peaks of each stage, one column per subsystem
+		out << "\n" << std::left << std::setw(24) << "stage peak (MB)" << std::right;
+		for(int i = 0; i < NUM_SUBSYSTEMS; i++)
+			out << std::setw(16) << subsystemName(static_cast<Subsystem>(i));
+		out << std::setw(16) << "process" << "\n";
+
+		for(const TStageMemory &stage : stages)
+		{
+			out << std::left << std::setw(24) << stage.name << std::right;
+			for(int i = 0; i < NUM_SUBSYSTEMS; i++)
+				out << std::setw(16) << stage.peak_bytes[i] / mb;
+			out << std::setw(16) << stage.peak_resident_bytes / mb << "\n";
+		}
+	}
+
+	return out.str();
+}
+
+const char *CMemoryMonitor::subsystemName(const Subsystem &subsystem)
+{
+	switch(subsystem)
+	{
+	case OBSERVATION_PAYLOADS:
+		return "payloads";
+	case CLOUD_CACHE:
+		return "clouds";
+	case PLANE_FEATURES:
+		return "planes";
+	case LINE_FEATURES:
+		return "lines";
+	case CORRESPONDENCES:
+		return "correspondences";
+	case SOLVER_MATRICES:
+		return "solver";
+	default:
+		return "unknown";
+	}
+}
+
+size_t CMemoryMonitor::currentResidentBytes()
+{
+	return readStatusField("VmRSS");
+}
+
+size_t CMemoryMonitor::peakResidentBytes()
+{
+	size_t peak = readStatusField("VmHWM");
+	if(peak > 0)
+		return peak;
+
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return usage.ru_maxrss * 1024;
+#endif
+}
+
+bool CMemoryMonitor::resetPeakResident()
+{
+	// writing 5 to clear_refs resets the peak resident set size of the process (Linux 4.0 and later)
+	std::ofstream clear_refs("/proc/self/clear_refs");
+	clear_refs << "5";
+	clear_refs.flush();
+
+	return static_cast<bool>(clear_refs);
+}
+
+CMemoryAccount::CMemoryAccount(const CMemoryMonitor::Subsystem &subsystem) : m_subsystem(subsystem), m_bytes(0)
+{}
+
+CMemoryAccount::~CMemoryAccount()
+{
+	set(0);
+}
+
+void CMemoryAccount::set(const size_t &bytes)
+{
+	if(bytes == m_bytes)
+		return;
+
+	CMemoryMonitor::instance().add(m_subsystem, static_cast<int64_t>(bytes) - static_cast<int64_t>(m_bytes));
+	m_bytes = bytes;
+}
+
+size_t CMemoryAccount::get() const
+{
+	return m_bytes;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Accounts the memory of the application by subsystem (observation payloads, cached clouds, features, correspondences,
+ * solver matrices), as attributed by their owners through CMemoryAccount, along with the memory used by the process as
+ * the resident set size the system reports, so that the peak memory of each stage can be told apart and compared between runs.
+ * The resident sizes are read from /proc on Linux; elsewhere only the peak is available, from getrusage(), and it cannot be reset.
+ */
+
+class CMemoryMonitor
+{
+	public:
+
+		enum Subsystem
+		{
+			OBSERVATION_PAYLOADS,
+			CLOUD_CACHE,
+			PLANE_FEATURES,
+			LINE_FEATURES,
+			CORRESPONDENCES,
+			SOLVER_MATRICES,
+			NUM_SUBSYSTEMS
+		};
+
+		/** The peak memory of each subsystem and of the process while a stage ran, in bytes. */
+		struct TStageMemory
+		{
+			std::string name;
+			std::array<size_t,NUM_SUBSYSTEMS> peak_bytes;
+			size_t peak_resident_bytes;
+		};
+
+		/** Returns the monitor shared by the whole application. */
+		static CMemoryMonitor &instance();
+
+		/** Adds bytes to (or removes them from, if negative) the memory of a subsystem. Can be called from any thread. */
+		void add(const Subsystem &subsystem, const int64_t &bytes);
+
+		/** Returns the memory currently attributed to a subsystem, in bytes. */
+		size_t getBytes(const Subsystem &subsystem) const;
+
+		/** Returns the peak memory of a subsystem since the application started, in bytes. */
+		size_t getPeakBytes(const Subsystem &subsystem) const;
+
+		/**
+		 * \brief Starts measuring the peak memory of a stage, ending the previous one if it was not ended.
+		 * Only one stage is measured at a time, as the stages of a calibration run one after the other.
+		 */
+		void beginStage(const std::string &name);
+
+		/** Ends the stage being measured, recording its peak memory. Does nothing if no stage was begun. */
+		void endStage();
+
+		/** Returns the peak memory of the stages ended so far, in the order they ran. */
+		std::vector<TStageMemory> getStages() const;
+
+		/** Discards the stages ended so far. */
+		void clearStages();
+
+		/** Returns a table with the current and peak memory of each subsystem and of the process, and the peak memory of each stage. */
+		std::string report() const;
+
+		static const char *subsystemName(const Subsystem &subsystem);
+
+		/** Returns the resident set size of the process, in bytes, or 0 where it cannot be read. */
+		static size_t currentResidentBytes();
+
+		/** Returns the peak resident set size of the process since it started or since the last reset, in bytes, or 0 where it cannot be read. */
+		static size_t peakResidentBytes();
+
+		/**
+		 * \brief Resets the peak resident set size to the current one, so that the peak of a stage is measured on its own.
+		 * \return false if the system does not support it, in which case the peak stays the one since the process started.
+		 */
+		static bool resetPeakResident();
+
+	private:
+
+		CMemoryMonitor();
+
+		/** Raises a peak to a value, if lower. */
+		static void raise(std::atomic<int64_t> &peak, const int64_t &value);
+
+		std::array<std::atomic<int64_t>,NUM_SUBSYSTEMS> m_bytes;
+		std::array<std::atomic<int64_t>,NUM_SUBSYSTEMS> m_peak_bytes;
+
+		/** The peak of each subsystem since the stage being measured began. */
+		std::array<std::atomic<int64_t>,NUM_SUBSYSTEMS> m_stage_peak_bytes;
+
+		mutable std::mutex m_stages_mutex;
+
+		/** The name of the stage being measured, empty if none. */
+		std::string m_stage_name;
+
+		std::vector<TStageMemory> m_stages;
+};
+
+/**
+ * The memory an object attributes to a subsystem of the memory monitor, set by the object as it changes and given back
+ * when the object is destroyed. Not thread-safe: an object updates its account under the lock that protects what it measures.
+ */
+
+class CMemoryAccount
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param subsystem the subsystem the memory is attributed to.
+		 */
+	    explicit CMemoryAccount(const CMemoryMonitor::Subsystem &subsystem);
+
+		~CMemoryAccount();
+
+		CMemoryAccount(const CMemoryAccount&) = delete;
+		CMemoryAccount &operator=(const CMemoryAccount&) = delete;
+
+		/** Sets the memory attributed by the object, in bytes, reporting the difference to the monitor. */
+		void set(const size_t &bytes);
+
+		size_t get() const;
+
+	private:
+
+		CMemoryMonitor::Subsystem m_subsystem;
+		size_t m_bytes;
+};
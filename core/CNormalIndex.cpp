@@ -0,0 +1,144 @@
+#include "CNormalIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	/** The smallest bucket size, which bounds the number of buckets per axis for thresholds close to 1. */
+	const double min_cell_size = 0.01;
+
+	/** Loosens the bound on the cosine of a match, to keep the matches whose dot product is rounded differently. */
+	const double cos_margin = 1e-5;
+}
+
+double CNormalIndex::cellSize(const double &min_dot_prod)
+{
+	double cell_size = std::sqrt(std::max(0.0, 2 - 2 * min_dot_prod));
+	return std::min(std::max(cell_size, min_cell_size), 2.0);
+}
+
+void CNormalIndex::build(const Eigen::Matrix3Xf &vectors, const double &cell_size)
+{
+	m_cell_size = std::min(std::max(cell_size, min_cell_size), 2.0);
+	m_cells_per_axis = int(std::floor(2 / m_cell_size)) + 1;
+	m_buckets.clear();
+	m_unbucketed.clear();
+	m_min_norm = std::numeric_limits<double>::max();
+	m_max_norm = 0;
+	m_size = vectors.cols();
+
+	for(int id = 0; id < vectors.cols(); id++)
+	{
+		Eigen::Vector3d vector = vectors.col(id).cast<double>();
+		double norm = vector.norm();
+		if(!(norm > 0) || !std::isfinite(norm))
+		{
+			m_unbucketed.push_back(id);
+			continue;
+		}
+
+		Eigen::Vector3d unit = vector / norm;
+		m_buckets.push_back(std::make_pair(cellKey(cellCoordinate(unit[0]), cellCoordinate(unit[1]), cellCoordinate(unit[2])), id));
+		m_min_norm = std::min(m_min_norm, norm);
+		m_max_norm = std::max(m_max_norm, norm);
+	}
+
+	std::sort(m_buckets.begin(), m_buckets.end());
+}
+
+void CNormalIndex::findCandidates(const Eigen::Vector3f &query, const double &min_dot_prod, std::vector<int> &candidates) const
+{
+	candidates = m_unbucketed;
+	if(m_buckets.empty())
+		return;
+
+	Eigen::Vector3d vector = query.cast<double>();
+	double query_norm = vector.norm();
+	if(!(query_norm > 0) || !std::isfinite(query_norm))
+	{
+		allCandidates(candidates);
+		std::sort(candidates.begin(), candidates.end());
+		return;
+	}
+
+	// A match has q.v > min_dot_prod, so the cosine of the angle between them is bounded from below over the norms of the vectors.
+	double min_cos = min_dot_prod / (query_norm * (min_dot_prod >= 0 ? m_max_norm : m_min_norm)) - cos_margin;
+	if(min_cos > 1)
+	{
+		std::sort(candidates.begin(), candidates.end());
+		return;
+	}
+
+	// The distance between the directions of a match on the unit sphere, and so the number of rings of buckets around the query to search.
+	double radius = std::sqrt(std::max(0.0, 2 - 2 * min_cos));
+	int rings = int(std::ceil(radius / m_cell_size));
+	if(min_cos <= -1 || 2 * rings + 1 >= m_cells_per_axis)
+	{
+		allCandidates(candidates);
+		std::sort(candidates.begin(), candidates.end());
+		return;
+	}
+
+	Eigen::Vector3d unit = vector / query_norm;
+	int cell[3] = {cellCoordinate(unit[0]), cellCoordinate(unit[1]), cellCoordinate(unit[2])};
+	int first[3], last[3];
+	for(int axis = 0; axis < 3; axis++)
+	{
+		first[axis] = std::max(cell[axis] - rings, 0);
+		last[axis] = std::min(cell[axis] + rings, m_cells_per_axis - 1);
+	}
+
+	// A box of more buckets than vectors, e.g. for a query much longer than the vectors, is cheaper to test vector by vector.
+	size_t num_cells = size_t(last[0] - first[0] + 1) * (last[1] - first[1] + 1) * (last[2] - first[2] + 1);
+	if(num_cells > m_buckets.size())
+	{
+		for(const std::pair<int64_t,int> &bucket : m_buckets)
+		{
+			int x = int(bucket.first / (int64_t(m_cells_per_axis) * m_cells_per_axis));
+			int y = int(bucket.first / m_cells_per_axis % m_cells_per_axis);
+			int z = int(bucket.first % m_cells_per_axis);
+			if(x >= first[0] && x <= last[0] && y >= first[1] && y <= last[1] && z >= first[2] && z <= last[2])
+				candidates.push_back(bucket.second);
+		}
+
+		std::sort(candidates.begin(), candidates.end());
+		return;
+	}
+
+	for(int x = first[0]; x <= last[0]; x++)
+		for(int y = first[1]; y <= last[1]; y++)
+			for(int z = first[2]; z <= last[2]; z++)
+			{
+				int64_t key = cellKey(x, y, z);
+				std::vector<std::pair<int64_t,int>>::const_iterator it =
+				        std::lower_bound(m_buckets.begin(), m_buckets.end(), std::make_pair(key, std::numeric_limits<int>::min()));
+				for(; it != m_buckets.end() && it->first == key; ++it)
+					candidates.push_back(it->second);
+			}
+
+	std::sort(candidates.begin(), candidates.end());
+}
+
+size_t CNormalIndex::size() const
+{
+	return m_size;
+}
+
+int64_t CNormalIndex::cellKey(const int &x, const int &y, const int &z) const
+{
+	return (int64_t(x) * m_cells_per_axis + y) * m_cells_per_axis + z;
+}
+
+int CNormalIndex::cellCoordinate(const double &coordinate) const
+{
+	int cell = int(std::floor((coordinate + 1) / m_cell_size));
+	return std::min(std::max(cell, 0), m_cells_per_axis - 1);
+}
+
+void CNormalIndex::allCandidates(std::vector<int> &candidates) const
+{
+	for(const std::pair<int64_t,int> &bucket : m_buckets)
+		candidates.push_back(bucket.second);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * A spatial index of a set of 3D vectors (e.g. the normals of the features of an observation) by their direction, to find
+ * the vectors whose dot product with a query vector may exceed a threshold without comparing the query with all of them.
+ * The directions are bucketed in a grid over the unit sphere. A dot product threshold bounds the angle between the directions
+ * of a match, and so the distance between them on the sphere, which is searched in the buckets around the query only.
+ * The vectors need not be unit: the bound takes their norms into account. The vectors of zero or non-finite norm, which
+ * have no direction, are always candidates.
+ */
+
+class CNormalIndex
+{
+	public:
+
+		/** Returns the size of the buckets suited to a dot product threshold between unit vectors, the distance between two of them at the threshold. */
+		static double cellSize(const double &min_dot_prod);
+
+		/**
+		 * \brief Indexes a set of vectors, replacing those indexed before.
+		 * \param vectors the vectors, one per column. Their ids are their columns.
+		 * \param cell_size the size of the buckets, see cellSize().
+		 */
+		void build(const Eigen::Matrix3Xf &vectors, const double &cell_size);
+
+		/**
+		 * \brief Finds the vectors whose dot product with a query vector may exceed a threshold, a superset of those that do.
+		 * \param candidates the ids of the candidates, replaced, in increasing order.
+		 */
+		void findCandidates(const Eigen::Vector3f &query, const double &min_dot_prod, std::vector<int> &candidates) const;
+
+		size_t size() const;
+
+	private:
+
+		/** Returns the key of the bucket of cell coordinates. */
+		int64_t cellKey(const int &x, const int &y, const int &z) const;
+
+		/** Returns the cell coordinate of a coordinate of a unit vector. */
+		int cellCoordinate(const double &coordinate) const;
+
+		/** Appends the ids of all the vectors to the candidates. */
+		void allCandidates(std::vector<int> &candidates) const;
+
+		double m_cell_size = 2;
+		int m_cells_per_axis = 1;
+
+		/** The key of the bucket of each vector of non-zero norm and its id, sorted by key. */
+		std::vector<std::pair<int64_t,int>> m_buckets;
+
+		/** The ids of the vectors of zero or non-finite norm, sorted. */
+		std::vector<int> m_unbucketed;
+
+		/** The range of the norms of the vectors of non-zero norm. */
+		double m_min_norm = 0;
+		double m_max_norm = 0;
+
+		size_t m_size = 0;
+};
@@ -0,0 +1,200 @@
+#include "CObservationStore.h"
+
+#include <mrpt/io/CStream.h>
+#include <mrpt/obs/CObservation3DRangeScan.h>
+#include <mrpt/serialization/CArchive.h>
+
+#include <stdexcept>
+
+using namespace mrpt::obs;
+using namespace mrpt::serialization;
+
+namespace
+{
+	/** Stream adapter that lets the deserializer read the rawlog file from its current position. */
+	class CSeekableGzStream : public mrpt::io::CStream
+	{
+		public:
+
+		    CSeekableGzStream(CSeekableGzFile &file) : m_file(file)
+			{}
+
+			size_t Read(void *buffer, size_t count) override
+			{
+				return m_file.read(buffer, count);
+			}
+
+			size_t Write(const void *, size_t) override
+			{
+				throw std::runtime_error("CSeekableGzStream is read-only");
+			}
+
+			uint64_t Seek(int64_t offset, CStream::TSeekOrigin origin) override
+			{
+				if(origin == CStream::sFromCurrent)
+					offset += m_file.tell();
+
+				if(origin == CStream::sFromEnd || offset < 0 || !m_file.seek(offset))
+					throw std::runtime_error("CSeekableGzStream can not seek to the requested offset");
+
+				return m_file.tell();
+			}
+
+			uint64_t getTotalBytesCount() const override
+			{
+				return 0;
+			}
+
+			uint64_t getPosition() const override
+			{
+				return m_file.tell();
+			}
+
+		private:
+
+			CSeekableGzFile &m_file;
+	};
+}
+
+CObservationStore::CObservationStore(const std::string &rawlog_path, const size_t &memory_budget)
+{
+	m_rawlog_path = rawlog_path;
+	m_memory_budget = memory_budget;
+}
+
+CObservationStore::~CObservationStore()
+{
+}
+
+CObservation::Ptr CObservationStore::get(const uint64_t &offset)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_cache_mutex);
+		auto iter = m_cache.find(offset);
+		if(iter != m_cache.end())
+		{
+			m_lru.splice(m_lru.begin(), m_lru, iter->second.lru_pos);
+			m_hits++;
+			return iter->second.obs;
+		}
+
+		m_misses++;
+	}
+
+	CObservation::Ptr obs = read(offset);
+	if(obs)
+		insert(offset, obs);
+
+	return obs;
+}
+
+void CObservationStore::insert(const uint64_t &offset, const CObservation::Ptr &obs)
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+
+	// another thread may have read the same payload in the meantime
+	if(m_cache.count(offset))
+		return;
+
+	m_lru.push_front(offset);
+
+	TCacheEntry &entry = m_cache[offset];
+	entry.obs = obs;
+	entry.bytes = estimatePayloadBytes(*obs);
+	entry.lru_pos = m_lru.begin();
+	m_memory_usage += entry.bytes;
+
+	evict();
+}
+
+void CObservationStore::evict()
+{
+	// the most recently used payload is always kept, even if it alone exceeds the budget
+	while(m_memory_budget > 0 && m_memory_usage > m_memory_budget && m_lru.size() > 1)
+	{
+		auto iter = m_cache.find(m_lru.back());
+		m_memory_usage -= iter->second.bytes;
+		m_cache.erase(iter);
+		m_lru.pop_back();
+	}
+
+	m_memory_account.set(m_memory_usage);
+}
+
+void CObservationStore::setMemoryBudget(const size_t &memory_budget)
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	m_memory_budget = memory_budget;
+	evict();
+}
+
+size_t CObservationStore::getMemoryBudget() const
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_memory_budget;
+}
+
+size_t CObservationStore::getMemoryUsage() const
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_memory_usage;
+}
+
+size_t CObservationStore::getHits() const
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_hits;
+}
+
+size_t CObservationStore::getMisses() const
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_misses;
+}
+
+size_t CObservationStore::estimatePayloadBytes(const CObservation &obs)
+{
+	const CObservation3DRangeScan *scan = dynamic_cast<const CObservation3DRangeScan*>(&obs);
+	if(!scan)
+		return sizeof(CObservation);
+
+	size_t bytes = sizeof(CObservation3DRangeScan);
+	bytes += scan->rangeImage.size() * sizeof(float);
+	bytes += (scan->points3D_x.size() + scan->points3D_y.size() + scan->points3D_z.size()) * sizeof(float);
+
+	if(scan->hasIntensityImage)
+		bytes += scan->intensityImage.getRowStride() * scan->intensityImage.getHeight();
+
+	return bytes;
+}
+
+CObservation::Ptr CObservationStore::read(const uint64_t &offset)
+{
+	std::lock_guard<std::mutex> lock(m_rawlog_mutex);
+
+	if(!m_rawlog.isOpen() && !m_rawlog.open(m_rawlog_path))
+		return nullptr;
+
+	if(!m_rawlog.seek(offset))
+		return nullptr;
+
+	CSeekableGzStream stream(m_rawlog);
+	CSerializable::Ptr obj;
+	CObservation::Ptr obs;
+
+	try
+	{
+		archiveFrom(stream) >> obj;
+
+		obs = std::dynamic_pointer_cast<CObservation>(obj);
+		if(obs)
+			obs->load();
+	}
+
+	catch(std::exception &e)
+	{
+		return nullptr;
+	}
+
+	return obs;
+}
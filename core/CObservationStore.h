@@ -0,0 +1,109 @@
+#pragma once
+
+#include "CMemoryMonitor.h"
+#include "CSeekableGzFile.h"
+
+#include <mrpt/obs/CObservation.h>
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Gives random access to the observations of a rawlog file, by their byte offset in the uncompressed stream.
+ * Shared by all the tree items, which only keep the offset and metadata of their observation.
+ * Deserialized payloads are kept in a least-recently-used cache bounded by a memory budget, and are read
+ * back from the rawlog after being evicted.
+ * The rawlog is read through a CSeekableGzFile, so that reading a payload back from a gzip-compressed rawlog only inflates
+ * the stream from the closest access point before it, rather than from its start.
+ */
+
+class CObservationStore
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param rawlog_path the path of the rawlog file the observations are read from.
+		 * \param memory_budget the maximum number of bytes of payload kept in memory, 0 for no limit.
+		 */
+	    CObservationStore(const std::string &rawlog_path, const size_t &memory_budget = 0);
+
+		~CObservationStore();
+
+		/**
+		 * \brief Returns the observation stored at an offset of the rawlog, reading it if it is not cached.
+		 * \param offset the byte offset of the observation in the uncompressed rawlog stream.
+		 * \return the observation, or a null pointer if it could not be read.
+		 */
+		mrpt::obs::CObservation::Ptr get(const uint64_t &offset);
+
+		/**
+		 * \brief Adds an already deserialized observation to the cache.
+		 * \param offset the byte offset of the observation in the uncompressed rawlog stream.
+		 * \param obs the observation.
+		 */
+		void insert(const uint64_t &offset, const mrpt::obs::CObservation::Ptr &obs);
+
+		/** Sets the maximum number of bytes of payload kept in memory (0 for no limit), evicting payloads as needed. */
+		void setMemoryBudget(const size_t &memory_budget);
+
+		/** Returns the maximum number of bytes of payload kept in memory. */
+		size_t getMemoryBudget() const;
+
+		/** Returns the estimated number of bytes of payload currently cached. */
+		size_t getMemoryUsage() const;
+
+		/** Returns the number of payloads found in the cache, and read from the rawlog, respectively. */
+		size_t getHits() const;
+		size_t getMisses() const;
+
+		/** Returns an estimate of the memory taken by the payload of an observation, in bytes. */
+		static size_t estimatePayloadBytes(const mrpt::obs::CObservation &obs);
+
+	private:
+
+		/** Reads the observation stored at an offset of the rawlog. */
+		mrpt::obs::CObservation::Ptr read(const uint64_t &offset);
+
+		/** Evicts the least recently used payloads until the cache fits in the budget. Expects m_cache_mutex to be held. */
+		void evict();
+
+		/** A cached payload. */
+		struct TCacheEntry
+		{
+			mrpt::obs::CObservation::Ptr obs;
+			size_t bytes;
+
+			/** Position of the entry in m_lru. */
+			std::list<uint64_t>::iterator lru_pos;
+		};
+
+		/** The path of the rawlog file. */
+		std::string m_rawlog_path;
+
+		/** The rawlog file, opened on first use. */
+		CSeekableGzFile m_rawlog;
+
+		/** Serializes the accesses to the rawlog stream. */
+		std::mutex m_rawlog_mutex;
+
+		/** The cached payloads, by offset. */
+		std::unordered_map<uint64_t, TCacheEntry> m_cache;
+
+		/** The offsets of the cached payloads, from the most to the least recently used. */
+		std::list<uint64_t> m_lru;
+
+		size_t m_memory_budget;
+		size_t m_memory_usage = 0;
+
+		/** The memory of the cached payloads, as attributed to the memory monitor. */
+		CMemoryAccount m_memory_account{CMemoryMonitor::OBSERVATION_PAYLOADS};
+		size_t m_hits = 0;
+		size_t m_misses = 0;
+
+		/** Protects the cache, which is accessed without holding m_rawlog_mutex. */
+		mutable std::mutex m_cache_mutex;
+};
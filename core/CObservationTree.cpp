@@ -1,196 +1,322 @@
 #include "CObservationTree.h"
+#include "CRawlogIndex.h"
+#include "CFeatureCache.h"
+#include "CProfiler.h"
 
-#include <mrpt/io/CFileGZInputStream.h>
-#include <mrpt/serialization/CArchive.h>
 #include <mrpt/rtti/CObject.h>
 
-using namespace mrpt::io;
-using namespace mrpt::serialization;
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
 using namespace mrpt::obs;
 
 CObservationTree::CObservationTree(const std::string &rawlog_path, const mrpt::config::CConfigFile &config_file)
 {
-	m_rootitem = new CObservationTreeItem("root");
 	m_rawlog_path = rawlog_path;
 	m_config_file = config_file;
+
+	// payloads are read back from the rawlog once evicted, so that logs larger than the memory can be processed
+	m_records = std::make_shared<TObservationRecords>();
+	m_records->store = std::make_shared<CObservationStore>(rawlog_path, readMemoryBudget("payload_memory_budget_mb", 2048));
+
+	// clouds are projected again once evicted
+	m_records->clouds = std::make_shared<CCloudCache>(m_records->store, readMemoryBudget("cloud_memory_budget_mb", 1024));
+
+	m_records->features = std::make_shared<CFeatureCache>(m_config_file.read_string("feature_cache", "path", ""), rawlog_path);
+	addItem(-1);
 	m_synced = false;
 }
 
 CObservationTree::~CObservationTree()
 {
-	delete m_rootitem;
 }
 
-void CObservationTree::loadTree()
-{	
-	CFileGZInputStream rawlog(m_rawlog_path);
-	CSerializable::Ptr obj;
+size_t CObservationTree::readMemoryBudget(const std::string &key, const int &default_mb) const
+{
+	int budget_mb = m_config_file.read_int("rawlog", key, default_mb);
+	if(budget_mb < 0)
+	{
+		std::cerr << "Error. [rawlog] " << key << " must be 0 (no limit) or positive, using " << default_mb << " MB" << std::endl;
+		budget_mb = default_mb;
+	}
 
-	bool read = true;
-	std::string sensor_label, obs_label;
+	return static_cast<size_t>(budget_mb) * 1024 * 1024;
+}
+
+int CObservationTree::addItem(const int &parent_id, const int &record_id, const int &prior_index)
+{
+	int item_id = m_items.size();
+	m_items.emplace_back(&m_items, item_id, record_id >= 0 ? m_records.get() : nullptr, record_id, prior_index);
+
+	if(parent_id >= 0)
+		m_items[parent_id].appendChild(item_id);
+
+	return item_id;
+}
 
-	while(read)
+bool CObservationTree::loadTree(const TRawlogLoadParams &params)
+{
+	CScopedTimer timer("loadTree");
+	CRawlogIndex index;
+	TObservationInfo info;
+	bool completed = true;
+	bool from_index = false;
+
+	// a damaged index is rebuilt from the rawlog rather than failing the loading
+	if(params.use_index)
 	{
 		try
 		{
-			archiveFrom(rawlog) >> obj;
+			from_index = index.load(m_rawlog_path);
+		}
 
-			CObservation::Ptr obs = std::dynamic_pointer_cast<CObservation>(obj);
-			m_obs_count++;
+		catch(std::exception &e)
+		{
+			std::cerr << "Error. Could not read the index of " << m_rawlog_path << ": " << e.what() << std::endl;
+			index.clear();
+		}
+	}
 
-			sensor_label = obs->sensorLabel;
-			obs_label = sensor_label + " : " + (obs->GetRuntimeClass()->className);
+	if(from_index)
+	{
+		m_items.reserve(index.size() + 1);
 
-			if(m_obs_count == 1)
+		for(size_t i = 0; i < index.size(); i++)
+		{
+			if(params.cancel && params.cancel->load())
 			{
-				m_sensor_labels.push_back(sensor_label);
-				m_count_of_label.push_back(1);
+				completed = false;
+				break;
 			}
 
-			else
-			{
-				auto iter = std::find(m_sensor_labels.begin(), m_sensor_labels.end(), sensor_label);
-				if(iter == m_sensor_labels.end())
-				{
-					m_sensor_labels.push_back(sensor_label);
-					m_count_of_label.push_back(1);
-				}
-
-				else
-					m_count_of_label[utils::findItemIndexIn(m_sensor_labels, sensor_label)]++;
-			}
+			const TRawlogIndexEntry &entry = index.entry(i);
+			if(!params.selects(index.sensorLabel(entry), entry.timestamp, index.entry(0).timestamp))
+				continue;
 
-			m_rootitem->appendChild(new CObservationTreeItem("[#" + std::to_string(m_obs_count - 1) + "] " + obs_label, obs, m_rootitem));
+			info.offset = entry.offset;
+			info.timestamp = entry.timestamp;
+			info.sensor_label = index.sensorLabel(entry);
+			info.class_name = index.className(entry);
+			appendObservation(info, nullptr);
+		}
+
+		if(params.progress_callback)
+			params.progress_callback(1.0);
+	}
+
+	else
+	{
+		CRawlogLoader loader(m_rawlog_path, params);
+
+		try
+		{
+			completed = loader.run([&](TLoadedObservation &loaded)
+			{
+				// the index covers the whole rawlog, whatever the filters
+				if(params.use_index)
+					index.addEntry(loaded.offset, loaded.timestamp, loaded.sensor_label, loaded.class_name);
+
+				if(!loaded.selected)
+					return;
+
+				info.offset = loaded.offset;
+				info.timestamp = loaded.timestamp;
+				info.sensor_label = loaded.sensor_label;
+				info.class_name = loaded.class_name;
+				appendObservation(info, loaded.obs);
+			});
 		}
 
 		catch(std::exception &e)
 		{
-			read = false;
+			std::cerr << "Error. Could not load " << m_rawlog_path << ": " << e.what() << std::endl;
+			completed = false;
 		}
+
+		if(completed && params.use_index)
+			index.save(m_rawlog_path);
+	}
+
+	if(!completed)
+	{
+		m_items.clear();
+		addItem(-1);
+		m_records->infos.clear();
+		m_obs_count = 0;
+		m_sensor_labels.clear();
+		m_count_of_label.clear();
+		return false;
 	}
 
+	CProfiler::instance().addCount("observations", m_obs_count);
+
 	Eigen::Matrix4f rt;
 	for(size_t i = 0; i < m_sensor_labels.size(); i++)
 	{
 		m_config_file.read_matrix("initial_calibration", m_sensor_labels[i], rt, Eigen::Matrix4f(), true);
 		m_sensor_poses.push_back(rt);
 	}
+
+	return true;
+}
+
+void CObservationTree::appendObservation(const TObservationInfo &info, const CObservation::Ptr &obs)
+{
+	m_obs_count++;
+
+	size_t label_id = utils::findItemIndexIn(m_sensor_labels, info.sensor_label);
+	if(label_id == static_cast<size_t>(-1))
+	{
+		m_sensor_labels.push_back(info.sensor_label);
+		m_count_of_label.push_back(1);
+	}
+
+	else
+		m_count_of_label[label_id]++;
+
+	// the payload is owned by the store's cache, so that it can be evicted
+	if(obs)
+		m_records->store->insert(info.offset, obs);
+
+	m_records->infos.push_back(info);
+	addItem(0, m_records->infos.size() - 1);
+}
+
+void CObservationTree::shareObservations(const CObservationTree &tree)
+{
+	m_records = tree.m_records;
+	m_items.clear();
+	m_items.reserve(m_records->infos.size() + 1);
+	addItem(-1);
+
+	for(size_t i = 0; i < m_records->infos.size(); i++)
+		addItem(0, i);
+
+	m_obs_count = tree.m_obs_count;
+	m_sensor_labels = tree.m_sensor_labels;
+	m_count_of_label = tree.m_count_of_label;
+	m_sensor_poses = tree.m_sensor_poses;
+	m_synced = false;
 }
 
 void CObservationTree::syncObservations(const std::vector<std::string> &selected_sensor_labels, const int &max_delay)
 {
-	CObservationTreeItem *new_rootitem = new CObservationTreeItem("root");
-	CObservation::Ptr curr_obs, next_obs;
-	std::string curr_sensor_label, obs_label;
-	std::vector<std::string> sensor_labels_in_set;
+	CScopedTimer timer("syncObservations");
 	size_t obs_sets_count = 0;
-	std::pair<CObservation::Ptr, int> curr_obs_with_model_id;
-	std::vector<std::pair<CObservation::Ptr, int>> obs_set;
-	mrpt::system::TTimeStamp curr_ts, next_ts, set_ts;
+	size_t num_sensors = selected_sensor_labels.size();
+	mrpt::system::TTimeStamp set_ts;
 	double delay;
 
-	std::vector<std::vector<int>> sync_indices_tmp;
+	// the observations of the selected sensors, in record order
+	const std::vector<TObservationInfo> &infos = m_records->infos;
+	std::vector<TSyncCandidate> candidates;
+	candidates.reserve(infos.size());
 
-	sync_indices_tmp.resize(selected_sensor_labels.size());
-	m_sync_indices.resize(selected_sensor_labels.size());
+	std::unordered_map<std::string, int> sensor_ids;
+	for(size_t i = 0; i < num_sensors; i++)
+		sensor_ids.emplace(selected_sensor_labels[i], i);
 
-	for(size_t i = 0; i < m_rootitem->childCount(); i++)
+	for(size_t i = 0; i < infos.size(); i++)
 	{
-		curr_obs = std::dynamic_pointer_cast<CObservation3DRangeScan>(m_rootitem->child(i)->getObservation());
-		curr_sensor_label = curr_obs->sensorLabel;
-		curr_ts = curr_obs->timestamp;
-		curr_obs_with_model_id.first = curr_obs;
-		curr_obs_with_model_id.second = i;
+		auto iter = sensor_ids.find(infos[i].sensor_label);
+		if(iter != sensor_ids.end())
+			candidates.push_back(TSyncCandidate{iter->second, infos[i].timestamp, static_cast<int>(i)});
+	}
 
-		auto iter = std::find(selected_sensor_labels.begin(), selected_sensor_labels.end(), curr_sensor_label);
+	// the candidates in the set being grouped, in the order they were added, and the one taken for each sensor
+	std::vector<size_t> obs_set;
+	std::vector<int> set_slots(num_sensors, -1);
+	obs_set.reserve(num_sensors);
 
-		if(iter != selected_sensor_labels.end())
+	// the candidates of all the sets, those of set i being in [set_starts[i], set_starts[i + 1])
+	std::vector<size_t> set_members;
+	std::vector<size_t> set_starts(1, 0);
+
+	m_sync_indices.assign(num_sensors, std::vector<int>());
+	m_set_sync_indices.clear();
+
+	auto insertSet = [&]()
+	{
+		obs_sets_count++;
+		m_set_sync_indices.resize(m_set_sync_indices.size() + num_sensors, -1);
+		set_members.insert(set_members.end(), obs_set.begin(), obs_set.end());
+		set_starts.push_back(set_members.size());
+
+		for(const size_t &c : obs_set)
 		{
-			if(obs_set.size() == 0)
-			{
-				sensor_labels_in_set.push_back(curr_sensor_label);
-				obs_set.push_back(curr_obs_with_model_id);
-				set_ts = curr_ts;
-				continue;
-			}
+			const TSyncCandidate &candidate = candidates[c];
 
-			else
-			{
-				iter = std::find(sensor_labels_in_set.begin(), sensor_labels_in_set.end(), curr_sensor_label);
-				delay = mrpt::system::timeDifference(set_ts, curr_ts);
-				if(iter == sensor_labels_in_set.end() && (delay <= max_delay))
-				{
-					sensor_labels_in_set.push_back(curr_sensor_label);
-					obs_set.push_back(curr_obs_with_model_id);
-				}
-
-				else
-				{
-					if(sensor_labels_in_set.size() == selected_sensor_labels.size())
-					{
-						new_rootitem->appendChild(new CObservationTreeItem("Observations set #" + std::to_string(obs_sets_count++), 0, new_rootitem));
-
-						auto iter2 = obs_set.begin();
-						for(iter = sensor_labels_in_set.begin(); (iter < sensor_labels_in_set.end()) && (iter2 < obs_set.end()); iter++, iter2++)
-						{
-							obs_label = "[#" + std::to_string((*iter2).second) + "] "
-							                                   + (*iter) + " : " + (*iter2).first->GetRuntimeClass()->className;
-							new_rootitem->child(new_rootitem->childCount() - 1)->appendChild(new CObservationTreeItem(obs_label, (*iter2).first,
-							                                                                                          new_rootitem->child(new_rootitem->childCount() - 1), (*iter2).second));
-							sync_indices_tmp[utils::findItemIndexIn(selected_sensor_labels, *iter)].push_back((*iter2).second);
-						}
-					}
-
-					i -= sensor_labels_in_set.size();
-					sensor_labels_in_set.clear();
-					obs_set.clear();
-				}
-			}
+			// an observation can be grouped in consecutive sets, but the indices of each sensor never decrease
+			std::vector<int> &sync_indices = m_sync_indices[candidate.sensor_id];
+			if(sync_indices.empty() || sync_indices.back() != candidate.model_id)
+				sync_indices.push_back(candidate.model_id);
+
+			m_set_sync_indices[(obs_sets_count - 1) * num_sensors + candidate.sensor_id] = sync_indices.size() - 1;
 		}
-	}
+	};
 
-	// inserting left over set
-	if(obs_set.size() > 0 && sensor_labels_in_set.size() == selected_sensor_labels.size())
+	size_t c = 0;
+	while(c < candidates.size())
 	{
-		new_rootitem->appendChild(new CObservationTreeItem("Observations set #" + std::to_string(obs_sets_count++), 0, new_rootitem));
+		const TSyncCandidate &candidate = candidates[c];
 
-		auto iter2 = obs_set.begin();
-		for(auto iter = sensor_labels_in_set.begin(); (iter < sensor_labels_in_set.end()) && (iter2 < obs_set.end()); iter++, iter2++)
+		if(obs_set.empty())
 		{
-			obs_label = "[#" + std::to_string((*iter2).second) + "] "
-			                                   + (*iter) + " : " + (*iter2).first->GetRuntimeClass()->className;
-			new_rootitem->child(new_rootitem->childCount() - 1)->appendChild(new CObservationTreeItem(obs_label, (*iter2).first,
-			                                                                                          new_rootitem->child(new_rootitem->childCount() - 1), (*iter2).second));
-			sync_indices_tmp[utils::findItemIndexIn(selected_sensor_labels, *iter)].push_back((*iter2).second);
+			obs_set.push_back(c);
+			set_slots[candidate.sensor_id] = c;
+			set_ts = candidate.timestamp;
+			c++;
+			continue;
 		}
 
-		sensor_labels_in_set.clear();
+		delay = mrpt::system::timeDifference(set_ts, candidate.timestamp);
+		if(set_slots[candidate.sensor_id] < 0 && delay <= max_delay)
+		{
+			obs_set.push_back(c);
+			set_slots[candidate.sensor_id] = c;
+			c++;
+			continue;
+		}
+
+		if(obs_set.size() == num_sensors)
+			insertSet();
+
+		// the next set starts from the first observation at or after the second position of the one just closed in the tree
+		int restart_id = candidate.model_id - static_cast<int>(obs_set.size()) + 1;
+		c = std::lower_bound(candidates.begin(), candidates.begin() + c, restart_id,
+		                     [](const TSyncCandidate &a, const int &model_id) { return a.model_id < model_id; }) - candidates.begin();
+
+		for(const size_t &i : obs_set)
+			set_slots[candidates[i].sensor_id] = -1;
 		obs_set.clear();
 	}
 
-	// removing any duplicate entries
-	for(size_t i = 0; i < sync_indices_tmp.size(); i++)
-	{
-		for(size_t j = 0; j < sync_indices_tmp[i].size(); j++)
-		{
-			if(j > 0)
-			{
-				auto iter = std::find(m_sync_indices[i].begin(), m_sync_indices[i].end(), sync_indices_tmp[i][j]);
-				if(iter == m_sync_indices[i].end())
-					m_sync_indices[i].push_back(sync_indices_tmp[i][j]);
-			}
+	// inserting left over set
+	if(obs_set.size() == num_sensors && num_sensors > 0)
+		insertSet();
 
-			else
-				m_sync_indices[i].push_back(sync_indices_tmp[i][j]);
-		}
+	// the sets replace the observation items, which only refer to the shared records. The set items follow the root,
+	// and the observations of each set follow them, so that the children of every item are contiguous
+	m_items.clear();
+	m_items.reserve(1 + obs_sets_count + set_members.size());
+	addItem(-1);
+
+	for(size_t set_id = 0; set_id < obs_sets_count; set_id++)
+		addItem(0);
+
+	for(size_t set_id = 0; set_id < obs_sets_count; set_id++)
+	{
+		for(size_t k = set_starts[set_id]; k < set_starts[set_id + 1]; k++)
+			addItem(1 + set_id, candidates[set_members[k]].model_id, candidates[set_members[k]].model_id);
 	}
 
-	m_rootitem = new_rootitem;
 	m_sensor_labels = selected_sensor_labels;
 	m_synced = true;
 	m_sync_offset = max_delay;
 
 	Eigen::Matrix4f rt;
+	m_sensor_poses.clear();
 	for(size_t i = 0; i < m_sensor_labels.size(); i++)
 	{
 		m_config_file.read_matrix("initial_calibration", m_sensor_labels[i], rt, Eigen::Matrix4f(), true);
@@ -205,7 +331,28 @@ std::string CObservationTree::getRawlogPath() const
 
 CObservationTreeItem *CObservationTree::getRootItem() const
 {
-	return this->m_rootitem;
+	// the items refer to each other through the vector, which the tree owns
+	return const_cast<CObservationTreeItem*>(&m_items.front());
+}
+
+CObservation::Ptr CObservationTree::getObservation(const int &record_id) const
+{
+	return m_records->store->get(m_records->infos.at(record_id).offset);
+}
+
+const TObservationInfo &CObservationTree::getObservationInfo(const int &record_id) const
+{
+	return m_records->infos.at(record_id);
+}
+
+std::shared_ptr<CFeatureCache> CObservationTree::getFeatureCache() const
+{
+	return m_records->features;
+}
+
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr CObservationTree::getCloud(const int &record_id, const CCloudCache::ProjectionMode &mode) const
+{
+	return m_records->clouds->get(m_records->infos.at(record_id).offset, mode);
 }
 
 int CObservationTree::getObsCount() const
@@ -241,24 +388,22 @@ bool CObservationTree::setSensorPoses(const std::vector<Eigen::Matrix4f> &sensor
 		this->m_sensor_poses = sensor_poses;
 }
 
-std::vector<std::vector<int>> CObservationTree::getSyncIndices() const
+const std::vector<std::vector<int>> &CObservationTree::getSyncIndices() const
 {
 	return this->m_sync_indices;
 }
 
 int CObservationTree::findSyncIndexFromSet(const int &set_id, const std::string &sensor_label) const
 {
-	if(!m_synced)
-		return -1;
+	return getSyncIndex(set_id, utils::findItemIndexIn(m_sensor_labels, sensor_label));
+}
+
+int CObservationTree::getSyncIndex(const int &set_id, const int &sensor_id) const
+{
+	size_t num_sensors = m_sensor_labels.size();
 
-	CObservationTreeItem *item = m_rootitem->child(set_id);
-	size_t sensor_index = utils::findItemIndexIn(m_sensor_labels, sensor_label);
+	if(!m_synced || set_id < 0 || sensor_id < 0 || static_cast<size_t>(sensor_id) >= num_sensors || static_cast<size_t>(set_id + 1) * num_sensors > m_set_sync_indices.size())
+		return -1;
 
-	for(size_t i = 0; i < item->childCount(); i++)
-	{
-		if(item->child(i)->getObservation()->sensorLabel == sensor_label)
-		{
-			return utils::findItemIndexIn(m_sync_indices[sensor_index], item->child(i)->getPriorIndex());
-		}
-	}
+	return m_set_sync_indices[set_id * num_sensors + sensor_id];
 }
@@ -2,12 +2,16 @@
 
 #include "Utils.h"
 #include "CObservationTreeItem.h"
+#include "CRawlogLoader.h"
+#include "CObservationStore.h"
 #include <interfaces/CTextObserver.h>
 
 #include <mrpt/obs/CObservation3DRangeScan.h>
 #include <mrpt/config/CConfigFile.h>
 #include <Eigen/Core>
 
+#include <vector>
+
 /**
  * Class for loading, storing, and synchronizing the observations from a rawlog file into a tree.
  * The class also maintains the relative transformations between all the sensors.
@@ -29,11 +33,22 @@ class CObservationTree
 		 */
 		~CObservationTree();
 
+		/** The items refer to the vector they are stored in, so the tree is not copied. */
+		CObservationTree(const CObservationTree &) = delete;
+		CObservationTree &operator=(const CObservationTree &) = delete;
+
 		/**
 		 * \brief loadTree loads the contents of the rawlog into the tree.
-		 * \param rawlog_filename the rawlog file.
+		 * The rawlog is read by a background pipeline (see CRawlogLoader), and the observations are appended in file order.
+		 * When the rawlog has an up to date index (see CRawlogIndex), the tree is built from it instead, without reading any payload;
+		 * otherwise the index is written after loading.
+		 * Only the observations that pass the sensor and time filters of the parameters are added to the tree;
+		 * the others are skipped from the index without being read, or dropped right after deserialization without being decoded.
+		 * \param params the loading parameters, with the optional progress callback, cancellation flag, and filters.
+		 * \return false if loading was cancelled or failed (e.g. on an externally stored payload that could not be loaded),
+		 * in which case the tree is left empty.
 		 */
-		void loadTree();
+		bool loadTree(const TRawlogLoadParams &params = TRawlogLoadParams());
 
 		/**
 		 * \brief Returns the path of the rawlog file this model was loaded from.
@@ -45,6 +60,18 @@ class CObservationTree
 		 */
 		CObservationTreeItem *getRootItem() const;
 
+		/** Returns the observation of a record (e.g. an index in getSyncIndices()), reading it from the rawlog if it is not cached. */
+		mrpt::obs::CObservation::Ptr getObservation(const int &record_id) const;
+
+		/** Returns the metadata of the observation of a record. */
+		const TObservationInfo &getObservationInfo(const int &record_id) const;
+
+		/** Returns the cache the features segmented from the observations are persisted in. */
+		std::shared_ptr<CFeatureCache> getFeatureCache() const;
+
+		/** Returns the organized cloud of the observation of a record, projecting it if it is not cached. */
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr getCloud(const int &record_id, const CCloudCache::ProjectionMode &mode) const;
+
 		/** Returns the count of total number of observations found in the rawlog. */
 		int getObsCount() const;
 
@@ -66,31 +93,83 @@ class CObservationTree
 		 */
 		bool setSensorPoses(const std::vector<Eigen::Matrix4f> &sensor_poses);
 
+		/**
+		 * \brief Makes the tree refer to the observations loaded in another tree from the same rawlog, without copying them.
+		 * \param tree the tree the observations were loaded into.
+		 */
+		void shareObservations(const CObservationTree &tree);
+
 		/** Groups observations together based on their time stamp proximity.
-		 * Stores the results back in the same tree.
+		 * Stores the results back in the same tree, whose observation items are replaced by the sets.
 		 * \param the labels of the sensors that are to be considered for grouping.
 		 * \param max_delay Maximum allowable delay between observations.
 		 */
 		void syncObservations(const std::vector<std::string> &selected_sensor_labels, const int &max_delay);
 
 		/** Returns the indices of the grouped observations with respect to the original tree, grouped by sensor. */
-		std::vector<std::vector<int>> getSyncIndices() const;
+		const std::vector<std::vector<int>> &getSyncIndices() const;
 
 		/** Retuns the sync index (the index in m_sync_indices[sensor_id] of an item within a set, identified by sensor label. */
 		int findSyncIndexFromSet(const int &set_id, const std::string &sensor_label) const;
 
+		/**
+		 * \brief Returns the sync index (the index in m_sync_indices[sensor_id]) of the observation of a sensor within a set, in constant time.
+		 * \param set_id the index of the set in the synchronized tree.
+		 * \param sensor_id the index of the sensor in the synchronized sensor labels.
+		 * \return the sync index, or -1 if the tree is not synchronized or the ids are out of range.
+		 */
+		int getSyncIndex(const int &set_id, const int &sensor_id) const;
+
     protected:
 
+		/** An observation considered for grouping by syncObservations(). */
+		struct TSyncCandidate
+		{
+			/** The index of the sensor label in the selected labels. */
+			int sensor_id;
+
+			mrpt::system::TTimeStamp timestamp;
+
+			/** The index of the observation item in the tree. */
+			int model_id;
+		};
+
+		/** Appends an observation item to the root and updates the count of its sensor label.
+		 * \param info the metadata of the observation.
+		 * \param obs the observation, or null if its payload is to be read on first access.
+		 */
+		void appendObservation(const TObservationInfo &info, const mrpt::obs::CObservation::Ptr &obs);
+
+		/** Returns a memory budget of the [rawlog] section of the config file, given in megabytes, in bytes. Negative budgets are rejected for the default. */
+		size_t readMemoryBudget(const std::string &key, const int &default_mb) const;
+
+		/**
+		 * \brief Allocates an item at the end of the items of the tree.
+		 * \param parent_id the index of the parent item the new item is appended to, whose last child must be the last item if any,
+		 * or -1 for the root item.
+		 * \param record_id the id of the observation contained in the item, or -1 for the root and set items.
+		 * \param prior_index the index of the item in the tree it belonged to before being synchronized, if any.
+		 * \return the index of the new item in m_items.
+		 */
+		int addItem(const int &parent_id, const int &record_id = -1, const int &prior_index = -1);
+
 		/** The path of the file the rawlog was loaded from. */
 		std::string m_rawlog_path;
 
 		mrpt::config::CConfigFile m_config_file;
 
-		/** The root parent item from which all the other observations originate. */
-		CObservationTreeItem *m_rootitem;
+		/** The observations loaded from the rawlog and the store giving access to their payloads, shared with the synchronized tree. */
+		std::shared_ptr<TObservationRecords> m_records;
+
+		/**
+		 * The items of the tree, the root first, laid out breadth first so that the children of each item are contiguous.
+		 * The items refer to each other by their index, and their addresses (e.g. those of the GUI model indices) are only
+		 * stable once the tree is built.
+		 */
+		std::vector<CObservationTreeItem> m_items;
 
 		/** The total number of observations loaded from the rawlog. */
-		int m_obs_count;
+		int m_obs_count = 0;
 
 		/** The unique sensor labels found in the rawlog. */
 		std::vector<std::string> m_sensor_labels;
@@ -104,6 +183,9 @@ class CObservationTree
 		/** m_sync_indices indices of the grouped (synchronized) observations with respect to the original tree, per sensor. */
 		std::vector<std::vector<int>> m_sync_indices;
 
+		/** The sync index of the observation of each sensor in each set, at [set_id * number of sensors + sensor_id]. */
+		std::vector<int> m_set_sync_indices;
+
 		/** the maximum allowable delay between observation items before they can be synced. */
 		int m_sync_offset = -1;
 
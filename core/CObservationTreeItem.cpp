@@ -1,71 +1,112 @@
 #include "CObservationTreeItem.h"
-#include <algorithm>
 
 using namespace mrpt::obs;
 
-CObservationTreeItem::CObservationTreeItem(const std::string &id, const CObservation::Ptr observation, CObservationTreeItem *parent, int prior_index)
+namespace
 {
-	m_parentitem = parent;
-	m_id = id;
-	m_observation = observation;
+	/** The metadata returned for the items that do not contain an observation. */
+	const TObservationInfo empty_info;
+}
+
+CObservationTreeItem::CObservationTreeItem(std::vector<CObservationTreeItem> *items, const int &item_id, const TObservationRecords *records,
+                                           const int &record_id, const int &prior_index)
+{
+	m_items = items;
+	m_item_id = item_id;
+	m_records = records;
+	m_record_id = record_id;
 	m_prior_index = prior_index;
 }
 
 CObservationTreeItem::~CObservationTreeItem()
 {
-	for(auto iter = m_childitems.begin(); iter != m_childitems.end(); iter++)
-	{
-		delete (*iter);
-	}
-
-	m_childitems.clear();
 }
 
-void CObservationTreeItem::appendChild(CObservationTreeItem *item)
+bool CObservationTreeItem::appendChild(const int &item_id)
 {
-	m_childitems.push_back(item);
+	if(m_child_count == 0)
+		m_first_child_id = item_id;
+
+	else if(item_id != m_first_child_id + m_child_count)
+		return false;
+
+	CObservationTreeItem &item = (*m_items)[item_id];
+	item.m_parent_id = m_item_id;
+	item.m_row = m_child_count++;
+	return true;
 }
 
 CObservationTreeItem *CObservationTreeItem::child(int row) const
 {
-	return m_childitems.at(row);
+	if(row < 0 || row >= m_child_count)
+		return nullptr;
+
+	return &(*m_items)[m_first_child_id + row];
 }
 
 int CObservationTreeItem::childCount() const
 {
-	return m_childitems.size();
+	return m_child_count;
 }
 
 int CObservationTreeItem::row() const
 {
-	if(m_parentitem)
-	{
-		auto iter = std::find(m_parentitem->m_childitems.begin(), m_parentitem->m_childitems.end(), const_cast<CObservationTreeItem*>(this));
-		if(iter != m_parentitem->m_childitems.end())
-			return std::distance(m_parentitem->m_childitems.begin(), iter);
-	}
-
-	return 0;
+	return this->m_row;
 }
 
 CObservationTreeItem *CObservationTreeItem::parentItem() const
 {
-	return this->m_parentitem;
+	if(m_parent_id < 0)
+		return nullptr;
+
+	return &(*m_items)[m_parent_id];
 }
 
 std::string CObservationTreeItem::itemId() const
 {
-	return this->m_id;
+	if(m_record_id >= 0)
+		return "[#" + std::to_string(m_record_id) + "] " + getSensorLabel() + " : " + getClassName();
+
+	if(m_parent_id >= 0)
+		return "Observations set #" + std::to_string(m_row);
+
+	return "root";
+}
+
+int CObservationTreeItem::getRecordId() const
+{
+	return this->m_record_id;
+}
+
+const TObservationInfo &CObservationTreeItem::getInfo() const
+{
+	if(m_record_id < 0)
+		return empty_info;
+
+	return this->m_records->infos[m_record_id];
 }
 
 mrpt::system::TTimeStamp CObservationTreeItem::getTimeStamp() const
 {
-	return this->m_observation->timestamp;
+	return getInfo().timestamp;
+}
+
+const std::string &CObservationTreeItem::getSensorLabel() const
+{
+	return getInfo().sensor_label;
+}
+
+const std::string &CObservationTreeItem::getClassName() const
+{
+	return getInfo().class_name;
 }
 
 CObservation::Ptr CObservationTreeItem::getObservation() const
 {
-	return this->m_observation;
+	if(m_record_id < 0)
+		return nullptr;
+
+	return m_records->store->get(getInfo().offset);
 }
 
 int CObservationTreeItem::getPriorIndex() const
@@ -73,8 +114,10 @@ int CObservationTreeItem::getPriorIndex() const
 	return this->m_prior_index;
 }
 
-pcl::PointCloud<pcl::PointXYZRGBA>::Ptr CObservationTreeItem::cloud() const
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr CObservationTreeItem::cloud(const CCloudCache::ProjectionMode &mode) const
 {
-	return this->m_cloud;
-}
+	if(m_record_id < 0)
+		return nullptr;
 
+	return m_records->clouds->get(getInfo().offset, mode);
+}
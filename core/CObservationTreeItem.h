@@ -1,13 +1,52 @@
 #pragma once
 
+#include "CObservationStore.h"
+#include "CCloudCache.h"
+
 #include <mrpt/obs/CObservation.h>
 #include <mrpt/system/datetime.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include <memory>
+
+class CFeatureCache;
+
+/** Metadata of an observation, known without deserializing its payload. */
+struct TObservationInfo
+{
+	/** The byte offset of the observation in the uncompressed rawlog stream. */
+	uint64_t offset = 0;
+
+	mrpt::system::TTimeStamp timestamp = 0;
+	std::string sensor_label;
+	std::string class_name;
+};
+
+/**
+ * The observations loaded from a rawlog, indexed by their record id (their position in the tree they were loaded into).
+ * Shared by the trees built from the same rawlog, so that the synchronized tree refers to the observations of the raw one.
+ */
+struct TObservationRecords
+{
+	std::vector<TObservationInfo> infos;
+
+	/** The store the payloads are read from, and cached in under its memory budget. */
+	std::shared_ptr<CObservationStore> store;
+
+	/** The clouds the payloads are projected into, cached under their own memory budget. */
+	std::shared_ptr<CCloudCache> clouds;
+
+	/** The features segmented from the observations, persisted across runs. */
+	std::shared_ptr<CFeatureCache> features;
+};
+
 /**
  * Defines the type of each item that
  * is stored internally in CObservationTree.
+ * The items are allocated and owned by the tree in a single vector (see CObservationTree::addItem()),
+ * and refer to their observation by its record id, and to their parent and children by their index in the vector.
+ * The children of an item are contiguous in the vector, so that the tree is built breadth first.
  */
 
 class CObservationTreeItem
@@ -16,27 +55,49 @@ class CObservationTreeItem
 
 	    /**
 		 * Constructor
-		 * \param id the item string id.
-		 * \param the observation to be contained in the item.
-		 * \param parentItem the parent of the item.
+		 * \param items the items of the tree, which the item is stored in at item_id.
+		 * \param item_id the index of the item in the items of the tree.
+		 * \param records the observation records of the tree, or null for the root and set items.
+		 * \param record_id the id of the observation contained in the item in the records, or -1 for the root and set items.
 		 * \param prior_index the index of the item with respect to the parent in its previous tree, if any.
 		 */
-	    CObservationTreeItem(const std::string &id, const mrpt::obs::CObservation::Ptr observation = 0, CObservationTreeItem *parentItem = 0,
-		                     int prior_index = -1);
+	    CObservationTreeItem(std::vector<CObservationTreeItem> *items, const int &item_id, const TObservationRecords *records = nullptr,
+		                     const int &record_id = -1, const int &prior_index = -1);
 
 		~CObservationTreeItem();
 
-		void appendChild(CObservationTreeItem *child);
+		/**
+		 * \brief Appends a child item, which caches its row and parent.
+		 * \param item_id the index of the child in the items of the tree, right after the last child of the item, if any.
+		 * \return false if the child would not be contiguous with the other children, in which case it is not appended.
+		 */
+		bool appendChild(const int &item_id);
 
-		/** Returns the item string id. */
+		/** Returns the item string id, generated on each call.
+		 * Can be of two types depending on whether the item represents an observation or a set item.
+		 * 1) [#record_id] sensor_id : class_name
+		 * 2) Observations set #set_index
+		 */
 		std::string itemId() const;
 
-		/** Returns a ponter to the contained observation item. */
+		/** Returns a ponter to the contained observation item, reading it from the rawlog if it is not cached. */
 		mrpt::obs::CObservation::Ptr getObservation() const;
 
+		/** Returns the id of the contained observation in the records of the tree, or -1 for the root and set items. */
+		int getRecordId() const;
+
+		/** Returns the metadata of the observation contained in the item. */
+		const TObservationInfo &getInfo() const;
+
 		/** Returns the timestamp of the observation contained in the item. */
 		mrpt::system::TTimeStamp getTimeStamp() const;
 
+		/** Returns the sensor label of the observation contained in the item. */
+		const std::string &getSensorLabel() const;
+
+		/** Returns the class name of the observation contained in the item. */
+		const std::string &getClassName() const;
+
 		/** Returns a pointer to the contained child item, at the specified index, if any. */
 		CObservationTreeItem *child(int row) const;
 
@@ -52,32 +113,33 @@ class CObservationTreeItem
 		/** Returns the index of the item with respect to its prior tree. */
 		int getPriorIndex() const;
 
-		/** Pointer to the cloud loaded and saved from the observation, for quicker access. */
-		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud() const;
+		/** Returns the organized cloud of the contained observation, projecting it if it is not cached, or null for the root and set items. */
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(const CCloudCache::ProjectionMode &mode = CCloudCache::COLOURED) const;
 
 	private:
 
-		/** List of child items the item contains. */
-		std::vector<CObservationTreeItem*> m_childitems;
+		/** The items of the tree, and the index of this one in them. */
+		std::vector<CObservationTreeItem> *m_items;
+		int m_item_id;
 
-		/** Pointer to the parent of the tree item. */
-		CObservationTreeItem *m_parentitem;
+		/** The index of the parent of the tree item, or -1 for the root. */
+		int m_parent_id = -1;
 
-		/** The item identifier string.
-		 * Can be of two types depending on whether the item represents an observation or a set item.
-		 * 1) [#item_index] sensor_id : class_name
-		 * 2) Observation set #set_index
-		 */
-		std::string m_id;
+		/** The index of the first child of the item, the others following it. */
+		int m_first_child_id = -1;
+		int m_child_count = 0;
+
+		/** The row of the item within its parent. */
+		int m_row = 0;
+
+		/** The observation records the item refers to. */
+		const TObservationRecords *m_records;
+
+		/** The id of the observation contained in the item in m_records. */
+		int m_record_id;
 
 		/** The index of the item with respect to the previous tree it was a part of, if any.
 		 * For example, the index with respect to the root item in the tree the item belonged to before it was synchronized.
 		 */
 		int m_prior_index;
-
-		/** Pointer to the observation contained in the item. */
-		mrpt::obs::CObservation::Ptr m_observation;
-
-		/** Pointer to the cloud loaded and saved from the observation, for quicker access. */
-		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr m_cloud = nullptr;
 };
@@ -39,3 +39,51 @@ class CPlaneCHull : public CPlane
     std::vector<size_t> v_hull_indices;
     std::vector<int> v_inliers;
 };
+
+/**
+ * The geometric characteristics of the planes of a sensor as a structure of arrays, with one column per plane,
+ * holding only what matching and solving read, so that they run over contiguous memory.
+ */
+struct TPlaneBatch
+{
+	Eigen::Matrix<Scalar,3,Eigen::Dynamic> normals;
+	Eigen::Matrix<Scalar,3,Eigen::Dynamic> centers;
+	Eigen::Matrix<Scalar,1,Eigen::Dynamic> d;
+	Eigen::Matrix<Scalar,1,Eigen::Dynamic> curvature;
+
+	size_t size() const
+	{
+		return d.cols();
+	}
+
+	void resize(const size_t &num_planes)
+	{
+		normals.resize(3, num_planes);
+		centers.resize(3, num_planes);
+		d.resize(num_planes);
+		curvature.resize(num_planes);
+	}
+
+	/** Sets a column of the batch to the characteristics of a plane. */
+	void set(const size_t &i, const CPlane &plane)
+	{
+		normals.col(i) = plane.v3normal;
+		centers.col(i) = plane.v3center;
+		d[i] = plane.d;
+		curvature[i] = plane.curvature;
+	}
+};
+
+/** The data of a plane that matching and solving do not read: its convex hull and inliers, and the statistics kept for display. */
+struct TPlaneHull
+{
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr ConvexHullPtr;
+	std::vector<size_t> v_hull_indices;
+	std::vector<int> v_inliers;
+
+	Eigen::Matrix<Scalar,4,4> covariance;
+	Scalar area;
+	size_t n_inliers;
+};
@@ -0,0 +1,255 @@
+#include "CProfiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace
+{
+	/** Upper bound of the records kept per thread, so that a long run with the profiler left on cannot exhaust the memory. */
+	const size_t max_records_per_thread = 1u << 20;
+
+	/** Orders the names by their contents rather than by their address, as the same literal may have several copies. */
+	struct TNameLess
+	{
+		bool operator()(const char *a, const char *b) const
+		{
+			return std::strcmp(a, b) < 0;
+		}
+	};
+}
+
+CProfiler &CProfiler::instance()
+{
+	static CProfiler profiler;
+	return profiler;
+}
+
+CProfiler::CProfiler() : m_epoch(std::chrono::steady_clock::now())
+{}
+
+void CProfiler::setEnabled(const bool &enabled)
+{
+	m_enabled = enabled;
+}
+
+bool CProfiler::isEnabled() const
+{
+	return m_enabled;
+}
+
+uint64_t CProfiler::now() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+CProfiler::TBufferLease::~TBufferLease()
+{
+	if(!buffer)
+		return;
+
+	std::lock_guard<std::mutex> lock(profiler->m_buffers_mutex);
+	profiler->m_released_buffers.push_back(buffer);
+}
+
+CProfiler::TThreadBuffer &CProfiler::threadBuffer()
+{
+	// the profiler is a singleton, so a thread has a single buffer
+	thread_local TBufferLease lease;
+
+	if(!lease.buffer)
+	{
+		std::lock_guard<std::mutex> lock(m_buffers_mutex);
+		lease.profiler = this;
+
+		if(!m_released_buffers.empty())
+		{
+			lease.buffer = m_released_buffers.back();
+			m_released_buffers.pop_back();
+		}
+
+		else
+		{
+			lease.buffer = std::make_shared<TThreadBuffer>();
+			lease.buffer->thread_id = m_buffers.size();
+			m_buffers.push_back(lease.buffer);
+		}
+	}
+
+	return *lease.buffer;
+}
+
+void CProfiler::addRecord(const TRecord &record)
+{
+	if(!m_enabled)
+		return;
+
+	TThreadBuffer &buffer = threadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+
+	if(buffer.records.size() < max_records_per_thread)
+		buffer.records.push_back(record);
+	else
+		m_dropped++;
+}
+
+void CProfiler::addEvent(const char *name, const uint64_t &start, const uint64_t &duration)
+{
+	addRecord(TRecord{name, start, static_cast<int64_t>(duration), false});
+}
+
+void CProfiler::addCount(const char *name, const int64_t &value)
+{
+	addRecord(TRecord{name, now(), value, true});
+}
+
+void CProfiler::clear()
+{
+	std::lock_guard<std::mutex> lock(m_buffers_mutex);
+	for(const std::shared_ptr<TThreadBuffer> &buffer : m_buffers)
+	{
+		std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+		buffer->records.clear();
+	}
+
+	m_dropped = 0;
+}
+
+std::vector<std::pair<uint32_t,CProfiler::TRecord>> CProfiler::collect() const
+{
+	std::vector<std::pair<uint32_t,TRecord>> records;
+
+	std::lock_guard<std::mutex> lock(m_buffers_mutex);
+	for(const std::shared_ptr<TThreadBuffer> &buffer : m_buffers)
+	{
+		std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+		for(const TRecord &record : buffer->records)
+			records.push_back(std::make_pair(buffer->thread_id, record));
+	}
+
+	std::stable_sort(records.begin(), records.end(), [](const std::pair<uint32_t,TRecord> &a, const std::pair<uint32_t,TRecord> &b)
+	{ return a.second.start < b.second.start; });
+
+	return records;
+}
+
+void CProfiler::writeChromeTrace(std::ostream &out) const
+{
+	std::vector<std::pair<uint32_t,TRecord>> records = collect();
+
+	// the counters are shown as their running totals across all the threads
+	std::map<const char*,int64_t,TNameLess> totals;
+
+	out << "{\"traceEvents\": [";
+	for(size_t i = 0; i < records.size(); i++)
+	{
+		const TRecord &record = records[i].second;
+		out << (i ? ",\n" : "\n");
+
+		if(record.is_counter)
+		{
+			int64_t &total = totals[record.name];
+			total += record.value;
+			out << "{\"name\": \"" << record.name << "\", \"ph\": \"C\", \"ts\": " << record.start
+			    << ", \"pid\": 1, \"args\": {\"" << record.name << "\": " << total << "}}";
+		}
+
+		else
+			out << "{\"name\": \"" << record.name << "\", \"ph\": \"X\", \"ts\": " << record.start << ", \"dur\": " << record.value
+			    << ", \"pid\": 1, \"tid\": " << records[i].first << "}";
+	}
+
+	out << "\n], \"displayTimeUnit\": \"ms\"}" << std::endl;
+}
+
+bool CProfiler::exportChromeTrace(const std::string &path) const
+{
+	std::ofstream file(path);
+	writeChromeTrace(file);
+
+	return static_cast<bool>(file);
+}
+
+std::string CProfiler::summary() const
+{
+	struct TEventStats
+	{
+		size_t calls = 0;
+		int64_t total = 0;
+		int64_t min = std::numeric_limits<int64_t>::max();
+		int64_t max = 0;
+	};
+
+	std::map<const char*,TEventStats,TNameLess> events;
+	std::map<const char*,int64_t,TNameLess> counters;
+
+	for(const std::pair<uint32_t,TRecord> &entry : collect())
+	{
+		const TRecord &record = entry.second;
+		if(record.is_counter)
+		{
+			counters[record.name] += record.value;
+			continue;
+		}
+
+		TEventStats &stats = events[record.name];
+		stats.calls++;
+		stats.total += record.value;
+		stats.min = std::min(stats.min, record.value);
+		stats.max = std::max(stats.max, record.value);
+	}
+
+	// the events taking the most time first
+	std::vector<std::pair<const char*,TEventStats>> sorted_events(events.begin(), events.end());
+	std::stable_sort(sorted_events.begin(), sorted_events.end(), [](const std::pair<const char*,TEventStats> &a, const std::pair<const char*,TEventStats> &b)
+	{ return a.second.total > b.second.total; });
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(3);
+	out << std::left << std::setw(24) << "event" << std::right << std::setw(10) << "calls" << std::setw(14) << "total (ms)"
+	    << std::setw(12) << "mean (ms)" << std::setw(12) << "min (ms)" << std::setw(12) << "max (ms)" << "\n";
+
+	for(const std::pair<const char*,TEventStats> &event : sorted_events)
+	{
+		const TEventStats &stats = event.second;
+		out << std::left << std::setw(24) << event.first << std::right << std::setw(10) << stats.calls << std::setw(14) << stats.total / 1e3
+		    << std::setw(12) << stats.total / 1e3 / stats.calls << std::setw(12) << stats.min / 1e3 << std::setw(12) << stats.max / 1e3 << "\n";
+	}
+
+	if(!counters.empty())
+	{
+		out << "\n" << std::left << std::setw(24) << "counter" << std::right << std::setw(10) << "total" << "\n";
+		for(const auto &counter : counters)
+			out << std::left << std::setw(24) << counter.first << std::right << std::setw(10) << counter.second << "\n";
+	}
+
+	if(m_dropped > 0)
+		out << "\n" << m_dropped << " record(s) dropped, the buffer of their thread was full\n";
+
+	return out.str();
+}
+
+CScopedTimer::CScopedTimer(const char *name) : m_name(name), m_start(CProfiler::instance().now()), m_duration(0), m_stopped(false)
+{}
+
+CScopedTimer::~CScopedTimer()
+{
+	stop();
+}
+
+double CScopedTimer::stop()
+{
+	if(!m_stopped)
+	{
+		CProfiler &profiler = CProfiler::instance();
+		m_duration = profiler.now() - m_start;
+		profiler.addEvent(m_name, m_start, m_duration);
+		m_stopped = true;
+	}
+
+	return m_duration / 1e6;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Records named timed events and counters (e.g. frames, planes, correspondences, solver iterations) from any thread of the
+ * application, to find where the time of a run goes and to compare runs with each other.
+ * Each thread records into a buffer of its own, so that the workers of a stage do not contend with each other; the buffers
+ * are only locked together when the records are exported, as a Chrome trace (chrome://tracing, Perfetto) or as a summary table.
+ * The buffer of a thread that exits keeps its records, and is handed to the next thread that records, so that the number of
+ * buffers and of thread ids in the trace are bounded by the number of threads recording at once rather than ever started.
+ * The names are kept by pointer, so they must outlive the profiler, as string literals do.
+ */
+
+class CProfiler
+{
+	public:
+
+		/** Returns the profiler shared by the whole application. */
+		static CProfiler &instance();
+
+		/** Enables or disables the recording, which is enabled by default. Can be called from any thread. */
+		void setEnabled(const bool &enabled);
+
+		bool isEnabled() const;
+
+		/** Returns the time elapsed since the profiler was created, in microseconds, the time base of the records. */
+		uint64_t now() const;
+
+		/**
+		 * \brief Records a timed event, in the buffer of the calling thread.
+		 * \param name the name of the event.
+		 * \param start the time the event started at, in microseconds as returned by now().
+		 * \param duration the duration of the event, in microseconds.
+		 */
+		void addEvent(const char *name, const uint64_t &start, const uint64_t &duration);
+
+		/** Adds a value to a counter, in the buffer of the calling thread. */
+		void addCount(const char *name, const int64_t &value = 1);
+
+		/** Discards the records of all the threads. */
+		void clear();
+
+		/** Writes the records as a Chrome trace in JSON, with the counters as their running totals. */
+		void writeChromeTrace(std::ostream &out) const;
+
+		/** Writes the records as a Chrome trace to a file. Returns false if the file could not be written. */
+		bool exportChromeTrace(const std::string &path) const;
+
+		/** Returns a table with the number of calls and the total, mean, minimum and maximum time of each event, and the total of each counter. */
+		std::string summary() const;
+
+	private:
+
+		CProfiler();
+
+		struct TRecord
+		{
+			const char *name;
+			uint64_t start;
+
+			/** The duration of an event, or the value added to a counter. */
+			int64_t value;
+
+			bool is_counter;
+		};
+
+		struct TThreadBuffer
+		{
+			/** A small sequential id, shown as the thread of the events in the trace. */
+			uint32_t thread_id;
+
+			/** Only contended while the records are exported or cleared. */
+			std::mutex mutex;
+
+			std::vector<TRecord> records;
+		};
+
+		/** The buffer of a thread, released to the profiler when the thread exits. */
+		struct TBufferLease
+		{
+			CProfiler *profiler = nullptr;
+			std::shared_ptr<TThreadBuffer> buffer;
+
+			~TBufferLease();
+		};
+
+		/** Returns the buffer of the calling thread, taking a released one or registering a new one on the first call. */
+		TThreadBuffer &threadBuffer();
+
+		void addRecord(const TRecord &record);
+
+		/** Returns a copy of the records of all the threads, each with its thread id. */
+		std::vector<std::pair<uint32_t,TRecord>> collect() const;
+
+		std::chrono::steady_clock::time_point m_epoch;
+
+		std::atomic<bool> m_enabled{true};
+
+		/** The number of records not kept because the buffer of their thread was full. */
+		std::atomic<size_t> m_dropped{0};
+
+		mutable std::mutex m_buffers_mutex;
+
+		/** The buffers of all the threads that recorded, kept after the threads exit. */
+		std::vector<std::shared_ptr<TThreadBuffer>> m_buffers;
+
+		/** The buffers of the threads that exited, to be taken by the next threads that record. */
+		std::vector<std::shared_ptr<TThreadBuffer>> m_released_buffers;
+};
+
+/**
+ * Records a timed event of the profiler covering its scope, or until it is stopped.
+ */
+
+class CScopedTimer
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param name the name of the event, which must outlive the profiler (e.g. a string literal).
+		 */
+	    explicit CScopedTimer(const char *name);
+
+		~CScopedTimer();
+
+		/** Records the event, if not recorded yet, and returns its duration in seconds. */
+		double stop();
+
+	private:
+
+		const char *m_name;
+		uint64_t m_start;
+		uint64_t m_duration;
+		bool m_stopped;
+};
@@ -0,0 +1,202 @@
+#include "CRawlogIndex.h"
+
+#include <mrpt/system/filesystem.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+	/** Identifies the index files, followed by the version of the format. */
+	const char index_magic[8] = {'R', 'L', 'O', 'G', 'I', 'D', 'X', '\0'};
+	const uint32_t index_version = 1;
+
+	template <typename T>
+	void writePod(std::ofstream &file, const T &value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	bool readPod(std::ifstream &file, T &value)
+	{
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+
+	void writeStrings(std::ofstream &file, const std::vector<std::string> &strings)
+	{
+		writePod<uint32_t>(file, strings.size());
+		for(const std::string &str : strings)
+		{
+			writePod<uint32_t>(file, str.size());
+			file.write(str.data(), str.size());
+		}
+	}
+
+	/** The number of bytes left to read in a file of the given size, which bounds the counts read from it. */
+	uint64_t remainingBytes(std::ifstream &file, const uint64_t &file_size)
+	{
+		std::streamoff pos = file.tellg();
+		return (pos < 0 || static_cast<uint64_t>(pos) > file_size) ? 0 : file_size - pos;
+	}
+
+	bool readStrings(std::ifstream &file, const uint64_t &file_size, std::vector<std::string> &strings)
+	{
+		uint32_t count, length;
+		if(!readPod(file, count) || count > remainingBytes(file, file_size) / sizeof(length))
+			return false;
+
+		strings.resize(count);
+		for(std::string &str : strings)
+		{
+			if(!readPod(file, length) || length > remainingBytes(file, file_size))
+				return false;
+
+			str.resize(length);
+			if(!file.read(&str[0], length))
+				return false;
+		}
+
+		return true;
+	}
+}
+
+std::string CRawlogIndex::indexPathFor(const std::string &rawlog_path)
+{
+	return rawlog_path + ".idx";
+}
+
+bool CRawlogIndex::load(const std::string &rawlog_path)
+{
+	clear();
+
+	std::ifstream file(indexPathFor(rawlog_path), std::ios::binary | std::ios::ate);
+	if(!file.is_open())
+		return false;
+
+	// the counts read from a damaged index are checked against what is left of the file before anything is allocated for them
+	const uint64_t file_size = file.tellg();
+	file.seekg(0);
+
+	char magic[sizeof(index_magic)];
+	uint32_t version;
+	uint64_t rawlog_size, num_entries;
+	int64_t rawlog_mtime;
+
+	if(!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), index_magic))
+		return false;
+
+	if(!readPod(file, version) || version != index_version)
+		return false;
+
+	// the index is only valid for the exact rawlog file it was built from
+	if(!readPod(file, rawlog_size) || !readPod(file, rawlog_mtime)
+	        || rawlog_size != mrpt::system::getFileSize(rawlog_path)
+	        || rawlog_mtime != static_cast<int64_t>(mrpt::system::getFileModificationTime(rawlog_path)))
+		return false;
+
+	const size_t entry_size = sizeof(TRawlogIndexEntry::offset) + sizeof(TRawlogIndexEntry::timestamp) + sizeof(TRawlogIndexEntry::label_id)
+	                          + sizeof(TRawlogIndexEntry::class_id);
+
+	if(!readStrings(file, file_size, m_sensor_labels) || !readStrings(file, file_size, m_class_names) || !readPod(file, num_entries)
+	        || num_entries > remainingBytes(file, file_size) / entry_size)
+	{
+		clear();
+		return false;
+	}
+
+	m_entries.resize(num_entries);
+	for(TRawlogIndexEntry &entry : m_entries)
+	{
+		if(!readPod(file, entry.offset) || !readPod(file, entry.timestamp) || !readPod(file, entry.label_id) || !readPod(file, entry.class_id)
+		        || entry.label_id >= m_sensor_labels.size() || entry.class_id >= m_class_names.size())
+		{
+			clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CRawlogIndex::save(const std::string &rawlog_path) const
+{
+	// written to a temporary file first, so that an interrupted write never leaves a truncated index behind
+	std::string index_path = indexPathFor(rawlog_path);
+	std::string tmp_path = index_path + ".tmp";
+
+	{
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		if(!file.is_open())
+			return false;
+
+		file.write(index_magic, sizeof(index_magic));
+		writePod<uint32_t>(file, index_version);
+		writePod<uint64_t>(file, mrpt::system::getFileSize(rawlog_path));
+		writePod<int64_t>(file, mrpt::system::getFileModificationTime(rawlog_path));
+		writeStrings(file, m_sensor_labels);
+		writeStrings(file, m_class_names);
+
+		writePod<uint64_t>(file, m_entries.size());
+		for(const TRawlogIndexEntry &entry : m_entries)
+		{
+			writePod(file, entry.offset);
+			writePod(file, entry.timestamp);
+			writePod(file, entry.label_id);
+			writePod(file, entry.class_id);
+		}
+
+		if(!file.good())
+		{
+			file.close();
+			std::remove(tmp_path.c_str());
+			return false;
+		}
+	}
+
+	std::remove(index_path.c_str());
+	return std::rename(tmp_path.c_str(), index_path.c_str()) == 0;
+}
+
+void CRawlogIndex::addEntry(const uint64_t &offset, const mrpt::system::TTimeStamp &timestamp, const std::string &sensor_label, const std::string &class_name)
+{
+	m_entries.push_back(TRawlogIndexEntry{offset, timestamp, intern(m_sensor_labels, sensor_label), intern(m_class_names, class_name)});
+}
+
+void CRawlogIndex::clear()
+{
+	m_entries.clear();
+	m_sensor_labels.clear();
+	m_class_names.clear();
+}
+
+size_t CRawlogIndex::size() const
+{
+	return m_entries.size();
+}
+
+const TRawlogIndexEntry &CRawlogIndex::entry(const size_t &i) const
+{
+	return m_entries[i];
+}
+
+const std::string &CRawlogIndex::sensorLabel(const TRawlogIndexEntry &entry) const
+{
+	return m_sensor_labels[entry.label_id];
+}
+
+const std::string &CRawlogIndex::className(const TRawlogIndexEntry &entry) const
+{
+	return m_class_names[entry.class_id];
+}
+
+uint16_t CRawlogIndex::intern(std::vector<std::string> &table, const std::string &str)
+{
+	auto iter = std::find(table.begin(), table.end(), str);
+	if(iter != table.end())
+		return static_cast<uint16_t>(std::distance(table.begin(), iter));
+
+	table.push_back(str);
+	return static_cast<uint16_t>(table.size() - 1);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <mrpt/system/datetime.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** An observation entry in the rawlog index. */
+struct TRawlogIndexEntry
+{
+	/** The byte offset of the observation in the uncompressed rawlog stream. */
+	uint64_t offset;
+
+	mrpt::system::TTimeStamp timestamp;
+
+	/** Index of the sensor label in the index's table of labels. */
+	uint16_t label_id;
+
+	/** Index of the class name in the index's table of class names. */
+	uint16_t class_id;
+};
+
+/**
+ * Seekable index of the observations in a rawlog, persisted in a sidecar file next to it (<rawlog>.idx).
+ * It stores the byte offset, timestamp, sensor label and class name of every observation,
+ * so the tree can be rebuilt without deserializing any payload.
+ * The index records the size and modification time of the rawlog it was built from,
+ * and is discarded when they no longer match.
+ */
+
+class CRawlogIndex
+{
+	public:
+
+	    /** Returns the path of the index file kept next to a rawlog. */
+	    static std::string indexPathFor(const std::string &rawlog_path);
+
+		/**
+		 * \brief Loads the index of a rawlog from its sidecar file.
+		 * \param rawlog_path the path of the rawlog file.
+		 * \return false if the index does not exist, is corrupted, or is out of date with respect to the rawlog.
+		 */
+		bool load(const std::string &rawlog_path);
+
+		/**
+		 * \brief Writes the index to the sidecar file of a rawlog.
+		 * \param rawlog_path the path of the rawlog file the index was built from.
+		 * \return false if the file could not be written.
+		 */
+		bool save(const std::string &rawlog_path) const;
+
+		/** Appends an observation to the index. */
+		void addEntry(const uint64_t &offset, const mrpt::system::TTimeStamp &timestamp, const std::string &sensor_label, const std::string &class_name);
+
+		/** Removes all the entries. */
+		void clear();
+
+		/** Returns the number of observations in the index. */
+		size_t size() const;
+
+		/** Returns the entry of an observation. */
+		const TRawlogIndexEntry &entry(const size_t &i) const;
+
+		/** Returns the sensor label of an entry. */
+		const std::string &sensorLabel(const TRawlogIndexEntry &entry) const;
+
+		/** Returns the class name of an entry. */
+		const std::string &className(const TRawlogIndexEntry &entry) const;
+
+	private:
+
+		/** Returns the index of a string in a table, adding it if it is not there yet. */
+		static uint16_t intern(std::vector<std::string> &table, const std::string &str);
+
+		/** The entries, in file order. */
+		std::vector<TRawlogIndexEntry> m_entries;
+
+		/** The unique sensor labels referenced by the entries. */
+		std::vector<std::string> m_sensor_labels;
+
+		/** The unique class names referenced by the entries. */
+		std::vector<std::string> m_class_names;
+};
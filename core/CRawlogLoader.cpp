@@ -0,0 +1,252 @@
+#include "CRawlogLoader.h"
+
+#include <mrpt/io/CStream.h>
+#include <mrpt/serialization/CArchive.h>
+#include <mrpt/system/filesystem.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+using namespace mrpt::obs;
+using namespace mrpt::serialization;
+
+bool TRawlogLoadParams::selects(const std::string &sensor_label, const mrpt::system::TTimeStamp &timestamp, const mrpt::system::TTimeStamp &first_timestamp) const
+{
+	if(!sensor_labels.empty() && std::find(sensor_labels.begin(), sensor_labels.end(), sensor_label) == sensor_labels.end())
+		return false;
+
+	double time = mrpt::system::timeDifference(first_timestamp, timestamp);
+	return time >= start_time && (end_time < 0 || time <= end_time);
+}
+
+class CRawlogLoader::CBlockStream : public mrpt::io::CStream
+{
+	public:
+
+	    CBlockStream(CBlockingQueue<TBlock> &blocks) : m_blocks(blocks)
+		{}
+
+		size_t Read(void *buffer, size_t count) override
+		{
+			uint8_t *out = static_cast<uint8_t*>(buffer);
+			size_t read = 0;
+
+			while(read < count)
+			{
+				if(m_pos_in_block == m_block.data.size())
+				{
+					if(!m_blocks.pop(m_block))
+						break;
+
+					m_pos_in_block = 0;
+					continue;
+				}
+
+				size_t n = std::min(count - read, m_block.data.size() - m_pos_in_block);
+				std::memcpy(out + read, m_block.data.data() + m_pos_in_block, n);
+				m_pos_in_block += n;
+				read += n;
+			}
+
+			m_position += read;
+			return read;
+		}
+
+		size_t Write(const void *, size_t) override
+		{
+			throw std::runtime_error("CBlockStream is read-only");
+		}
+
+		uint64_t Seek(int64_t, CStream::TSeekOrigin) override
+		{
+			throw std::runtime_error("CBlockStream can not seek");
+		}
+
+		uint64_t getTotalBytesCount() const override
+		{
+			return 0;
+		}
+
+		uint64_t getPosition() const override
+		{
+			return m_position;
+		}
+
+		/** Returns the byte offset reached in the compressed file by the block currently being read. */
+		uint64_t getFilePosition() const
+		{
+			return m_block.file_pos;
+		}
+
+	private:
+
+		CBlockingQueue<TBlock> &m_blocks;
+		TBlock m_block{{}, 0};
+		size_t m_pos_in_block = 0;
+		uint64_t m_position = 0;
+};
+
+CRawlogLoader::CRawlogLoader(const std::string &rawlog_path, const TRawlogLoadParams &params) :
+    m_rawlog_path(rawlog_path),
+    m_params(params),
+    m_blocks(8),
+    m_deserialized(params.queue_capacity)
+{
+	m_file_size = mrpt::system::getFileSize(rawlog_path);
+}
+
+CRawlogLoader::~CRawlogLoader()
+{
+}
+
+bool CRawlogLoader::cancelled() const
+{
+	return m_params.cancel && m_params.cancel->load();
+}
+
+void CRawlogLoader::inflate()
+{
+	gzFile file = gzopen(m_rawlog_path.c_str(), "rb");
+
+	if(!file)
+		m_inflate_error = std::make_exception_ptr(std::runtime_error("could not open the rawlog"));
+
+	else
+	{
+		gzbuffer(file, 256 * 1024);
+
+		while(!cancelled())
+		{
+			TBlock block;
+			block.data.resize(m_params.block_size);
+
+			int n = gzread(file, block.data.data(), static_cast<unsigned>(block.data.size()));
+			if(n <= 0)
+			{
+				// a truncated or damaged gzip stream also ends the reads, but leaves an error behind
+				int err = Z_OK;
+				const char *message = gzerror(file, &err);
+				if(n < 0 || err != Z_OK)
+					m_inflate_error = std::make_exception_ptr(std::runtime_error(std::string("could not inflate the rawlog: ") + message));
+
+				break;
+			}
+
+			block.data.resize(n);
+			block.file_pos = gzoffset(file);
+
+			if(!m_blocks.push(std::move(block)))
+				break;
+		}
+
+		gzclose(file);
+	}
+
+	m_blocks.close();
+}
+
+void CRawlogLoader::deserialize()
+{
+	CBlockStream stream(m_blocks);
+	auto archive = archiveFrom(stream);
+	CSerializable::Ptr obj;
+	size_t seq = 0;
+	mrpt::system::TTimeStamp first_timestamp = 0;
+
+	while(!cancelled())
+	{
+		TLoadedObservation loaded;
+		loaded.offset = stream.getPosition();
+
+		// the end of the file is only reached between two objects: an object that fails once read in part is corrupted or truncated
+		try
+		{
+			archive >> obj;
+		}
+
+		catch(std::exception &e)
+		{
+			if(stream.getPosition() != loaded.offset && !cancelled())
+				m_error = std::make_exception_ptr(std::runtime_error("could not read the object at byte " + std::to_string(loaded.offset) +
+				                                                     " of the inflated rawlog: " + e.what()));
+			break;
+		}
+
+		loaded.obs = std::dynamic_pointer_cast<CObservation>(obj);
+		if(!loaded.obs)
+			continue;
+
+		loaded.sensor_label = loaded.obs->sensorLabel;
+		loaded.class_name = loaded.obs->GetRuntimeClass()->className;
+		loaded.timestamp = loaded.obs->timestamp;
+
+		if(seq == 0)
+			first_timestamp = loaded.timestamp;
+
+		// the metadata is all that is kept of the observations that are filtered out
+		loaded.selected = m_params.selects(loaded.sensor_label, loaded.timestamp, first_timestamp);
+		if(!loaded.selected)
+			loaded.obs.reset();
+
+		// brings any externally stored payload (e.g. images saved in separate files) into memory
+		if(loaded.obs)
+		{
+			try
+			{
+				loaded.obs->load();
+			}
+
+			catch(...)
+			{
+				m_error = std::current_exception();
+				break;
+			}
+		}
+
+		loaded.seq = seq++;
+		loaded.file_pos = stream.getFilePosition();
+
+		if(!m_deserialized.push(std::move(loaded)))
+			break;
+	}
+
+	// unblock the inflating thread in case loading stopped early
+	m_blocks.close();
+	m_deserialized.close();
+}
+
+bool CRawlogLoader::run(const std::function<void(TLoadedObservation &)> &on_observation)
+{
+	std::thread inflater(&CRawlogLoader::inflate, this);
+	std::thread deserializer(&CRawlogLoader::deserialize, this);
+
+	TLoadedObservation loaded;
+
+	while(!cancelled() && m_deserialized.pop(loaded))
+	{
+		on_observation(loaded);
+
+		if(m_params.progress_callback && m_file_size > 0)
+			m_params.progress_callback(std::min(1.0, static_cast<double>(loaded.file_pos) / m_file_size));
+	}
+
+	// wake up any stage still waiting for space or data
+	m_blocks.close();
+	m_deserialized.close();
+
+	inflater.join();
+	deserializer.join();
+
+	// the errors are only read once the threads have been joined, that of the inflater first as it makes the objects fail to read
+	if(m_inflate_error)
+		std::rethrow_exception(m_inflate_error);
+
+	if(m_error)
+		std::rethrow_exception(m_error);
+
+	return !cancelled();
+}
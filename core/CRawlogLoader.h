@@ -0,0 +1,135 @@
+#pragma once
+
+#include "CBlockingQueue.h"
+
+#include <mrpt/obs/CObservation.h>
+#include <mrpt/system/datetime.h>
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+/** Parameters controlling how a rawlog file is loaded. */
+struct TRawlogLoadParams
+{
+	/** Size in bytes of the blocks the inflating thread reads from the (compressed) rawlog. */
+	size_t block_size = 1 << 20;
+
+	/** Maximum number of deserialized observations waiting to be handed back to the calling thread. */
+	size_t queue_capacity = 32;
+
+	/** Called from the thread running the loader, after each observation, in file order, with the fraction [0,1] of the file loaded so far. */
+	std::function<void(double)> progress_callback;
+
+	/** When not null, loading stops as soon as possible after the flag is set. */
+	const std::atomic<bool> *cancel = nullptr;
+
+	/** Whether to build the tree from the index sidecar of the rawlog when it is up to date, and to write it otherwise. */
+	bool use_index = true;
+
+	/** The labels of the sensors whose observations are loaded. Empty loads the observations of all the sensors. */
+	std::vector<std::string> sensor_labels;
+
+	/** Start and end of the time window loaded, in seconds since the first observation in the rawlog. A negative end loads until the end. */
+	double start_time = 0;
+	double end_time = -1;
+
+	/**
+	 * \brief Returns whether an observation passes the sensor and time filters.
+	 * \param sensor_label the label of the sensor the observation was taken with.
+	 * \param timestamp the timestamp of the observation.
+	 * \param first_timestamp the timestamp of the first observation in the rawlog.
+	 */
+	bool selects(const std::string &sensor_label, const mrpt::system::TTimeStamp &timestamp, const mrpt::system::TTimeStamp &first_timestamp) const;
+};
+
+/** An observation read from the rawlog, along with where it was found in the file. */
+struct TLoadedObservation
+{
+	/** The position of the object in the rawlog, counting from zero. */
+	size_t seq;
+
+	/** The byte offset of the object in the uncompressed rawlog stream. */
+	uint64_t offset;
+
+	/** The byte offset reached in the (compressed) file when the object was read, used for progress reporting. */
+	uint64_t file_pos;
+
+	mrpt::obs::CObservation::Ptr obs;
+	std::string sensor_label;
+	std::string class_name;
+	mrpt::system::TTimeStamp timestamp;
+
+	/** Whether the observation passes the filters of the loading parameters. The payload of unselected observations is dropped undecoded. */
+	bool selected = true;
+};
+
+/**
+ * Loads the observations of a rawlog file through a pipeline of threads:
+ * one thread inflates the gzip stream into blocks, and another deserializes the objects from those blocks and loads
+ * any externally stored payload, while the calling thread consumes the observations in file order.
+ * Deserialization stays on a single thread: the objects of a rawlog are not length-prefixed, so where one ends is only
+ * known once it has been read.
+ * Observations filtered out by the loading parameters are still handed back, with their metadata only, so that the index can be built.
+ */
+
+class CRawlogLoader
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param rawlog_path the path of the rawlog file to load.
+		 * \param params the loading parameters.
+		 */
+	    CRawlogLoader(const std::string &rawlog_path, const TRawlogLoadParams &params);
+
+		~CRawlogLoader();
+
+		/**
+		 * \brief Runs the loading pipeline until the end of the file is reached, or loading is cancelled.
+		 * \param on_observation called from the calling thread for every observation, in file order.
+		 * \return false if loading was cancelled.
+		 * \throw std::exception the error that stopped the pipeline, e.g. a damaged gzip stream, an object that could not be read
+		 * before the end of the file, or an externally stored payload that could not be loaded.
+		 */
+		bool run(const std::function<void(TLoadedObservation &)> &on_observation);
+
+	private:
+
+		/** A chunk of the inflated rawlog stream. */
+		struct TBlock
+		{
+			std::vector<uint8_t> data;
+
+			/** The byte offset reached in the compressed file after inflating the block. */
+			uint64_t file_pos;
+		};
+
+		/** Stream adapter that lets the deserializer read the inflated blocks. */
+		class CBlockStream;
+
+		/** Inflates the rawlog file into blocks. */
+		void inflate();
+
+		/** Deserializes the objects from the inflated blocks, and loads their externally stored payloads. */
+		void deserialize();
+
+		bool cancelled() const;
+
+		std::string m_rawlog_path;
+		TRawlogLoadParams m_params;
+
+		/** Size of the rawlog file on disk, in bytes. */
+		uint64_t m_file_size;
+
+		CBlockingQueue<TBlock> m_blocks;
+		CBlockingQueue<TLoadedObservation> m_deserialized;
+
+		/** The errors that stopped the inflating and the deserializing threads, rethrown by run(). */
+		std::exception_ptr m_inflate_error;
+		std::exception_ptr m_error;
+};
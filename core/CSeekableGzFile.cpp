@@ -0,0 +1,252 @@
+#include "CSeekableGzFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	/** The size of the deflate window, the furthest back a block may refer to. */
+	const size_t window_size = 32768;
+
+	/** The size of the chunks the compressed file is read in. */
+	const size_t input_size = 65536;
+}
+
+CSeekableGzFile::CSeekableGzFile(const uint64_t &span) : m_span(std::max<uint64_t>(span, window_size))
+{
+	std::memset(&m_stream, 0, sizeof(m_stream));
+}
+
+CSeekableGzFile::~CSeekableGzFile()
+{
+	close();
+}
+
+bool CSeekableGzFile::open(const std::string &path)
+{
+	close();
+
+	m_file = std::fopen(path.c_str(), "rb");
+	if(!m_file)
+		return false;
+
+	unsigned char magic[2];
+	m_compressed = std::fread(magic, 1, 2, m_file) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+
+	fseeko(m_file, 0, SEEK_END);
+	m_file_size = ftello(m_file);
+
+	m_input.resize(input_size);
+	m_window.assign(window_size, 0);
+
+	if(m_compressed)
+		return restart();
+
+	m_out = 0;
+	return fseeko(m_file, 0, SEEK_SET) == 0;
+}
+
+void CSeekableGzFile::close()
+{
+	if(m_stream_open)
+	{
+		inflateEnd(&m_stream);
+		m_stream_open = false;
+	}
+
+	if(m_file)
+	{
+		std::fclose(m_file);
+		m_file = nullptr;
+	}
+
+	m_points.clear();
+	m_out = 0;
+}
+
+bool CSeekableGzFile::isOpen() const
+{
+	return m_file != nullptr;
+}
+
+bool CSeekableGzFile::isCompressed() const
+{
+	return m_compressed;
+}
+
+bool CSeekableGzFile::seek(const uint64_t &offset)
+{
+	if(!m_file)
+		return false;
+
+	if(!m_compressed)
+	{
+		if(offset > m_file_size || fseeko(m_file, offset, SEEK_SET) != 0)
+			return false;
+
+		m_out = offset;
+		return true;
+	}
+
+	// the closest access point before the offset, resumed from unless the current position is closer
+	std::vector<TAccessPoint>::const_iterator next = std::upper_bound(m_points.begin(), m_points.end(), offset,
+	                                                                  [](const uint64_t &out, const TAccessPoint &point) { return out < point.out; });
+
+	if(offset < m_out || (next != m_points.begin() && std::prev(next)->out > m_out))
+	{
+		bool resumed = (next == m_points.begin()) ? restart() : resume(*std::prev(next));
+		if(!resumed)
+			return false;
+	}
+
+	inflateTo(nullptr, offset - m_out);
+	return m_out == offset;
+}
+
+size_t CSeekableGzFile::read(void *buffer, const size_t &count)
+{
+	if(!m_file)
+		return 0;
+
+	if(m_compressed)
+		return inflateTo(static_cast<uint8_t*>(buffer), count);
+
+	size_t n = std::fread(buffer, 1, count, m_file);
+	m_out += n;
+	return n;
+}
+
+uint64_t CSeekableGzFile::tell() const
+{
+	return m_out;
+}
+
+size_t CSeekableGzFile::getNumberOfAccessPoints() const
+{
+	return m_points.size();
+}
+
+size_t CSeekableGzFile::getAccessPointBytes() const
+{
+	return m_points.capacity() * sizeof(TAccessPoint) + m_points.size() * window_size;
+}
+
+bool CSeekableGzFile::restart()
+{
+	if(m_stream_open)
+		inflateEnd(&m_stream);
+
+	// 15 bits of window, and 32 to detect and skip the gzip header
+	std::memset(&m_stream, 0, sizeof(m_stream));
+	m_stream_open = inflateInit2(&m_stream, 15 + 32) == Z_OK;
+	if(!m_stream_open)
+		return false;
+
+	m_in = 0;
+	m_out = 0;
+	m_window_pos = 0;
+	m_end = false;
+	return fseeko(m_file, 0, SEEK_SET) == 0;
+}
+
+bool CSeekableGzFile::resume(const TAccessPoint &point)
+{
+	if(m_stream_open)
+		inflateEnd(&m_stream);
+
+	// a raw deflate stream, as the point is past the gzip header
+	std::memset(&m_stream, 0, sizeof(m_stream));
+	m_stream_open = inflateInit2(&m_stream, -15) == Z_OK;
+	if(!m_stream_open)
+		return false;
+
+	m_in = point.in - (point.bits ? 1 : 0);
+	if(fseeko(m_file, m_in, SEEK_SET) != 0)
+		return false;
+
+	// the point is in the middle of a byte, whose remaining bits are fed to the inflater first
+	if(point.bits)
+	{
+		int byte = std::getc(m_file);
+		if(byte == EOF)
+			return false;
+
+		m_in++;
+		inflatePrime(&m_stream, point.bits, byte >> (8 - point.bits));
+	}
+
+	inflateSetDictionary(&m_stream, point.window.data(), window_size);
+
+	m_window = point.window;
+	m_window_pos = 0;
+	m_out = point.out;
+	m_end = false;
+	return true;
+}
+
+size_t CSeekableGzFile::inflateTo(uint8_t *buffer, const size_t &count)
+{
+	size_t done = 0;
+
+	while(done < count && !m_end)
+	{
+		if(m_stream.avail_in == 0)
+		{
+			size_t n = std::fread(m_input.data(), 1, m_input.size(), m_file);
+			if(n == 0)
+			{
+				// a truncated stream
+				m_end = true;
+				break;
+			}
+
+			m_in += n;
+			m_stream.next_in = m_input.data();
+			m_stream.avail_in = static_cast<uInt>(n);
+		}
+
+		// the output goes to the window first, and is copied out from it
+		size_t chunk = std::min(count - done, window_size - m_window_pos);
+		m_stream.next_out = m_window.data() + m_window_pos;
+		m_stream.avail_out = static_cast<uInt>(chunk);
+
+		// Z_BLOCK stops at the end of every deflate block, where an access point can be recorded
+		int result = inflate(&m_stream, Z_BLOCK);
+
+		size_t produced = chunk - m_stream.avail_out;
+		if(buffer && produced > 0)
+			std::memcpy(buffer + done, m_window.data() + m_window_pos, produced);
+
+		m_window_pos = (m_window_pos + produced) % window_size;
+		m_out += produced;
+		done += produced;
+
+		if(result == Z_STREAM_END || (result != Z_OK && result != Z_BUF_ERROR))
+		{
+			m_end = true;
+			break;
+		}
+
+		// bit 7 tells the inflater is at the end of a block, and bit 6 that it was the last one
+		bool block_end = (m_stream.data_type & 128) && !(m_stream.data_type & 64);
+		if(block_end && (m_points.empty() || m_out >= m_points.back().out + m_span))
+			addAccessPoint();
+	}
+
+	return done;
+}
+
+void CSeekableGzFile::addAccessPoint()
+{
+	TAccessPoint point;
+	point.out = m_out;
+	point.in = m_in - m_stream.avail_in;
+	point.bits = m_stream.data_type & 7;
+
+	// the ring unrolled, from the oldest byte to the newest
+	point.window.resize(window_size);
+	std::memcpy(point.window.data(), m_window.data() + m_window_pos, window_size - m_window_pos);
+	std::memcpy(point.window.data() + window_size - m_window_pos, m_window.data(), m_window_pos);
+
+	m_points.push_back(std::move(point));
+}
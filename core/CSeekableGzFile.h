@@ -0,0 +1,123 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Reads the uncompressed content of a gzip-compressed (or plain) file at random offsets.
+ * zlib can only resume inflating a stream where it stopped, so seeking backwards with gzseek() inflates the file again from
+ * its start. Instead, as the file is inflated, the state of the inflater is recorded at the block boundaries every `span`
+ * bytes of output (the access points of zlib's zran example): the position in the compressed file, and the last 32 KiB of
+ * output, which later blocks may refer to. A seek then resumes from the closest access point before the offset, and inflates
+ * at most about `span` bytes to reach it.
+ * Plain files are read directly.
+ * Not thread safe.
+ */
+
+class CSeekableGzFile
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param span the minimum number of uncompressed bytes between two access points. Each one takes 32 KiB of memory.
+		 */
+	    explicit CSeekableGzFile(const uint64_t &span = 4 << 20);
+
+		~CSeekableGzFile();
+
+		CSeekableGzFile(const CSeekableGzFile &) = delete;
+		CSeekableGzFile &operator=(const CSeekableGzFile &) = delete;
+
+		/** Opens a file, positioned at its start, closing the one open before. Returns false if it could not be opened. */
+		bool open(const std::string &path);
+
+		void close();
+
+		bool isOpen() const;
+
+		/** Returns whether the open file is gzip-compressed. */
+		bool isCompressed() const;
+
+		/**
+		 * \brief Moves to an offset of the uncompressed content.
+		 * \return false if the offset is past the end of the content or the file is corrupted, in which case the position is undefined.
+		 */
+		bool seek(const uint64_t &offset);
+
+		/**
+		 * \brief Reads from the current position.
+		 * \return the number of bytes read, less than count only at the end of the content or on a corrupted file.
+		 */
+		size_t read(void *buffer, const size_t &count);
+
+		/** Returns the current offset in the uncompressed content. */
+		uint64_t tell() const;
+
+		/** Returns the number of access points recorded so far. */
+		size_t getNumberOfAccessPoints() const;
+
+		/** Returns the memory taken by the access points, in bytes. */
+		size_t getAccessPointBytes() const;
+
+	private:
+
+		/** A position the inflater can resume from. */
+		struct TAccessPoint
+		{
+			/** The offset of the point in the uncompressed content. */
+			uint64_t out;
+
+			/** The offset of the first byte of the point in the compressed file, with bits of the byte before it if not 0. */
+			uint64_t in;
+			int bits;
+
+			/** The 32 KiB of uncompressed content before the point. */
+			std::vector<uint8_t> window;
+		};
+
+		/** Restarts inflating from the start of the file. */
+		bool restart();
+
+		/** Restarts inflating from an access point. */
+		bool resume(const TAccessPoint &point);
+
+		/** Inflates up to count bytes into the buffer, or discards them if the buffer is null. */
+		size_t inflateTo(uint8_t *buffer, const size_t &count);
+
+		/** Records an access point at the current position. */
+		void addAccessPoint();
+
+		uint64_t m_span;
+
+		FILE *m_file = nullptr;
+		bool m_compressed = false;
+
+		/** The size of the file, which is that of its content when it is not compressed. */
+		uint64_t m_file_size = 0;
+
+		/** The current offset in the uncompressed content. */
+		uint64_t m_out = 0;
+
+		/** The inflater, and whether it is initialized. */
+		z_stream m_stream;
+		bool m_stream_open = false;
+
+		/** Whether the end of the compressed stream, or an error, was reached. */
+		bool m_end = false;
+
+		/** The offset in the compressed file of the next byte read into m_input. */
+		uint64_t m_in = 0;
+		std::vector<uint8_t> m_input;
+
+		/** The last 32 KiB of output, as a ring whose next byte is written at m_window_pos. */
+		std::vector<uint8_t> m_window;
+		size_t m_window_pos = 0;
+
+		/** The access points, by increasing offset. */
+		std::vector<TAccessPoint> m_points;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Utils.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Tracks which stages of a pipeline run in sequence (e.g. extraction, matching, solving) are up to date with their inputs.
+ * Each stage is keyed by the hash of its own inputs chained with the key of the stage before it, so that a stage stays
+ * up to date only as long as neither its inputs nor those of any stage upstream change.
+ */
+
+class CStageTracker
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param num_stages the number of stages of the pipeline.
+		 */
+	    explicit CStageTracker(const size_t &num_stages) : m_keys(num_stages, 0), m_done(num_stages, false)
+		{}
+
+		/** Returns the key a stage runs with, given the hash of its own inputs. */
+		uint64_t key(const size_t &stage, const uint64_t &inputs_hash) const
+		{
+			uint64_t key = (stage > 0) ? m_keys[stage - 1] : utils::hash_seed;
+			utils::hashCombine(key, inputs_hash);
+			return key;
+		}
+
+		/** Returns whether a stage has run with these inputs, after all the stages upstream last ran. */
+		bool isUpToDate(const size_t &stage, const uint64_t &inputs_hash) const
+		{
+			for(size_t i = 0; i <= stage; i++)
+				if(!m_done[i])
+					return false;
+
+			return m_keys[stage] == key(stage, inputs_hash);
+		}
+
+		/** Records that a stage has run with these inputs, which makes the stages downstream out of date. */
+		void markDone(const size_t &stage, const uint64_t &inputs_hash)
+		{
+			m_keys[stage] = key(stage, inputs_hash);
+			m_done[stage] = true;
+		}
+
+		/** Marks a stage, and the stages downstream, as out of date, e.g. when it failed half-way. */
+		void invalidate(const size_t &stage)
+		{
+			for(size_t i = stage; i < m_done.size(); i++)
+				m_done[i] = false;
+		}
+
+	private:
+
+		/** The key each stage last ran with. */
+		std::vector<uint64_t> m_keys;
+
+		std::vector<bool> m_done;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed pool of worker threads running batches of independent tasks.
+ * The workers are started once and wait for the next batch between calls to parallelFor().
+ */
+
+class CThreadPool
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param num_threads the number of worker threads. 0 uses the number of hardware threads.
+		 */
+	    CThreadPool(const size_t &num_threads = 0)
+		{
+			size_t n = num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+
+			for(size_t i = 0; i < n; i++)
+				m_workers.emplace_back(&CThreadPool::work, this, i);
+		}
+
+		~CThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+
+			m_batch_cv.notify_all();
+			for(std::thread &worker : m_workers)
+				worker.join();
+		}
+
+		CThreadPool(const CThreadPool &) = delete;
+		CThreadPool &operator=(const CThreadPool &) = delete;
+
+		/** Returns the number of worker threads. */
+		size_t size() const
+		{
+			return m_workers.size();
+		}
+
+		/**
+		 * \brief Runs task(i, thread_id) for every i in [0, num_tasks), and waits until all of them are done.
+		 * The tasks are handed out one at a time, so uneven tasks balance across the workers.
+		 * thread_id is in [0, size()), and identifies the worker running the task, e.g. to use per-thread scratch data.
+		 * If any task throws, the remaining tasks are skipped and the first exception is rethrown here.
+		 */
+		void parallelFor(const size_t &num_tasks, const std::function<void(size_t, size_t)> &task)
+		{
+			if(num_tasks == 0)
+				return;
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_task = &task;
+			m_num_tasks = num_tasks;
+			m_next_task = 0;
+			m_busy_workers = m_workers.size();
+			m_error = nullptr;
+			m_batch++;
+
+			m_batch_cv.notify_all();
+			m_done_cv.wait(lock, [this]{ return m_busy_workers == 0; });
+			m_task = nullptr;
+
+			if(m_error)
+				std::rethrow_exception(m_error);
+		}
+
+	private:
+
+		void work(const size_t &thread_id)
+		{
+			size_t batch = 0;
+
+			while(true)
+			{
+				const std::function<void(size_t, size_t)> *task;
+				size_t num_tasks;
+
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_batch_cv.wait(lock, [&]{ return m_stop || m_batch != batch; });
+					if(m_stop)
+						return;
+
+					batch = m_batch;
+					task = m_task;
+					num_tasks = m_num_tasks;
+				}
+
+				for(size_t i = m_next_task++; i < num_tasks; i = m_next_task++)
+				{
+					try
+					{
+						(*task)(i, thread_id);
+					}
+
+					catch(...)
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						if(!m_error)
+							m_error = std::current_exception();
+						m_next_task = num_tasks;
+					}
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_busy_workers--;
+				}
+
+				m_done_cv.notify_all();
+			}
+		}
+
+		std::vector<std::thread> m_workers;
+
+		/** The current batch: its task, number of tasks, and the next task to be handed out. */
+		const std::function<void(size_t, size_t)> *m_task = nullptr;
+		size_t m_num_tasks = 0;
+		std::atomic<size_t> m_next_task{0};
+
+		/** Counts the batches run, so that the workers tell a new batch from a spurious wake-up. */
+		size_t m_batch = 0;
+
+		size_t m_busy_workers = 0;
+		std::exception_ptr m_error;
+		bool m_stop = false;
+
+		std::mutex m_mutex;
+		std::condition_variable m_batch_cv;
+		std::condition_variable m_done_cv;
+};
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <string>
+#include <type_traits>
 #include <vector>
 #include <mrpt/img/TCamera.h>
 #include <mrpt/poses/CPose3D.h>
@@ -61,18 +64,77 @@ namespace utils
 		point.z = tpoint(2);
 	}
 
+	/** A read-only view of a range image, indexed as (row, col), that refers to the matrix it is made from without copying it. */
+	typedef Eigen::Map<const Eigen::MatrixXf, Eigen::Unaligned, Eigen::Stride<Eigen::Dynamic,Eigen::Dynamic>> TRangeView;
+
+	/** Returns a view of a range image (e.g. the rangeImage of a CObservation3DRangeScan), whatever the storage order of its matrix. */
+	template <typename Derived>
+	TRangeView rangeView(const Eigen::PlainObjectBase<Derived> &range)
+	{
+		return TRangeView(range.data(), range.rows(), range.cols(), Eigen::Stride<Eigen::Dynamic,Eigen::Dynamic>(range.colStride(), range.rowStride()));
+	}
+
 	/**
 	 * \brief Function template to back project 2D point to its corresponding 3D point in space
 	 * \param point the 2D pixel coordinates
-	 * \param range the depth image
+	 * \param range the depth image, a matrix or a view of one
 	 * \param params the intrinsic parameters of the camera
 	 * \param point3D the calculated 3D point in space
 	 */
-	template <typename T, typename S>
-	void backprojectTo3D(T &point,  Eigen::MatrixXf &range, const mrpt::img::TCamera &params, S &point3D)
+	template <typename T, typename R, typename S>
+	void backprojectTo3D(const T &point, const R &range, const mrpt::img::TCamera &params, S &point3D)
 	{
 		point3D[2] = range(point[1], point[0]);
 		point3D[0] = ((point[0] - params.cx())/params.fx()) * point3D[2];
 		point3D[1] = ((point[1] - params.cy())/params.fy()) * point3D[2];
 	}
+
+	/**
+	 * \brief Back projects a batch of 2D points to 3D, gathering their depths from the range image in one pass and then scaling
+	 * all their rays at once, rather than calling backprojectTo3D() point by point.
+	 * \param points the 2D pixel coordinates, one point per column
+	 * \param range the depth image, a matrix or a view of one
+	 * \param params the intrinsic parameters of the camera
+	 * \param points3D the calculated 3D points, one per column
+	 */
+	template <typename R>
+	void backprojectPointsTo3D(const Eigen::Matrix2Xi &points, const R &range, const mrpt::img::TCamera &params, Eigen::Matrix3Xf &points3D)
+	{
+		points3D.resize(3, points.cols());
+
+		for(Eigen::Index i = 0; i < points.cols(); i++)
+			points3D(2,i) = range(points(1,i), points(0,i));
+
+		points3D.row(0) = (((points.row(0).cast<float>().array() - static_cast<float>(params.cx())) / static_cast<float>(params.fx())) * points3D.row(2).array()).matrix();
+		points3D.row(1) = (((points.row(1).cast<float>().array() - static_cast<float>(params.cy())) / static_cast<float>(params.fy())) * points3D.row(2).array()).matrix();
+	}
+
+	/** The initial value of a 64-bit FNV-1a hash, see hashCombine(). */
+	static const uint64_t hash_seed = 14695981039346656037ULL;
+
+	/**
+	 * \brief Accumulates the bytes of a value into a 64-bit FNV-1a hash, e.g. to key caches by the parameters they depend on.
+	 * Only for plain values; the fields of structs are to be hashed one by one, to skip their padding.
+	 */
+	template <typename T>
+	void hashCombine(uint64_t &hash, const T &value)
+	{
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "only plain values can be hashed by their bytes");
+
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&value);
+		for(size_t i = 0; i < sizeof(T); i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	/** Accumulates the characters and the length of a string into a 64-bit FNV-1a hash. */
+	inline void hashCombine(uint64_t &hash, const std::string &value)
+	{
+		for(const char &c : value)
+			hashCombine(hash, c);
+
+		hashCombine(hash, static_cast<uint64_t>(value.size()));
+	}
 }
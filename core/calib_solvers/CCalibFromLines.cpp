@@ -1,264 +1,249 @@
 #include "CCalibFromLines.h"
+#include "CLineDetector.h"
+#include <CFeatureCache.h>
+#include <CNormalIndex.h>
+#include <CProfiler.h>
+#include <CThreadPool.h>
 #include <mrpt/math/geometry.h>
+#include <mrpt/obs/CObservation3DRangeScan.h>
+
+#include <algorithm>
+#include <atomic>
+
+using namespace mrpt::obs;
+
+namespace
+{
+	/** Returns an OpenCV header over the pixels of an image, without copying them. The image must outlive the header. */
+	cv::Mat imageView(const mrpt::img::CImage &image)
+	{
+		return cv::Mat(image.getHeight(), image.getWidth(), CV_8UC(image.getChannelCount()),
+		               const_cast<unsigned char*>(image.get_unsafe(0, 0, 0)), image.getRowStride());
+	}
+}
 
 CCalibFromLines::CCalibFromLines(CObservationTree *model) : CExtrinsicCalib(model)
-{}
+{
+	// every sensor starts with no observations, until the lines are extracted
+	m_line_store.assign(std::vector<std::vector<TLineBatch>>(sync_model->getNumberOfSensors()));
+}
 
 CCalibFromLines::~CCalibFromLines(){}
 
-void CCalibFromLines::segmentLines(const cv::Mat &image, Eigen::MatrixXf &range, const TLineSegmentationParams &params, const mrpt::img::TCamera &camera_params, std::vector<CLine> &lines)
+void CCalibFromLines::segmentLines(const cv::Mat &image, const utils::TRangeView &range, const TLineSegmentationParams &params, const mrpt::img::TCamera &camera_params, TLineBatch &lines)
 {
-	cv::Mat canny_image;
+	std::vector<TLineSegment> segments;
+	CLineDetector::create(params.detector)->detect(image, params, segments);
 
-	cv::Canny(image, canny_image, params.clow_threshold, params.clow_threshold * params.chigh_to_low_ratio, params.ckernel_size);
+	const size_t num_lines = segments.size();
+	lines.resize(num_lines);
 
-	std::vector<cv::Vec2f> hlines;
+	if(num_lines == 0)
+		return;
 
-	cv::HoughLines(canny_image, hlines, 1, CV_PI, params.hthreshold);
+	for(size_t i = 0; i < num_lines; i++)
+	{
+		lines.rho[i] = segments[i].rho;
+		lines.theta[i] = segments[i].theta;
+		lines.m[i] = segments[i].m;
+		lines.c[i] = segments[i].c;
+		lines.end_points[0].col(i) = segments[i].end_points[0];
+		lines.end_points[1].col(i) = segments[i].end_points[1];
+	}
 
+	lines.mean_points = (lines.end_points[0] + lines.end_points[1]) / 2;
+	lines.l = lines.end_points[0] - lines.end_points[1];
 
-	double rho, theta;
-	double cos_theta, sin_theta;
-	double m, c, c_max;
-	CLine line;
+	// the mean points and both end points of every line are back-projected in a single pass
+	Eigen::Matrix2Xi pixels(2, 3 * num_lines);
+	pixels << lines.mean_points, lines.end_points[0], lines.end_points[1];
 
-	int x, y, xf, yf;
+	Eigen::Matrix3Xf points3D;
+	utils::backprojectPointsTo3D(pixels, range, camera_params, points3D);
 
-	for(size_t n(0); n < hlines.size(); n++)
+	lines.points = points3D.leftCols(num_lines);
+	lines.end_points3D[0] = points3D.middleCols(num_lines, num_lines);
+	lines.end_points3D[1] = points3D.rightCols(num_lines);
+	lines.directions = lines.end_points3D[1] - lines.end_points3D[0];
+
+	lines.rays.row(0) = ((lines.mean_points.row(0).cast<float>().array() - static_cast<float>(camera_params.cx())) / static_cast<float>(camera_params.fx())).matrix();
+	lines.rays.row(1) = ((lines.mean_points.row(1).cast<float>().array() - static_cast<float>(camera_params.cy())) / static_cast<float>(camera_params.fy())).matrix();
+	lines.rays.row(2).setOnes();
+
+	// the cross product of [lx ly 0] with the rays, whose third coordinate is 1
+	Eigen::Array<float,1,Eigen::Dynamic> lx = lines.l.row(0).cast<float>(), ly = lines.l.row(1).cast<float>();
+	lines.normals.row(0) = ly.matrix();
+	lines.normals.row(1) = -lx.matrix();
+	lines.normals.row(2) = (lx * lines.rays.row(1).array() - ly * lines.rays.row(0).array()).matrix();
+}
+
+bool CCalibFromLines::extractLines(const TLineSegmentationParams &params, std::vector<std::vector<double>> *times, const TStageControl &control)
+{
+	CScopedTimer timer("extractLines");
+
+	const std::vector<std::vector<int>> &sync_indices = sync_model->getSyncIndices();
+	std::vector<std::vector<TLineBatch>> sensor_lines(sync_indices.size());
+	std::vector<std::pair<int,int>> tasks;
+
+	// the slots are allocated up front, so that the workers never modify the containers themselves
+	for(size_t i = 0; i < sync_indices.size(); i++)
 	{
-		if(hlines[n][0] < 0)
-		{
-			rho = -hlines[n][0];
-			theta = hlines[n][1] - CV_PI;
-		}
+		sensor_lines[i].assign(sync_indices[i].size(), TLineBatch());
 
-		else
-		{
-			rho = hlines[n][0];
-			theta = hlines[n][1];
-		}
+		for(size_t j = 0; j < sync_indices[i].size(); j++)
+			tasks.push_back(std::make_pair(i, j));
+	}
 
-		if (rho == 0 && theta == 0)
-			continue;
+	// the observations are taken in file order, so that the payloads evicted from the cache are read back forwards through the rawlog
+	std::sort(tasks.begin(), tasks.end(), [&](const std::pair<int,int> &a, const std::pair<int,int> &b)
+	{
+		return sync_indices[a.first][a.second] < sync_indices[b.first][b.second];
+	});
 
-		if (fabs(theta) < 0.00001)
-		{
-			x = xf = static_cast<int>(rho + 0.5);
-			y = 0;
-			yf = canny_image.rows - 1;
-		}
+	if(times)
+	{
+		times->resize(sync_indices.size());
+		for(size_t i = 0; i < sync_indices.size(); i++)
+			(*times)[i].assign(sync_indices[i].size(), 0);
+	}
 
-		else
-		{
-			cos_theta = cos(theta);
-			sin_theta = sin(theta);
-			m = -cos_theta / sin_theta;
-			c = rho * (sin_theta - m * cos_theta);
+	std::shared_ptr<CFeatureCache> features = sync_model->getFeatureCache();
+	const uint64_t params_hash = CFeatureCache::hashParams(params);
 
-			if (c >= 0)
-			{
-				if (c < canny_image.rows)
-				{
-					x = 0;
-					y = static_cast<int>(c);
-				}
-				else
-				{
-					y = canny_image.rows - 1;
-					x = static_cast<int>((y - c) / m);
-				}
-			}
+	CThreadPool &pool = threadPool(params.num_threads);
+	std::atomic<size_t> tasks_done(0);
+	std::atomic<size_t> unread(0);
 
-			else
-			{
-				x = static_cast<int>(-c / m);
-				y = 0;
-			}
+	pool.parallelFor(tasks.size(), [&](size_t task, size_t thread_id)
+	{
+		// the remaining tasks are skipped once cancelled, each returning right away
+		if(control.isCancelled())
+			return;
 
-			c_max = m * (canny_image.cols - 1) + c;
-			if (c_max >= 0)
-			{
-				if (c_max < canny_image.rows)
-				{
-					xf = canny_image.cols - 1;
-					yf = static_cast<int>(c_max);
-				}
+		int sensor_id = tasks[task].first, sync_obs_id = tasks[task].second;
 
-				else
-				{
-					yf = canny_image.rows - 1;
-					xf = static_cast<int>((yf - c) / m);
-				}
-			}
-			else
+		int record_id = sync_indices[sensor_id][sync_obs_id];
+		TLineBatch &lines = sensor_lines[sensor_id][sync_obs_id];
+
+		CScopedTimer task_timer("segmentLines");
+
+		// lines segmented with the same parameters in a previous run are read back without reading the observation
+		if(!features->loadLines(sync_model->getObservationInfo(record_id), params_hash, lines))
+		{
+			// the observation is held for the duration of the task, so that the views stay valid even if the store evicts it
+			CObservation3DRangeScan::Ptr obs = std::dynamic_pointer_cast<CObservation3DRangeScan>(sync_model->getObservation(record_id));
+			if(!obs)
 			{
-				xf = static_cast<int>(-c / m);
-				yf = 0;
+				// the features of the observation are missing, which fails the stage once the other observations are done
+				unread++;
+				control.reportProgress(static_cast<double>(++tasks_done) / tasks.size());
+				return;
 			}
-		}
 
-		line.rho = rho;
-		line.theta = theta;
-		line.m = m;
-		line.c = c;
+			segmentLines(imageView(obs->intensityImage), utils::rangeView(obs->rangeImage), params, obs->cameraParamsIntensity, lines);
+			features->storeLines(sync_model->getObservationInfo(record_id), params_hash, lines);
+		}
 
-		// Bresenham algorithm
+		double elapsed = task_timer.stop();
+		if(times)
+			(*times)[sensor_id][sync_obs_id] = elapsed;
 
-		bool onSegment = false;
-		int memory;
-		int memoryX = 0, memoryY = 0;
-		int xPrev = 0, yPrev = 0;
-		size_t nbPixels = 0;
+		CProfiler::instance().addCount("frames");
+		CProfiler::instance().addCount("lines", lines.size());
 
-		int w = xf - x;
-		int h = yf - y;
-		int dx1, dy1, dx2, dy2 = 0;
+		control.reportProgress(static_cast<double>(++tasks_done) / tasks.size());
+	});
 
-		int longest, shortest;
-		int numerator;
+	m_line_store.assign(sensor_lines);
 
-		if (w < 0)
-		{
-			longest = -w;
-			dx1 = -1;
-			dx2 = -1;
-		}
-		else
-		{
-			longest = w;
-			dx1 = 1;
-			dx2 = 1;
-		}
+	accountLineMemory();
 
-		if (h < 0)
-		{
-			shortest = -h;
-			dy1 = -1;
-		}
+	m_unread_observations = unread;
+	return !control.isCancelled() && m_unread_observations == 0;
+}
 
-		else
-		{
-			shortest = h;
-			dy1 = 1;
-		}
+const CLineStore &CCalibFromLines::getLineStore() const
+{
+	return m_line_store;
+}
 
-		if (longest <= shortest)
-		{
-			memory = longest;
-			longest = shortest;
-			shortest = memory;
-			dx2 = 0;
-			if (h < 0)
-			{
-				dy2 = -1;
-			}
+void CCalibFromLines::accountLineMemory()
+{
+	m_line_memory.set(m_line_store.estimateBytes());
+}
 
-			else
-			{
-				dy2 = 1;
-			}
-		}
+uint64_t CCalibFromLines::extractionInputsHash(const TLineSegmentationParams &params) const
+{
+	uint64_t hash = hashSyncIndices();
+	utils::hashCombine(hash, CFeatureCache::hashParams(params));
 
-		numerator = longest / 2;
+	return hash;
+}
 
-		for (int i(0); i <= longest; ++i)
-		{
-			if (onSegment)
-			{
-				if (canny_image.at<char>(y, x) == 0 || i == longest)
-				{
-					onSegment = false;
-					if (nbPixels >= params.hthreshold)
-					{
-						std::array<Eigen::Vector2i, 2> end_points;
-						end_points[0] = Eigen::Vector2i(memoryX, memoryY);
-						end_points[1] = Eigen::Vector2i(xPrev, yPrev);
-
-						Eigen::Vector2i mean_point = Eigen::Vector2i((memoryX + xPrev)/2, (memoryY + yPrev)/2);
-
-						Eigen::Vector3f ray;
-						ray[0] = (mean_point[0] - camera_params.cx())/camera_params.fx();
-						ray[1] = (mean_point[1] - camera_params.cy())/camera_params.fy();
-						ray[2] = 1;
-
-						Eigen::Vector2i l_temp = (end_points[0] - end_points[1]);
-						Eigen::Vector3i l(l_temp[0], l_temp[1], 0);
-
-						Eigen::Vector3f normal;
-						mrpt::math::crossProduct3D(l, ray, normal);
-
-						Eigen::Vector3f p;
-						utils::backprojectTo3D(mean_point, range, camera_params, p);
-
-						std::array<Eigen::Vector3f, 2> end_points3D;
-						utils::backprojectTo3D(end_points[0], range, camera_params, end_points3D[0]);
-						utils::backprojectTo3D(end_points[1], range, camera_params, end_points3D[1]);
-
-						Eigen::Vector3f v;
-						v = end_points3D[1] - end_points3D[0];
-
-						line.end_points = end_points;
-						line.end_points3D = end_points3D;
-						line.mean_point = mean_point;
-						line.ray = ray;
-						line.l = l;
-						line.normal = normal;
-						line.p = p;
-						line.v = v;
-						lines.push_back(line);
-					}
-				}
+uint64_t CCalibFromLines::matchingInputsHash(const TLineMatchingParams &params) const
+{
+	uint64_t hash = hashSensorPoses();
+	utils::hashCombine(hash, params.min_normals_dot_prod);
+	utils::hashCombine(hash, params.max_line_normal_dot_prod);
 
-				else
-				{
-					++nbPixels;
-				}
-			}
+	return hash;
+}
 
-			else if (canny_image.at<char>(y, x) != 0)
-			{
-				onSegment = true;
-				nbPixels = 0;
-				memoryX = x;
-				memoryY = y;
-			}
+void CCalibFromLines::clearMatches()
+{
+	for(auto &sensor_i : mmv_line_corresp)
+		for(auto &sensor_j : sensor_i.second)
+			sensor_j.second.clear();
 
-			xPrev = x;
-			yPrev = y;
+	m_correspondence_memory.set(estimateCorrespondenceBytes(mmv_line_corresp));
+}
 
-			numerator += shortest;
+void CCalibFromLines::findPotentialMatches(const int &set_id, const TLineMatchingParams &params)
+{
+	const int num_sensors = m_line_store.getNumberOfSensors();
+	const std::vector<Eigen::Matrix4f> sensor_poses = sync_model->getSensorPoses();
 
-			if(numerator >= longest)
-			{
-				numerator -= longest;
-				x += dx1;
-				y += dy1;
-			}
+	// the lines of the set in the common frame, rotated once per sensor rather than once per pair of lines
+	std::vector<Eigen::Matrix3Xf> normals(num_sensors), directions(num_sensors);
+	std::vector<CNormalIndex> normal_index(num_sensors);
+	const double cell_size = CNormalIndex::cellSize(params.min_normals_dot_prod);
 
-			else
-			{
-				x += dx2;
-				y += dy2;
-			}
+	for(int sensor_id = 0; sensor_id < num_sensors; ++sensor_id)
+	{
+		// the lines of the set are a range of the arrays of each sensor
+		const TLineBatch &lines = m_line_store.getLines(sensor_id);
+		const int obs_id = sync_model->getSyncIndex(set_id, sensor_id);
+		const int begin = m_line_store.begin(sensor_id, obs_id), count = m_line_store.count(sensor_id, obs_id);
+		const Eigen::Matrix3f rotation = sensor_poses[sensor_id].block(0,0,3,3);
+
+		normals[sensor_id].resize(3, count);
+		directions[sensor_id].resize(3, count);
+		for(int k = 0; k < count; ++k)
+		{
+			normals[sensor_id].col(k) = rotation * lines.normals.col(begin + k);
+			directions[sensor_id].col(k) = rotation * lines.directions.col(begin + k);
 		}
+
+		// the lines of every sensor but the first are searched for the lines of the sensors before it
+		if(sensor_id > 0)
+			normal_index[sensor_id].build(normals[sensor_id], cell_size);
 	}
-}
 
-void CCalibFromLines::findPotentialMatches(const std::vector<std::vector<CLine>> &lines, const int &set_id, const TLineMatchingParams &params)
-{
-	for(int i = 0; i < lines.size()-1; ++i)
-		for(int j = i+1; j < lines.size(); ++j)
+	std::vector<int> candidates;
+	for(int i = 0; i < num_sensors-1; ++i)
+		for(int j = i+1; j < num_sensors; ++j)
 		{
-			for(int ii = 0; ii < lines[i].size(); ++ii)
-			{	for(int jj = 0; jj < lines[j].size(); ++jj)
-				{
-					Eigen::Vector3f n_ii = sync_model->getSensorPoses()[i].block(0,0,3,3) * lines[i][ii].normal;
-					Eigen::Vector3f v_ii = sync_model->getSensorPoses()[i].block(0,0,3,3) * lines[i][ii].v;
+			const int count_i = normals[i].cols(), count_j = normals[j].cols();
 
-					Eigen::Vector3f n_jj = sync_model->getSensorPoses()[j].block(0,0,3,3) * lines[j][jj].normal;
-					Eigen::Vector3f v_jj = sync_model->getSensorPoses()[j].block(0,0,3,3) * lines[j][jj].v;
+			for(int ii = 0; ii < count_i; ++ii)
+			{
+				const Eigen::Vector3f n_ii = normals[i].col(ii);
 
-					if((n_ii.dot(n_jj) > params.min_normals_dot_prod) && (n_ii.dot(v_jj) < params.max_line_normal_dot_prod))
+				// only the lines of j with a normal close enough to n_ii can match, in increasing order as the full search
+				normal_index[j].findCandidates(n_ii, params.min_normals_dot_prod, candidates);
+				for(const int jj : candidates)
+				{
+					if((n_ii.dot(normals[j].col(jj)) > params.min_normals_dot_prod) && (n_ii.dot(directions[j].col(jj)) < params.max_line_normal_dot_prod))
 					{
 						std::array<int,3> potential_match{set_id, ii, jj};
 						mmv_line_corresp[i][j].push_back(potential_match);
@@ -267,7 +252,7 @@ void CCalibFromLines::findPotentialMatches(const std::vector<std::vector<CLine>>
 			}
 
 			// for stats printing when no matches exist
-			if((lines[i].size() == 0) || (lines[j].size() == 0))
+			if((count_i == 0) || (count_j == 0))
 			{
 				std::array<int,3> temp_match{-1, -1, -1};
 				mmv_line_corresp[i][j].push_back(temp_match);
@@ -275,12 +260,34 @@ void CCalibFromLines::findPotentialMatches(const std::vector<std::vector<CLine>>
 		}
 }
 
+bool CCalibFromLines::matchLines(const TLineMatchingParams &params, const TStageControl &control)
+{
+	CScopedTimer timer("matchLines");
+
+	clearMatches();
+
+	const int num_sets = sync_model->getRootItem()->childCount();
+
+	for(int set_id = 0; set_id < num_sets; set_id++)
+	{
+		if(control.isCancelled())
+			return false;
+
+		findPotentialMatches(set_id, params);
+		control.reportProgress(static_cast<double>(set_id + 1) / num_sets);
+	}
+
+	m_correspondence_memory.set(estimateCorrespondenceBytes(mmv_line_corresp));
+	CProfiler::instance().addCount("correspondences", countCorrespondences(mmv_line_corresp));
+	return true;
+}
+
 Scalar CCalibFromLines::computeRotationResidual(const std::vector<Eigen::Matrix4f> &sensor_poses)
 {
 
 }
 
-Scalar CCalibFromLines::computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> & sensor_poses, std::string &stats)
+Scalar CCalibFromLines::computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> & sensor_poses, std::string &stats, const TStageControl &control)
 {
 
 }
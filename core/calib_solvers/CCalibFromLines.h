@@ -3,6 +3,7 @@
 #include "CExtrinsicCalib.h"
 #include "TCalibFromLinesParams.h"
 #include "CLine.h"
+#include <CFeatureStore.h>
 
 #include <mrpt/img/TCamera.h>
 #include <opencv2/highgui/highgui.hpp>
@@ -17,11 +18,6 @@ class CCalibFromLines : public CExtrinsicCalib
 {
 public:
 
-	/** The segmented lines, the vector indices to access them are [sensor_id][obs_id][line_id]
-	 * obs_id is with respect to the synchronized model.
-	 */
-	std::map<int,std::vector<std::vector<CLine>>> mvv_lines;
-
 	/** The line correspondences between the different sensors.
 	 * The map indices correspond to the sensor ids, with the list of correspondeces
 	 * stored as a matrix with each row of the form - set_id, line_id1, line_id2.
@@ -32,19 +28,56 @@ public:
 	~CCalibFromLines();
 
 	/**
-	 * \brief Runs Canny-Hough, and Bresenham algorithm on a single image.
+	 * \brief Finds the line segments of a single image with the detector chosen in the parameters (see CLineDetector), and back-projects them.
+	 * The lines are built as a batch: the end points and mean points of all of them are back-projected in one pass, and their rays and
+	 * normals computed as whole rows.
 	 * \param image the input image
-	 * \param lines vector of lines segmented
+	 * \param range the range image the end points of the lines are back-projected with, e.g. utils::rangeView(obs->rangeImage)
+	 * \param lines the lines segmented, replacing those of the batch
+	 */
+	void segmentLines(const cv::Mat &image, const utils::TRangeView &range, const TLineSegmentationParams &params, const mrpt::img::TCamera &camera_params, TLineBatch &lines);
+
+	/**
+	 * \brief Segments the lines of every synchronized observation of every sensor into the line store, in parallel, reading them from the feature cache when stored.
+	 * Each observation is an independent task, writing to its own preallocated slot, and reading the range and intensity
+	 * images of its observation in place, without copying them. The batches of the slots are copied into the store once all are done.
+	 * \param params the parameters for segmentation, with the number of worker threads.
+	 * \param times if not null, filled with the segmentation time in seconds of each observation, indexed as [sensor_id][obs_id].
+	 * \param control receives the fraction of the observations segmented, and is checked for cancellation before each observation.
+	 * \return false if the segmentation was cancelled, or some observations could not be read from the rawlog (see
+	 * getUnreadObservationCount()), in which case the lines of the observations not segmented are left empty.
 	 */
-	void segmentLines(const cv::Mat &image, Eigen::MatrixXf &range, const TLineSegmentationParams &params, const mrpt::img::TCamera &camera_params, std::vector<CLine> &lines);
+	bool extractLines(const TLineSegmentationParams &params, std::vector<std::vector<double>> *times = nullptr,
+	                  const TStageControl &control = TStageControl());
+
+	/** Returns the segmented lines, indexed by sensor and observation, obs_id being with respect to the synchronized model. */
+	const CLineStore &getLineStore() const;
+
+	/** Returns the hash of the inputs of the extraction stage: the parameters that change the lines, and the synchronized observations. */
+	uint64_t extractionInputsHash(const TLineSegmentationParams &params) const;
+
+	/** Returns the hash of the inputs of the matching stage: its parameters, and the sensor poses the lines are compared in. */
+	uint64_t matchingInputsHash(const TLineMatchingParams &params) const;
+
+	/** Removes the line correspondences found so far, before matching again. */
+	void clearMatches();
 
 	/**
-	 * Search for potential line matches between each sensor pair in a syc obs set.
-	 * \param lines lines extracted from sensor observations that belong to the same synchronized set. lines[sensor_id][line_id] gives a line.
+	 * Search for potential line matches between each sensor pair in a syc obs set, reading the lines from the line store.
+	 * The lines are rotated into the common frame once, and each one is compared only with the lines whose normal is close
+	 * enough to its own in a CNormalIndex, which finds the same matches as comparing every pair.
 	 * \param set_id the id of the synchronized set the lines belong to.
 	 * \param params the parameters for line matching.
 	 */
-	void findPotentialMatches(const std::vector<std::vector<CLine>> &lines, const int &set_id, const TLineMatchingParams &params);
+	void findPotentialMatches(const int &set_id, const TLineMatchingParams &params);
+
+	/**
+	 * \brief Searches for line matches in every synchronized set, replacing the correspondences found so far.
+	 * \param params the parameters for line matching.
+	 * \param control receives the fraction of the sets matched, and is checked for cancellation before each set.
+	 * \return false if the matching was cancelled, in which case only the sets matched so far have correspondences.
+	 */
+	bool matchLines(const TLineMatchingParams &params, const TStageControl &control = TStageControl());
 
 	/** Calculate the angular residual error of the correspondences.
 	 * \param sensor_poses relative poses of the sensors
@@ -56,10 +89,22 @@ public:
 	 * \param sensor_poses initial calibration
 	 * \return the residual
 	 */
-    virtual Scalar computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> &sensor_poses, std::string &stats);
+    virtual Scalar computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> &sensor_poses, std::string &stats,
+	                               const TStageControl &control = TStageControl());
 
     /** Compute Calibration (only translation).
         \param sensor_poses initial calibration
         \return the residual */
     virtual Scalar computeTranslation(const std::vector<Eigen::Matrix4f> &sensor_poses, std::string &stats);
+
+private:
+
+	/** Attributes the memory of the lines segmented so far to the memory monitor. */
+	void accountLineMemory();
+
+	/** The segmented lines. */
+	CLineStore m_line_store;
+
+	/** The memory of the line store, as attributed to the memory monitor. */
+	CMemoryAccount m_line_memory{CMemoryMonitor::LINE_FEATURES};
 };
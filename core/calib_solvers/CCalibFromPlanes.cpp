@@ -9,6 +9,10 @@
    +------------------------------------------------------------------------+ */
 
 #include "CCalibFromPlanes.h"
+#include <CThreadPool.h>
+#include <CFeatureCache.h>
+#include <CNormalIndex.h>
+#include <CProfiler.h>
 #include <mrpt/poses/CPose3D.h>
 
 #include <mrpt/pbmap/PbMap.h>
@@ -18,7 +22,8 @@
 #include <pcl/ModelCoefficients.h>
 #include <pcl/features/normal_3d.h>
 #include <pcl/features/integral_image_normal.h>
-#include <pcl/filters/extract_indices.h>
+
+#include <algorithm>
 
 using namespace std;
 
@@ -27,18 +32,28 @@ CCalibFromPlanes::CCalibFromPlanes(CObservationTree *model) :
 {
 	for(int sensor_id1=0; sensor_id1 < sync_model->getNumberOfSensors(); sensor_id1++)
 	{
-		mvv_planes[sensor_id1] = std::vector<std::vector<CPlaneCHull>>();
 		mmv_plane_corresp[sensor_id1] = std::map<int, std::vector<std::array<int,3>>>();
 		for(int sensor_id2 = sensor_id1 + 1; sensor_id2 < sync_model->getNumberOfSensors(); sensor_id2++)
 			mmv_plane_corresp[sensor_id1][sensor_id2] = std::vector<std::array<int,3>>();
 	}
+
+	// every sensor starts with no observations, until the planes are extracted
+	std::vector<std::vector<std::vector<CPlaneCHull>>> no_planes(sync_model->getNumberOfSensors());
+	m_plane_store.assign(no_planes);
 }
 
 void CCalibFromPlanes::segmentPlanes(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const TPlaneSegmentationParams & params, std::vector<CPlaneCHull> & planes)
+{
+	CPlaneSegmentationWorkspace workspace;
+	segmentPlanes(cloud, params, planes, workspace);
+}
+
+void CCalibFromPlanes::segmentPlanes(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const TPlaneSegmentationParams & params, std::vector<CPlaneCHull> & planes,
+                                     CPlaneSegmentationWorkspace &workspace)
 {
 	unsigned min_inliers = params.min_inliers_frac * cloud->size();
 
-	pcl::IntegralImageNormalEstimation<pcl::PointXYZRGBA, pcl::Normal> normal_estimation;
+	pcl::IntegralImageNormalEstimation<pcl::PointXYZRGBA, pcl::Normal> &normal_estimation = workspace.normal_estimation;
 
 	if(params.normal_estimation_method == 0)
 		normal_estimation.setNormalEstimationMethod(normal_estimation.COVARIANCE_MATRIX);
@@ -51,39 +66,48 @@ void CCalibFromPlanes::segmentPlanes(const pcl::PointCloud<pcl::PointXYZRGBA>::P
 	normal_estimation.setMaxDepthChangeFactor(params.max_depth_change_factor);
 	normal_estimation.setNormalSmoothingSize(params.normal_smoothing_size);
 
-	pcl::PointCloud<pcl::Normal>::Ptr normal_cloud(new pcl::PointCloud<pcl::Normal>);
+	// the integral images of the estimator are kept, and only rebuilt in place, for frames of the same resolution
+	pcl::PointCloud<pcl::Normal>::Ptr &normal_cloud = workspace.normal_cloud;
 	normal_estimation.setInputCloud(cloud);
 	normal_estimation.compute(*normal_cloud);
 
-	pcl::OrganizedMultiPlaneSegmentation<pcl::PointXYZRGBA, pcl::Normal, pcl::Label> multi_plane_segmentation;
+	pcl::OrganizedMultiPlaneSegmentation<pcl::PointXYZRGBA, pcl::Normal, pcl::Label> &multi_plane_segmentation = workspace.multi_plane_segmentation;
 	multi_plane_segmentation.setMinInliers(min_inliers);
 	multi_plane_segmentation.setAngularThreshold(params.angle_threshold);
 	multi_plane_segmentation.setDistanceThreshold(params.dist_threshold);
 	multi_plane_segmentation.setInputNormals(normal_cloud);
 	multi_plane_segmentation.setInputCloud(cloud);
 
-	std::vector<pcl::PlanarRegion<pcl::PointXYZRGBA>, Eigen::aligned_allocator<pcl::PlanarRegion<pcl::PointXYZRGBA>>> regions;
-	std::vector<pcl::ModelCoefficients> model_coefficients;
-	std::vector<pcl::PointIndices> inlier_indices;
-	pcl::PointCloud<pcl::Label>::Ptr labels(new pcl::PointCloud<pcl::Label>);
-	std::vector<pcl::PointIndices> label_indices;
-	std::vector<pcl::PointIndices> boundary_indices;
+	// the result vectors are emptied, keeping their capacity
+	std::vector<pcl::PlanarRegion<pcl::PointXYZRGBA>, Eigen::aligned_allocator<pcl::PlanarRegion<pcl::PointXYZRGBA>>> &regions = workspace.regions;
+	std::vector<pcl::ModelCoefficients> &model_coefficients = workspace.model_coefficients;
+	std::vector<pcl::PointIndices> &inlier_indices = workspace.inlier_indices;
+	pcl::PointCloud<pcl::Label>::Ptr &labels = workspace.labels;
+	std::vector<pcl::PointIndices> &label_indices = workspace.label_indices;
+	std::vector<pcl::PointIndices> &boundary_indices = workspace.boundary_indices;
+
+	regions.clear();
+	model_coefficients.clear();
+	inlier_indices.clear();
+	label_indices.clear();
+	boundary_indices.clear();
 
 	multi_plane_segmentation.segmentAndRefine(regions, model_coefficients, inlier_indices, labels, label_indices, boundary_indices);
 
 	// Create a vector with the planes detected in this frame, and calculate their parameters (normal, center, pointclouds, etc.)
 
-	mrpt::pbmap::PbMap pbmap;
+	// the regions that are too curved are left out, so that every plane of the frame is filled in
 	planes.resize(regions.size());
+	size_t num_planes = 0;
 
 	for (size_t i = 0; i < regions.size(); i++)
 	{
-		CPlaneCHull planehull;
-
 		if(regions[i].getCurvature() > params.max_curvature)
 			continue;
 
-		mrpt::pbmap::Plane plane;
+		CPlaneCHull &plane_hull = planes[num_planes++];
+
+		mrpt::pbmap::Plane &plane = workspace.plane;
 		plane.v3center = regions[i].getCentroid ();
 		plane.v3normal = Eigen::Vector3f(model_coefficients[i].values[0], model_coefficients[i].values[1], model_coefficients[i].values[2]);
 		plane.d = model_coefficients[i].values[3];
@@ -97,28 +121,27 @@ void CCalibFromPlanes::segmentPlanes(const pcl::PointCloud<pcl::PointXYZRGBA>::P
 
 		plane.curvature = regions[i].getCurvature();
 
-		// Extract the planar inliers from the input cloud
-		pcl::ExtractIndices<pcl::PointXYZRGBA> extract;
-		extract.setInputCloud ( cloud );
-		extract.setIndices ( boost::make_shared<const pcl::PointIndices> (inlier_indices[i]) );
-		extract.setNegative (false);
-		extract.filter (*plane.planePointCloudPtr);
-		plane.inliers = inlier_indices[i].indices;
+		// the inliers are only kept as indices; the workspace refills inlier_indices on the next frame
+		plane_hull.v3normal = plane.v3normal;
+		plane_hull.v3center = plane.v3center;
+		plane_hull.d = plane.d;
+		plane_hull.curvature = plane.curvature;
+		plane_hull.n_inliers = inlier_indices[i].indices.size();
+		plane_hull.v_inliers = std::move(inlier_indices[i].indices);
 
-		planes[i].v3normal = plane.v3normal;
-		planes[i].v3center = plane.v3center;
-		planes[i].d = plane.d;
-		planes[i].v_inliers = inlier_indices[i].indices;
+		// the segmentation gives no uncertainty of the plane parameters
+		plane_hull.covariance.setZero();
 
 		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr contourPtr(new pcl::PointCloud<pcl::PointXYZRGBA>);
 		contourPtr->points = regions[i].getContour();
-		plane.calcConvexHull(contourPtr, planes[i].v_hull_indices);
+		plane.calcConvexHull(contourPtr, plane_hull.v_hull_indices);
 		plane.computeMassCenterAndArea();
+		plane_hull.area = plane.areaHull;
 
-		planes[i].ConvexHullPtr = contourPtr;
+		plane_hull.ConvexHullPtr = contourPtr;
 
-		for (size_t j = 0; j < planes[i].v_hull_indices.size(); j++)
-			planes[i].v_hull_indices[j] = boundary_indices[i].indices[planes[i].v_hull_indices[j]];
+		for (size_t j = 0; j < plane_hull.v_hull_indices.size(); j++)
+			plane_hull.v_hull_indices[j] = boundary_indices[i].indices[plane_hull.v_hull_indices[j]];
 
 
 //        Check whether this region correspond to the same plane as a previous one (this situation may happen when there exists a small discontinuity in the observation)
@@ -136,6 +159,8 @@ void CCalibFromPlanes::segmentPlanes(const pcl::PointCloud<pcl::PointXYZRGBA>::P
 //            pbmap.vPlanes.push_back(plane);
 	}
 
+	planes.resize(num_planes);
+
 //    planes.resize( pbmap.vPlanes.size() );
 //    for (size_t i = 0; i < pbmap.vPlanes.size (); i++)
 //    {
@@ -147,19 +172,184 @@ void CCalibFromPlanes::segmentPlanes(const pcl::PointCloud<pcl::PointXYZRGBA>::P
 
 }
 
-void CCalibFromPlanes::findPotentialMatches(const std::vector<std::vector<CPlaneCHull>> &planes, const int &set_id, const TPlaneMatchingParams &params)
+bool CCalibFromPlanes::extractPlanes(const TPlaneSegmentationParams &params, std::vector<std::vector<double>> *times, const TStageControl &control)
 {
-	for(int i = 0; i < planes.size()-1; ++i)
-		for(int j = i+1; j < planes.size(); ++j)
-		{	for(int ii = 0; ii < planes[i].size(); ++ii)
+	CScopedTimer timer("extractPlanes");
+
+	const std::vector<std::vector<int>> &sync_indices = sync_model->getSyncIndices();
+	std::vector<std::vector<std::vector<CPlaneCHull>>> sensor_planes(sync_indices.size());
+	std::vector<std::pair<int,int>> tasks;
+
+	// the slots are allocated up front, so that the workers never modify the containers themselves
+	for(size_t i = 0; i < sync_indices.size(); i++)
+	{
+		sensor_planes[i].assign(sync_indices[i].size(), std::vector<CPlaneCHull>());
+
+		for(size_t j = 0; j < sync_indices[i].size(); j++)
+			tasks.push_back(std::make_pair(i, j));
+	}
+
+	// the observations are taken in file order, so that the payloads evicted from the cache are read back forwards through the rawlog
+	std::sort(tasks.begin(), tasks.end(), [&](const std::pair<int,int> &a, const std::pair<int,int> &b)
+	{
+		return sync_indices[a.first][a.second] < sync_indices[b.first][b.second];
+	});
+
+	if(times)
+	{
+		times->resize(sync_indices.size());
+		for(size_t i = 0; i < sync_indices.size(); i++)
+			(*times)[i].assign(sync_indices[i].size(), 0);
+	}
+
+	std::shared_ptr<CFeatureCache> features = sync_model->getFeatureCache();
+	const uint64_t params_hash = CFeatureCache::hashParams(params);
+
+	CThreadPool &pool = threadPool(params.num_threads);
+
+	// one workspace per worker, kept across calls
+	while(m_workspaces.size() < pool.size())
+		m_workspaces.emplace_back(new CPlaneSegmentationWorkspace);
+
+	std::atomic<size_t> tasks_done(0);
+	std::atomic<size_t> unread(0);
+
+	pool.parallelFor(tasks.size(), [&](size_t task, size_t thread_id)
+	{
+		// the remaining tasks are skipped once cancelled, each returning right away
+		if(control.isCancelled())
+			return;
+
+		CPlaneSegmentationWorkspace &workspace = *m_workspaces[thread_id];
+		int sensor_id = tasks[task].first, sync_obs_id = tasks[task].second;
+
+		int record_id = sync_indices[sensor_id][sync_obs_id];
+		std::vector<CPlaneCHull> &planes = sensor_planes[sensor_id][sync_obs_id];
+
+		CScopedTimer task_timer("segmentPlanes");
+
+		// planes segmented with the same parameters in a previous run are read back without projecting the observation
+		if(!features->loadPlanes(sync_model->getObservationInfo(record_id), params_hash, planes))
+		{
+			// segmentation only needs the coordinates of the points, and reuses a cloud already projected for display
+			pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud = sync_model->getCloud(record_id, CCloudCache::COORDINATES);
+			if(!cloud)
 			{
-				for(int jj = 0; jj < planes[j].size(); ++jj)
+				// the features of the observation are missing, which fails the stage once the other observations are done
+				unread++;
+				control.reportProgress(static_cast<double>(++tasks_done) / tasks.size());
+				return;
+			}
+
+			segmentPlanes(cloud, params, planes, workspace);
+
+			features->storePlanes(sync_model->getObservationInfo(record_id), params_hash, planes);
+		}
+
+		double elapsed = task_timer.stop();
+		if(times)
+			(*times)[sensor_id][sync_obs_id] = elapsed;
+
+		CProfiler::instance().addCount("frames");
+		CProfiler::instance().addCount("planes", planes.size());
+
+		control.reportProgress(static_cast<double>(++tasks_done) / tasks.size());
+	});
+
+	// the hulls and inliers are moved to the side table of the store, and the slots released
+	m_plane_store.assign(sensor_planes);
+
+	accountPlaneMemory();
+
+	m_unread_observations = unread;
+	return !control.isCancelled() && m_unread_observations == 0;
+}
+
+const CPlaneStore &CCalibFromPlanes::getPlaneStore() const
+{
+	return m_plane_store;
+}
+
+void CCalibFromPlanes::accountPlaneMemory()
+{
+	m_plane_memory.set(m_plane_store.estimateBytes());
+}
+
+uint64_t CCalibFromPlanes::extractionInputsHash(const TPlaneSegmentationParams &params) const
+{
+	uint64_t hash = hashSyncIndices();
+	utils::hashCombine(hash, CFeatureCache::hashParams(params));
+
+	return hash;
+}
+
+uint64_t CCalibFromPlanes::matchingInputsHash(const TPlaneMatchingParams &params) const
+{
+	uint64_t hash = hashSensorPoses();
+	utils::hashCombine(hash, params.min_normals_dot_prod);
+	utils::hashCombine(hash, params.max_dist_diff);
+
+	return hash;
+}
+
+void CCalibFromPlanes::clearMatches()
+{
+	for(auto &sensor_i : mmv_plane_corresp)
+		for(auto &sensor_j : sensor_i.second)
+			sensor_j.second.clear();
+
+	m_correspondence_memory.set(estimateCorrespondenceBytes(mmv_plane_corresp));
+}
+
+void CCalibFromPlanes::findPotentialMatches(const int &set_id, const TPlaneMatchingParams &params)
+{
+	const int num_sensors = m_plane_store.getNumberOfSensors();
+	const std::vector<Eigen::Matrix4f> sensor_poses = sync_model->getSensorPoses();
+
+	// the planes of the set in the common frame, rotated once per sensor rather than once per pair of planes
+	std::vector<Eigen::Matrix<Scalar,3,Eigen::Dynamic>> normals(num_sensors);
+	std::vector<Eigen::Matrix<Scalar,1,Eigen::Dynamic>> d(num_sensors);
+	std::vector<CNormalIndex> normal_index(num_sensors);
+	const double cell_size = CNormalIndex::cellSize(params.min_normals_dot_prod);
+
+	for(int sensor_id = 0; sensor_id < num_sensors; ++sensor_id)
+	{
+		// the planes of the set are a range of the arrays of each sensor
+		const TPlaneBatch &planes = m_plane_store.getPlanes(sensor_id);
+		const int obs_id = sync_model->getSyncIndex(set_id, sensor_id);
+		const int begin = m_plane_store.begin(sensor_id, obs_id), count = m_plane_store.count(sensor_id, obs_id);
+		const Eigen::Matrix3f rotation = sensor_poses[sensor_id].block(0,0,3,3);
+		const Eigen::Vector3f translation = sensor_poses[sensor_id].block(0,3,3,1);
+
+		normals[sensor_id].resize(3, count);
+		d[sensor_id].resize(count);
+		for(int k = 0; k < count; ++k)
+		{
+			normals[sensor_id].col(k) = rotation * planes.normals.col(begin + k);
+			d[sensor_id][k] = planes.d[begin + k] - translation.dot(normals[sensor_id].col(k));
+		}
+
+		// the planes of every sensor but the first are searched for the planes of the sensors before it
+		if(sensor_id > 0)
+			normal_index[sensor_id].build(normals[sensor_id], cell_size);
+	}
+
+	std::vector<int> candidates;
+	for(int i = 0; i < num_sensors-1; ++i)
+		for(int j = i+1; j < num_sensors; ++j)
+		{
+			const int count_i = normals[i].cols(), count_j = normals[j].cols();
+
+			for(int ii = 0; ii < count_i; ++ii)
+			{
+				const Eigen::Vector3f n_ii = normals[i].col(ii);
+				const Scalar d1 = d[i][ii];
+
+				// only the planes of j with a normal close enough to n_ii can match, in increasing order as the full search
+				normal_index[j].findCandidates(n_ii, params.min_normals_dot_prod, candidates);
+				for(const int jj : candidates)
 				{
-					Eigen::Vector3f n_ii = sync_model->getSensorPoses()[i].block(0,0,3,3) * planes[i][ii].v3normal;
-                    Scalar d1 = planes[i][ii].d - Eigen::Vector3f(sync_model->getSensorPoses()[i].block(0,3,3,1)).dot(n_ii);
-					Eigen::Vector3f n_jj = sync_model->getSensorPoses()[j].block(0,0,3,3) * planes[j][jj].v3normal;
-                    Scalar d2 = planes[j][jj].d - Eigen::Vector3f(sync_model->getSensorPoses()[j].block(0,3,3,1)).dot(n_jj);
-					if((n_ii.dot(n_jj) > params.min_normals_dot_prod) && (d1 - d2 < params.max_dist_diff))
+					if((d1 - d[j][jj] < params.max_dist_diff) && (n_ii.dot(normals[j].col(jj)) > params.min_normals_dot_prod))
 					{
 						std::array<int,3> potential_match{set_id, ii, jj};
 						mmv_plane_corresp[i][j].push_back(potential_match);
@@ -168,7 +358,7 @@ void CCalibFromPlanes::findPotentialMatches(const std::vector<std::vector<CPlane
 			}
 
 			// for stats printing when no matches exist
-			if((planes[i].size() == 0) || (planes[j].size() == 0))
+			if((count_i == 0) || (count_j == 0))
 			{
 				std::array<int,3> temp_match{-1, -1, -1};
 				mmv_plane_corresp[i][j].push_back(temp_match);
@@ -176,6 +366,28 @@ void CCalibFromPlanes::findPotentialMatches(const std::vector<std::vector<CPlane
 		}
 }
 
+bool CCalibFromPlanes::matchPlanes(const TPlaneMatchingParams &params, const TStageControl &control)
+{
+	CScopedTimer timer("matchPlanes");
+
+	clearMatches();
+
+	const int num_sets = sync_model->getRootItem()->childCount();
+
+	for(int set_id = 0; set_id < num_sets; set_id++)
+	{
+		if(control.isCancelled())
+			return false;
+
+		findPotentialMatches(set_id, params);
+		control.reportProgress(static_cast<double>(set_id + 1) / num_sets);
+	}
+
+	m_correspondence_memory.set(estimateCorrespondenceBytes(mmv_plane_corresp));
+	CProfiler::instance().addCount("correspondences", countCorrespondences(mmv_plane_corresp));
+	return true;
+}
+
 Scalar CCalibFromPlanes::computeRotationResidual(const std::vector<Eigen::Matrix4f> & sensor_poses)
 {
 	Scalar sum_squared_error = 0.; // Accumulated squared error for all plane correspondences
@@ -188,15 +400,19 @@ Scalar CCalibFromPlanes::computeRotationResidual(const std::vector<Eigen::Matrix
 		    it_sensor_j != it_sensor_i->second.end(); it_sensor_j++)
 		{
 			size_t sensor_j = it_sensor_j->first;
+			const TPlaneBatch &planes_i = m_plane_store.getPlanes(sensor_i), &planes_j = m_plane_store.getPlanes(sensor_j);
 			std::vector<std::array<int,3>> &correspondences = it_sensor_j->second;
 			for(int i = 0; i < correspondences.size(); i++)
 			{
 				int set_id = correspondences[i][0];
-				int sync_obs1_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_i]);
-				int sync_obs2_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_j]);
+				if(set_id < 0) // placeholder of a pair of sensors without planes in a set
+					continue;
+
+				int sync_obs1_id = sync_model->getSyncIndex(set_id, sensor_i);
+				int sync_obs2_id = sync_model->getSyncIndex(set_id, sensor_j);
 
-				Eigen::Vector3f n_obs_i = mvv_planes[sensor_i][sync_obs1_id][correspondences[i][1]].v3normal;
-				Eigen::Vector3f n_obs_j = mvv_planes[sensor_j][sync_obs2_id][correspondences[i][2]].v3normal;
+				Eigen::Vector3f n_obs_i = planes_i.normals.col(m_plane_store.index(sensor_i, sync_obs1_id, correspondences[i][1]));
+				Eigen::Vector3f n_obs_j = planes_j.normals.col(m_plane_store.index(sensor_j, sync_obs2_id, correspondences[i][2]));
 
 				Eigen::Vector3f n_i = sensor_poses[sensor_i].block(0,0,3,3) * n_obs_i;
 				Eigen::Vector3f n_j = sensor_poses[sensor_j].block(0,0,3,3) * n_obs_j;
@@ -210,8 +426,10 @@ Scalar CCalibFromPlanes::computeRotationResidual(const std::vector<Eigen::Matrix
 	return sum_squared_error;
 }
 
-Scalar CCalibFromPlanes::computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> & sensor_poses, std::string &stats)
+Scalar CCalibFromPlanes::computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> & sensor_poses, std::string &stats, const TStageControl &control)
 {
+	CScopedTimer timer("computeRotation");
+
 	const int num_sensors = sensor_poses.size();
 	const int dof = 3 * (num_sensors - 1);
 	Eigen::VectorXf update_vector(dof);
@@ -226,8 +444,9 @@ Scalar CCalibFromPlanes::computeRotation(const TSolverParams &params, const std:
 	int it = 0;
 
     init_error = computeRotationResidual(sensor_poses);
+	new_error = init_error;
 
-	while(it < params.max_iters && increment > params.min_update && diff_error > params.converge_error)
+	while(it < params.max_iters && increment > params.min_update && diff_error > params.converge_error && !control.isCancelled())
 	{
 		// Calculate the hessian and the gradient
 		hessian = Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic>::Zero(dof, dof); // Hessian of the rotation of the decoupled system
@@ -243,19 +462,22 @@ Scalar CCalibFromPlanes::computeRotation(const TSolverParams &params, const std:
 			    it_sensor_j != it_sensor_i->second.end(); it_sensor_j++)
 			{
 				size_t sensor_j = it_sensor_j->first;
+				const TPlaneBatch &planes_i = m_plane_store.getPlanes(sensor_i), &planes_j = m_plane_store.getPlanes(sensor_j);
 				int pos_sensor_i = 3 * (sensor_i - 1);
 				int pos_sensor_j = 3 * (sensor_j - 1);
 
 				std::vector<std::array<int,3>> &correspondences = it_sensor_j->second;
 				for(int i = 0; i < correspondences.size(); i++)
 				{
-					size_t set_id = correspondences[i][0];
+					int set_id = correspondences[i][0];
+					if(set_id < 0) // placeholder of a pair of sensors without planes in a set
+						continue;
 
-					int sync_obs1_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_i]);
-					int sync_obs2_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_j]);
+					int sync_obs1_id = sync_model->getSyncIndex(set_id, sensor_i);
+					int sync_obs2_id = sync_model->getSyncIndex(set_id, sensor_j);
 
-					Eigen::Vector3f n_obs_i = mvv_planes[sensor_i][sync_obs1_id][correspondences[i][1]].v3normal;
-					Eigen::Vector3f n_obs_j = mvv_planes[sensor_j][sync_obs2_id][correspondences[i][2]].v3normal;
+					Eigen::Vector3f n_obs_i = planes_i.normals.col(m_plane_store.index(sensor_i, sync_obs1_id, correspondences[i][1]));
+					Eigen::Vector3f n_obs_j = planes_j.normals.col(m_plane_store.index(sensor_j, sync_obs2_id, correspondences[i][2]));
 
 					Eigen::Vector3f n_i = sensor_poses[sensor_i].block(0,0,3,3) * n_obs_i;
 					Eigen::Vector3f n_j = sensor_poses[sensor_j].block(0,0,3,3) * n_obs_j;
@@ -334,6 +556,8 @@ Scalar CCalibFromPlanes::computeRotation(const TSolverParams &params, const std:
 		increment = update_vector.dot(update_vector);
 		diff_error = error - new_error;
 		++it;
+		CProfiler::instance().addCount("solver_iterations");
+		control.reportProgress(static_cast<double>(it) / params.max_iters);
 		//cout << "Iteration " << it << " increment " << increment << " diff_error " << diff_error << endl;
 	}
 
@@ -347,7 +571,15 @@ Scalar CCalibFromPlanes::computeRotation(const TSolverParams &params, const std:
 	stats += "\n\nEstimated rotation: \n";
 	stats += stream.str();
 
+	m_calibration.resize(num_sensors);
+	for(int sensor_id = 0; sensor_id < num_sensors; sensor_id++)
+		m_calibration[sensor_id] = estimated_poses[sensor_id];
+
+	accountSolverMemory();
+
 	//std::cout << "ErrorCalibRotation " << accum_error2/numPlaneCorresp << " " << av_angle_error/numPlaneCorresp << std::endl;
+
+	return new_error;
 }
 
 Scalar CCalibFromPlanes::computeTranslation(const std::vector<Eigen::Matrix4f> & sensor_poses, std::string &stats)
@@ -366,25 +598,31 @@ Scalar CCalibFromPlanes::computeTranslation(const std::vector<Eigen::Matrix4f> &
             it_sensor_j != it_sensor_i->second.end(); it_sensor_j++)
         {
             size_t sensor_j = it_sensor_j->first;
+            const TPlaneBatch &planes_i = m_plane_store.getPlanes(sensor_i), &planes_j = m_plane_store.getPlanes(sensor_j);
             int pos_sensor_i = 3 * (sensor_i - 1);
             int pos_sensor_j = 3 * (sensor_j - 1);
 
             std::vector<std::array<int,3>> &correspondences = it_sensor_j->second;
             for(int i = 0; i < correspondences.size(); i++)
             {
-                size_t set_id = correspondences[i][0];
+                int set_id = correspondences[i][0];
+                if(set_id < 0) // placeholder of a pair of sensors without planes in a set
+                    continue;
+
+                int sync_obs1_id = sync_model->getSyncIndex(set_id, sensor_i);
+                int sync_obs2_id = sync_model->getSyncIndex(set_id, sensor_j);
 
-                int sync_obs1_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_i]);
-                int sync_obs2_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_j]);
+                size_t plane_i = m_plane_store.index(sensor_i, sync_obs1_id, correspondences[i][1]);
+                size_t plane_j = m_plane_store.index(sensor_j, sync_obs2_id, correspondences[i][2]);
 
-                Eigen::Vector3f n_obs_i = mvv_planes[sensor_i][sync_obs1_id][correspondences[i][1]].v3normal;
-                Eigen::Vector3f n_obs_j = mvv_planes[sensor_j][sync_obs2_id][correspondences[i][2]].v3normal;
+                Eigen::Vector3f n_obs_i = planes_i.normals.col(plane_i);
+                Eigen::Vector3f n_obs_j = planes_j.normals.col(plane_j);
 
                 Eigen::Vector3f n_i = sensor_poses[sensor_i].block(0,0,3,3) * n_obs_i;
                 Eigen::Vector3f n_j = sensor_poses[sensor_j].block(0,0,3,3) * n_obs_j;
 
-                float trans_error = mvv_planes[sensor_i][sync_obs1_id][correspondences[i][1]].d - mvv_planes[sensor_j][sync_obs2_id][correspondences[i][2]].d; // Consider all zero initial translations
-                //trans_error = (mvv_planes[sensor_i][sync_obs1_id][correspondences[i][1]].d - Eigen::Vector3fsensor_poses[sensor_i].block(0,3,3,1)).dot(n_i) - (mvv_planes[sensor_j][sync_obs2_id][correspondences[i][2]].d - Eigen::Vector3f(sensor_poses[sensor_j].block(0,3,3,1)).dot(n_j));
+                float trans_error = planes_i.d[plane_i] - planes_j.d[plane_j]; // Consider all zero initial translations
+                //trans_error = (planes_i.d[plane_i] - Eigen::Vector3fsensor_poses[sensor_i].block(0,3,3,1)).dot(n_i) - (planes_j.d[plane_j] - Eigen::Vector3f(sensor_poses[sensor_j].block(0,3,3,1)).dot(n_j));
                 accum_error2 += trans_error * trans_error;
 
                 jacobian_trans_i = n_i * n_i.transpose();
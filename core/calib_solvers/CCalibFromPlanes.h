@@ -10,10 +10,13 @@
 
 #include "CExtrinsicCalib.h"
 #include "TCalibFromPlanesParams.h"
+#include "CPlaneSegmentationWorkspace.h"
 #include <CPlane.h>
+#include <CFeatureStore.h>
 //#include <mrpt/pbmap/PbMap.h>
 //#include <mrpt/pbmap/Miscellaneous.h>
 #include <map>
+#include <memory>
 
 /**
  * \brief Exploit 3D plane observations from a set of sensors to perform extrinsic calibration.
@@ -23,11 +26,6 @@ class CCalibFromPlanes : public CExtrinsicCalib
 {
   public:
 
-	/** The segmented planes, the vector indices to access them are [sensor_id][obs_id][plane_id]
-	 * obs_id is with respect to the synchronized model.
-	 */
-	std::map<int,std::vector<std::vector<CPlaneCHull>>> mvv_planes;
-
 	/** The plane correspondences between the different sensors.
 	 * The map indices correspond to the sensor ids, with the list of correspondeces
 	 * stored as a matrix with each row of the form - set_id, plane_id1, plane_id2.
@@ -48,17 +46,60 @@ class CCalibFromPlanes : public CExtrinsicCalib
 	 * \brief Runs pcl's organized multi-plane segmentation over the given cloud.
 	 * @param cloud the input cloud.
 	 * @param params the parameters for segmentation.
-	 * @param planes the segmented planes.
+	 * @param planes the segmented planes, leaving out the regions more curved than the maximum.
 	 */
 	void segmentPlanes(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const TPlaneSegmentationParams &params, std::vector<CPlaneCHull> &planes);
 
 	/**
-	 * Search for potential plane matches between each sensor pair in a sync obs set.
-	 * \param planes planes extracted from sensor observations that belong to the same synchronized set. planes[sensor_id][plane_id] gives a plane.
+	 * \brief Runs pcl's organized multi-plane segmentation over the given cloud, reusing the buffers of a workspace.
+	 * @param cloud the input cloud.
+	 * @param params the parameters for segmentation.
+	 * @param planes the segmented planes, leaving out the regions more curved than the maximum.
+	 * @param workspace the workspace of the calling thread.
+	 */
+	void segmentPlanes(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const TPlaneSegmentationParams &params, std::vector<CPlaneCHull> &planes,
+	                   CPlaneSegmentationWorkspace &workspace);
+
+	/**
+	 * \brief Segments the planes of every synchronized observation of every sensor, in parallel, into the plane store.
+	 * Each observation is an independent task, writing to its own preallocated slot, and the slots are moved into the store once all are done.
+	 * @param params the parameters for segmentation, with the number of worker threads.
+	 * @param times if not null, filled with the segmentation time in seconds of each observation, indexed as [sensor_id][obs_id].
+	 * @param control receives the fraction of the observations segmented, and is checked for cancellation before each observation.
+	 * @return false if the segmentation was cancelled, or some observations could not be read from the rawlog (see
+	 * getUnreadObservationCount()), in which case the planes of the observations not segmented are left empty.
+	 */
+	bool extractPlanes(const TPlaneSegmentationParams &params, std::vector<std::vector<double>> *times = nullptr,
+	                   const TStageControl &control = TStageControl());
+
+	/** Returns the segmented planes, indexed by sensor and observation, obs_id being with respect to the synchronized model. */
+	const CPlaneStore &getPlaneStore() const;
+
+	/** Returns the hash of the inputs of the extraction stage: the parameters that change the planes, and the synchronized observations. */
+	uint64_t extractionInputsHash(const TPlaneSegmentationParams &params) const;
+
+	/** Returns the hash of the inputs of the matching stage: its parameters, and the sensor poses the planes are compared in. */
+	uint64_t matchingInputsHash(const TPlaneMatchingParams &params) const;
+
+	/** Removes the plane correspondences found so far, before matching again. */
+	void clearMatches();
+
+	/**
+	 * Search for potential plane matches between each sensor pair in a sync obs set, reading the planes from the plane store.
+	 * The planes are rotated into the common frame once, and each one is compared only with the planes whose normal is close
+	 * enough to its own in a CNormalIndex, which finds the same matches as comparing every pair.
 	 * \param set_id the id of the synchronized set the planes belong to.
 	 * \param params the parameters for plane matching.
 	 */
-	void findPotentialMatches(const std::vector<std::vector<CPlaneCHull>> &planes, const int &set_id, const TPlaneMatchingParams &params);
+	void findPotentialMatches(const int &set_id, const TPlaneMatchingParams &params);
+
+	/**
+	 * \brief Searches for plane matches in every synchronized set, replacing the correspondences found so far.
+	 * \param params the parameters for plane matching.
+	 * \param control receives the fraction of the sets matched, and is checked for cancellation before each set.
+	 * \return false if the matching was cancelled, in which case only the sets matched so far have correspondences.
+	 */
+	bool matchPlanes(const TPlaneMatchingParams &params, const TStageControl &control = TStageControl());
 
     /** Calculate the residual error of the correspondences.
         \param sensor_poses relative poses of the sensors
@@ -81,14 +122,28 @@ class CCalibFromPlanes : public CExtrinsicCalib
 //        \return the residual */
 //    virtual Scalar computeCalibration(const std::vector<mrpt::math::CMatrixFixedNumeric<Scalar,4,4> > & sensor_poses);
 
-    /** Compute Calibration (only rotation).
+    /** Compute Calibration (only rotation). The estimated poses are stored in m_calibration.
         \param sensor_poses initial calibration
         \return the residual */
-    virtual Scalar computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> &sensor_poses, std::string &stats);
+    virtual Scalar computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> &sensor_poses, std::string &stats,
+	                               const TStageControl &control = TStageControl());
 
     /** Compute Calibration (only translation).
         \param sensor_poses initial calibration
         \return the residual */
     virtual Scalar computeTranslation(const std::vector<Eigen::Matrix4f> &sensor_poses, std::string &stats);
 
+  private:
+
+	/** Attributes the memory of the planes segmented so far to the memory monitor. */
+	void accountPlaneMemory();
+
+	/** The segmented planes. */
+	CPlaneStore m_plane_store;
+
+	/** The memory of the plane store, as attributed to the memory monitor. */
+	CMemoryAccount m_plane_memory{CMemoryMonitor::PLANE_FEATURES};
+
+	/** The segmentation workspace of each worker thread of extractPlanes(), kept across calls. */
+	std::vector<std::unique_ptr<CPlaneSegmentationWorkspace>> m_workspaces;
 };
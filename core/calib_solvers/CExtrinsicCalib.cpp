@@ -19,3 +19,83 @@ Scalar CExtrinsicCalib::computeCalibration(const std::vector<Eigen::Matrix4f> &
 //    computeRotation(sensor_poses, stats);
 //    computeTranslation(sensor_poses, stats);
 }
+
+uint64_t CExtrinsicCalib::solverInputsHash(const TSolverParams &params) const
+{
+	uint64_t hash = hashSensorPoses();
+	utils::hashCombine(hash, params.max_iters);
+	utils::hashCombine(hash, params.min_update);
+	utils::hashCombine(hash, params.converge_error);
+
+	return hash;
+}
+
+uint64_t CExtrinsicCalib::hashSyncIndices() const
+{
+	uint64_t hash = utils::hash_seed;
+	for(const std::vector<int> &indices : sync_model->getSyncIndices())
+	{
+		utils::hashCombine(hash, static_cast<uint64_t>(indices.size()));
+		for(const int &index : indices)
+			utils::hashCombine(hash, index);
+	}
+
+	return hash;
+}
+
+uint64_t CExtrinsicCalib::hashSensorPoses() const
+{
+	uint64_t hash = utils::hash_seed;
+	for(const Eigen::Matrix4f &pose : sync_model->getSensorPoses())
+		for(int i = 0; i < pose.size(); i++)
+			utils::hashCombine(hash, pose(i));
+
+	return hash;
+}
+
+size_t CExtrinsicCalib::countCorrespondences(const std::map<int,std::map<int,std::vector<std::array<int,3>>>> &correspondences)
+{
+	size_t count = 0;
+	for(const auto &sensor_i : correspondences)
+		for(const auto &sensor_j : sensor_i.second)
+			for(const std::array<int,3> &correspondence : sensor_j.second)
+				if(correspondence[0] >= 0)
+					count++;
+
+	return count;
+}
+
+size_t CExtrinsicCalib::estimateCorrespondenceBytes(const std::map<int,std::map<int,std::vector<std::array<int,3>>>> &correspondences)
+{
+	size_t bytes = 0;
+	for(const auto &sensor_i : correspondences)
+	{
+		bytes += sizeof(sensor_i);
+		for(const auto &sensor_j : sensor_i.second)
+			bytes += sizeof(sensor_j) + sensor_j.second.capacity() * sizeof(std::array<int,3>);
+	}
+
+	return bytes;
+}
+
+void CExtrinsicCalib::accountSolverMemory()
+{
+	size_t bytes = (hessian.size() + gradient.size()) * sizeof(Scalar);
+	bytes += m_calibration.capacity() * sizeof(mrpt::math::CMatrixFixedNumeric<Scalar,4,4>);
+	bytes += m_calib_uncertainty.capacity() * sizeof(mrpt::math::CMatrixFixedNumeric<Scalar,6,6>);
+
+	m_solver_memory.set(bytes);
+}
+
+CThreadPool &CExtrinsicCalib::threadPool(const int &num_threads)
+{
+	if(!m_thread_pool || num_threads != m_thread_pool_request)
+	{
+		// the previous workers are joined before the new ones start
+		m_thread_pool.reset();
+		m_thread_pool.reset(new CThreadPool(std::max(num_threads, 0)));
+		m_thread_pool_request = num_threads;
+	}
+
+	return *m_thread_pool;
+}
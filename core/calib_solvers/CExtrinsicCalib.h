@@ -10,8 +10,15 @@
 
 #include "TExtrinsicCalibParams.h"
 #include <CObservationTree.h>
+#include <CStageTracker.h>
+#include <CMemoryMonitor.h>
+#include <CThreadPool.h>
 #include <mrpt/math/CMatrixFixedNumeric.h>
 
+#include <array>
+#include <map>
+#include <memory>
+
 typedef float Scalar;
 
 /*! Generate a skew-symmetric matrix from a 3D vector */
@@ -39,7 +46,7 @@ class CExtrinsicCalib
 {
 public:
     /** Default constructor. */
-	CExtrinsicCalib(CObservationTree *model)
+	CExtrinsicCalib(CObservationTree *model) : m_stages(NUM_CALIBRATION_STAGES)
 	{
 		sync_model = model;
 	}
@@ -80,8 +87,10 @@ public:
     /** Compute Calibration (only rotation).
 	 * \params params the parameters related to the least-squares solver
 	 * \param sensor_poses the initial calibration
+	 * \param control checked for cancellation between the iterations of the solver
 	 * \return the residual */
-    virtual Scalar computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> & sensor_poses, std::string &stats) = 0;
+    virtual Scalar computeRotation(const TSolverParams &params, const std::vector<Eigen::Matrix4f> & sensor_poses, std::string &stats,
+	                               const TStageControl &control = TStageControl()) = 0;
 
     /** Compute Calibration (only translation).
         \param sensor_poses initial calibration
@@ -117,4 +126,51 @@ public:
 
     /** Gradient of the of the least-squares problem */
     Eigen::Matrix<Scalar,Eigen::Dynamic,1> gradient;
+
+    /** Returns the hash of the inputs of the solver stage: its parameters, and the initial sensor poses. */
+    uint64_t solverInputsHash(const TSolverParams &params) const;
+
+    /** Returns the number of observations the last feature extraction could not read from the rawlog, whose features are missing. */
+    size_t getUnreadObservationCount() const
+    {
+        return m_unread_observations;
+    }
+
+protected:
+
+    /** Returns the hash of the synchronized observations the features are extracted from. */
+    uint64_t hashSyncIndices() const;
+
+    /** Returns the hash of the current sensor poses of the synchronized model. */
+    uint64_t hashSensorPoses() const;
+
+    /** Returns the number of correspondences between all the pairs of sensors, leaving out the placeholders of the sets without features. */
+    static size_t countCorrespondences(const std::map<int,std::map<int,std::vector<std::array<int,3>>>> &correspondences);
+
+    /** Returns the memory taken by the correspondences between all the pairs of sensors, in bytes. */
+    static size_t estimateCorrespondenceBytes(const std::map<int,std::map<int,std::vector<std::array<int,3>>>> &correspondences);
+
+    /** Attributes the memory of the hessian, the gradient and the estimated calibration to the solver, once solved. */
+    void accountSolverMemory();
+
+    /**
+     * \brief Returns the worker threads the stages of the calibration run their tasks on, started on the first call and kept
+     * across stages and runs, so that a stage does not start and join its own threads.
+     * \param num_threads the number of threads, 0 for the number of hardware threads. The pool is started again if it changes.
+     */
+    CThreadPool &threadPool(const int &num_threads);
+
+    /** Tracks which calibration stages are up to date with their inputs, indexed by CalibrationStage. */
+    CStageTracker m_stages;
+
+    /** The number of observations the last feature extraction could not read from the rawlog. */
+    size_t m_unread_observations = 0;
+
+    /** The worker threads of the stages, and the number of threads they were started with. */
+    std::unique_ptr<CThreadPool> m_thread_pool;
+    int m_thread_pool_request = 0;
+
+    /** The memory of the correspondences found, and of the matrices of the solver, as attributed to the memory monitor. */
+    CMemoryAccount m_correspondence_memory{CMemoryMonitor::CORRESPONDENCES};
+    CMemoryAccount m_solver_memory{CMemoryMonitor::SOLVER_MATRICES};
 };
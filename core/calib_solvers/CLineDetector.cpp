@@ -0,0 +1,467 @@
+#include "CLineDetector.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	/** The running sums of a total least squares fit of a line to pixels, to add and remove pixels from the fit in constant time. */
+	struct TLineFit
+	{
+		double n = 0, sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+
+		void add(const Eigen::Vector2i &point)
+		{
+			n++;
+			sx += point[0];
+			sy += point[1];
+			sxx += static_cast<double>(point[0]) * point[0];
+			syy += static_cast<double>(point[1]) * point[1];
+			sxy += static_cast<double>(point[0]) * point[1];
+		}
+
+		/** Removes a pixel added before. The sums of integer coordinates are exact, so the fit does not drift. */
+		void remove(const Eigen::Vector2i &point)
+		{
+			n--;
+			sx -= point[0];
+			sy -= point[1];
+			sxx -= static_cast<double>(point[0]) * point[0];
+			syy -= static_cast<double>(point[1]) * point[1];
+			sxy -= static_cast<double>(point[0]) * point[1];
+		}
+
+		Eigen::Vector2d mean() const
+		{
+			return Eigen::Vector2d(sx / n, sy / n);
+		}
+
+		/** The direction of the line, the main axis of the covariance of the pixels. */
+		Eigen::Vector2d direction() const
+		{
+			double cxx = sxx / n - (sx / n) * (sx / n);
+			double cyy = syy / n - (sy / n) * (sy / n);
+			double cxy = sxy / n - (sx / n) * (sy / n);
+			double angle = 0.5 * std::atan2(2 * cxy, cxx - cyy);
+
+			return Eigen::Vector2d(std::cos(angle), std::sin(angle));
+		}
+
+		/** The distance of a pixel to the line, given its direction. */
+		double distance(const Eigen::Vector2i &point, const Eigen::Vector2d &direction) const
+		{
+			Eigen::Vector2d offset = point.cast<double>() - mean();
+			return std::abs(direction[0] * offset[1] - direction[1] * offset[0]);
+		}
+
+		/** The projection of a pixel on the line, rounded to a pixel of an image of a size. */
+		Eigen::Vector2i project(const Eigen::Vector2i &point, const Eigen::Vector2d &direction, const cv::Size &size) const
+		{
+			Eigen::Vector2d projection = mean() + direction * direction.dot(point.cast<double>() - mean());
+			return Eigen::Vector2i(std::min(std::max(static_cast<int>(std::lround(projection[0])), 0), size.width - 1),
+			                       std::min(std::max(static_cast<int>(std::lround(projection[1])), 0), size.height - 1));
+		}
+	};
+
+	/** The neighbours of a pixel, the 4-connected first, so that the chains follow the edges without cutting their corners. */
+	const int neighbour_offsets[8][2] = {{1,0}, {0,1}, {-1,0}, {0,-1}, {1,1}, {-1,1}, {-1,-1}, {1,-1}};
+
+	/**
+	 * Follows a chain of edge pixels from a pixel, clearing the pixels walked so that each pixel belongs to a single chain.
+	 * \param chain the pixels walked, appended in order, without the starting one.
+	 */
+	void followChain(cv::Mat &edges, Eigen::Vector2i point, std::vector<Eigen::Vector2i> &chain)
+	{
+		bool found = true;
+		while(found)
+		{
+			found = false;
+			for(int k = 0; k < 8 && !found; k++)
+			{
+				int x = point[0] + neighbour_offsets[k][0], y = point[1] + neighbour_offsets[k][1];
+				if(x < 0 || y < 0 || x >= edges.cols || y >= edges.rows || edges.at<uchar>(y, x) == 0)
+					continue;
+
+				edges.at<uchar>(y, x) = 0;
+				point = Eigen::Vector2i(x, y);
+				chain.push_back(point);
+				found = true;
+			}
+		}
+	}
+}
+
+CLineDetector::~CLineDetector(){}
+
+std::unique_ptr<CLineDetector> CLineDetector::create(const int &type)
+{
+	switch(type)
+	{
+	case PROBABILISTIC_HOUGH:
+		return std::unique_ptr<CLineDetector>(new CProbabilisticHoughLineDetector());
+	case EDGE_CHAINS:
+		return std::unique_ptr<CLineDetector>(new CEdgeChainLineDetector());
+	default:
+		return std::unique_ptr<CLineDetector>(new CHoughLineDetector());
+	}
+}
+
+const char *CLineDetector::typeName(const int &type)
+{
+	switch(type)
+	{
+	case PROBABILISTIC_HOUGH:
+		return "PROBABILISTIC_HOUGH";
+	case EDGE_CHAINS:
+		return "EDGE_CHAINS";
+	default:
+		return "HOUGH";
+	}
+}
+
+int CLineDetector::typeFromName(const std::string &name)
+{
+	for(int type = 0; type < NUM_TYPES; type++)
+		if(name == typeName(type))
+			return type;
+
+	return HOUGH;
+}
+
+void CLineDetector::detectEdges(const cv::Mat &image, const TLineSegmentationParams &params, cv::Mat &edges)
+{
+	cv::Canny(image, edges, params.clow_threshold, params.clow_threshold * params.chigh_to_low_ratio, params.ckernel_size);
+}
+
+TLineSegment CLineDetector::segmentFromEndPoints(const Eigen::Vector2i &end_point1, const Eigen::Vector2i &end_point2)
+{
+	TLineSegment segment;
+	segment.end_points[0] = end_point1;
+	segment.end_points[1] = end_point2;
+
+	// the normal of the line, turned to point away from the origin so that rho is non-negative, as the Hough lines of the reference
+	Eigen::Vector2d direction = (end_point2 - end_point1).cast<double>().normalized();
+	Eigen::Vector2d normal(-direction[1], direction[0]);
+	double rho = normal.dot(end_point1.cast<double>());
+	if(rho < 0)
+	{
+		normal = -normal;
+		rho = -rho;
+	}
+
+	segment.rho = rho;
+	segment.theta = std::atan2(normal[1], normal[0]);
+	segment.m = 0;
+	segment.c = 0;
+
+	if(std::abs(normal[1]) > 0.00001)
+	{
+		segment.m = -normal[0] / normal[1];
+		segment.c = rho / normal[1];
+	}
+
+	return segment;
+}
+
+void CHoughLineDetector::detect(const cv::Mat &image, const TLineSegmentationParams &params, std::vector<TLineSegment> &segments) const
+{
+	cv::Mat canny_image;
+
+	detectEdges(image, params, canny_image);
+
+	std::vector<cv::Vec2f> hlines;
+
+	cv::HoughLines(canny_image, hlines, 1, CV_PI, params.hthreshold);
+
+
+	double rho, theta;
+	double cos_theta, sin_theta;
+	double m = 0, c = 0, c_max;
+	TLineSegment line;
+
+	int x, y, xf, yf;
+
+	for(size_t n(0); n < hlines.size(); n++)
+	{
+		if(hlines[n][0] < 0)
+		{
+			rho = -hlines[n][0];
+			theta = hlines[n][1] - CV_PI;
+		}
+
+		else
+		{
+			rho = hlines[n][0];
+			theta = hlines[n][1];
+		}
+
+		if (rho == 0 && theta == 0)
+			continue;
+
+		if (fabs(theta) < 0.00001)
+		{
+			x = xf = static_cast<int>(rho + 0.5);
+			y = 0;
+			yf = canny_image.rows - 1;
+		}
+
+		else
+		{
+			cos_theta = cos(theta);
+			sin_theta = sin(theta);
+			m = -cos_theta / sin_theta;
+			c = rho * (sin_theta - m * cos_theta);
+
+			if (c >= 0)
+			{
+				if (c < canny_image.rows)
+				{
+					x = 0;
+					y = static_cast<int>(c);
+				}
+				else
+				{
+					y = canny_image.rows - 1;
+					x = static_cast<int>((y - c) / m);
+				}
+			}
+
+			else
+			{
+				x = static_cast<int>(-c / m);
+				y = 0;
+			}
+
+			c_max = m * (canny_image.cols - 1) + c;
+			if (c_max >= 0)
+			{
+				if (c_max < canny_image.rows)
+				{
+					xf = canny_image.cols - 1;
+					yf = static_cast<int>(c_max);
+				}
+
+				else
+				{
+					yf = canny_image.rows - 1;
+					xf = static_cast<int>((yf - c) / m);
+				}
+			}
+			else
+			{
+				xf = static_cast<int>(-c / m);
+				yf = 0;
+			}
+		}
+
+		line.rho = rho;
+		line.theta = theta;
+		line.m = m;
+		line.c = c;
+
+		// Bresenham algorithm
+
+		bool onSegment = false;
+		int memory;
+		int memoryX = 0, memoryY = 0;
+		int xPrev = 0, yPrev = 0;
+		size_t nbPixels = 0;
+
+		int w = xf - x;
+		int h = yf - y;
+		int dx1, dy1, dx2, dy2 = 0;
+
+		int longest, shortest;
+		int numerator;
+
+		if (w < 0)
+		{
+			longest = -w;
+			dx1 = -1;
+			dx2 = -1;
+		}
+		else
+		{
+			longest = w;
+			dx1 = 1;
+			dx2 = 1;
+		}
+
+		if (h < 0)
+		{
+			shortest = -h;
+			dy1 = -1;
+		}
+
+		else
+		{
+			shortest = h;
+			dy1 = 1;
+		}
+
+		if (longest <= shortest)
+		{
+			memory = longest;
+			longest = shortest;
+			shortest = memory;
+			dx2 = 0;
+			if (h < 0)
+			{
+				dy2 = -1;
+			}
+
+			else
+			{
+				dy2 = 1;
+			}
+		}
+
+		numerator = longest / 2;
+
+		for (int i(0); i <= longest; ++i)
+		{
+			if (onSegment)
+			{
+				if (canny_image.at<char>(y, x) == 0 || i == longest)
+				{
+					onSegment = false;
+					if (nbPixels >= params.hthreshold)
+					{
+						line.end_points[0] = Eigen::Vector2i(memoryX, memoryY);
+						line.end_points[1] = Eigen::Vector2i(xPrev, yPrev);
+						segments.push_back(line);
+					}
+				}
+
+				else
+				{
+					++nbPixels;
+				}
+			}
+
+			else if (canny_image.at<char>(y, x) != 0)
+			{
+				onSegment = true;
+				nbPixels = 0;
+				memoryX = x;
+				memoryY = y;
+			}
+
+			xPrev = x;
+			yPrev = y;
+
+			numerator += shortest;
+
+			if(numerator >= longest)
+			{
+				numerator -= longest;
+				x += dx1;
+				y += dy1;
+			}
+
+			else
+			{
+				x += dx2;
+				y += dy2;
+			}
+		}
+	}
+}
+
+void CProbabilisticHoughLineDetector::detect(const cv::Mat &image, const TLineSegmentationParams &params, std::vector<TLineSegment> &segments) const
+{
+	cv::Mat edges;
+	detectEdges(image, params, edges);
+
+	std::vector<cv::Vec4i> hsegments;
+	cv::HoughLinesP(edges, hsegments, 1, CV_PI / 180, params.hthreshold, params.min_line_length, params.max_line_gap);
+
+	for(size_t n = 0; n < hsegments.size(); n++)
+	{
+		Eigen::Vector2i end_point1(hsegments[n][0], hsegments[n][1]), end_point2(hsegments[n][2], hsegments[n][3]);
+		if(end_point1 != end_point2)
+			segments.push_back(segmentFromEndPoints(end_point1, end_point2));
+	}
+}
+
+void CEdgeChainLineDetector::detect(const cv::Mat &image, const TLineSegmentationParams &params, std::vector<TLineSegment> &segments) const
+{
+	cv::Mat edges;
+	detectEdges(image, params, edges);
+
+	std::vector<Eigen::Vector2i> chain, backward_chain;
+
+	// every edge pixel is visited once, as the chains clear the pixels they walk
+	for(int y = 0; y < edges.rows; y++)
+	{
+		for(int x = 0; x < edges.cols; x++)
+		{
+			if(edges.at<uchar>(y, x) == 0)
+				continue;
+
+			edges.at<uchar>(y, x) = 0;
+
+			// the chain is followed both ways from the first pixel found, which may lie in the middle of it
+			chain.clear();
+			backward_chain.clear();
+			followChain(edges, Eigen::Vector2i(x, y), backward_chain);
+			chain.assign(backward_chain.rbegin(), backward_chain.rend());
+			chain.push_back(Eigen::Vector2i(x, y));
+			followChain(edges, Eigen::Vector2i(x, y), chain);
+
+			fitSegments(chain, params, edges.size(), segments);
+		}
+	}
+}
+
+void CEdgeChainLineDetector::fitSegments(const std::vector<Eigen::Vector2i> &chain, const TLineSegmentationParams &params, const cv::Size &size,
+                                         std::vector<TLineSegment> &segments)
+{
+	const size_t min_length = std::max(params.min_line_length, 2);
+	size_t start = 0;
+
+	// the fit of the shortest segment from start
+	TLineFit window;
+	for(size_t i = 0; i < min_length && i < chain.size(); i++)
+		window.add(chain[i]);
+
+	while(start + min_length <= chain.size())
+	{
+		Eigen::Vector2d direction = window.direction();
+
+		// a run is started where the shortest segment fits, and the window slid along the chain by a pixel otherwise
+		bool fits = true;
+		for(size_t i = start; i < start + min_length && fits; i++)
+			fits = window.distance(chain[i], direction) <= params.max_line_deviation;
+
+		if(!fits)
+		{
+			window.remove(chain[start]);
+			if(start + min_length < chain.size())
+				window.add(chain[start + min_length]);
+
+			start++;
+			continue;
+		}
+
+		TLineFit fit = window;
+		size_t end = start + min_length;
+		while(end < chain.size() && fit.distance(chain[end], direction) <= params.max_line_deviation)
+		{
+			fit.add(chain[end++]);
+			direction = fit.direction();
+		}
+
+		Eigen::Vector2i end_point1 = fit.project(chain[start], direction, size), end_point2 = fit.project(chain[end - 1], direction, size);
+		if(end_point1 != end_point2)
+			segments.push_back(segmentFromEndPoints(end_point1, end_point2));
+
+		// the next window starts past the pixels of the run
+		start = end;
+		window = TLineFit();
+		for(size_t i = start; i < start + min_length && i < chain.size(); i++)
+			window.add(chain[i]);
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "TCalibFromLinesParams.h"
+#include "CLine.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** A 2D line segment found by a line detector, with the equation of the line it lies on. */
+struct TLineSegment
+{
+	std::array<Eigen::Vector2i,2> end_points;
+
+	/** The line in normal form, x cos(theta) + y sin(theta) = rho, with rho non-negative. */
+	Scalar rho;
+	Scalar theta;
+
+	/** The line in slope-intercept form, y = m x + c, undefined (left 0) for vertical lines. */
+	Scalar m;
+	Scalar c;
+};
+
+/**
+ * \brief Finds the line segments of an intensity image, the first step of CCalibFromLines::segmentLines.
+ * The backends differ in speed and in how they split the lines into segments, but all of them report the segments
+ * the same way, so that the rest of the segmentation does not depend on the backend.
+ * A detector holds no state between images, so that a single one can be used by several threads.
+ */
+
+class CLineDetector
+{
+	public:
+
+		/** The backends, in the order of the detector combo box of the gui. */
+		enum Type
+		{
+			/** Canny, then Hough lines walked with Bresenham to recover the segments; the reference. */
+			HOUGH,
+			/** Canny, then the probabilistic Hough transform, which outputs the segments directly. */
+			PROBABILISTIC_HOUGH,
+			/** Canny, then the edge pixels chained and split into straight runs by least squares, in linear time (as EDLines). */
+			EDGE_CHAINS,
+			NUM_TYPES
+		};
+
+		virtual ~CLineDetector();
+
+		/** Returns the detector of a type, or the reference one if the type is unknown. */
+		static std::unique_ptr<CLineDetector> create(const int &type);
+
+		/** Returns the name of a type, as written in the config file. */
+		static const char *typeName(const int &type);
+
+		/** Returns the type of a name, as written in the config file, or HOUGH if the name is unknown. */
+		static int typeFromName(const std::string &name);
+
+		/**
+		 * \brief Finds the line segments of an image.
+		 * \param image the 8-bit intensity image.
+		 * \param params the parameters for segmentation, of which each backend uses its own.
+		 * \param segments the segments found, appended.
+		 */
+		virtual void detect(const cv::Mat &image, const TLineSegmentationParams &params, std::vector<TLineSegment> &segments) const = 0;
+
+	protected:
+
+		/** Runs Canny on the image with the parameters for segmentation. */
+		static void detectEdges(const cv::Mat &image, const TLineSegmentationParams &params, cv::Mat &edges);
+
+		/** Returns the segment between two points, computing the equation of its line. */
+		static TLineSegment segmentFromEndPoints(const Eigen::Vector2i &end_point1, const Eigen::Vector2i &end_point2);
+};
+
+class CHoughLineDetector : public CLineDetector
+{
+	public:
+
+		void detect(const cv::Mat &image, const TLineSegmentationParams &params, std::vector<TLineSegment> &segments) const override;
+};
+
+class CProbabilisticHoughLineDetector : public CLineDetector
+{
+	public:
+
+		void detect(const cv::Mat &image, const TLineSegmentationParams &params, std::vector<TLineSegment> &segments) const override;
+};
+
+class CEdgeChainLineDetector : public CLineDetector
+{
+	public:
+
+		void detect(const cv::Mat &image, const TLineSegmentationParams &params, std::vector<TLineSegment> &segments) const override;
+
+	private:
+
+		/** Splits a chain of edge pixels into the straight runs of it that are long enough, with their end points kept within an image of a size. */
+		static void fitSegments(const std::vector<Eigen::Vector2i> &chain, const TLineSegmentationParams &params, const cv::Size &size,
+		                        std::vector<TLineSegment> &segments);
+};
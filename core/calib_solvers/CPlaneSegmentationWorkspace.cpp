@@ -0,0 +1,7 @@
+#include "CPlaneSegmentationWorkspace.h"
+
+CPlaneSegmentationWorkspace::CPlaneSegmentationWorkspace() :
+    normal_cloud(new pcl::PointCloud<pcl::Normal>),
+    labels(new pcl::PointCloud<pcl::Label>)
+{
+}
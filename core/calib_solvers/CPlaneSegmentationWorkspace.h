@@ -0,0 +1,39 @@
+#pragma once
+
+#include <mrpt/pbmap/Plane.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/features/integral_image_normal.h>
+#include <pcl/segmentation/organized_multi_plane_segmentation.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
+
+#include <vector>
+
+/**
+ * The objects and buffers used to segment the planes of a frame, kept across frames.
+ * Frames of the same resolution reuse the normal cloud, the integral images of the normal estimation, and the capacity of
+ * the result vectors. The point indices within the results are still allocated by PCL for every frame, as counted by calib_benchmarks.
+ * A workspace is not thread-safe; use one per thread.
+ */
+
+class CPlaneSegmentationWorkspace
+{
+	public:
+
+	    CPlaneSegmentationWorkspace();
+
+		pcl::IntegralImageNormalEstimation<pcl::PointXYZRGBA, pcl::Normal> normal_estimation;
+		pcl::PointCloud<pcl::Normal>::Ptr normal_cloud;
+
+		pcl::OrganizedMultiPlaneSegmentation<pcl::PointXYZRGBA, pcl::Normal, pcl::Label> multi_plane_segmentation;
+		std::vector<pcl::PlanarRegion<pcl::PointXYZRGBA>, Eigen::aligned_allocator<pcl::PlanarRegion<pcl::PointXYZRGBA>>> regions;
+		std::vector<pcl::ModelCoefficients> model_coefficients;
+		std::vector<pcl::PointIndices> inlier_indices;
+		pcl::PointCloud<pcl::Label>::Ptr labels;
+		std::vector<pcl::PointIndices> label_indices;
+		std::vector<pcl::PointIndices> boundary_indices;
+
+		/** The plane the convex hull and area of each region are computed with. */
+		mrpt::pbmap::Plane plane;
+};
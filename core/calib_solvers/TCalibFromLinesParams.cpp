@@ -0,0 +1,22 @@
+#include "TCalibFromLinesParams.h"
+#include "CLineDetector.h"
+
+void TCalibFromLinesParams::load(const mrpt::config::CConfigFile &config_file)
+{
+	seg.clow_threshold = config_file.read_int("line_segmentation", "canny_low_threshold", 150);
+	seg.chigh_to_low_ratio = config_file.read_int("line_segmentation", "canny_high_to_low_ratio", 3);
+	seg.ckernel_size = config_file.read_int("line_segmentation", "canny_kernel_size", 3);
+	seg.detector = CLineDetector::typeFromName(config_file.read_string("line_segmentation", "detector", "HOUGH"));
+	seg.hthreshold = config_file.read_int("line_segmentation", "hough_threshold", 150);
+	seg.min_line_length = config_file.read_int("line_segmentation", "min_line_length", 50);
+	seg.max_line_gap = config_file.read_int("line_segmentation", "max_line_gap", 5);
+	seg.max_line_deviation = config_file.read_double("line_segmentation", "max_line_deviation", 1.0);
+	seg.num_threads = config_file.read_int("line_segmentation", "num_threads", 0);
+
+	match.min_normals_dot_prod = config_file.read_double("line_matching", "min_normals_dot_product", 0.9);
+	match.max_line_normal_dot_prod = config_file.read_double("line_matching", "max_line_normal_dot_product", 0.1);
+
+	solver.load(config_file);
+
+	calib_status = CalibrationFromLinesStatus::LCALIB_YET_TO_START;
+}
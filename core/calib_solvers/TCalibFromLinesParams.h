@@ -11,8 +11,19 @@ struct TLineSegmentationParams
 	int chigh_to_low_ratio;
 	int ckernel_size;
 
+	//line detector backend, a CLineDetector::Type
+	int detector;
+
 	//params for hough transform
 	int hthreshold;
+
+	//params for the backends that output segments directly, the probabilistic hough transform and the edge chains
+	int min_line_length;
+	int max_line_gap;
+	double max_line_deviation;
+
+	//number of threads segmenting observations in parallel, 0 for the number of hardware threads
+	int num_threads;
 };
 
 struct TLineMatchingParams
@@ -39,4 +50,10 @@ struct TCalibFromLinesParams
 	TLineMatchingParams match;
 	TSolverParams solver;
 	CalibrationFromLinesStatus calib_status;
+
+	/**
+	 * \brief Reads the parameters from the [line_segmentation], [line_matching] and [solver] sections of the app config file,
+	 * with the defaults of config_files/app_config.ini, and resets the status to LCALIB_YET_TO_START.
+	 */
+	void load(const mrpt::config::CConfigFile &config_file);
 };
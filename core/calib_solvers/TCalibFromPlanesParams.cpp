@@ -0,0 +1,32 @@
+#include "TCalibFromPlanesParams.h"
+
+#include <string>
+
+void TCalibFromPlanesParams::load(const mrpt::config::CConfigFile &config_file)
+{
+	std::string ne_method_string = config_file.read_string("plane_segmentation", "normal_estimation_method", "COVARIANCE_MATRIX");
+
+	// the indices of the methods in the normal estimation combo box of the gui
+	if(ne_method_string == "AVERAGE_3D_GRADIENT")
+		seg.normal_estimation_method = 1;
+	else if(ne_method_string == "AVERAGE_DEPTH_CHANGE")
+		seg.normal_estimation_method = 2;
+	else
+		seg.normal_estimation_method = 0;
+
+	seg.depth_dependent_smoothing = config_file.read_bool("plane_segmentation", "depth_dependent_smoothing", true);
+	seg.max_depth_change_factor = config_file.read_double("plane_segmentation", "max_depth_change_factor", 0.02);
+	seg.normal_smoothing_size = config_file.read_double("plane_segmentation", "normal_smoothing_size", 10.00);
+	seg.angle_threshold = config_file.read_double("plane_segmentation", "angle_threshold", 4.00);
+	seg.dist_threshold = config_file.read_double("plane_segmentation", "distance_threshold", 0.05);
+	seg.min_inliers_frac = config_file.read_double("plane_segmentation", "min_inliers_frac", 0.001);
+	seg.max_curvature = config_file.read_double("plane_segmentation", "max_curvature", 0.1);
+	seg.num_threads = config_file.read_int("plane_segmentation", "num_threads", 0);
+
+	match.min_normals_dot_prod = config_file.read_double("plane_matching", "min_normals_dot_product", 0.9);
+	match.max_dist_diff = config_file.read_double("plane_matching", "max_plane_dist_diff", 0.2);
+
+	solver.load(config_file);
+
+	calib_status = CalibrationFromPlanesStatus::PCALIB_YET_TO_START;
+}
@@ -17,6 +17,9 @@ struct TPlaneSegmentationParams
 	double dist_threshold;
 	double min_inliers_frac;
 	double max_curvature;
+
+	//number of threads segmenting observations in parallel, 0 for the number of hardware threads
+	int num_threads;
 };
 
 struct TPlaneMatchingParams
@@ -43,4 +46,10 @@ struct TCalibFromPlanesParams
 	TPlaneMatchingParams match;
 	TSolverParams solver;
 	CalibrationFromPlanesStatus calib_status;
+
+	/**
+	 * \brief Reads the parameters from the [plane_segmentation], [plane_matching] and [solver] sections of the app config file,
+	 * with the defaults of config_files/app_config.ini, and resets the status to PCALIB_YET_TO_START.
+	 */
+	void load(const mrpt::config::CConfigFile &config_file);
 };
@@ -0,0 +1,8 @@
+#include "TExtrinsicCalibParams.h"
+
+void TSolverParams::load(const mrpt::config::CConfigFile &config_file)
+{
+	max_iters = config_file.read_int("solver", "max_iters", 10);
+	min_update = config_file.read_double("solver", "min_update", 0.00001);
+	converge_error = config_file.read_double("solver", "convergence_error", 0.00001);
+}
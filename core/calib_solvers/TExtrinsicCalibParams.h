@@ -1,8 +1,55 @@
 #pragma once
 
+#include <mrpt/config/CConfigFile.h>
+
+#include <atomic>
+#include <functional>
+
 struct TSolverParams
 {
 	int max_iters;
 	double min_update;
 	double converge_error;
+
+	/** Reads the parameters from the [solver] section of the app config file, with the defaults of config_files/app_config.ini. */
+	void load(const mrpt::config::CConfigFile &config_file);
+};
+
+/**
+ * The stages of a calibration, run in this order.
+ * The results of each stage are kept until its inputs, or those of a stage upstream, change.
+ */
+enum CalibrationStage
+{
+	EXTRACTION_STAGE,
+	MATCHING_STAGE,
+	SOLVER_STAGE,
+	NUM_CALIBRATION_STAGES
+};
+
+
+/**
+ * Lets a calibration stage run on a worker thread report its progress, and be cancelled.
+ * Stages check the flag between their units of work (an observation, a set, a solver iteration).
+ */
+struct TStageControl
+{
+	/** Called from the threads running the stage with the fraction [0,1] of the stage done so far. */
+	std::function<void(double)> progress_callback;
+
+	/** When not null, the stage stops as soon as possible after the flag is set. */
+	const std::atomic<bool> *cancel = nullptr;
+
+	/** Returns whether the stage was asked to stop. */
+	bool isCancelled() const
+	{
+		return cancel && *cancel;
+	}
+
+	/** Reports the fraction of the stage done so far, if anyone listens. */
+	void reportProgress(const double &fraction) const
+	{
+		if(progress_callback)
+			progress_callback(fraction);
+	}
 };
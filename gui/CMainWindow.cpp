@@ -2,18 +2,25 @@
 #include <ui_CMainWindow.h>
 #include <observation_tree/CObservationTreeGui.h>
 #include <Utils.h>
+#include <CProfiler.h>
+#include <CMemoryMonitor.h>
 
 #include <mrpt/obs/CObservation3DRangeScan.h>
 #include <mrpt/maps/PCL_adapters.h>
 #include <mrpt/maps/CColouredPointsMap.h>
-#include <mrpt/system/CTicTac.h>
+#include <mrpt/system/string_utils.h>
 #include <pcl/search/impl/search.hpp>
 #include <pcl/common/transforms.h>
 
 #include <QFileDialog>
 #include <QSpinBox>
+#include <QProgressDialog>
 #include <QDebug>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <thread>
 
 using namespace mrpt::obs;
@@ -43,6 +50,12 @@ CMainWindow::CMainWindow(QWidget *parent) :
 	connect(m_ui->ity_sbox, SIGNAL(valueChanged(double)), this, SLOT(initCalibChanged(double)));
 	connect(m_ui->itz_sbox, SIGNAL(valueChanged(double)), this, SLOT(initCalibChanged(double)));
 
+	connect(&m_calib_timer, SIGNAL(timeout()), this, SLOT(pollCalibStage()));
+	connect(&m_log_timer, SIGNAL(timeout()), this, SLOT(flushLog()));
+
+	m_log_sink = std::make_shared<CLogSink>();
+	m_log_timer.start(100);
+
 	setWindowTitle("Automatic Calibration of Sensor Extrinsics");
 	m_calib_from_planes_gui = nullptr;
 	m_calib_from_lines_gui = nullptr;
@@ -54,6 +67,7 @@ CMainWindow::CMainWindow(QWidget *parent) :
 
 CMainWindow::~CMainWindow()
 {
+	stopCalibStage();
 	m_settings.setValue("recent_rlog", m_recent_rlog_path);
 	m_settings.setValue("recent_config", m_recent_config_path);
 	delete m_ui;
@@ -81,6 +95,7 @@ void CMainWindow::loadConfigFile()
 		m_recent_config_path = path;
 		m_ui->config_file_line_edit->setText(path);
 		m_config_file.setFileName(path.toStdString());
+		loadLogParams();
 		m_ui->rlog_file_line_edit->setText(QString::fromStdString(m_config_file.read_string("rawlog", "path", "")));
 		m_ui->rlog_file_line_edit->setDisabled(false);
 		m_ui->rlog_file_select_button->setDisabled(false);
@@ -119,6 +134,9 @@ void CMainWindow::selectRawlogFile()
 
 void CMainWindow::loadRawlog()
 {
+	// the calibration stage running refers to the models about to be replaced
+	stopCalibStage();
+
 	// To ensure all options are disabled when a new rawlog is loaded again.
 	m_ui->sensor_cbox->setDisabled(true);
 	m_ui->irx_sbox->setDisabled(true);
@@ -155,18 +173,70 @@ void CMainWindow::loadRawlog()
 
 	m_ui->status_bar->showMessage("Loading Rawlog...");
 
+	TRawlogLoadParams load_params;
+	std::vector<std::string> listed_sensor_labels;
+
+	// when the same rawlog is loaded again, only the sensors checked in the selection list are loaded
+	if(m_model && m_model->getRawlogPath() == rlog_path.toStdString())
+	{
+		for(size_t i = 0; i < m_ui->sensors_selection_list->count(); i++)
+		{
+			QListWidgetItem *item = m_ui->sensors_selection_list->item(i);
+			listed_sensor_labels.push_back(item->text().toStdString());
+			if(item->checkState() == Qt::Checked)
+				load_params.sensor_labels.push_back(item->text().toStdString());
+		}
+	}
+
+	else
+		mrpt::system::tokenize(m_config_file.read_string("rawlog", "sensor_labels", ""), " ,", load_params.sensor_labels);
+
+	load_params.start_time = m_config_file.read_double("rawlog", "start_time", 0);
+	load_params.end_time = m_config_file.read_double("rawlog", "end_time", -1);
+
+	m_ui->sensors_selection_list->clear();
+	m_ui->sensor_cbox->clear();
+
 	if(m_model)
 		delete m_model;
 
-	CTicTac stop_watch;
-	double time_to_load;
-
 	m_model = new CObservationTreeGui(rlog_path.toStdString(), m_config_file, m_ui->observations_treeview);
 	m_model->addTextObserver(m_ui->viewer_container);
 
-	stop_watch.Tic();
-	m_model->loadTree();
-	time_to_load = stop_watch.Tac();
+	// the rawlog is loaded on a background thread, while the UI keeps responding to the progress dialog
+	QProgressDialog progress_dialog("Loading rawlog...", "Cancel", 0, 100, this);
+	progress_dialog.setWindowModality(Qt::WindowModal);
+	progress_dialog.setMinimumDuration(0);
+	m_ui->load_rlog_button->setDisabled(true);
+
+	std::atomic<int> progress(0);
+	std::atomic<bool> cancel(false), done(false);
+
+	load_params.cancel = &cancel;
+	load_params.progress_callback = [&progress](double fraction) { progress = static_cast<int>(100 * fraction); };
+
+	// the profile of a rawlog starts with its loading
+	CProfiler::instance().clear();
+	CMemoryMonitor::instance().clearStages();
+	CMemoryMonitor::instance().beginStage("load");
+	CScopedTimer load_timer("loadRawlog");
+	std::thread loader([&]() { m_model->loadTree(load_params); done = true; });
+
+	while(!done)
+	{
+		progress_dialog.setValue(progress);
+		if(progress_dialog.wasCanceled())
+			cancel = true;
+
+		QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+
+	loader.join();
+	double time_to_load = load_timer.stop();
+	CMemoryMonitor::instance().endStage();
+	progress_dialog.reset();
+	m_ui->load_rlog_button->setDisabled(false);
 
 	if((m_model->getRootItem()) != nullptr && m_model->getRootItem()->childCount() > 0)
 	{
@@ -192,19 +262,32 @@ void CMainWindow::loadRawlog()
 		std::vector<std::string> sensor_labels = m_model->getSensorLabels();
 
 		for(size_t i = 0; i < sensor_labels.size(); i++)
+			m_ui->sensor_cbox->insertItem(i, QString::fromStdString(sensor_labels[i]));
+
+		// the sensors filtered out stay listed, unchecked, so that they can be selected for the next load
+		for(size_t i = 0; i < sensor_labels.size(); i++)
+		{
+			if(std::find(listed_sensor_labels.begin(), listed_sensor_labels.end(), sensor_labels[i]) == listed_sensor_labels.end())
+				listed_sensor_labels.push_back(sensor_labels[i]);
+		}
+
+		for(size_t i = 0; i < listed_sensor_labels.size(); i++)
 		{
 			QListWidgetItem *item = new QListWidgetItem;
-			item->setText(QString::fromStdString(sensor_labels[i]));
+			item->setText(QString::fromStdString(listed_sensor_labels[i]));
 			item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
-			item->setCheckState(Qt::Checked);
+			item->setCheckState(std::find(sensor_labels.begin(), sensor_labels.end(), listed_sensor_labels[i]) != sensor_labels.end() ? Qt::Checked : Qt::Unchecked);
 			m_ui->sensors_selection_list->insertItem(i, item);
-			m_ui->sensor_cbox->insertItem(i, QString::fromStdString(sensor_labels[i]));
 		}
 
 		std::string stats_string;
 		stats_string = "RAWLOG STATS";
 		stats_string += "\n- - - - - - - - - - - - - - - - - - - - - - - - - - - - - ";
 		stats_string += "\nNumber of observations loaded: " + std::to_string(m_model->getObsCount());
+		stats_string += "\nTime taken to load: " + std::to_string(time_to_load) + " s";
+		stats_string += "\nMemory taken by the observations: " + std::to_string(CMemoryMonitor::instance().getBytes(CMemoryMonitor::OBSERVATION_PAYLOADS) / (1024 * 1024)) + " MB";
+		stats_string += "\nMemory taken by the app: " + std::to_string(CMemoryMonitor::currentResidentBytes() / (1024 * 1024)) + " MB (peak "
+		        + std::to_string(CMemoryMonitor::peakResidentBytes() / (1024 * 1024)) + " MB)";
 		stats_string += "\nNumber of unique sensors found in rawlog: " + std::to_string(m_model->getSensorLabels().size());
 		stats_string += "\n\nSummary of sensors found in rawlog:";
 		stats_string += "\n- - - - - - - - - - - - - - - - - - - - - - - - - - - - - ";
@@ -249,6 +332,12 @@ void CMainWindow::listItemClicked(const QModelIndex &index)
 		mrpt::img::CImage::Ptr image(new mrpt::img::CImage());
 
 		obs_item = std::dynamic_pointer_cast<CObservation3DRangeScan>(m_model->getItem(index)->getObservation());
+		if(!obs_item)
+		{
+			m_ui->status_bar->showMessage("The observation could not be read from the rawlog!");
+			return;
+		}
+
 		obs_item->getDescriptionAsText(update_stream);
 		image = std::make_shared<mrpt::img::CImage>(obs_item->intensityImage);
 		sensor_id = utils::findItemIndexIn(m_model->getSensorLabels(), obs_item->sensorLabel);
@@ -260,26 +349,10 @@ void CMainWindow::listItemClicked(const QModelIndex &index)
 		m_ui->viewer_container->updateImageViewers(sensor_id, image);
 		m_ui->observations_description_textbrowser->setText(QString::fromStdString(update_stream.str()));
 
-		if(item->cloud() != nullptr)
-			m_ui->viewer_container->updateCloudViewers(sensor_id, item->cloud(), viewer_text);
-		    //m_ui->viewer_container->updateCloudViewer(viewer_id, item->cloud(), viewer_text);
-
-		else
-		{
-			pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
-
-			T3DPointsProjectionParams projection_params;
-			projection_params.MAKE_DENSE = false;
-			projection_params.MAKE_ORGANIZED = false;
-
-			obs_item->project3DPointsFromDepthImageInto(*cloud, projection_params);
-			cloud->is_dense = false;
-
-			//m_ui->viewer_container->updateCloudViewer(viewer_id, cloud, viewer_text);
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud = item->cloud();
+		if(cloud != nullptr)
 			m_ui->viewer_container->updateCloudViewers(sensor_id, cloud, viewer_text);
-
-			item->cloud() = cloud;
-		}
+		    //m_ui->viewer_container->updateCloudViewer(viewer_id, cloud, viewer_text);
 	}
 }
 
@@ -299,6 +372,8 @@ void CMainWindow::sensorIndexChanged(int index)
 
 void CMainWindow::syncObservationsClicked()
 {
+	stopCalibStage();
+
 	std::vector<std::string> selected_sensor_labels;
 	QListWidgetItem *item;
 
@@ -330,15 +405,19 @@ void CMainWindow::syncObservationsClicked()
 			delete m_sync_model;
 		}
 
-		// creating a copy of the model
-		m_sync_model = new CObservationTreeGui(m_model->getRawlogPath(), m_config_file, m_ui->grouped_observations_treeview);
+		// the results of the calibrations refer to the previous synchronized model
+		delete m_calib_from_planes_gui;
+		m_calib_from_planes_gui = nullptr;
+		delete m_calib_from_lines_gui;
+		m_calib_from_lines_gui = nullptr;
 
-		for(size_t i = 0; i < m_model->getRootItem()->childCount(); i++)
-		{
-			m_sync_model->getRootItem()->appendChild(m_model->getRootItem()->child(i));
-		}
+		// the synchronized model refers to the observations of the raw model, without copying them
+		m_sync_model = new CObservationTreeGui(m_model->getRawlogPath(), m_config_file, m_ui->grouped_observations_treeview);
+		m_sync_model->shareObservations(*m_model);
 
+		CMemoryMonitor::instance().beginStage("sync");
 		m_sync_model->syncObservations(selected_sensor_labels, m_ui->observations_delay_sbox->value());
+		CMemoryMonitor::instance().endStage();
 
 		if(m_sync_model->getRootItem()->childCount() > 0)
 		{
@@ -358,7 +437,7 @@ void CMainWindow::syncObservationsClicked()
 			{
 				stats_string += "\nSensor #" + std::to_string(i);
 				stats_string += "\nSensor label : Class :: " + selected_sensor_labels[i] + " : "
-				        + m_model->getRootItem()->child(m_sync_model->getSyncIndices()[i][0])->getObservation()->GetRuntimeClass()->className;
+				        + m_model->getRootItem()->child(m_sync_model->getSyncIndices()[i][0])->getClassName();
 				stats_string += "\nNumber of observations: " + std::to_string(m_sync_model->getSyncIndices()[i].size()) + "\n";
 			}
 
@@ -374,6 +453,10 @@ void CMainWindow::treeItemClicked(const QModelIndex &index)
 {
 	if(index.isValid())
 	{
+		// the features are published only when no stage is writing them
+		CCalibFromPlanesGui *planes_calib = calibStageRunning() ? nullptr : m_calib_from_planes_gui;
+		CCalibFromLinesGui *lines_calib = calibStageRunning() ? nullptr : m_calib_from_lines_gui;
+
 		CObservationTreeItem *item = static_cast<CObservationTreeItem*>(index.internalPointer());
 
 		std::stringstream update_stream;
@@ -388,39 +471,32 @@ void CMainWindow::treeItemClicked(const QModelIndex &index)
 		if((index.parent()).isValid())
 		{
 			obs_item = std::dynamic_pointer_cast<CObservation3DRangeScan>(m_sync_model->getItem(index)->getObservation());
+			if(!obs_item)
+			{
+				m_ui->status_bar->showMessage("The observation could not be read from the rawlog!");
+				return;
+			}
+
 			obs_item->getDescriptionAsText(update_stream);
 			image = std::make_shared<mrpt::img::CImage>(obs_item->intensityImage);
 
 			sensor_id = utils::findItemIndexIn(m_sync_model->getSensorLabels(), obs_item->sensorLabel);
-			sync_obs_id = utils::findItemIndexIn(m_sync_model->getSyncIndices()[sensor_id], item->getPriorIndex());
+			sync_obs_id = m_sync_model->getSyncIndex(index.parent().row(), sensor_id);
 			viewer_id = sensor_id;
 			viewer_text = (m_sync_model->data(index.parent())).toString().toStdString() + " : " + obs_item->sensorLabel;
 			m_ui->viewer_container->updateImageViewer(viewer_id, image);
 
-			if(item->cloud() != nullptr)
-				m_ui->viewer_container->updateCloudViewer(viewer_id, item->cloud(), viewer_text);
-
-			else
-			{
-				T3DPointsProjectionParams projection_params;
-				projection_params.MAKE_DENSE = false;
-				projection_params.MAKE_ORGANIZED = false;
-
-				pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
-				obs_item->project3DPointsFromDepthImageInto(*cloud, projection_params);
-				cloud->is_dense = false;
+			pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud = item->cloud();
+			if(cloud != nullptr)
 				m_ui->viewer_container->updateCloudViewer(viewer_id, cloud, viewer_text);
 
-				item->cloud() = cloud;
-			}
-
-			if((m_calib_from_planes_gui != nullptr) && (m_calib_from_planes_gui->calibStatus() == CalibrationFromPlanesStatus::PLANES_EXTRACTED
-			                                           || m_calib_from_planes_gui->calibStatus() == CalibrationFromPlanesStatus::PLANES_MATCHED))
-				m_calib_from_planes_gui->publishPlanes(sensor_id, sync_obs_id);
+			if((planes_calib != nullptr) && (planes_calib->calibStatus() == CalibrationFromPlanesStatus::PLANES_EXTRACTED
+			                                || planes_calib->calibStatus() == CalibrationFromPlanesStatus::PLANES_MATCHED))
+				planes_calib->publishPlanes(sensor_id, sync_obs_id);
 
-			else if((m_calib_from_lines_gui != nullptr) && (m_calib_from_lines_gui->calibStatus() == CalibrationFromLinesStatus::LINES_EXTRACTED
-			                                           || m_calib_from_lines_gui->calibStatus() == CalibrationFromLinesStatus::LINES_MATCHED))
-				m_calib_from_lines_gui->publishLines(sensor_id, sync_obs_id);
+			else if((lines_calib != nullptr) && (lines_calib->calibStatus() == CalibrationFromLinesStatus::LINES_EXTRACTED
+			                                || lines_calib->calibStatus() == CalibrationFromLinesStatus::LINES_MATCHED))
+				lines_calib->publishLines(sensor_id, sync_obs_id);
 		}
 
 		//else set-item was clicked
@@ -429,11 +505,17 @@ void CMainWindow::treeItemClicked(const QModelIndex &index)
 			for(int i = 0; i < item->childCount(); i++)
 			{
 				obs_item = std::dynamic_pointer_cast<CObservation3DRangeScan>(item->child(i)->getObservation());
+				if(!obs_item)
+				{
+					m_ui->status_bar->showMessage("An observation of the set could not be read from the rawlog!");
+					continue;
+				}
+
 				obs_item->getDescriptionAsText(update_stream);
 				image = std::make_shared<mrpt::img::CImage>(obs_item->intensityImage);
 
 				sensor_id = utils::findItemIndexIn(m_sync_model->getSensorLabels(), obs_item->sensorLabel);
-				sync_obs_id = utils::findItemIndexIn(m_sync_model->getSyncIndices()[sensor_id], item->child(i)->getPriorIndex());
+				sync_obs_id = m_sync_model->getSyncIndex(index.row(), sensor_id);
 				viewer_id = sensor_id;
 				viewer_text = (m_sync_model->data(index)).toString().toStdString() + " : " + obs_item->sensorLabel;
 				update_stream << "- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n";
@@ -442,46 +524,30 @@ void CMainWindow::treeItemClicked(const QModelIndex &index)
 				//for debugging
 				//m_ui->viewer_container->updateText(std::to_string(viewer_id) + " " + std::to_string(sync_obs_id));
 
-				if(item->cloud() != nullptr)
-				{
-					m_ui->viewer_container->updateCloudViewer(viewer_id, item->cloud(), viewer_text);
-					m_ui->viewer_container->updateSetCloudViewer(item->cloud(), obs_item->sensorLabel,
-					                                             m_sync_model->getSensorPoses()[sensor_id],
-					                                             m_sync_model->data(index).toString().toStdString() + " Overlapped");
-				}
-
-				else
+				pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud = item->child(i)->cloud();
+				if(cloud != nullptr)
 				{
-					T3DPointsProjectionParams projection_params;
-					projection_params.MAKE_DENSE = false;
-					projection_params.MAKE_ORGANIZED = false;
-
-					pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
-					obs_item->project3DPointsFromDepthImageInto(*cloud, projection_params);
-					cloud->is_dense = false;
-
 					m_ui->viewer_container->updateCloudViewer(viewer_id, cloud, viewer_text);
 					m_ui->viewer_container->updateSetCloudViewer(cloud, obs_item->sensorLabel,
 					                                             m_sync_model->getSensorPoses()[sensor_id],
 					                                             (m_sync_model->data(index)).toString().toStdString() + " Overlapped");
-					item->cloud() = cloud;
 				}
 
-				if((m_calib_from_planes_gui != nullptr) && (m_calib_from_planes_gui->calibStatus() == CalibrationFromPlanesStatus::PLANES_EXTRACTED
-				                                            || m_calib_from_planes_gui->calibStatus() == CalibrationFromPlanesStatus::PLANES_MATCHED))
-					m_calib_from_planes_gui->publishPlanes(sensor_id, sync_obs_id);
+				if((planes_calib != nullptr) && (planes_calib->calibStatus() == CalibrationFromPlanesStatus::PLANES_EXTRACTED
+				                                 || planes_calib->calibStatus() == CalibrationFromPlanesStatus::PLANES_MATCHED))
+					planes_calib->publishPlanes(sensor_id, sync_obs_id);
 
 
-				else if((m_calib_from_lines_gui != nullptr) && (m_calib_from_lines_gui->calibStatus() == CalibrationFromLinesStatus::LINES_EXTRACTED
-				                                           || m_calib_from_lines_gui->calibStatus() == CalibrationFromLinesStatus::LINES_MATCHED))
-					m_calib_from_lines_gui->publishLines(sensor_id, sync_obs_id);
+				else if((lines_calib != nullptr) && (lines_calib->calibStatus() == CalibrationFromLinesStatus::LINES_EXTRACTED
+				                                || lines_calib->calibStatus() == CalibrationFromLinesStatus::LINES_MATCHED))
+					lines_calib->publishLines(sensor_id, sync_obs_id);
 			}
 
-			if((m_calib_from_planes_gui != nullptr) && (m_calib_from_planes_gui->calibStatus() == CalibrationFromPlanesStatus::PLANES_MATCHED))
-				m_calib_from_planes_gui->publishCorrespPlanes(item->row());
+			if((planes_calib != nullptr) && (planes_calib->calibStatus() == CalibrationFromPlanesStatus::PLANES_MATCHED))
+				planes_calib->publishCorrespPlanes(item->row());
 
-			else if((m_calib_from_lines_gui != nullptr) && (m_calib_from_lines_gui->calibStatus() == CalibrationFromLinesStatus::LINES_MATCHED))
-				m_calib_from_lines_gui->publishCorrespLines(item->row());
+			else if((lines_calib != nullptr) && (lines_calib->calibStatus() == CalibrationFromLinesStatus::LINES_MATCHED))
+				lines_calib->publishCorrespLines(item->row());
 		}
     
 		m_ui->observations_description_textbrowser->setText(QString::fromStdString(update_stream.str()));
@@ -490,6 +556,8 @@ void CMainWindow::treeItemClicked(const QModelIndex &index)
 
 void CMainWindow::algosIndexChanged(int index)
 {
+	stopCalibStage();
+
 	switch(index)
 	{
 	case 0:
@@ -560,6 +628,12 @@ void CMainWindow::initCalibChanged(double value)
 
 void CMainWindow::runCalibFromPlanes(TCalibFromPlanesParams *params)
 {
+	if(calibStageRunning())
+	{
+		m_ui->viewer_container->updateText("A calibration stage is still running. Wait for it to finish, or cancel it.");
+		return;
+	}
+
 	switch(params->calib_status)
 	{
 	case CalibrationFromPlanesStatus::PCALIB_YET_TO_START:
@@ -567,13 +641,21 @@ void CMainWindow::runCalibFromPlanes(TCalibFromPlanesParams *params)
 		if(m_sync_model != nullptr && (m_sync_model->getRootItem()->childCount() > 0))
 		{
 			m_calib_from_lines_gui = nullptr;
-			m_calib_from_planes_gui = new CCalibFromPlanesGui(m_sync_model, params);
-			m_calib_from_planes_gui->addTextObserver(m_ui->viewer_container);
-			m_calib_from_planes_gui->addPlanesObserver(m_ui->viewer_container);
-			m_calib_from_planes_gui->addCorrespPlanesObserver(m_ui->viewer_container);
-			m_calib_from_planes_gui->extractPlanes();
-			//std::thread thr(&CCalibFromPlanesGui::extractPlanes, m_calib_from_planes_gui);
-			//thr.detach();
+
+			// the calibration is kept across runs, so that only the stages whose inputs changed are run again
+			if(m_calib_from_planes_gui == nullptr)
+			{
+				m_calib_from_planes_gui = new CCalibFromPlanesGui(m_sync_model, *params);
+				m_calib_from_planes_gui->setLogSink(m_log_sink);
+				m_calib_from_planes_gui->addPlanesObserver(m_ui->viewer_container);
+				m_calib_from_planes_gui->addCorrespPlanesObserver(m_ui->viewer_container);
+			}
+
+			else
+				m_calib_from_planes_gui->setParams(*params);
+
+			CCalibFromPlanesGui *calib = m_calib_from_planes_gui;
+			runCalibStage("extractPlanes", [calib](const TStageControl &control) { calib->extractPlanes(control); });
 		}
 
 		else
@@ -584,13 +666,30 @@ void CMainWindow::runCalibFromPlanes(TCalibFromPlanesParams *params)
 
 	case CalibrationFromPlanesStatus::PLANES_EXTRACTED:
 	{
-		m_calib_from_planes_gui->matchPlanes();
+		// the calibration is dropped when the observations are synchronized again or another calibration is chosen
+		if(m_calib_from_planes_gui == nullptr)
+		{
+			m_ui->viewer_container->updateText("Extract the planes first!");
+			break;
+		}
+
+		CCalibFromPlanesGui *calib = m_calib_from_planes_gui;
+		calib->setParams(*params);
+		runCalibStage("matchPlanes", [calib](const TStageControl &control) { calib->matchPlanes(control); });
 		break;
 	}
 
 	case CalibrationFromPlanesStatus::PLANES_MATCHED:
 	{
-		m_calib_from_planes_gui->calibrate();
+		if(m_calib_from_planes_gui == nullptr)
+		{
+			m_ui->viewer_container->updateText("Extract the planes first!");
+			break;
+		}
+
+		CCalibFromPlanesGui *calib = m_calib_from_planes_gui;
+		calib->setParams(*params);
+		runCalibStage("calibrate", [calib](const TStageControl &control) { calib->calibrate(control); });
 		break;
 	}
 	}
@@ -598,6 +697,12 @@ void CMainWindow::runCalibFromPlanes(TCalibFromPlanesParams *params)
 
 void CMainWindow::runCalibFromLines(TCalibFromLinesParams *params)
 {
+	if(calibStageRunning())
+	{
+		m_ui->viewer_container->updateText("A calibration stage is still running. Wait for it to finish, or cancel it.");
+		return;
+	}
+
 	switch(params->calib_status)
 	{
 	case CalibrationFromLinesStatus::LCALIB_YET_TO_START:
@@ -605,11 +710,21 @@ void CMainWindow::runCalibFromLines(TCalibFromLinesParams *params)
 		if(m_sync_model != nullptr && (m_sync_model->getRootItem()->childCount() > 0))
 		{
 			m_calib_from_planes_gui = nullptr;
-			m_calib_from_lines_gui = new CCalibFromLinesGui(m_sync_model, params);
-			m_calib_from_lines_gui->addTextObserver(m_ui->viewer_container);
-			m_calib_from_lines_gui->addLinesObserver(m_ui->viewer_container);
-			m_calib_from_lines_gui->addCorrespLinesObserver(m_ui->viewer_container);
-			m_calib_from_lines_gui->extractLines();
+
+			// the calibration is kept across runs, so that only the stages whose inputs changed are run again
+			if(m_calib_from_lines_gui == nullptr)
+			{
+				m_calib_from_lines_gui = new CCalibFromLinesGui(m_sync_model, *params);
+				m_calib_from_lines_gui->setLogSink(m_log_sink);
+				m_calib_from_lines_gui->addLinesObserver(m_ui->viewer_container);
+				m_calib_from_lines_gui->addCorrespLinesObserver(m_ui->viewer_container);
+			}
+
+			else
+				m_calib_from_lines_gui->setParams(*params);
+
+			CCalibFromLinesGui *calib = m_calib_from_lines_gui;
+			runCalibStage("extractLines", [calib](const TStageControl &control) { calib->extractLines(control); });
 		}
 
 		else
@@ -620,12 +735,144 @@ void CMainWindow::runCalibFromLines(TCalibFromLinesParams *params)
 
 	case CalibrationFromLinesStatus::LINES_EXTRACTED:
 	{
-		m_calib_from_lines_gui->matchLines();
+		// as with the planes, the lines are extracted again for a new calibration
+		if(m_calib_from_lines_gui == nullptr)
+		{
+			m_ui->viewer_container->updateText("Extract the lines first!");
+			break;
+		}
+
+		CCalibFromLinesGui *calib = m_calib_from_lines_gui;
+		calib->setParams(*params);
+		runCalibStage("matchLines", [calib](const TStageControl &control) { calib->matchLines(control); });
 		break;
 	}
 	}
 }
 
+void CMainWindow::runCalibStage(const std::string &name, const std::function<void(const TStageControl&)> &stage)
+{
+	CMemoryMonitor::instance().beginStage(name);
+
+	m_calib_cancel = false;
+	m_calib_progress = 0;
+
+	TStageControl control;
+	control.cancel = &m_calib_cancel;
+	control.progress_callback = [this](double fraction) { m_calib_progress = static_cast<int>(100 * fraction); };
+
+	// the dialog is not modal, so that the rest of the window keeps responding while the stage runs
+	m_calib_progress_dialog = new QProgressDialog("Running calibration stage...", "Cancel", 0, 100, this);
+	m_calib_progress_dialog->setWindowModality(Qt::NonModal);
+	m_calib_progress_dialog->setMinimumDuration(0);
+	m_calib_progress_dialog->setAutoReset(false);
+	m_calib_progress_dialog->setAutoClose(false);
+	connect(m_calib_progress_dialog, SIGNAL(canceled()), this, SLOT(cancelCalibStage()));
+
+	m_ui->status_bar->showMessage("Running calibration stage...");
+	m_calib_stage = std::async(std::launch::async, stage, control);
+	m_calib_timer.start(50);
+}
+
+bool CMainWindow::calibStageRunning() const
+{
+	// the future is reset once the stage is finished
+	return m_calib_stage.valid();
+}
+
+void CMainWindow::cancelCalibStage()
+{
+	m_calib_cancel = true;
+	m_ui->status_bar->showMessage("Cancelling calibration stage...");
+}
+
+void CMainWindow::stopCalibStage()
+{
+	if(!calibStageRunning())
+		return;
+
+	m_calib_cancel = true;
+	m_calib_stage.wait();
+	finishCalibStage();
+}
+
+void CMainWindow::pollCalibStage()
+{
+	if(m_calib_progress_dialog)
+		m_calib_progress_dialog->setValue(m_calib_progress);
+
+	if(m_calib_stage.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		finishCalibStage();
+}
+
+void CMainWindow::finishCalibStage()
+{
+	m_calib_timer.stop();
+
+	try
+	{
+		m_calib_stage.get();
+	}
+
+	catch(std::exception &e)
+	{
+		m_log_sink->log(std::string("The calibration stage failed: ") + e.what(), CLogSink::LOG_ERROR);
+	}
+
+	CMemoryMonitor::instance().endStage();
+
+	// the profile and the memory cover all the stages run since the rawlog was loaded
+	m_log_sink->log("Profile of the calibration so far:\n" + CProfiler::instance().summary(), CLogSink::LOG_DEBUG);
+	m_log_sink->log("MEMORY STATS\n- - - - - - - - - - - - - - - - - - - - - - - - - - - - - \n" + CMemoryMonitor::instance().report());
+
+	std::string trace_path = m_config_file.read_string("profiling", "trace_path", "");
+	if(!trace_path.empty() && !CProfiler::instance().exportChromeTrace(trace_path))
+		m_log_sink->log("Could not write the profiling trace to " + trace_path, CLogSink::LOG_WARNING);
+
+	flushLog();
+
+	if(m_calib_progress_dialog)
+	{
+		m_calib_progress_dialog->deleteLater();
+		m_calib_progress_dialog = nullptr;
+	}
+
+	m_ui->status_bar->showMessage(m_calib_cancel ? "Calibration stage cancelled" : "Calibration stage done");
+}
+
+void CMainWindow::flushLog()
+{
+	std::vector<CLogSink::TLogMessage> messages;
+	m_log_sink->drain(messages, m_log_batch_size);
+
+	std::string text;
+	for(const CLogSink::TLogMessage &message : messages)
+	{
+		if(!text.empty())
+			text += "\n\n";
+
+		if(message.level >= CLogSink::LOG_WARNING)
+			text += std::string("[") + CLogSink::levelName(message.level) + "] ";
+
+		text += message.text;
+	}
+
+	size_t dropped = m_log_sink->takeDropped();
+	if(dropped > 0)
+		text += (text.empty() ? "" : "\n\n") + std::string("[WARNING] ") + std::to_string(dropped) + " message(s) dropped, the log was published faster than shown";
+
+	// a single update for the whole batch, rather than one per message
+	if(!text.empty())
+		m_ui->viewer_container->updateText(text);
+}
+
+void CMainWindow::loadLogParams()
+{
+	m_log_sink->setMinLevel(CLogSink::levelFromString(m_config_file.read_string("log", "level", "info")));
+	m_log_batch_size = std::max(1, m_config_file.read_int("log", "max_messages_per_flush", 200));
+	m_log_timer.start(std::max(10, m_config_file.read_int("log", "flush_interval_ms", 100)));
+}
+
 void CMainWindow::saveParams()
 {
 	m_config_file.write<double>("initial_calibration", "irx", m_ui->irx_sbox->value());
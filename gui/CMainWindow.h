@@ -8,9 +8,15 @@
 
 #include <QMainWindow>
 #include <QSettings>
+#include <QTimer>
+#include <QProgressDialog>
 
 #include <mrpt/config/CConfigFile.h>
 
+#include <atomic>
+#include <functional>
+#include <future>
+
 namespace Ui {
 class CMainWindow;
 }
@@ -36,6 +42,20 @@ public:
 	/** Triggers the calibration from lines method. */
 	void runCalibFromLines(TCalibFromLinesParams *params);
 
+	/**
+	 * \brief Runs a calibration stage on a worker thread, showing its progress in a dialog that can cancel it.
+	 * The text it publishes is queued in the log sink, drained to the viewers from the UI thread.
+	 * \param name the name of the stage, under which its peak memory is reported.
+	 * \param stage the stage, called with the control to report its progress to and to check for cancellation.
+	 */
+	void runCalibStage(const std::string &name, const std::function<void(const TStageControl&)> &stage);
+
+	/** Returns whether a calibration stage is running on the worker thread. */
+	bool calibStageRunning() const;
+
+	/** Cancels the calibration stage running, if any, and waits for it to stop. */
+	void stopCalibStage();
+
 	/** Receives the estimated relative transformation from the gui calib classes. */
 	void ontReceivingRt(const std::vector<Eigen::Matrix4f> &relative_transformations);
 
@@ -65,7 +85,22 @@ private slots:
 	/** Call back function for the "Sync Observations" button. */
 	void syncObservationsClicked();
 
+	/** Call back function for the cancel button of the calibration progress dialog. */
+	void cancelCalibStage();
+
+	/** Updates the progress of the calibration stage running, and finishes it once it is done. */
+	void pollCalibStage();
+
+	/** Shows the messages queued in the log sink since the last flush, up to the batch size, in a single update of the text output. */
+	void flushLog();
+
 private:
+	/** Collects the result of the calibration stage that ran, reporting its failure if it threw, on the UI thread. */
+	void finishCalibStage();
+
+	/** Reads the level, flush interval and batch size of the log from the config file. */
+	void loadLogParams();
+
 	Ui::CMainWindow *m_ui;
 	QWidget *m_central_widget;
 
@@ -101,4 +136,28 @@ private:
 
 	/** Object to interact with the calibration from lines gui class. */
 	CCalibFromLinesGui *m_calib_from_lines_gui;
+
+	/** The calibration stage running on the worker thread, invalid when none is. */
+	std::future<void> m_calib_stage;
+
+	/** Set to cancel the calibration stage running. */
+	std::atomic<bool> m_calib_cancel{false};
+
+	/** The percentage of the calibration stage running done so far. */
+	std::atomic<int> m_calib_progress{0};
+
+	/** Polls the calibration stage running from the UI thread. */
+	QTimer m_calib_timer;
+
+	/** Shows the progress of the calibration stage running. */
+	QProgressDialog *m_calib_progress_dialog = nullptr;
+
+	/** Collects the text published by the calibration stages, from any thread, without contending with the UI thread. */
+	std::shared_ptr<CLogSink> m_log_sink;
+
+	/** Drains the log sink to the text output at a bounded rate. */
+	QTimer m_log_timer;
+
+	/** The maximum number of messages shown on each flush of the log sink. */
+	size_t m_log_batch_size = 200;
 };
@@ -9,12 +9,16 @@ CCalibFromLinesConfig::CCalibFromLinesConfig(mrpt::config::CConfigFile &config_f
 {
 	m_ui->setupUi(this);
 
-	m_ui->clow_threshold_sbox->setValue(m_config_file.read_int("line_segmentation", "canny_low_threshold", 150, true));
-	m_ui->chightolow_ratio_sbox->setValue(m_config_file.read_int("line_segmentation", "canny_high_to_low_ratio", 3, true));
-	m_ui->ckernel_size_sbox->setValue(m_config_file.read_double("line_segmentation", "canny_kernel_size", 3, true));
-	m_ui->hthreshold_sbox->setValue(m_config_file.read_int("line_segmentation", "hough_threshold", 150, true));
-	m_ui->min_normals_dot_prod_sbox->setValue(m_config_file.read_double("line_matching", "min_normals_dot_product", 0.90, true));
-	m_ui->max_line_normal_dot_prod_sbox->setValue(m_config_file.read_double("line_matching", "max_line_normal_dot_product", 0.10, true));
+	// the parameters not shown in the ui, e.g. those of the segment detectors and the solver, keep the values of the config file
+	m_params.load(m_config_file);
+
+	m_ui->clow_threshold_sbox->setValue(m_params.seg.clow_threshold);
+	m_ui->chightolow_ratio_sbox->setValue(m_params.seg.chigh_to_low_ratio);
+	m_ui->ckernel_size_sbox->setValue(m_params.seg.ckernel_size);
+	m_ui->hthreshold_sbox->setValue(m_params.seg.hthreshold);
+	m_ui->detector_cbox->setCurrentIndex(m_params.seg.detector);
+	m_ui->min_normals_dot_prod_sbox->setValue(m_params.match.min_normals_dot_prod);
+	m_ui->max_line_normal_dot_prod_sbox->setValue(m_params.match.max_line_normal_dot_prod);
 
 	connect(m_ui->extract_lines_button, SIGNAL(clicked(bool)), this, SLOT(extractLinesClicked()));
 	connect(m_ui->save_calib_button, SIGNAL(clicked(bool)), this, SLOT(saveCalibClicked()));
@@ -37,6 +41,7 @@ void CCalibFromLinesConfig::extractLinesClicked()
 	m_params.seg.chigh_to_low_ratio = m_ui->chightolow_ratio_sbox->value();
 	m_params.seg.ckernel_size = m_ui->ckernel_size_sbox->value();
 	m_params.seg.hthreshold = m_ui->hthreshold_sbox->value();
+	m_params.seg.detector = m_ui->detector_cbox->currentIndex();
 	m_params.calib_status = CalibrationFromLinesStatus::LCALIB_YET_TO_START;
 	m_ui->match_lines_button->setDisabled(false);
 	static_cast<CMainWindow*>(parentWidget()->parentWidget()->parentWidget())->runCalibFromLines(&m_params);
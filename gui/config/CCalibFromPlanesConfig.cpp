@@ -9,31 +9,27 @@ CCalibFromPlanesConfig::CCalibFromPlanesConfig(mrpt::config::CConfigFile &config
 {
 	m_ui->setupUi(this);
 
-	std::string ne_method_string = m_config_file.read_string("plane_segmentation", "normal_estimation_method", "COVARIANCE_MATRIX", true);
+	// the parameters not shown in the ui, e.g. the number of threads, keep the values of the config file
+	m_params.load(m_config_file);
 
-	if(ne_method_string == "AVERAGE_3D_GRADIENT")
-		m_ui->ne_method_cbox->setCurrentIndex(1);
-	else if(ne_method_string == "AVERAGE_DEPTH_CHANGE")
-		m_ui->ne_method_cbox->setCurrentIndex(2);
-	else
-		m_ui->ne_method_cbox->setCurrentIndex(0);
+	m_ui->ne_method_cbox->setCurrentIndex(m_params.seg.normal_estimation_method);
 
-	if(m_config_file.read_bool("plane_segmentation", "depth_dependent_smoothing", true, true))
+	if(m_params.seg.depth_dependent_smoothing)
 		m_ui->depth_dependent_smoothing_check->setCheckState(Qt::Checked);
 	else
 		m_ui->depth_dependent_smoothing_check->setCheckState(Qt::Unchecked);
 
-	m_ui->max_depth_change_factor_sbox->setValue(m_config_file.read_double("plane_segmentation", "max_depth_change_factor", 0.02, true));
-	m_ui->normal_smoothing_size_sbox->setValue(m_config_file.read_double("plane_segmentation", "normal_smoothing_size", 10.00, true));
-	m_ui->angle_threshold_sbox->setValue(m_config_file.read_double("plane_segmentation", "angle_threshold", 4.00, true));
-	m_ui->distance_threshold_sbox->setValue(m_config_file.read_double("plane_segmentation", "distance_threshold", 0.05, true));
-	m_ui->minimum_threshold_sbox->setValue(m_config_file.read_double("plane_segmentation", "min_inliers_frac", 0.001, true));
-	m_ui->max_curvature_sbox->setValue(m_config_file.read_double("plane_segmentation", "max_curvature", 0.1, true));
-	m_ui->min_normals_dot_sbox->setValue(m_config_file.read_double("plane_matching", "min_normals_dot_product", 0.9, true));
-	m_ui->max_dist_diff_sbox->setValue(m_config_file.read_double("plane_matching", "max_plane_dist_diff", 0.2, true));
-	m_ui->max_iters_sbox->setValue(m_config_file.read_int("solver", "max_iters", 10, true));
-	m_ui->min_update_sbox->setValue(m_config_file.read_double("solver", "min_update", 0.00001, true));
-	m_ui->converge_error_sbox->setValue(m_config_file.read_double("solver", "convergence_error", 0.00001, true));
+	m_ui->max_depth_change_factor_sbox->setValue(m_params.seg.max_depth_change_factor);
+	m_ui->normal_smoothing_size_sbox->setValue(m_params.seg.normal_smoothing_size);
+	m_ui->angle_threshold_sbox->setValue(m_params.seg.angle_threshold);
+	m_ui->distance_threshold_sbox->setValue(m_params.seg.dist_threshold);
+	m_ui->minimum_threshold_sbox->setValue(m_params.seg.min_inliers_frac);
+	m_ui->max_curvature_sbox->setValue(m_params.seg.max_curvature);
+	m_ui->min_normals_dot_sbox->setValue(m_params.match.min_normals_dot_prod);
+	m_ui->max_dist_diff_sbox->setValue(m_params.match.max_dist_diff);
+	m_ui->max_iters_sbox->setValue(m_params.solver.max_iters);
+	m_ui->min_update_sbox->setValue(m_params.solver.min_update);
+	m_ui->converge_error_sbox->setValue(m_params.solver.converge_error);
 
 	connect(m_ui->extract_planes_button, SIGNAL(clicked(bool)), this, SLOT(extractPlanes()));
 	connect(m_ui->match_planes_button, SIGNAL(clicked(bool)), this, SLOT(matchPlanes()));
@@ -1,10 +1,8 @@
 #include <core_gui/CCalibFromLinesGui.h>
+#include <CFeatureCache.h>
+#include <CProfiler.h>
 
-#include <mrpt/obs/CObservation3DRangeScan.h>
-
-using namespace mrpt::obs;
-
-CCalibFromLinesGui::CCalibFromLinesGui(CObservationTree *model, TCalibFromLinesParams *params) :
+CCalibFromLinesGui::CCalibFromLinesGui(CObservationTree *model, const TCalibFromLinesParams &params) :
     CCalibFromLines(model)
 {
 	m_params = params;
@@ -14,9 +12,9 @@ CCalibFromLinesGui::~CCalibFromLinesGui()
 {
 }
 
-void CCalibFromLinesGui::addTextObserver(CTextObserver *observer)
+void CCalibFromLinesGui::setLogSink(const std::shared_ptr<CLogSink> &log_sink)
 {
-	m_text_observers.push_back(observer);
+	m_log_sink = log_sink;
 }
 
 void CCalibFromLinesGui::addLinesObserver(CLinesObserver *observer)
@@ -29,19 +27,17 @@ void CCalibFromLinesGui::addCorrespLinesObserver(CCorrespLinesObserver *observer
 	m_corresp_lines_observers.push_back(observer);
 }
 
-void CCalibFromLinesGui::publishText(const std::string &msg)
+void CCalibFromLinesGui::publishText(const std::string &msg, const CLogSink::LogLevel &level)
 {
-	for(CTextObserver *observer : m_text_observers)
-	{
-		observer->onReceivingText(msg);
-	}
+	if(m_log_sink)
+		m_log_sink->log(msg, level);
 }
 
 void CCalibFromLinesGui::publishLines(const int &sensor_id, const int &sync_obs_id)
 {
 	for(CLinesObserver *observer : m_lines_observers)
 	{
-		observer->onReceivingLines(sensor_id, mvv_lines[sensor_id][sync_obs_id]);
+		observer->onReceivingLines(sensor_id, getLineStore().getObservationLines(sensor_id, sync_obs_id));
 	}
 }
 
@@ -63,11 +59,11 @@ void CCalibFromLinesGui::publishCorrespLines(const int &obs_set_id)
 				int set_id = correspondences[i][0];
 				if(set_id == obs_set_id)
 				{
-					int sync_obs1_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_i]);
-					int sync_obs2_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_j]);
+					int sync_obs1_id = sync_model->getSyncIndex(set_id, sensor_i);
+					int sync_obs2_id = sync_model->getSyncIndex(set_id, sensor_j);
 
-					std::array<CLine,2> lines_pair{mvv_lines[sensor_i][sync_obs1_id][correspondences[i][1]],
-						                                 mvv_lines[sensor_j][sync_obs2_id][correspondences[i][2]]};
+					std::array<CLine,2> lines_pair{getLineStore().getLine(sensor_i, sync_obs1_id, correspondences[i][1]),
+						                                 getLineStore().getLine(sensor_j, sync_obs2_id, correspondences[i][2])};
 					corresp_lines[sensor_i][sensor_j].push_back(lines_pair);
 				}
 			}
@@ -80,122 +76,109 @@ void CCalibFromLinesGui::publishCorrespLines(const int &obs_set_id)
 	}
 }
 
-CalibrationFromLinesStatus CCalibFromLinesGui::calibStatus()
+void CCalibFromLinesGui::setParams(const TCalibFromLinesParams &params)
 {
-	return m_params->calib_status;
+	m_params = params;
 }
 
-void CCalibFromLinesGui::extractLines()
+CalibrationFromLinesStatus CCalibFromLinesGui::calibStatus()
 {
-	publishText("****Running line segmentation algorithm****");
+	return m_params.calib_status;
+}
 
-	CObservationTreeItem *root_item, *tree_item, *item;
-	CObservation3DRangeScan::Ptr obs_item;
-	size_t sync_obs_id = 0;
-	root_item = sync_model->getRootItem();
+bool CCalibFromLinesGui::extractLines(const TStageControl &control)
+{
+	uint64_t inputs_hash = extractionInputsHash(m_params.seg);
+	if(m_stages.isUpToDate(EXTRACTION_STAGE, inputs_hash))
+	{
+		publishText("Lines are up to date with the segmentation parameters, reusing them");
+		m_params.calib_status = CalibrationFromLinesStatus::LINES_EXTRACTED;
+		return true;
+	}
 
-	std::vector<CLine> segmented_lines;
-	size_t n_lines;
-	double line_segment_start, line_segment_end;
+	publishText("****Running line segmentation algorithm****");
 
-	std::vector<std::string> selected_sensor_labels;
-	std::string prev_sensor_label;
-	mrpt::system::TTimeStamp prev_ts = 0;
+	std::vector<std::vector<double>> times;
+	CScopedTimer timer("lineSegmentationStage");
+	bool done = CCalibFromLines::extractLines(m_params.seg, &times, control);
+	double elapsed = timer.stop();
 
-	selected_sensor_labels = sync_model->getSensorLabels();
+	if(!done)
+	{
+		// the lines of the observations not segmented are missing, so the matching cannot use them
+		m_stages.invalidate(EXTRACTION_STAGE);
+		if(getUnreadObservationCount() > 0)
+			publishText(std::to_string(getUnreadObservationCount()) + " observations could not be read from the rawlog, their lines are missing",
+			            CLogSink::LOG_ERROR);
+		else
+			publishText("Line segmentation cancelled", CLogSink::LOG_WARNING);
+
+		return false;
+	}
 
-	for(size_t i = 0; i < selected_sensor_labels.size(); i++)
+	for(size_t i = 0; i < getLineStore().getNumberOfSensors(); i++)
 	{
-		publishText("**Extracting lines from sensor #" + std::to_string(i) + " observations**");
-		mvv_lines[i].resize((sync_model->getSyncIndices()[i]).size());
+		publishText("**Extracting lines from sensor #" + std::to_string(i) + " observations**", CLogSink::LOG_DEBUG);
 
-		//let's run it for 15 sets
-		for(size_t j = 0; j < 15; j++)
+		for(size_t j = 0; j < getLineStore().getNumberOfObservations(i); j++)
 		{
-			tree_item = root_item->child(j);
-
-			for(size_t k = 0; k < tree_item->childCount(); k++)
-			{
-				item = tree_item->child(k);
-				obs_item = std::dynamic_pointer_cast<CObservation3DRangeScan>(item->getObservation());
-				if((obs_item->sensorLabel == selected_sensor_labels[i]) && (obs_item->timestamp != prev_ts))
-				{
-					cv::Mat image = cv::cvarrToMat(obs_item->intensityImage.getAs<IplImage>());
-					Eigen::MatrixXf range = obs_item->rangeImage;
-
-					line_segment_start = pcl::getTime();
-					segmented_lines.clear();
-					segmentLines(image, range, m_params->seg, obs_item->cameraParamsIntensity, segmented_lines);
-					line_segment_end = pcl::getTime();
-
-					n_lines = segmented_lines.size();
-					publishText(std::to_string(n_lines) + " line(s) extracted from observation #" + std::to_string(tree_item->child(k)->getPriorIndex())
-					            + "\nTime elapsed: " +  std::to_string(line_segment_end - line_segment_start));
-
-					mvv_lines[i][sync_obs_id] = segmented_lines;
-					sync_obs_id++;
-					prev_ts = obs_item->timestamp;
-				}
-			}
+			publishText(std::to_string(getLineStore().count(i, j)) + " line(s) extracted from observation #" + std::to_string(sync_model->getSyncIndices()[i][j])
+			            + "\nTime elapsed: " +  std::to_string(times[i][j]), CLogSink::LOG_DEBUG);
 		}
-
-		sync_obs_id = 0;
 	}
 
-	m_params->calib_status = CalibrationFromLinesStatus::LINES_EXTRACTED;
-}
-
-void CCalibFromLinesGui::matchLines()
-{
-	publishText("****Running line matching algorithm****");
+	publishText("Total time elapsed: " + std::to_string(elapsed));
 
-	std::vector<Eigen::Matrix4f> sensor_poses = sync_model->getSensorPoses();
-	std::vector<std::string> sensor_labels;
+	std::shared_ptr<CFeatureCache> features = sync_model->getFeatureCache();
+	if(features->isEnabled())
+		publishText("Feature cache hits: " + std::to_string(features->getHits()) + ", misses: " + std::to_string(features->getMisses()));
 
-	CObservationTreeItem *root_item, *tree_item, *item;
-	int sync_obs_id, sensor_id;
-	root_item = sync_model->getRootItem();
-	sensor_labels = sync_model->getSensorLabels();
+	m_stages.markDone(EXTRACTION_STAGE, inputs_hash);
+	m_params.calib_status = CalibrationFromLinesStatus::LINES_EXTRACTED;
+	return true;
+}
 
-	std::vector<std::vector<CLine>> lines;
+bool CCalibFromLinesGui::matchLines(const TStageControl &control)
+{
+	// the lines are segmented again only if their inputs changed
+	if(!extractLines(control))
+		return false;
 
-	//for(int i = 0; i < root_item->childCount(); i++)
-	for(int i = 0; i < 15; i++)
+	uint64_t inputs_hash = matchingInputsHash(m_params.match);
+	if(m_stages.isUpToDate(MATCHING_STAGE, inputs_hash))
 	{
-		tree_item = root_item->child(i);
-		lines.resize(sensor_labels.size());
-
-		publishText("**Finding matches between lines in set #" + std::to_string(i) + "**");
-
-		for(int j = 0; j < tree_item->childCount(); j++)
-		{
-			item = tree_item->child(j);
-			sensor_id = utils::findItemIndexIn(sensor_labels, item->getObservation()->sensorLabel);
-			sync_obs_id = sync_model->findSyncIndexFromSet(i, item->getObservation()->sensorLabel);
-			lines[sensor_id] = mvv_lines[sensor_id][sync_obs_id];
-		}
+		publishText("Line matches are up to date with the matching parameters, reusing them");
+		m_params.calib_status = CalibrationFromLinesStatus::LINES_MATCHED;
+		return true;
+	}
 
-		findPotentialMatches(lines, i, m_params->match);
-		lines.clear();
+	publishText("****Running line matching algorithm****");
 
-		//print statistics
-		int count = 0;
+	if(!CCalibFromLines::matchLines(m_params.match, control))
+	{
+		m_stages.invalidate(MATCHING_STAGE);
+		publishText("Line matching cancelled", CLogSink::LOG_WARNING);
+		return false;
+	}
 
-		for(std::map<int,std::map<int,std::vector<std::array<int,3>>>>::iterator iter1 = mmv_line_corresp.begin(); iter1 != mmv_line_corresp.end(); iter1++)
+	//print statistics
+	for(std::map<int,std::map<int,std::vector<std::array<int,3>>>>::iterator iter1 = mmv_line_corresp.begin(); iter1 != mmv_line_corresp.end(); iter1++)
+	{
+		for(std::map<int,std::vector<std::array<int,3>>>::iterator iter2 = iter1->second.begin(); iter2 != iter1->second.end(); iter2++)
 		{
-			for(std::map<int,std::vector<std::array<int,3>>>::iterator iter2 = iter1->second.begin(); iter2 != iter1->second.end(); iter2++)
+			// the sets without lines of either sensor are recorded with a set id of -1
+			int count = 0;
+			for(int k = 0; k < iter2->second.size(); k++)
 			{
-				for(int k = 0; k < iter2->second.size(); k++)
-				{
-					if(iter2->second[k][0] == i)
-						count++;
-				}
-
-				publishText(std::to_string(count) + " matches found between sensor #" + std::to_string(iter1->first) + " and sensor #" + std::to_string(iter2->first));
-				count = 0;
+				if(iter2->second[k][0] >= 0)
+					count++;
 			}
+
+			publishText(std::to_string(count) + " matches found between sensor #" + std::to_string(iter1->first) + " and sensor #" + std::to_string(iter2->first));
 		}
 	}
 
-	m_params->calib_status = CalibrationFromLinesStatus::LINES_MATCHED;
+	m_stages.markDone(MATCHING_STAGE, inputs_hash);
+	m_params.calib_status = CalibrationFromLinesStatus::LINES_MATCHED;
+	return true;
 }
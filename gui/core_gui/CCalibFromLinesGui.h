@@ -2,6 +2,7 @@
 
 #include <observation_tree/CObservationTreeGui.h>
 #include <calib_solvers/CCalibFromLines.h>
+#include <CLogSink.h>
 #include <interfaces/CLinesObserver.h>
 #include <interfaces/CCorrespLinesObserver.h>
 
@@ -11,6 +12,8 @@
 
 /**
  * Provides a GUI wrapper around the core calibration from lines classes.
+ * The stages may run on a worker thread: their text is queued in the log sink without locking, and drained by the UI thread,
+ * and the lines and matches are only published to the observers, by reference, once the stage is done.
  */
 
 class CCalibFromLinesGui : public CCalibFromLines
@@ -20,20 +23,24 @@ public:
 	/**
 	 * Constructor
 	 * \param model The sync rawlog model.
-	 * \param params The parameters for the calibration.
+	 * \param params The parameters for the calibration, copied so that the stages do not race with the widget they come from.
 	 */
-	CCalibFromLinesGui(CObservationTree *model, TCalibFromLinesParams *params);
+	CCalibFromLinesGui(CObservationTree *model, const TCalibFromLinesParams &params);
 
 	~CCalibFromLinesGui();
 
-	/** Runs line segmentation on all the image observations in the model. */
-	void extractLines();
+	/**
+	 * \brief Runs line segmentation on all the image observations in the model, unless the lines are up to date with the segmentation parameters.
+	 * \param control receives the progress of the stage, and cancels it.
+	 * \return false if the stage was cancelled.
+	 */
+	bool extractLines(const TStageControl &control = TStageControl());
 
-	/** Runs line matching. */
-	void matchLines();
+	/** Runs line matching, after the segmentation if its inputs changed, unless the matches are up to date. Returns false if cancelled. */
+	bool matchLines(const TStageControl &control = TStageControl());
 
-	/** Adds observer to list of text observers. */
-	void addTextObserver(CTextObserver *observer);
+	/** Sets the sink the text is published to, shared with the other publishers of the application. */
+	void setLogSink(const std::shared_ptr<CLogSink> &log_sink);
 
 	/** Adds observer to list of line observers. */
 	void addLinesObserver(CLinesObserver *observer);
@@ -41,8 +48,8 @@ public:
 	/** Adds observer to list of matched lines observers. */
 	void addCorrespLinesObserver(CCorrespLinesObserver *observer);
 
-	/** Notifies text observers with a message. */
-	void publishText(const std::string &msg);
+	/** Queues a message in the log sink, if its level is not filtered out. Can be called from any thread. */
+	void publishText(const std::string &msg, const CLogSink::LogLevel &level = CLogSink::LOG_INFO);
 
 	/** Notifies observers with the extracted lines.
 	 * \param sensor_id id of the sensor whose observation the lines were extracted from.
@@ -55,6 +62,9 @@ public:
 	 */
 	void publishCorrespLines(const int &obs_set_id);
 
+	/** Sets the parameters the next runs use, e.g. those of a newly loaded configuration. */
+	void setParams(const TCalibFromLinesParams &params);
+
 	/** Returns the status of the calibration progress. */
 	CalibrationFromLinesStatus calibStatus();
 
@@ -62,10 +72,10 @@ public:
 private:
 
 	/** The parameters for the calibration. */
-	TCalibFromLinesParams *m_params;
+	TCalibFromLinesParams m_params;
 
-	/** List of text observers to be notified about the progress. */
-	std::vector<CTextObserver*> m_text_observers;
+	/** Hands the progress over to the UI thread. */
+	std::shared_ptr<CLogSink> m_log_sink;
 
 	/** List of observers to be notified about the extracted lines. */
 	std::vector<CLinesObserver*> m_lines_observers;
@@ -1,4 +1,6 @@
 #include "CCalibFromPlanesGui.h"
+#include <CFeatureCache.h>
+#include <CProfiler.h>
 
 #include <mrpt/obs/CObservation3DRangeScan.h>
 #include <mrpt/math/types_math.h>
@@ -11,14 +13,13 @@
 #include <pcl/features/normal_3d.h>
 #include <pcl/features/integral_image_normal.h>
 #include <pcl/filters/extract_indices.h>
-#include <pcl/common/time.h>
 
 #include <thread>
 #include <functional>
 
 using namespace mrpt::obs;
 
-CCalibFromPlanesGui::CCalibFromPlanesGui(CObservationTreeGui *model, TCalibFromPlanesParams *params) :
+CCalibFromPlanesGui::CCalibFromPlanesGui(CObservationTreeGui *model, const TCalibFromPlanesParams &params) :
     CCalibFromPlanes(model)
 {
 	m_params = params;
@@ -28,9 +29,9 @@ CCalibFromPlanesGui::~CCalibFromPlanesGui()
 {
 }
 
-void CCalibFromPlanesGui::addTextObserver(CTextObserver *observer)
+void CCalibFromPlanesGui::setLogSink(const std::shared_ptr<CLogSink> &log_sink)
 {
-	m_text_observers.push_back(observer);
+	m_log_sink = log_sink;
 }
 
 void CCalibFromPlanesGui::addPlanesObserver(CPlanesObserver *observer)
@@ -43,19 +44,17 @@ void CCalibFromPlanesGui::addCorrespPlanesObserver(CCorrespPlanesObserver *obser
 	m_corresp_planes_observers.push_back(observer);
 }
 
-void CCalibFromPlanesGui::publishText(const std::string &msg)
+void CCalibFromPlanesGui::publishText(const std::string &msg, const CLogSink::LogLevel &level)
 {
-	for(CTextObserver *observer : m_text_observers)
-	{
-		observer->onReceivingText(msg);
-	}
+	if(m_log_sink)
+		m_log_sink->log(msg, level);
 }
 
 void CCalibFromPlanesGui::publishPlanes(const int &sensor_id, const int &sync_obs_id)
 {
 	for(CPlanesObserver *observer : m_planes_observers)
 	{
-		observer->onReceivingPlanes(sensor_id, mvv_planes[sensor_id][sync_obs_id]);
+		observer->onReceivingPlanes(sensor_id, getPlaneStore().getObservationPlanes(sensor_id, sync_obs_id));
 	}
 }
 
@@ -77,11 +76,11 @@ void CCalibFromPlanesGui::publishCorrespPlanes(const int &obs_set_id)
 				int set_id = correspondences[i][0];
 				if(set_id == obs_set_id)
 				{
-					int sync_obs1_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_i]);
-					int sync_obs2_id = sync_model->findSyncIndexFromSet(set_id, sync_model->getSensorLabels()[sensor_j]);
+					int sync_obs1_id = sync_model->getSyncIndex(set_id, sensor_i);
+					int sync_obs2_id = sync_model->getSyncIndex(set_id, sensor_j);
 
-					std::array<CPlaneCHull,2> planes_pair{mvv_planes[sensor_i][sync_obs1_id][correspondences[i][1]],
-						                                 mvv_planes[sensor_j][sync_obs2_id][correspondences[i][2]]};
+					std::array<CPlaneCHull,2> planes_pair{getPlaneStore().getPlane(sensor_i, sync_obs1_id, correspondences[i][1]),
+						                                 getPlaneStore().getPlane(sensor_j, sync_obs2_id, correspondences[i][2])};
 					corresp_planes[sensor_i][sensor_j].push_back(planes_pair);
 				}
 			}
@@ -94,9 +93,14 @@ void CCalibFromPlanesGui::publishCorrespPlanes(const int &obs_set_id)
 	}
 }
 
+void CCalibFromPlanesGui::setParams(const TCalibFromPlanesParams &params)
+{
+	m_params = params;
+}
+
 CalibrationFromPlanesStatus CCalibFromPlanesGui::calibStatus()
 {
-	return m_params->calib_status;
+	return m_params.calib_status;
 }
 
 void CCalibFromPlanesGui::run()
@@ -104,139 +108,132 @@ void CCalibFromPlanesGui::run()
 	// For running all steps at a time
 }
 
-void CCalibFromPlanesGui::extractPlanes()
+bool CCalibFromPlanesGui::extractPlanes(const TStageControl &control)
 {
-	publishText("****Running plane segmentation algorithm****");
-
-	CObservationTreeItem *root_item, *tree_item, *item;
-	CObservation3DRangeScan::Ptr obs_item;
-	size_t sync_obs_id = 0;
-	root_item = sync_model->getRootItem();
-
-	T3DPointsProjectionParams projection_params;
-	projection_params.MAKE_DENSE = false;
-	projection_params.MAKE_ORGANIZED = true;
-
-	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+	uint64_t inputs_hash = extractionInputsHash(m_params.seg);
+	if(m_stages.isUpToDate(EXTRACTION_STAGE, inputs_hash))
+	{
+		publishText("Planes are up to date with the segmentation parameters, reusing them");
+		m_params.calib_status = CalibrationFromPlanesStatus::PLANES_EXTRACTED;
+		return true;
+	}
 
-	std::vector<CPlaneCHull> segmented_planes;
-	size_t n_planes;
-	double plane_segment_start, plane_segment_end;
+	publishText("****Running plane segmentation algorithm****");
 
-	std::vector<std::string> selected_sensor_labels;
-	std::string prev_sensor_label;
-	mrpt::system::TTimeStamp prev_ts = 0;
+	std::vector<std::vector<double>> times;
+	CScopedTimer timer("planeSegmentationStage");
+	bool done = CCalibFromPlanes::extractPlanes(m_params.seg, &times, control);
+	double elapsed = timer.stop();
 
-	selected_sensor_labels = sync_model->getSensorLabels();
+	if(!done)
+	{
+		// the planes of the observations not segmented are missing, so the stages downstream cannot use them
+		m_stages.invalidate(EXTRACTION_STAGE);
+		if(getUnreadObservationCount() > 0)
+			publishText(std::to_string(getUnreadObservationCount()) + " observations could not be read from the rawlog, their planes are missing",
+			            CLogSink::LOG_ERROR);
+		else
+			publishText("Plane segmentation cancelled", CLogSink::LOG_WARNING);
+
+		return false;
+	}
 
-	for(size_t i = 0; i < selected_sensor_labels.size(); i++)
+	// the results are published once all the workers are done, from the calling thread
+	for(size_t i = 0; i < getPlaneStore().getNumberOfSensors(); i++)
 	{
-		publishText("**Extracting planes from sensor #" + std::to_string(i) + " observations**");
-		mvv_planes[i].resize((sync_model->getSyncIndices()[i]).size());
+		publishText("**Extracting planes from sensor #" + std::to_string(i) + " observations**", CLogSink::LOG_DEBUG);
 
-		//let's run it for 15 sets
-		for(size_t j = 0; j < 15; j++)
+		for(size_t j = 0; j < getPlaneStore().getNumberOfObservations(i); j++)
 		{
-			tree_item = root_item->child(j);
-
-			for(size_t k = 0; k < tree_item->childCount(); k++)
-			{
-				item = tree_item->child(k);
-				obs_item = std::dynamic_pointer_cast<CObservation3DRangeScan>(item->getObservation());
-				if((obs_item->sensorLabel == selected_sensor_labels[i]) && (obs_item->timestamp != prev_ts))
-				{
-					if(item->cloud() != nullptr)
-						cloud  = item->cloud();
-
-					else
-					{
-						obs_item->project3DPointsFromDepthImageInto(*cloud, projection_params);
-						cloud->is_dense = false;
-						item->cloud() = cloud;
-					}
-
-					plane_segment_start = pcl::getTime();
-					segmented_planes.clear();
-					segmentPlanes(cloud, m_params->seg, segmented_planes);
-					plane_segment_end = pcl::getTime();
-
-					n_planes = segmented_planes.size();
-					publishText(std::to_string(n_planes) + " plane(s) extracted from observation #" + std::to_string(tree_item->child(k)->getPriorIndex())
-					            + "\nTime elapsed: " +  std::to_string(plane_segment_end - plane_segment_start));
-
-					mvv_planes[i][sync_obs_id] = segmented_planes;
-					sync_obs_id++;
-					prev_ts = obs_item->timestamp;
-				}
-			}
+			publishText(std::to_string(getPlaneStore().count(i, j)) + " plane(s) extracted from observation #" + std::to_string(sync_model->getSyncIndices()[i][j])
+			            + "\nTime elapsed: " +  std::to_string(times[i][j]), CLogSink::LOG_DEBUG);
 		}
-
-		sync_obs_id = 0;
 	}
 
-	m_params->calib_status = CalibrationFromPlanesStatus::PLANES_EXTRACTED;
-}
-
-void CCalibFromPlanesGui::matchPlanes()
-{
-	publishText("****Running plane matching algorithm****");
+	publishText("Total time elapsed: " + std::to_string(elapsed));
 
-	std::vector<Eigen::Matrix4f> sensor_poses = sync_model->getSensorPoses();
-	std::vector<std::string> sensor_labels;
+	std::shared_ptr<CFeatureCache> features = sync_model->getFeatureCache();
+	if(features->isEnabled())
+		publishText("Feature cache hits: " + std::to_string(features->getHits()) + ", misses: " + std::to_string(features->getMisses()));
 
-	CObservationTreeItem *root_item, *tree_item, *item;
-	int sync_obs_id, sensor_id;
-	root_item = sync_model->getRootItem();
-	sensor_labels = sync_model->getSensorLabels();
+	m_stages.markDone(EXTRACTION_STAGE, inputs_hash);
+	m_params.calib_status = CalibrationFromPlanesStatus::PLANES_EXTRACTED;
+	return true;
+}
 
-	std::vector<std::vector<CPlaneCHull>> planes;
+bool CCalibFromPlanesGui::matchPlanes(const TStageControl &control)
+{
+	// the planes are segmented again only if their inputs changed
+	if(!extractPlanes(control))
+		return false;
 
-	//for(int i = 0; i < root_item->childCount(); i++)
-	for(int i = 0; i < 15; i++)
+	uint64_t inputs_hash = matchingInputsHash(m_params.match);
+	if(m_stages.isUpToDate(MATCHING_STAGE, inputs_hash))
 	{
-		tree_item = root_item->child(i);
-		planes.resize(sensor_labels.size());
-
-		publishText("**Finding matches between planes in set #" + std::to_string(i) + "**");
+		publishText("Plane matches are up to date with the matching parameters, reusing them");
+		m_params.calib_status = CalibrationFromPlanesStatus::PLANES_MATCHED;
+		return true;
+	}
 
-		for(int j = 0; j < tree_item->childCount(); j++)
-		{
-			item = tree_item->child(j);
-			sensor_id = utils::findItemIndexIn(sensor_labels, item->getObservation()->sensorLabel);
-			sync_obs_id = sync_model->findSyncIndexFromSet(i, item->getObservation()->sensorLabel);
-			planes[sensor_id] = mvv_planes[sensor_id][sync_obs_id];
-		}
+	publishText("****Running plane matching algorithm****");
 
-		findPotentialMatches(planes, i, m_params->match);
-		planes.clear();
+	if(!CCalibFromPlanes::matchPlanes(m_params.match, control))
+	{
+		m_stages.invalidate(MATCHING_STAGE);
+		publishText("Plane matching cancelled", CLogSink::LOG_WARNING);
+		return false;
+	}
 
-		//print statistics
-		int count = 0;
-		for(std::map<int,std::map<int,std::vector<std::array<int,3>>>>::iterator iter1 = mmv_plane_corresp.begin(); iter1 != mmv_plane_corresp.end(); iter1++)
+	//print statistics
+	for(std::map<int,std::map<int,std::vector<std::array<int,3>>>>::iterator iter1 = mmv_plane_corresp.begin(); iter1 != mmv_plane_corresp.end(); iter1++)
+	{
+		for(std::map<int,std::vector<std::array<int,3>>>::iterator iter2 = iter1->second.begin(); iter2 != iter1->second.end(); iter2++)
 		{
-			for(std::map<int,std::vector<std::array<int,3>>>::iterator iter2 = iter1->second.begin(); iter2 != iter1->second.end(); iter2++)
+			// the sets without planes of either sensor are recorded with a set id of -1
+			int count = 0;
+			for(int k = 0; k < iter2->second.size(); k++)
 			{
-				for(int k = 0; k < iter2->second.size(); k++)
-				{
-					if(iter2->second[k][0] == i)
-						count++;
-				}
-
-				publishText(std::to_string(count) + " matches found between sensor #" + std::to_string(iter1->first) + " and sensor #" + std::to_string(iter2->first));
-				count = 0;
+				if(iter2->second[k][0] >= 0)
+					count++;
 			}
+
+			publishText(std::to_string(count) + " matches found between sensor #" + std::to_string(iter1->first) + " and sensor #" + std::to_string(iter2->first));
 		}
 	}
 
-	m_params->calib_status = CalibrationFromPlanesStatus::PLANES_MATCHED;
+	m_stages.markDone(MATCHING_STAGE, inputs_hash);
+	m_params.calib_status = CalibrationFromPlanesStatus::PLANES_MATCHED;
+	return true;
 }
 
-void CCalibFromPlanesGui::calibrate()
+bool CCalibFromPlanesGui::calibrate(const TStageControl &control)
 {
+	// the planes are segmented and matched again only if their inputs changed
+	if(!matchPlanes(control))
+		return false;
+
+	uint64_t inputs_hash = solverInputsHash(m_params.solver);
+	if(m_stages.isUpToDate(SOLVER_STAGE, inputs_hash))
+	{
+		publishText("The calibration is up to date with the solver parameters");
+		publishText(m_solver_stats);
+		return true;
+	}
+
 	publishText("****Running the calibration solver****");
 
 	std::string stats;
-    computeRotation(m_params->solver, sync_model->getSensorPoses(), stats);
+    computeRotation(m_params.solver, sync_model->getSensorPoses(), stats, control);
+
+	if(control.isCancelled())
+	{
+		m_stages.invalidate(SOLVER_STAGE);
+		publishText("Calibration solver cancelled", CLogSink::LOG_WARNING);
+		return false;
+	}
 
+	m_solver_stats = stats;
+	m_stages.markDone(SOLVER_STAGE, inputs_hash);
 	publishText(stats);
+	return true;
 }
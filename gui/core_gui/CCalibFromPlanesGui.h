@@ -1,7 +1,7 @@
 #pragma once
 
 #include <observation_tree/CObservationTreeGui.h>
-#include <interfaces/CTextObserver.h>
+#include <CLogSink.h>
 #include <interfaces/CPlanesObserver.h>
 #include <interfaces/CCorrespPlanesObserver.h>
 #include <calib_solvers/CCalibFromPlanes.h>
@@ -13,6 +13,8 @@
 
 /**
  * Provides a GUI wrapper around the core calibration from planes classes.
+ * The stages may run on a worker thread: their text is queued in the log sink without locking, and drained by the UI thread,
+ * and the planes and matches are only published to the observers, by reference, once the stage is done.
  *
  * Inherits from CCalibFromPlanes.
  */
@@ -23,25 +25,29 @@ public:
 	/**
 	 * Constructor
 	 * \param model the synced rawlog model.
-	 * \param params parameters for the algorithm.
+	 * \param params parameters for the algorithm, copied so that the stages do not race with the widget they come from.
 	 */
-	CCalibFromPlanesGui(CObservationTreeGui *model, TCalibFromPlanesParams *params);
+	CCalibFromPlanesGui(CObservationTreeGui *model, const TCalibFromPlanesParams &params);
 
 	~CCalibFromPlanesGui();
 
 	void run();
 
-	/** Runs plane segmentation. */
-	void extractPlanes();
+	/**
+	 * \brief Runs plane segmentation, unless the planes are up to date with the segmentation parameters and the synchronized observations.
+	 * \param control receives the progress of the stage, and cancels it.
+	 * \return false if the stage was cancelled.
+	 */
+	bool extractPlanes(const TStageControl &control = TStageControl());
 
-	/** Runs plane matching. */
-	void matchPlanes();
+	/** Runs plane matching, after any upstream stage whose inputs changed, unless the matches are up to date. Returns false if cancelled. */
+	bool matchPlanes(const TStageControl &control = TStageControl());
 
-	/** Runs the calibration solver. */
-	void calibrate();
+	/** Runs the calibration solver, after any upstream stage whose inputs changed, unless the calibration is up to date. Returns false if cancelled. */
+	bool calibrate(const TStageControl &control = TStageControl());
 
-	/** Adds observer to list of text observers. */
-	void addTextObserver(CTextObserver *observer);
+	/** Sets the sink the text is published to, shared with the other publishers of the application. */
+	void setLogSink(const std::shared_ptr<CLogSink> &log_sink);
 
 	/** Adds observer to list of plane observers. */
 	void addPlanesObserver(CPlanesObserver *observer);
@@ -49,8 +55,8 @@ public:
 	/** Adds observer to list of matched planes observers. */
 	void addCorrespPlanesObserver(CCorrespPlanesObserver *observer);
 
-	/** Notifies text observers with a message. */
-	void publishText(const std::string &msg);
+	/** Queues a message in the log sink, if its level is not filtered out. Can be called from any thread. */
+	void publishText(const std::string &msg, const CLogSink::LogLevel &level = CLogSink::LOG_INFO);
 
 	/** Notifies observers with the extracted planes.
 	 * \param sensor_id id of the sensor whose observervation the planes were extracted from.
@@ -63,16 +69,22 @@ public:
 	 */
 	void publishCorrespPlanes(const int &obs_set_id);
 
+	/** Sets the parameters the next runs use, e.g. those of a newly loaded configuration. */
+	void setParams(const TCalibFromPlanesParams &params);
+
 	/** Returns the status of the calibration progress. */
 	CalibrationFromPlanesStatus calibStatus();
 
 private:
 
 	/** The parameters for the calibration. */
-	TCalibFromPlanesParams *m_params;
+	TCalibFromPlanesParams m_params;
+
+	/** The statistics of the last solver run, published again while the calibration is up to date. */
+	std::string m_solver_stats;
 
-	/** List of text observers to be notified about the progress. */
-	std::vector<CTextObserver*> m_text_observers;
+	/** Hands the progress over to the UI thread. */
+	std::shared_ptr<CLogSink> m_log_sink;
 
 	/** List of observers to be notified about the extracted planes. */
 	std::vector<CPlanesObserver*> m_planes_observers;
@@ -43,7 +43,7 @@ QModelIndex CObservationTreeGui::index(int row, int column, const QModelIndex &p
 	CObservationTreeItem *parent_item;
 
 	if(!parent.isValid())
-		parent_item =  m_rootitem;
+		parent_item =  getRootItem();
 	else
 		parent_item = static_cast<CObservationTreeItem*>(parent.internalPointer());
 
@@ -63,7 +63,7 @@ QModelIndex CObservationTreeGui::parent(const QModelIndex &index) const
 	CObservationTreeItem *child_item = static_cast<CObservationTreeItem*>(index.internalPointer());
 	CObservationTreeItem *parent_item = child_item->parentItem();
 
-	if(parent_item == m_rootitem)
+	if(parent_item == getRootItem())
 		return QModelIndex();
 
 	return createIndex(parent_item->row(), 0, parent_item);
@@ -77,7 +77,7 @@ int CObservationTreeGui::rowCount(const QModelIndex &parent) const
 		return 0;
 
 	if(!parent.isValid())
-		parent_item = m_rootitem;
+		parent_item = getRootItem();
 	else
 		parent_item = static_cast<CObservationTreeItem*>(parent.internalPointer());
 
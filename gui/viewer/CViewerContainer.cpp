@@ -12,6 +12,9 @@ CViewerContainer::CViewerContainer(QWidget *parent) :
 {
 	m_ui->setupUi(this);
 
+	// the oldest paragraphs are dropped, so that long runs do not slow down the text output as it grows
+	m_ui->text_output->document()->setMaximumBlockCount(10000);
+
 	connect(m_ui->input1_cbox, SIGNAL(activated(int)), this, SLOT(sensorIndexChanged(int)));
 	connect(m_ui->input2_cbox, SIGNAL(activated(int)), this, SLOT(sensorIndexChanged(int)));
 
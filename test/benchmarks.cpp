@@ -0,0 +1,379 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#include "synthetic/CSyntheticScene.h"
+
+#include <CObservationTree.h>
+#include <CDepthProjector.h>
+#include <CProfiler.h>
+#include <calib_solvers/CCalibFromPlanes.h>
+#include <calib_solvers/CCalibFromLines.h>
+#include <calib_solvers/CLineDetector.h>
+#include <calib_solvers/CPlaneSegmentationWorkspace.h>
+
+#include <mrpt/config/CConfigFile.h>
+#include <mrpt/system/filesystem.h>
+#include <pcl/console/parse.h>
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * The number and total size of the allocations made through the global operator new, which the containers of the standard library
+ * and of PCL go through. The buffers Eigen aligns itself, e.g. those of the points of a cloud, are taken with malloc and not counted.
+ */
+static atomic<size_t> allocation_count(0);
+static atomic<size_t> allocated_bytes(0);
+
+void *operator new(size_t size)
+{
+	allocation_count.fetch_add(1, memory_order_relaxed);
+	allocated_bytes.fetch_add(size, memory_order_relaxed);
+
+	if(void *ptr = malloc(size > 0 ? size : 1))
+		return ptr;
+
+	throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+/** The times of the repetitions of a benchmark, in seconds. */
+struct TBenchmarkResult
+{
+	string name;
+	vector<double> times;
+};
+
+void print_help(char ** argv)
+{
+	cout << "\nThis program renders a synthetic rawlog of a rig of RGB-D sensors with known extrinsics, and times the stages of the calibration on it,\n";
+	cout << "each on its own (micro benchmarks) and all together from a fresh load of the rawlog (end to end).\n";
+	cout << "It also counts the heap allocations of the plane segmentation per frame, with and without a warmed up workspace.\n";
+	cout << "  usage: " <<  argv[0] << " [-d data_dir] [-c config_file] [-n num_sensors] [-f num_frames] [-r repetitions] [-o output_file]\n";
+	cout << "            -d the directory the synthetic rawlog is written to, the current directory by default\n";
+	cout << "            -c the app configuration file the parameters of the stages are read from, the defaults of the app if not given\n";
+	cout << "            -n the number of sensors of the rig, 2 by default\n";
+	cout << "            -f the number of frames observed by every sensor, 30 by default\n";
+	cout << "            -r the number of repetitions of each benchmark, 5 by default\n";
+	cout << "            -o the file the times of all the repetitions are written to as CSV\n";
+	cout << argv[0] << " -h | --help : shows this help" << endl;
+}
+
+/**
+ * Times the repetitions of a benchmark, each also recorded by the profiler under the name of the benchmark.
+ * \param setup run before each repetition, untimed, e.g. to clear the results of the previous one.
+ */
+template <typename Setup, typename Body>
+TBenchmarkResult runBenchmark(const char *name, const int &repetitions, const Setup &setup, const Body &body)
+{
+	TBenchmarkResult result;
+	result.name = name;
+
+	for(int i = 0; i < repetitions; i++)
+	{
+		setup();
+
+		CScopedTimer timer(name);
+		body();
+		result.times.push_back(timer.stop());
+	}
+
+	return result;
+}
+
+template <typename Body>
+TBenchmarkResult runBenchmark(const char *name, const int &repetitions, const Body &body)
+{
+	return runBenchmark(name, repetitions, [](){}, body);
+}
+
+void printResults(ostream &out, const vector<TBenchmarkResult> &results)
+{
+	out << fixed << setprecision(3);
+	out << left << setw(24) << "benchmark" << right << setw(8) << "reps" << setw(12) << "min (ms)"
+	    << setw(14) << "median (ms)" << setw(12) << "mean (ms)" << "\n";
+
+	for(const TBenchmarkResult &result : results)
+	{
+		vector<double> times = result.times;
+		sort(times.begin(), times.end());
+		double mean = accumulate(times.begin(), times.end(), 0.0) / times.size();
+
+		out << left << setw(24) << result.name << right << setw(8) << times.size() << setw(12) << 1e3 * times.front()
+		    << setw(14) << 1e3 * times[times.size() / 2] << setw(12) << 1e3 * mean << "\n";
+	}
+
+	out << endl;
+}
+
+void writeCsv(ostream &out, const vector<TBenchmarkResult> &results)
+{
+	out << "benchmark,repetition,time_ms\n";
+	for(const TBenchmarkResult &result : results)
+		for(size_t i = 0; i < result.times.size(); i++)
+			out << result.name << "," << i << "," << 1e3 * result.times[i] << "\n";
+}
+
+/** Returns the largest rotation error of the estimated sensor poses, in degrees, matching them to the ground truth by label. */
+double maxRotationError(const CSyntheticScene &scene, const vector<string> &sensor_labels, const vector<Eigen::Matrix4f> &estimated_poses)
+{
+	double max_error = 0;
+	const vector<string> &labels = scene.getSensorLabels();
+
+	for(size_t i = 0; i < sensor_labels.size() && i < estimated_poses.size(); i++)
+	{
+		size_t truth_id = find(labels.begin(), labels.end(), sensor_labels[i]) - labels.begin();
+		if(truth_id < labels.size())
+			max_error = max(max_error, CSyntheticScene::rotationError(scene.getSensorPoses()[truth_id], estimated_poses[i]));
+	}
+
+	return max_error;
+}
+
+/*! This program benchmarks the stages of the calibration on a synthetic rawlog, without any external dataset. */
+int main(int argc, char ** argv)
+{
+	try
+	{
+		if(pcl::console::find_switch(argc, argv, "-h") || pcl::console::find_switch(argc, argv, "--help"))
+		{
+			print_help(argv);
+			return 0;
+		}
+
+		string data_dir = ".", config_path, output_path;
+		int num_sensors = 2, num_frames = 30, repetitions = 5;
+
+		pcl::console::parse_argument(argc, argv, "-d", data_dir);
+		pcl::console::parse_argument(argc, argv, "-c", config_path);
+		pcl::console::parse_argument(argc, argv, "-n", num_sensors);
+		pcl::console::parse_argument(argc, argv, "-f", num_frames);
+		pcl::console::parse_argument(argc, argv, "-r", repetitions);
+		pcl::console::parse_argument(argc, argv, "-o", output_path);
+
+		if(num_sensors < 2 || num_frames < 1 || repetitions < 1)
+		{
+			cerr << "At least two sensors, one frame and one repetition are needed" << endl;
+			return 1;
+		}
+
+		if(!mrpt::system::directoryExists(data_dir) && !mrpt::system::createDirectory(data_dir))
+		{
+			cerr << "Could not create " << data_dir << endl;
+			return 1;
+		}
+
+		TSyntheticSceneParams scene_params;
+		scene_params.num_frames = num_frames;
+		CSyntheticScene scene(scene_params, CSyntheticScene::defaultRig(num_sensors));
+
+		string rawlog_path = data_dir + "/synthetic.rawlog", synthetic_config_path = data_dir + "/synthetic.ini";
+		cerr << "Writing " << num_sensors * num_frames << " synthetic observations to " << rawlog_path << endl;
+
+		if(!scene.writeRawlog(rawlog_path)
+		   || !scene.writeConfig(synthetic_config_path, rawlog_path, CSyntheticScene::perturbPoses(scene.getSensorPoses(), 5, 0.05, scene_params.seed)))
+		{
+			cerr << "Could not write the synthetic rawlog to " << data_dir << endl;
+			return 1;
+		}
+
+		// the stages are configured as in the app, and the rawlog as written by the scene
+		mrpt::config::CConfigFile config_file(config_path.empty() ? synthetic_config_path : config_path);
+		mrpt::config::CConfigFile synthetic_config(synthetic_config_path);
+		int max_delay = synthetic_config.read_int("grouping_observations", "max_delay", 30);
+
+		TCalibFromPlanesParams planes_params;
+		planes_params.load(config_file);
+		TCalibFromLinesParams lines_params;
+		lines_params.load(config_file);
+
+		CProfiler::instance().clear();
+		vector<TBenchmarkResult> results;
+
+		// micro benchmarks, each stage on its own on a model loaded once
+		CObservationTree model(rawlog_path, synthetic_config);
+		TRawlogLoadParams load_params;
+		load_params.use_index = false;
+		model.loadTree(load_params);
+		model.syncObservations(model.getSensorLabels(), max_delay);
+
+		const int num_sets = model.getRootItem()->childCount();
+		if(num_sets == 0)
+		{
+			cerr << "Error. No synchronized observation sets in the synthetic rawlog" << endl;
+			return 1;
+		}
+
+		const int record_id = model.getSyncIndices()[0][0];
+		mrpt::obs::CObservation3DRangeScan::Ptr obs = std::dynamic_pointer_cast<mrpt::obs::CObservation3DRangeScan>(model.getObservation(record_id));
+		if(!obs)
+		{
+			cerr << "Error. The first observation could not be read from the synthetic rawlog" << endl;
+			return 1;
+		}
+
+		vector<Eigen::Matrix4f> initial_poses = model.getSensorPoses();
+
+		results.push_back(runBenchmark("render", repetitions, [&]() { scene.render(0, 0); }));
+
+		CDepthProjector projector;
+		pcl::PointCloud<pcl::PointXYZRGBA> projected_cloud;
+		results.push_back(runBenchmark("project", repetitions, [&]() { projector.project(*obs, projected_cloud); }));
+
+		CCalibFromPlanes planes_calib(&model);
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud = model.getCloud(record_id, CCloudCache::COORDINATES);
+		vector<CPlaneCHull> planes;
+		results.push_back(runBenchmark("segmentPlanes", repetitions, [&]() { planes.clear(); planes_calib.segmentPlanes(cloud, planes_params.seg, planes); }));
+
+		// the allocations of segmentPlanes per frame once warmed up, with and without a workspace, what remains with one being
+		// allocated inside PCL (e.g. the point indices of the regions) or for the planes returned
+		vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> frame_clouds;
+		for(const int &frame_record_id : model.getSyncIndices()[0])
+			if(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr frame_cloud = model.getCloud(frame_record_id, CCloudCache::COORDINATES))
+				frame_clouds.push_back(frame_cloud);
+
+		CPlaneSegmentationWorkspace workspace;
+		for(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &frame_cloud : frame_clouds)
+		{
+			planes.clear();
+			planes_calib.segmentPlanes(frame_cloud, planes_params.seg, planes, workspace);
+		}
+
+		size_t frame_allocations[2] = {0, 0}, frame_bytes[2] = {0, 0};
+		for(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &frame_cloud : frame_clouds)
+		{
+			for(int reuse = 0; reuse < 2; reuse++)
+			{
+				planes.clear();
+				size_t count_before = allocation_count, bytes_before = allocated_bytes;
+
+				if(reuse)
+					planes_calib.segmentPlanes(frame_cloud, planes_params.seg, planes, workspace);
+				else
+					planes_calib.segmentPlanes(frame_cloud, planes_params.seg, planes);
+
+				frame_allocations[reuse] += allocation_count - count_before;
+				frame_bytes[reuse] += allocated_bytes - bytes_before;
+			}
+		}
+
+		planes_calib.extractPlanes(planes_params.seg);
+
+		results.push_back(runBenchmark("findPotentialMatches", repetitions, [&]() { planes_calib.clearMatches(); }, [&]()
+		{
+			for(int set_id = 0; set_id < num_sets; set_id++)
+				planes_calib.findPotentialMatches(set_id, planes_params.match);
+		}));
+
+		string stats;
+		results.push_back(runBenchmark("computeRotation", repetitions, [&]() { planes_calib.computeRotation(planes_params.solver, initial_poses, stats); }));
+
+		CCalibFromLines lines_calib(&model);
+		cv::Mat image = cv::cvarrToMat(obs->intensityImage.getAs<IplImage>());
+		TLineBatch lines;
+
+		// the latency of a frame with each line detector, the one of the config file being the one used end to end
+		const char *detector_benchmarks[CLineDetector::NUM_TYPES] = {"segmentLines.hough", "segmentLines.probabilisticHough", "segmentLines.edgeChains"};
+		TLineSegmentationParams detector_params = lines_params.seg;
+		for(int type = 0; type < CLineDetector::NUM_TYPES; type++)
+		{
+			detector_params.detector = type;
+			results.push_back(runBenchmark(detector_benchmarks[type], repetitions, [&]()
+			{
+				lines_calib.segmentLines(image, utils::rangeView(obs->rangeImage), detector_params, obs->cameraParamsIntensity, lines);
+			}));
+
+			cerr << lines.size() << " lines segmented from the first observation by " << CLineDetector::typeName(type) << endl;
+		}
+
+		lines_calib.extractLines(lines_params.seg);
+
+		results.push_back(runBenchmark("findPotentialMatches.lines", repetitions, [&]() { lines_calib.clearMatches(); }, [&]()
+		{
+			for(int set_id = 0; set_id < num_sets; set_id++)
+				lines_calib.findPotentialMatches(set_id, lines_params.match);
+		}));
+
+		cerr << planes.size() << " planes segmented from the first observation" << endl;
+
+		// end to end, from a fresh load of the rawlog to the rotation of the sensors
+		vector<string> sensor_labels;
+		vector<Eigen::Matrix4f> estimated_poses;
+
+		results.push_back(runBenchmark("endToEnd", repetitions, [&]()
+		{
+			CObservationTree run_model(rawlog_path, synthetic_config);
+			run_model.loadTree(load_params);
+			run_model.syncObservations(run_model.getSensorLabels(), max_delay);
+
+			CCalibFromPlanes run_calib(&run_model);
+			run_calib.extractPlanes(planes_params.seg);
+			run_calib.matchPlanes(planes_params.match);
+			run_calib.computeRotation(planes_params.solver, run_model.getSensorPoses(), stats);
+
+			sensor_labels = run_model.getSensorLabels();
+			estimated_poses.assign(run_calib.m_calibration.begin(), run_calib.m_calibration.end());
+		}));
+
+		cerr << "Rotation error of the calibration: " << maxRotationError(scene, sensor_labels, initial_poses) << " deg initially, "
+		     << maxRotationError(scene, sensor_labels, estimated_poses) << " deg estimated\n" << endl;
+
+		printResults(cout, results);
+
+		const char *allocation_rows[2] = {"segmentPlanes", "segmentPlanes.workspace"};
+		cout << left << setw(24) << "allocations per frame" << right << setw(8) << "frames" << setw(12) << "count" << setw(14) << "size (KB)" << "\n";
+		for(int reuse = 0; reuse < 2 && !frame_clouds.empty(); reuse++)
+			cout << left << setw(24) << allocation_rows[reuse] << right << setw(8) << frame_clouds.size()
+			     << setw(12) << static_cast<double>(frame_allocations[reuse]) / frame_clouds.size()
+			     << setw(14) << frame_bytes[reuse] / 1024.0 / frame_clouds.size() << "\n";
+		cout << endl;
+
+		cerr << CProfiler::instance().summary() << endl;
+
+		if(!output_path.empty())
+		{
+			ofstream output(output_path);
+			writeCsv(output, results);
+
+			if(!output)
+			{
+				cerr << "Could not write the results to " << output_path << endl;
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	catch(exception &e)
+	{
+		cerr << "Exception caught: " << e.what() << endl;
+		return 1;
+	}
+}
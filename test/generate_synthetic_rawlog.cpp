@@ -0,0 +1,87 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#include "synthetic/CSyntheticScene.h"
+
+#include <mrpt/system/filesystem.h>
+#include <pcl/console/parse.h>
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+void print_help(char ** argv)
+{
+	cout << "\nThis program renders a rig of RGB-D sensors with known extrinsics sweeping a synthetic room, and writes the frames as a rawlog\n";
+	cout << "together with a config file whose initial calibration is off the ground truth by the given amounts.\n";
+	cout << "  usage: " <<  argv[0] << " <output_dir> [-n num_sensors] [-f num_frames] [-noise sigma] [-rot degrees] [-trans meters] [-seed seed]\n";
+	cout << "            <output_dir> the directory synthetic.rawlog and synthetic.ini are written to, created if needed\n";
+	cout << "            -n the number of sensors of the rig, 2 by default\n";
+	cout << "            -f the number of frames observed by every sensor, 30 by default\n";
+	cout << "            -noise the standard deviation of the depth noise at 1 m, in meters, 0 by default\n";
+	cout << "            -rot, -trans the error of the initial calibration, 5 degrees and 0.05 m by default\n";
+	cout << argv[0] << " -h | --help : shows this help" << endl;
+}
+
+int main(int argc, char ** argv)
+{
+	if(argc < 2 || pcl::console::find_switch(argc, argv, "-h") || pcl::console::find_switch(argc, argv, "--help"))
+	{
+		print_help(argv);
+		return 0;
+	}
+
+	string output_dir = argv[1];
+	int num_sensors = 2, num_frames = 30, seed = 1;
+	double rotation_error = 5, translation_error = 0.05;
+	float depth_noise = 0;
+
+	pcl::console::parse_argument(argc, argv, "-n", num_sensors);
+	pcl::console::parse_argument(argc, argv, "-f", num_frames);
+	pcl::console::parse_argument(argc, argv, "-noise", depth_noise);
+	pcl::console::parse_argument(argc, argv, "-rot", rotation_error);
+	pcl::console::parse_argument(argc, argv, "-trans", translation_error);
+	pcl::console::parse_argument(argc, argv, "-seed", seed);
+
+	if(num_sensors < 2 || num_frames < 1)
+	{
+		cerr << "At least two sensors and one frame are needed" << endl;
+		return 1;
+	}
+
+	if(!mrpt::system::directoryExists(output_dir) && !mrpt::system::createDirectory(output_dir))
+	{
+		cerr << "Could not create " << output_dir << endl;
+		return 1;
+	}
+
+	TSyntheticSceneParams params;
+	params.num_frames = num_frames;
+	params.depth_noise = depth_noise;
+	params.seed = seed;
+
+	CSyntheticScene scene(params, CSyntheticScene::defaultRig(num_sensors));
+
+	string rawlog_path = output_dir + "/synthetic.rawlog", config_path = output_dir + "/synthetic.ini";
+	if(!scene.writeRawlog(rawlog_path))
+	{
+		cerr << "Could not write " << rawlog_path << endl;
+		return 1;
+	}
+
+	if(!scene.writeConfig(config_path, rawlog_path, CSyntheticScene::perturbPoses(scene.getSensorPoses(), rotation_error, translation_error, seed)))
+	{
+		cerr << "Could not write " << config_path << endl;
+		return 1;
+	}
+
+	cout << num_sensors * num_frames << " observations written to " << rawlog_path << ", calibrate them with " << config_path << endl;
+	return 0;
+}
@@ -0,0 +1,373 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#include "synthetic/CSyntheticScene.h"
+
+#include <CObservationTree.h>
+#include <CMemoryMonitor.h>
+#include <CProfiler.h>
+#include <calib_solvers/CCalibFromPlanes.h>
+#include <calib_solvers/CCalibFromLines.h>
+
+#include <mrpt/config/CConfigFile.h>
+#include <mrpt/system/filesystem.h>
+#include <pcl/console/parse.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** The wall time and the peak resident memory of a stage of the pipelines. */
+struct TStageMeasure
+{
+	string name;
+	double time_ms;
+	double peak_memory_mb;
+};
+
+/** What a run of the pipelines is checked against: the accuracy bounds, and the measures of the baseline run with their tolerances. */
+struct TBaseline
+{
+	double max_rotation_error = 0.5;
+
+	/** The translation is not estimated yet, so the estimated poses must keep the translation of the initial calibration. */
+	double max_translation_drift = 1e-4;
+
+	/** The fractions by which the time and the peak memory of a stage may exceed those of the baseline. */
+	double time_tolerance = 1.0;
+	double memory_tolerance = 0.25;
+
+	/** The fraction by which the number of features and correspondences may fall short of those of the baseline. */
+	double count_tolerance = 0.2;
+};
+
+void print_help(char ** argv)
+{
+	cout << "\nThis program runs the plane and line calibration pipelines on a rawlog with known extrinsics, and fails if they are less accurate\n";
+	cout << "than the bounds of a baseline file, or more memory hungry or finding fewer features than the run the baseline was written from.\n";
+	cout << "  usage: " <<  argv[0] << " <baseline_file> [-d data_dir] [-c config_file] [-t] [-w]\n";
+	cout << "            <baseline_file> the bounds and the measures of the baseline run (see test/regression_baseline.ini)\n";
+	cout << "            -d the directory the synthetic rawlog of the [dataset] of the baseline is written to, the current directory by default\n";
+	cout << "            -c a configuration file with a [rawlog] path and the [ground_truth] of its sensors, to check a recorded rawlog instead\n";
+	cout << "            -t checks the wall time of the stages against the baseline too, which only holds on the machine it was written on\n";
+	cout << "            -w writes the measures of this run as the new baseline, keeping its bounds and tolerances, instead of checking them\n";
+	cout << argv[0] << " -h | --help : shows this help" << endl;
+}
+
+/** Runs a stage of the pipelines, measuring its wall time and the peak resident memory of the process while it runs. */
+template <typename Stage>
+void runStage(const char *name, vector<TStageMeasure> &measures, const Stage &stage)
+{
+	CMemoryMonitor::resetPeakResident();
+
+	CScopedTimer timer(name);
+	stage();
+	double seconds = timer.stop();
+
+	measures.push_back(TStageMeasure{name, 1e3 * seconds, CMemoryMonitor::peakResidentBytes() / (1024.0 * 1024.0)});
+}
+
+/** Counts the correspondences between all the pairs of sensors, leaving out the placeholders of the sets without features. */
+size_t countCorrespondences(const map<int,map<int,vector<array<int,3>>>> &correspondences)
+{
+	size_t count = 0;
+	for(const auto &sensor_i : correspondences)
+		for(const auto &sensor_j : sensor_i.second)
+			count += count_if(sensor_j.second.begin(), sensor_j.second.end(), [](const array<int,3> &match) { return match[0] >= 0; });
+
+	return count;
+}
+
+/** Writes the measures of a run as a baseline, with the bounds and tolerances of the current one. */
+bool writeBaseline(const string &path, const mrpt::config::CConfigFile &current, const TBaseline &baseline,
+                   const vector<TStageMeasure> &measures, const vector<pair<string,size_t>> &counts)
+{
+	ofstream file(path);
+
+	file << "# Baseline of the calibration regression gate (test/regression_gate.cpp), written by calib_regression -w.\n";
+	file << "# The measures depend on the build and the machine: write them again with calib_regression test/regression_baseline.ini -w\n";
+	file << "# on the machine that runs the gate, and commit the result along with any change that is meant to move them.\n\n";
+	file << "[dataset]\n";
+	file << "#the synthetic rig the pipelines are run on (see test/synthetic/CSyntheticScene.h)\n";
+	file << "num_sensors=" << current.read_int("dataset", "num_sensors", 2) << "\n";
+	file << "num_frames=" << current.read_int("dataset", "num_frames", 30) << "\n";
+	file << "depth_noise=" << current.read_double("dataset", "depth_noise", 0) << "\n";
+	file << "seed=" << current.read_int("dataset", "seed", 1) << "\n";
+	file << "#error of the initial calibration in degrees and meters, in random directions\n";
+	file << "initial_rotation_error=" << current.read_double("dataset", "initial_rotation_error", 5) << "\n";
+	file << "initial_translation_error=" << current.read_double("dataset", "initial_translation_error", 0.05) << "\n\n";
+
+	file << "[accuracy]\n";
+	file << "#largest error of the estimated pose of a sensor, in degrees\n";
+	file << "max_rotation_error=" << baseline.max_rotation_error << "\n";
+	file << "#the translation is not estimated yet, so the largest distance between the estimated and the initial position of a sensor, in meters\n";
+	file << "max_translation_drift=" << baseline.max_translation_drift << "\n\n";
+
+	file << "[tolerance]\n";
+	file << "#fraction by which the time and the peak memory of a stage may exceed their baseline\n";
+	file << "time=" << baseline.time_tolerance << "\n";
+	file << "memory=" << baseline.memory_tolerance << "\n";
+	file << "#fraction by which the number of features and correspondences may fall short of their baseline\n";
+	file << "count=" << baseline.count_tolerance << "\n\n";
+
+	file << fixed << setprecision(1);
+	file << "[time_ms]\n";
+	for(const TStageMeasure &measure : measures)
+		file << measure.name << "=" << measure.time_ms << "\n";
+
+	file << "\n[peak_memory_mb]\n";
+	for(const TStageMeasure &measure : measures)
+		file << measure.name << "=" << measure.peak_memory_mb << "\n";
+
+	file << "\n[counts]\n";
+	for(const pair<string,size_t> &count : counts)
+		file << count.first << "=" << count.second << "\n";
+
+	return static_cast<bool>(file);
+}
+
+/*! This program fails when the calibration gets less accurate, slower or more memory hungry than a baseline, to be run as a test. */
+int main(int argc, char ** argv)
+{
+	try
+	{
+		if(argc < 2 || pcl::console::find_switch(argc, argv, "-h") || pcl::console::find_switch(argc, argv, "--help"))
+		{
+			print_help(argv);
+			return 0;
+		}
+
+		string baseline_path = argv[1], data_dir = ".", config_path;
+		pcl::console::parse_argument(argc, argv, "-d", data_dir);
+		pcl::console::parse_argument(argc, argv, "-c", config_path);
+		bool write_baseline = pcl::console::find_switch(argc, argv, "-w");
+		bool check_time = pcl::console::find_switch(argc, argv, "-t");
+
+		if(!mrpt::system::fileExists(baseline_path) && !write_baseline)
+		{
+			cerr << "Baseline file " << baseline_path << " not found" << endl;
+			return 1;
+		}
+
+		mrpt::config::CConfigFile baseline_file(baseline_path);
+
+		TBaseline baseline;
+		baseline.max_rotation_error = baseline_file.read_double("accuracy", "max_rotation_error", baseline.max_rotation_error);
+		baseline.max_translation_drift = baseline_file.read_double("accuracy", "max_translation_drift", baseline.max_translation_drift);
+		baseline.time_tolerance = baseline_file.read_double("tolerance", "time", baseline.time_tolerance);
+		baseline.memory_tolerance = baseline_file.read_double("tolerance", "memory", baseline.memory_tolerance);
+		baseline.count_tolerance = baseline_file.read_double("tolerance", "count", baseline.count_tolerance);
+
+		// the synthetic rawlog of the baseline, unless a recorded one is given with its ground truth
+		if(config_path.empty())
+		{
+			if(!mrpt::system::directoryExists(data_dir) && !mrpt::system::createDirectory(data_dir))
+			{
+				cerr << "Could not create " << data_dir << endl;
+				return 1;
+			}
+
+			TSyntheticSceneParams scene_params;
+			scene_params.num_frames = baseline_file.read_int("dataset", "num_frames", 30);
+			scene_params.depth_noise = baseline_file.read_float("dataset", "depth_noise", 0);
+			scene_params.seed = baseline_file.read_int("dataset", "seed", 1);
+
+			CSyntheticScene scene(scene_params, CSyntheticScene::defaultRig(baseline_file.read_int("dataset", "num_sensors", 2)));
+			vector<Eigen::Matrix4f> initial_poses = CSyntheticScene::perturbPoses(scene.getSensorPoses(),
+			                                                                      baseline_file.read_double("dataset", "initial_rotation_error", 5),
+			                                                                      baseline_file.read_double("dataset", "initial_translation_error", 0.05),
+			                                                                      scene_params.seed);
+
+			string rawlog_path = data_dir + "/regression.rawlog";
+			config_path = data_dir + "/regression.ini";
+
+			if(!scene.writeRawlog(rawlog_path) || !scene.writeConfig(config_path, rawlog_path, initial_poses))
+			{
+				cerr << "Could not write the synthetic rawlog to " << data_dir << endl;
+				return 1;
+			}
+		}
+
+		mrpt::config::CConfigFile config_file(config_path);
+		string rawlog_path = config_file.read_string("rawlog", "path", "");
+		if(!mrpt::system::fileExists(rawlog_path))
+		{
+			cerr << "Rawlog file " << rawlog_path << " not found" << endl;
+			return 1;
+		}
+
+		TCalibFromPlanesParams planes_params;
+		planes_params.load(config_file);
+		TCalibFromLinesParams lines_params;
+		lines_params.load(config_file);
+
+		vector<TStageMeasure> measures;
+		vector<pair<string,size_t>> counts;
+		vector<string> failures;
+		vector<string> warnings;
+
+		// the payloads are decoded on every run, rather than read from an index written by a previous one
+		TRawlogLoadParams load_params;
+		load_params.use_index = false;
+
+		CObservationTree model(rawlog_path, config_file);
+		runStage("load", measures, [&]() { model.loadTree(load_params); });
+		runStage("sync", measures, [&]() { model.syncObservations(model.getSensorLabels(), config_file.read_int("grouping_observations", "max_delay", 30)); });
+
+		const vector<string> sensor_labels = model.getSensorLabels();
+		const vector<Eigen::Matrix4f> initial_poses = model.getSensorPoses();
+		counts.push_back(make_pair("sets", static_cast<size_t>(model.getRootItem()->childCount())));
+
+		CCalibFromPlanes planes_calib(&model);
+		string stats;
+		runStage("extractPlanes", measures, [&]() { planes_calib.extractPlanes(planes_params.seg); });
+		runStage("matchPlanes", measures, [&]() { planes_calib.matchPlanes(planes_params.match); });
+		runStage("computeRotation", measures, [&]() { planes_calib.computeRotation(planes_params.solver, initial_poses, stats); });
+
+		counts.push_back(make_pair("planes", planes_calib.getPlaneStore().size()));
+		counts.push_back(make_pair("plane_correspondences", countCorrespondences(planes_calib.mmv_plane_corresp)));
+
+		// the solver of the calibration from lines is not implemented yet, so only its features are checked
+		CCalibFromLines lines_calib(&model);
+		runStage("extractLines", measures, [&]() { lines_calib.extractLines(lines_params.seg); });
+		runStage("matchLines", measures, [&]() { lines_calib.matchLines(lines_params.match); });
+
+		counts.push_back(make_pair("lines", lines_calib.getLineStore().size()));
+		counts.push_back(make_pair("line_correspondences", countCorrespondences(lines_calib.mmv_line_corresp)));
+
+		// every synchronized observation must have been read back, even once evicted from the payload cache
+		if(planes_calib.getUnreadObservationCount() + lines_calib.getUnreadObservationCount() > 0)
+			failures.push_back(to_string(planes_calib.getUnreadObservationCount() + lines_calib.getUnreadObservationCount()) +
+			                   " observations could not be read from the rawlog");
+
+		// the accuracy of the estimated poses, against the ground truth of the sensors
+		vector<Eigen::Matrix4f> estimated_poses(planes_calib.m_calibration.begin(), planes_calib.m_calibration.end());
+		if(estimated_poses.size() != sensor_labels.size())
+			failures.push_back("the rotation solver did not estimate the poses of all the sensors: " + stats);
+
+		double rotation_error = 0, translation_error = 0, translation_drift = 0;
+		for(size_t i = 0; i < sensor_labels.size() && i < estimated_poses.size(); i++)
+		{
+			Eigen::Matrix4f ground_truth;
+			config_file.read_matrix("ground_truth", sensor_labels[i], ground_truth, Eigen::Matrix4f(), true);
+
+			rotation_error = max(rotation_error, CSyntheticScene::rotationError(ground_truth, estimated_poses[i]));
+			translation_error = max(translation_error, CSyntheticScene::translationError(ground_truth, estimated_poses[i]));
+			translation_drift = max(translation_drift, CSyntheticScene::translationError(initial_poses[i], estimated_poses[i]));
+		}
+
+		// the translation error is only reported, as it is that of the initial calibration until the translation is estimated
+		cout << fixed << setprecision(4);
+		cout << "rotation error " << rotation_error << " deg (bound " << baseline.max_rotation_error << "), translation drift "
+		     << translation_drift << " m (bound " << baseline.max_translation_drift << "), translation error " << translation_error << " m\n\n";
+
+		if(rotation_error > baseline.max_rotation_error)
+			failures.push_back("rotation error of " + to_string(rotation_error) + " deg, over the bound of " + to_string(baseline.max_rotation_error));
+		if(translation_drift > baseline.max_translation_drift)
+			failures.push_back("translation drift of " + to_string(translation_drift) + " m from the initial calibration, over the bound of " +
+			                   to_string(baseline.max_translation_drift));
+
+		// a run without features or correspondences would write a baseline that lets the pipelines lose all of them unnoticed
+		for(const pair<string,size_t> &count : counts)
+			if(count.second == 0)
+				failures.push_back("no " + count.first + " found");
+
+		// a run that fails its bounds is not written as the baseline of the next ones
+		if(write_baseline && !failures.empty())
+		{
+			for(const string &failure : failures)
+				cerr << "FAILED: " << failure << endl;
+
+			cerr << "The baseline " << baseline_path << " was not written" << endl;
+			return 1;
+		}
+
+		if(write_baseline)
+		{
+			if(!writeBaseline(baseline_path, baseline_file, baseline, measures, counts))
+			{
+				cerr << "Could not write the baseline to " << baseline_path << endl;
+				return 1;
+			}
+
+			cout << "Baseline written to " << baseline_path << endl;
+			return 0;
+		}
+
+		// the budgets of the stages, from the measures of the baseline run, the time budgets only if asked for
+		cout << setprecision(1);
+		cout << left << setw(18) << "stage" << right << setw(12) << "time (ms)" << setw(14) << "budget (ms)"
+		     << setw(14) << "peak (MB)" << setw(14) << "budget (MB)" << "\n";
+
+		for(const TStageMeasure &measure : measures)
+		{
+			double time_budget = baseline_file.read_double("time_ms", measure.name, -1) * (1 + baseline.time_tolerance);
+			double memory_budget = baseline_file.read_double("peak_memory_mb", measure.name, -1) * (1 + baseline.memory_tolerance);
+
+			cout << left << setw(18) << measure.name << right << setw(12) << measure.time_ms << setw(14) << time_budget
+			     << setw(14) << measure.peak_memory_mb << setw(14) << memory_budget << "\n";
+
+			// a baseline written before a stage or a measure was gated does not fail the runs, which only warn until it is written again
+			if(check_time && time_budget < 0)
+				warnings.push_back("no time budget for the stage " + measure.name + " in the baseline, not gated");
+			if(memory_budget < 0)
+				warnings.push_back("no memory budget for the stage " + measure.name + " in the baseline, not gated");
+			if(check_time && time_budget >= 0 && measure.time_ms > time_budget)
+				failures.push_back(measure.name + " took " + to_string(measure.time_ms) + " ms, over the budget of " + to_string(time_budget));
+			if(memory_budget >= 0 && measure.peak_memory_mb > memory_budget)
+				failures.push_back(measure.name + " peaked at " + to_string(measure.peak_memory_mb) + " MB, over the budget of " + to_string(memory_budget));
+		}
+
+		cout << "\n" << left << setw(24) << "count" << right << setw(10) << "found" << setw(10) << "minimum" << "\n";
+		for(const pair<string,size_t> &count : counts)
+		{
+			double minimum = baseline_file.read_double("counts", count.first, 0) * (1 - baseline.count_tolerance);
+			cout << left << setw(24) << count.first << right << setw(10) << count.second << setw(10) << minimum << "\n";
+
+			if(minimum <= 0)
+				warnings.push_back("no count of " + count.first + " in the baseline, not gated");
+			else if(count.second < minimum)
+				failures.push_back("only " + to_string(count.second) + " " + count.first + " found, under the minimum of " + to_string(minimum));
+		}
+
+		cout << endl;
+		cerr << CProfiler::instance().summary() << endl;
+
+		for(const string &warning : warnings)
+			cerr << "WARNING: " << warning << endl;
+
+		if(!warnings.empty())
+			cerr << "Write the baseline again with -w to gate them" << endl;
+
+		for(const string &failure : failures)
+			cerr << "FAILED: " << failure << endl;
+
+		if(!failures.empty())
+		{
+			cerr << failures.size() << " regression(s) against " << baseline_path << endl;
+			return 1;
+		}
+
+		cout << "No regression against " << baseline_path << endl;
+		return 0;
+	}
+
+	catch(exception &e)
+	{
+		cerr << "Exception caught: " << e.what() << endl;
+		return 1;
+	}
+}
@@ -0,0 +1,296 @@
+#include "CSyntheticScene.h"
+
+#include <mrpt/io/CFileGZOutputStream.h>
+#include <mrpt/serialization/CArchive.h>
+#include <mrpt/system/datetime.h>
+#include <mrpt/poses/CPose3D.h>
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+
+using namespace mrpt::obs;
+using namespace mrpt::img;
+
+namespace
+{
+	const float pi = 3.14159265f;
+
+	float deg2rad(const float &deg)
+	{
+		return deg * pi / 180;
+	}
+
+	/** Returns the gray level of a face of a box, different enough from those of the neighbouring faces to be an edge. */
+	unsigned char faceShade(const size_t &box_id, const int &face)
+	{
+		return static_cast<unsigned char>(50 + ((box_id * 6 + face) * 37) % 180);
+	}
+
+	/** Writes a pose in the format of the [initial_calibration] section of the config file. */
+	std::string poseString(const Eigen::Matrix4f &pose)
+	{
+		std::ostringstream out;
+		out.precision(std::numeric_limits<float>::max_digits10);
+		out << "[";
+		for(int r = 0; r < 4; r++)
+			for(int c = 0; c < 4; c++)
+				out << pose(r,c) << (c < 3 ? " " : (r < 3 ? "; " : "]"));
+
+		return out.str();
+	}
+}
+
+TSyntheticSceneParams::TSyntheticSceneParams()
+{
+	room.min = Eigen::Vector3f(-3, -2.5, 0);
+	room.max = Eigen::Vector3f(3, 2.5, 3);
+
+	// a table, a cabinet against a wall and a pillar, adding planes and edges at other heights and orientations
+	furniture.push_back(TSyntheticBox{Eigen::Vector3f(1.2, 0.8, 0), Eigen::Vector3f(2.2, 1.6, 0.75)});
+	furniture.push_back(TSyntheticBox{Eigen::Vector3f(-3, -2.5, 0), Eigen::Vector3f(-2.4, -1.3, 1.9)});
+	furniture.push_back(TSyntheticBox{Eigen::Vector3f(-1.2, 1.6, 0), Eigen::Vector3f(-0.8, 2.0, 3)});
+}
+
+CSyntheticScene::CSyntheticScene(const TSyntheticSceneParams &params, const std::vector<Eigen::Matrix4f> &sensor_poses,
+                                 const std::vector<std::string> &sensor_labels)
+{
+	m_params = params;
+	m_sensor_poses = sensor_poses;
+	m_sensor_labels = sensor_labels;
+
+	for(size_t i = m_sensor_labels.size(); i < m_sensor_poses.size(); i++)
+		m_sensor_labels.push_back("RGBD_" + std::to_string(i + 1));
+}
+
+std::vector<Eigen::Matrix4f> CSyntheticScene::defaultRig(const size_t &num_sensors)
+{
+	std::vector<Eigen::Matrix4f> poses(num_sensors, Eigen::Matrix4f::Identity());
+
+	for(size_t i = 1; i < num_sensors; i++)
+	{
+		// turned about the vertical axis, and tilted down (about y, pointing left), so that the neighbouring sensors share the floor
+		Eigen::Matrix3f rotation = (Eigen::AngleAxisf(deg2rad(45 * i), Eigen::Vector3f::UnitZ())
+		                            * Eigen::AngleAxisf(deg2rad(10), Eigen::Vector3f::UnitY())).toRotationMatrix();
+		poses[i].block(0,0,3,3) = rotation;
+		poses[i].block(0,3,3,1) = Eigen::Vector3f(-0.05f * i, 0.1f * i, 0.02f * i);
+	}
+
+	return poses;
+}
+
+std::vector<Eigen::Matrix4f> CSyntheticScene::perturbPoses(const std::vector<Eigen::Matrix4f> &poses, const double &rotation_deg, const double &translation,
+                                                           const unsigned int &seed)
+{
+	std::mt19937 generator(seed);
+	std::normal_distribution<float> normal(0, 1);
+	std::vector<Eigen::Matrix4f> perturbed = poses;
+
+	for(size_t i = 1; i < perturbed.size(); i++)
+	{
+		Eigen::Vector3f axis(normal(generator), normal(generator), normal(generator));
+		Eigen::Vector3f offset(normal(generator), normal(generator), normal(generator));
+
+		perturbed[i].block(0,0,3,3) = Eigen::AngleAxisf(deg2rad(rotation_deg), axis.normalized()).toRotationMatrix() * poses[i].block(0,0,3,3);
+		perturbed[i].block(0,3,3,1) += static_cast<float>(translation) * offset.normalized();
+	}
+
+	return perturbed;
+}
+
+double CSyntheticScene::rotationError(const Eigen::Matrix4f &pose1, const Eigen::Matrix4f &pose2)
+{
+	Eigen::Matrix3f rotation = pose1.block(0,0,3,3).transpose() * pose2.block(0,0,3,3);
+	return Eigen::AngleAxisf(rotation).angle() * 180 / pi;
+}
+
+double CSyntheticScene::translationError(const Eigen::Matrix4f &pose1, const Eigen::Matrix4f &pose2)
+{
+	return (pose1.block(0,3,3,1) - pose2.block(0,3,3,1)).norm();
+}
+
+Eigen::Matrix4f CSyntheticScene::rigPose(const size_t &frame) const
+{
+	// the rig turns from -60 to 60 degrees while wobbling, so that the planes are seen from enough orientations to constrain the rotations
+	float s = (m_params.num_frames > 1) ? static_cast<float>(frame) / (m_params.num_frames - 1) : 0.5f;
+	float phase = 2 * pi * s;
+
+	Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+	pose.block(0,0,3,3) = (Eigen::AngleAxisf(deg2rad(-60 + 120 * s), Eigen::Vector3f::UnitZ())
+	                       * Eigen::AngleAxisf(deg2rad(8 * std::sin(phase)), Eigen::Vector3f::UnitY())
+	                       * Eigen::AngleAxisf(deg2rad(5 * std::cos(phase)), Eigen::Vector3f::UnitX())).toRotationMatrix();
+	pose.block(0,3,3,1) = Eigen::Vector3f(0.5f * std::sin(phase), 0.3f * std::cos(phase), 1.3f);
+
+	return pose;
+}
+
+bool CSyntheticScene::castRay(const Eigen::Vector3f &origin, const Eigen::Vector3f &dir, float &t, unsigned char &shade) const
+{
+	t = std::numeric_limits<float>::max();
+
+	// the walls, floor and ceiling, where the ray leaves the room
+	for(int axis = 0; axis < 3; axis++)
+	{
+		if(dir[axis] == 0)
+			continue;
+
+		bool positive = dir[axis] > 0;
+		float t_face = ((positive ? m_params.room.max[axis] : m_params.room.min[axis]) - origin[axis]) / dir[axis];
+		if(t_face > 0 && t_face < t)
+		{
+			t = t_face;
+			shade = faceShade(0, 2 * axis + positive);
+		}
+	}
+
+	// the furniture, where the ray enters a box
+	for(size_t i = 0; i < m_params.furniture.size(); i++)
+	{
+		const TSyntheticBox &box = m_params.furniture[i];
+		float t_enter = -std::numeric_limits<float>::max(), t_exit = std::numeric_limits<float>::max();
+		int enter_face = 0;
+
+		for(int axis = 0; axis < 3; axis++)
+		{
+			if(dir[axis] == 0)
+			{
+				if(origin[axis] < box.min[axis] || origin[axis] > box.max[axis])
+					t_enter = std::numeric_limits<float>::max();
+				continue;
+			}
+
+			float t1 = (box.min[axis] - origin[axis]) / dir[axis];
+			float t2 = (box.max[axis] - origin[axis]) / dir[axis];
+			bool entering_max = t2 < t1;
+			if(entering_max)
+				std::swap(t1, t2);
+
+			if(t1 > t_enter)
+			{
+				t_enter = t1;
+				enter_face = 2 * axis + entering_max;
+			}
+
+			t_exit = std::min(t_exit, t2);
+		}
+
+		if(t_enter <= t_exit && t_enter > 0 && t_enter < t)
+		{
+			t = t_enter;
+			shade = faceShade(i + 1, enter_face);
+		}
+	}
+
+	return t < std::numeric_limits<float>::max();
+}
+
+CObservation3DRangeScan::Ptr CSyntheticScene::render(const size_t &frame, const size_t &sensor_id) const
+{
+	const size_t width = m_params.width, height = m_params.height;
+
+	CObservation3DRangeScan::Ptr obs = std::make_shared<CObservation3DRangeScan>();
+	obs->sensorLabel = m_sensor_labels[sensor_id];
+	obs->timestamp = mrpt::system::time_tToTimestamp(1e9 + frame * m_params.frame_period + sensor_id * m_params.sensor_delay);
+	obs->sensorPose = mrpt::poses::CPose3D(mrpt::math::CMatrixDouble44(m_sensor_poses[sensor_id].cast<double>()));
+	obs->maxRange = 10;
+
+	obs->cameraParams.ncols = width;
+	obs->cameraParams.nrows = height;
+	obs->cameraParams.setIntrinsicParamsFromValues(m_params.fx, m_params.fy, m_params.cx, m_params.cy);
+	obs->cameraParamsIntensity = obs->cameraParams;
+
+	obs->hasRangeImage = true;
+	obs->range_is_depth = true;
+	obs->rangeImage_setSize(height, width);
+
+	obs->hasIntensityImage = true;
+	obs->intensityImageChannel = CObservation3DRangeScan::CH_VISIBLE;
+	obs->intensityImage = CImage(width, height, CH_GRAY);
+
+	// the noise of each observation is seeded by its frame and sensor, so that rendering in any order gives the same frames
+	std::mt19937 generator(m_params.seed + frame * m_sensor_poses.size() + sensor_id);
+
+	// a normal distribution needs a positive standard deviation, so the noiseless frames have none
+	std::unique_ptr<std::normal_distribution<float>> noise;
+	if(m_params.depth_noise > 0)
+		noise.reset(new std::normal_distribution<float>(0, m_params.depth_noise));
+
+	Eigen::Matrix4f pose = rigPose(frame) * m_sensor_poses[sensor_id];
+	Eigen::Matrix3f rotation = pose.block(0,0,3,3);
+	Eigen::Vector3f origin = pose.block(0,3,3,1);
+
+	for(size_t r = 0; r < height; r++)
+	{
+		for(size_t c = 0; c < width; c++)
+		{
+			// the ray of the pixel has a unit x, so that the distance along it is the depth (see CDepthProjector)
+			Eigen::Vector3f ray(1, (m_params.cx - c) / m_params.fx, (m_params.cy - r) / m_params.fy);
+
+			float depth = 0;
+			unsigned char shade = 0;
+			if(castRay(origin, rotation * ray, depth, shade) && noise)
+				depth += (*noise)(generator) * depth * depth;
+
+			obs->rangeImage(r,c) = std::max(depth, 0.f);
+			*obs->intensityImage.get_unsafe(c, r, 0) = shade;
+		}
+	}
+
+	return obs;
+}
+
+bool CSyntheticScene::writeRawlog(const std::string &path) const
+{
+	mrpt::io::CFileGZOutputStream file;
+	if(!file.open(path))
+		return false;
+
+	auto archive = mrpt::serialization::archiveFrom(file);
+
+	for(size_t frame = 0; frame < m_params.num_frames; frame++)
+		for(size_t sensor_id = 0; sensor_id < m_sensor_poses.size(); sensor_id++)
+			archive << *render(frame, sensor_id);
+
+	return true;
+}
+
+bool CSyntheticScene::writeConfig(const std::string &path, const std::string &rawlog_path, const std::vector<Eigen::Matrix4f> &initial_poses) const
+{
+	std::ofstream file(path);
+
+	file << "# Configuration of a synthetic rawlog, written by CSyntheticScene.\n\n";
+	file << "[rawlog]\npath=" << rawlog_path << "\n\n";
+
+	file << "[initial_calibration]\n";
+	for(size_t i = 0; i < m_sensor_labels.size(); i++)
+		file << m_sensor_labels[i] << "=" << poseString(initial_poses[i]) << "\n";
+
+	file << "\n[ground_truth]\n";
+	for(size_t i = 0; i < m_sensor_labels.size(); i++)
+		file << m_sensor_labels[i] << "=" << poseString(m_sensor_poses[i]) << "\n";
+
+	// the observations of a frame are all within a millisecond per sensor of each other
+	file << "\n[grouping_observations]\nmax_delay=" << static_cast<int>(1e3 * m_params.sensor_delay * m_sensor_poses.size()) + 1 << "\n";
+
+	return static_cast<bool>(file);
+}
+
+const TSyntheticSceneParams &CSyntheticScene::getParams() const
+{
+	return m_params;
+}
+
+const std::vector<Eigen::Matrix4f> &CSyntheticScene::getSensorPoses() const
+{
+	return m_sensor_poses;
+}
+
+const std::vector<std::string> &CSyntheticScene::getSensorLabels() const
+{
+	return m_sensor_labels;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <mrpt/obs/CObservation3DRangeScan.h>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <string>
+#include <vector>
+
+/** An axis-aligned box of the synthetic room, in meters. */
+struct TSyntheticBox
+{
+	Eigen::Vector3f min;
+	Eigen::Vector3f max;
+};
+
+/** The parameters of a synthetic scene and of the sensors observing it. */
+struct TSyntheticSceneParams
+{
+	/** The resolution and intrinsics of the depth and intensity cameras, shared by all the sensors. */
+	size_t width = 320;
+	size_t height = 240;
+	double fx = 262.5;
+	double fy = 262.5;
+	double cx = 159.5;
+	double cy = 119.5;
+
+	/** The room the rig moves in, with its floor at z = 0. */
+	TSyntheticBox room;
+
+	/** The furniture standing in the room, seen from outside. */
+	std::vector<TSyntheticBox> furniture;
+
+	/** The number of frames observed by every sensor, as the rig sweeps the room. */
+	size_t num_frames = 30;
+
+	/** The time between two frames, and between the observations of two consecutive sensors of a frame, in seconds. */
+	double frame_period = 0.1;
+	double sensor_delay = 0.002;
+
+	/** The standard deviation of the depth noise at 1 m, in meters, growing with the square of the depth. 0 renders exact depths. */
+	float depth_noise = 0;
+
+	/** The seed of the depth noise, so that the same parameters always render the same frames. */
+	unsigned int seed = 1;
+
+	/** Sets up a 6 x 5 x 3 m room with a table, a cabinet and a pillar. */
+	TSyntheticSceneParams();
+};
+
+/**
+ * Renders the organized depth and intensity frames of a rig of RGB-D sensors with known extrinsics, sweeping a room made of
+ * boxes, so that the calibration can be benchmarked and checked against its ground truth without recorded datasets.
+ * Every surface of the room has a shade of its own, so that the plane boundaries are also edges of the intensity images.
+ * The frames are CObservation3DRangeScan with depth ranges, in the convention of mrpt (x forward, y left, z up),
+ * and the sensor poses are relative to the rig, as in the [initial_calibration] section of the config file.
+ */
+
+class CSyntheticScene
+{
+	public:
+
+	    /**
+		 * Constructor
+		 * \param params the room and the sensors.
+		 * \param sensor_poses the ground truth pose of each sensor relative to the rig.
+		 * \param sensor_labels the label of each sensor, RGBD_1, RGBD_2, ... if empty.
+		 */
+	    CSyntheticScene(const TSyntheticSceneParams &params, const std::vector<Eigen::Matrix4f> &sensor_poses,
+		                const std::vector<std::string> &sensor_labels = std::vector<std::string>());
+
+		/** Returns the poses of a rig of sensors side by side, each turned 45 degrees from the previous one and tilted down. */
+		static std::vector<Eigen::Matrix4f> defaultRig(const size_t &num_sensors);
+
+		/**
+		 * \brief Returns the poses with their rotation and translation off by the given amounts in random directions, e.g. as an initial calibration.
+		 * The first pose is left as is, as it is the reference of the others.
+		 */
+		static std::vector<Eigen::Matrix4f> perturbPoses(const std::vector<Eigen::Matrix4f> &poses, const double &rotation_deg, const double &translation,
+		                                                 const unsigned int &seed);
+
+		/** Returns the angle of the rotation between two poses, in degrees. */
+		static double rotationError(const Eigen::Matrix4f &pose1, const Eigen::Matrix4f &pose2);
+
+		/** Returns the distance between the positions of two poses, in meters. */
+		static double translationError(const Eigen::Matrix4f &pose1, const Eigen::Matrix4f &pose2);
+
+		/** Returns the pose of the rig in the room at a frame. */
+		Eigen::Matrix4f rigPose(const size_t &frame) const;
+
+		/** Renders the observation of a sensor at a frame. */
+		mrpt::obs::CObservation3DRangeScan::Ptr render(const size_t &frame, const size_t &sensor_id) const;
+
+		/** Writes the observations of all the sensors at all the frames to a rawlog, in timestamp order. Returns false if it could not be written. */
+		bool writeRawlog(const std::string &path) const;
+
+		/**
+		 * \brief Writes a config file for the app and the command-line tool, calibrating the rawlog from an initial calibration.
+		 * The ground truth poses are written to a [ground_truth] section.
+		 * \return false if the file could not be written.
+		 */
+		bool writeConfig(const std::string &path, const std::string &rawlog_path, const std::vector<Eigen::Matrix4f> &initial_poses) const;
+
+		const TSyntheticSceneParams &getParams() const;
+
+		const std::vector<Eigen::Matrix4f> &getSensorPoses() const;
+
+		const std::vector<std::string> &getSensorLabels() const;
+
+	private:
+
+		/**
+		 * \brief Finds the first surface hit by a ray.
+		 * \param origin the origin of the ray, inside the room.
+		 * \param dir the direction of the ray, not necessarily unit.
+		 * \param t the distance to the surface, in units of dir.
+		 * \param shade the gray level of the surface.
+		 * \return false if the ray hits nothing, which only happens for rays leaving the room through an edge.
+		 */
+		bool castRay(const Eigen::Vector3f &origin, const Eigen::Vector3f &dir, float &t, unsigned char &shade) const;
+
+		TSyntheticSceneParams m_params;
+
+		std::vector<Eigen::Matrix4f> m_sensor_poses;
+
+		std::vector<std::string> m_sensor_labels;
+};
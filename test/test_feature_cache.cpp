@@ -0,0 +1,313 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#define BOOST_TEST_MODULE test_feature_cache
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "synthetic/CSyntheticScene.h"
+
+#include <CFeatureCache.h>
+#include <CObservationTree.h>
+#include <calib_solvers/CCalibFromPlanes.h>
+
+#include <mrpt/config/CConfigFile.h>
+
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	/** A cache directory and a stand-in rawlog, removed at the end of the test. */
+	struct TCacheDir
+	{
+		boost::filesystem::path dir;
+		std::string cache_dir;
+		std::string rawlog_path;
+
+		TCacheDir()
+		{
+			dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("feature-cache-%%%%%%%%");
+			boost::filesystem::create_directories(dir);
+			cache_dir = (dir / "cache").string();
+			rawlog_path = (dir / "a.rawlog").string();
+			writeFile(rawlog_path, "rawlog contents");
+		}
+
+		~TCacheDir()
+		{
+			boost::filesystem::remove_all(dir);
+		}
+
+		static void writeFile(const std::string &path, const std::string &contents)
+		{
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			file << contents;
+		}
+	};
+
+	TObservationInfo makeInfo()
+	{
+		TObservationInfo info;
+		info.offset = 123456;
+		info.timestamp = 987654321;
+		info.sensor_label = "RGBD_1";
+		info.class_name = "CObservation3DRangeScan";
+		return info;
+	}
+
+	std::vector<CPlaneCHull> makePlanes(std::mt19937 &rng)
+	{
+		std::uniform_real_distribution<Scalar> value(-10, 10);
+		std::vector<CPlaneCHull> planes(5);
+
+		for(CPlaneCHull &plane : planes)
+		{
+			plane.v3center = Eigen::Matrix<Scalar,3,1>::NullaryExpr([&](){ return value(rng); });
+			plane.v3normal = Eigen::Matrix<Scalar,3,1>::NullaryExpr([&](){ return value(rng); }).normalized();
+			plane.d = value(rng);
+			plane.covariance = Eigen::Matrix<Scalar,4,4>::NullaryExpr([&](){ return value(rng); });
+			plane.curvature = value(rng);
+			plane.area = value(rng);
+			plane.n_inliers = rng() % 100000;
+
+			plane.ConvexHullPtr.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+			plane.ConvexHullPtr->points.resize(rng() % 40);
+			for(pcl::PointXYZRGBA &point : plane.ConvexHullPtr->points)
+			{
+				point.x = value(rng);
+				point.y = value(rng);
+				point.z = value(rng);
+				point.rgba = rng();
+			}
+
+			plane.v_hull_indices.resize(plane.ConvexHullPtr->points.size());
+			for(size_t &index : plane.v_hull_indices)
+				index = rng() % 76800;
+
+			plane.v_inliers.resize(rng() % 500);
+			for(int &index : plane.v_inliers)
+				index = rng() % 76800;
+		}
+
+		return planes;
+	}
+
+	/** Checks that planes read back from the cache are those stored, field by field. */
+	void checkSamePlanes(const std::vector<CPlaneCHull> &loaded, const std::vector<CPlaneCHull> &planes)
+	{
+		BOOST_REQUIRE_EQUAL(loaded.size(), planes.size());
+
+		for(size_t i = 0; i < planes.size(); i++)
+		{
+			BOOST_CHECK(loaded[i].v3center == planes[i].v3center);
+			BOOST_CHECK(loaded[i].v3normal == planes[i].v3normal);
+			BOOST_CHECK_EQUAL(loaded[i].d, planes[i].d);
+			BOOST_CHECK(loaded[i].covariance == planes[i].covariance);
+			BOOST_CHECK_EQUAL(loaded[i].curvature, planes[i].curvature);
+			BOOST_CHECK_EQUAL(loaded[i].area, planes[i].area);
+			BOOST_CHECK_EQUAL(loaded[i].n_inliers, planes[i].n_inliers);
+
+			BOOST_REQUIRE(loaded[i].ConvexHullPtr);
+			BOOST_REQUIRE_EQUAL(loaded[i].ConvexHullPtr->points.size(), planes[i].ConvexHullPtr->points.size());
+			for(size_t k = 0; k < planes[i].ConvexHullPtr->points.size(); k++)
+			{
+				const pcl::PointXYZRGBA &a = loaded[i].ConvexHullPtr->points[k];
+				const pcl::PointXYZRGBA &b = planes[i].ConvexHullPtr->points[k];
+				BOOST_CHECK(a.x == b.x && a.y == b.y && a.z == b.z && a.rgba == b.rgba);
+			}
+
+			BOOST_CHECK(loaded[i].v_hull_indices == planes[i].v_hull_indices);
+			BOOST_CHECK(loaded[i].v_inliers == planes[i].v_inliers);
+		}
+	}
+
+	TLineBatch makeLines(std::mt19937 &rng)
+	{
+		std::uniform_real_distribution<Scalar> value(-10, 10);
+		auto random = [&](){ return value(rng); };
+		auto pixel = [&](){ return static_cast<int>(rng() % 240); };
+
+		TLineBatch lines;
+		lines.resize(7);
+		lines.rho = Eigen::Matrix<Scalar,1,Eigen::Dynamic>::NullaryExpr(lines.size(), random);
+		lines.theta = Eigen::Matrix<Scalar,1,Eigen::Dynamic>::NullaryExpr(lines.size(), random);
+		lines.m = Eigen::Matrix<Scalar,1,Eigen::Dynamic>::NullaryExpr(lines.size(), random);
+		lines.c = Eigen::Matrix<Scalar,1,Eigen::Dynamic>::NullaryExpr(lines.size(), random);
+		for(int k = 0; k < 2; k++)
+		{
+			lines.end_points[k] = Eigen::Matrix2Xi::NullaryExpr(2, lines.size(), pixel);
+			lines.end_points3D[k] = Eigen::Matrix3Xf::NullaryExpr(3, lines.size(), random);
+		}
+
+		lines.mean_points = Eigen::Matrix2Xi::NullaryExpr(2, lines.size(), pixel);
+		lines.l = Eigen::Matrix2Xi::NullaryExpr(2, lines.size(), pixel);
+		lines.rays = Eigen::Matrix3Xf::NullaryExpr(3, lines.size(), random);
+		lines.normals = Eigen::Matrix3Xf::NullaryExpr(3, lines.size(), random);
+		lines.points = Eigen::Matrix3Xf::NullaryExpr(3, lines.size(), random);
+		lines.directions = Eigen::Matrix3Xf::NullaryExpr(3, lines.size(), random);
+
+		return lines;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(planes_round_trip)
+{
+	TCacheDir dir;
+	std::mt19937 rng(1);
+	const std::vector<CPlaneCHull> planes = makePlanes(rng);
+
+	CFeatureCache cache(dir.cache_dir, dir.rawlog_path);
+	BOOST_REQUIRE(cache.isEnabled());
+	BOOST_REQUIRE(cache.storePlanes(makeInfo(), 42, planes));
+
+	std::vector<CPlaneCHull> loaded;
+	BOOST_REQUIRE(cache.loadPlanes(makeInfo(), 42, loaded));
+
+	checkSamePlanes(loaded, planes);
+
+	// other parameters address another entry
+	BOOST_CHECK(!cache.loadPlanes(makeInfo(), 43, loaded));
+	BOOST_CHECK_EQUAL(cache.getHits(), 1);
+	BOOST_CHECK_EQUAL(cache.getMisses(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(segmented_planes_round_trip)
+{
+	TCacheDir dir;
+	const std::string rawlog_path = (dir.dir / "synthetic.rawlog").string();
+	const std::string config_path = (dir.dir / "synthetic.ini").string();
+
+	TSyntheticSceneParams scene_params;
+	scene_params.num_frames = 2;
+
+	CSyntheticScene scene(scene_params, CSyntheticScene::defaultRig(2));
+	BOOST_REQUIRE(scene.writeRawlog(rawlog_path));
+	BOOST_REQUIRE(scene.writeConfig(config_path, rawlog_path, scene.getSensorPoses()));
+
+	mrpt::config::CConfigFile config_file(config_path);
+	TCalibFromPlanesParams params;
+	params.load(config_file);
+
+	CObservationTree model(rawlog_path, config_file);
+	BOOST_REQUIRE(model.loadTree());
+	CCalibFromPlanes calib(&model);
+	CFeatureCache cache(dir.cache_dir, rawlog_path);
+	size_t num_planes = 0;
+
+	// the planes are those the segmentation gives, with every field the cache writes set by it rather than by hand
+	for(int record_id = 0; record_id < model.getObsCount(); record_id++)
+	{
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud = model.getCloud(record_id, CCloudCache::COORDINATES);
+		BOOST_REQUIRE(cloud);
+
+		std::vector<CPlaneCHull> planes;
+		calib.segmentPlanes(cloud, params.seg, planes);
+
+		for(const CPlaneCHull &plane : planes)
+		{
+			BOOST_CHECK(plane.v3normal.allFinite() && plane.v3center.allFinite() && std::isfinite(plane.d));
+			BOOST_CHECK(plane.covariance.allFinite());
+			BOOST_CHECK(plane.curvature >= 0 && plane.curvature <= params.seg.max_curvature);
+			BOOST_CHECK_GT(plane.area, 0);
+			BOOST_CHECK_EQUAL(plane.n_inliers, plane.v_inliers.size());
+		}
+
+		const TObservationInfo &info = model.getObservationInfo(record_id);
+		BOOST_REQUIRE(cache.storePlanes(info, 42, planes));
+
+		std::vector<CPlaneCHull> loaded;
+		BOOST_REQUIRE(cache.loadPlanes(info, 42, loaded));
+		checkSamePlanes(loaded, planes);
+
+		num_planes += planes.size();
+	}
+
+	// the walls of the room are found, so that the comparison is not vacuous
+	BOOST_CHECK_GT(num_planes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(lines_round_trip)
+{
+	TCacheDir dir;
+	std::mt19937 rng(2);
+	const TLineBatch lines = makeLines(rng);
+
+	CFeatureCache cache(dir.cache_dir, dir.rawlog_path);
+	BOOST_REQUIRE(cache.storeLines(makeInfo(), 42, lines));
+
+	TLineBatch loaded;
+	BOOST_REQUIRE(cache.loadLines(makeInfo(), 42, loaded));
+	BOOST_REQUIRE_EQUAL(loaded.size(), lines.size());
+
+	BOOST_CHECK(loaded.rho == lines.rho);
+	BOOST_CHECK(loaded.theta == lines.theta);
+	BOOST_CHECK(loaded.m == lines.m);
+	BOOST_CHECK(loaded.c == lines.c);
+	for(int k = 0; k < 2; k++)
+	{
+		BOOST_CHECK(loaded.end_points[k] == lines.end_points[k]);
+		BOOST_CHECK(loaded.end_points3D[k] == lines.end_points3D[k]);
+	}
+
+	BOOST_CHECK(loaded.mean_points == lines.mean_points);
+	BOOST_CHECK(loaded.l == lines.l);
+	BOOST_CHECK(loaded.rays == lines.rays);
+	BOOST_CHECK(loaded.normals == lines.normals);
+	BOOST_CHECK(loaded.points == lines.points);
+	BOOST_CHECK(loaded.directions == lines.directions);
+
+	// an empty batch of lines is stored too, so that observations without lines are not segmented again
+	TObservationInfo other = makeInfo();
+	other.offset++;
+	BOOST_REQUIRE(cache.storeLines(other, 42, TLineBatch()));
+	BOOST_CHECK(cache.loadLines(other, 42, loaded));
+	BOOST_CHECK_EQUAL(loaded.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(entries_are_keyed_by_rawlog)
+{
+	TCacheDir dir;
+	std::mt19937 rng(3);
+	const TLineBatch lines = makeLines(rng);
+	TLineBatch loaded;
+
+	{
+		CFeatureCache cache(dir.cache_dir, dir.rawlog_path);
+		BOOST_REQUIRE(cache.storeLines(makeInfo(), 42, lines));
+	}
+
+	// the same rawlog, unchanged, finds the entry
+	{
+		CFeatureCache cache(dir.cache_dir, dir.rawlog_path);
+		BOOST_CHECK(cache.loadLines(makeInfo(), 42, loaded));
+	}
+
+	// another rawlog of the same size does not
+	{
+		std::string other_path = (dir.dir / "b.rawlog").string();
+		TCacheDir::writeFile(other_path, "rawlog_contents");
+		boost::filesystem::last_write_time(other_path, boost::filesystem::last_write_time(dir.rawlog_path));
+
+		CFeatureCache cache(dir.cache_dir, other_path);
+		BOOST_CHECK(!cache.loadLines(makeInfo(), 42, loaded));
+	}
+
+	// nor does the rawlog recorded again in place with the same size
+	{
+		TCacheDir::writeFile(dir.rawlog_path, "rawlog_contents");
+		boost::filesystem::last_write_time(dir.rawlog_path, boost::filesystem::last_write_time(dir.rawlog_path) + 10);
+
+		CFeatureCache cache(dir.cache_dir, dir.rawlog_path);
+		BOOST_CHECK(!cache.loadLines(makeInfo(), 42, loaded));
+	}
+}
@@ -0,0 +1,236 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#define BOOST_TEST_MODULE test_line_batch
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "synthetic/CSyntheticScene.h"
+
+#include <CObservationTree.h>
+#include <calib_solvers/CCalibFromLines.h>
+#include <calib_solvers/CLineDetector.h>
+
+#include <mrpt/config/CConfigFile.h>
+#include <mrpt/math/geometry.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace mrpt::obs;
+
+namespace
+{
+	/** A synthetic rawlog of two sensors with its config file, loaded and synchronized, and removed at the end of the test. */
+	struct TSyntheticModel
+	{
+		boost::filesystem::path dir;
+		std::unique_ptr<mrpt::config::CConfigFile> config_file;
+		std::unique_ptr<CObservationTree> model;
+		TCalibFromLinesParams params;
+
+		TSyntheticModel()
+		{
+			dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("line-batch-%%%%%%%%");
+			boost::filesystem::create_directories(dir);
+			const std::string rawlog_path = (dir / "synthetic.rawlog").string();
+			const std::string config_path = (dir / "synthetic.ini").string();
+
+			TSyntheticSceneParams scene_params;
+			scene_params.num_frames = 6;
+
+			CSyntheticScene scene(scene_params, CSyntheticScene::defaultRig(2));
+			BOOST_REQUIRE(scene.writeRawlog(rawlog_path));
+			BOOST_REQUIRE(scene.writeConfig(config_path, rawlog_path, scene.getSensorPoses()));
+
+			config_file.reset(new mrpt::config::CConfigFile(config_path));
+			params.load(*config_file);
+
+			model.reset(new CObservationTree(rawlog_path, *config_file));
+			BOOST_REQUIRE(model->loadTree());
+			model->syncObservations(model->getSensorLabels(), config_file->read_int("grouping_observations", "max_delay", 30));
+			BOOST_REQUIRE(model->getRootItem()->childCount() > 0);
+		}
+
+		~TSyntheticModel()
+		{
+			boost::filesystem::remove_all(dir);
+		}
+
+		CObservation3DRangeScan::Ptr observation(const int &sensor_id, const int &sync_obs_id) const
+		{
+			return std::dynamic_pointer_cast<CObservation3DRangeScan>(model->getObservation(model->getSyncIndices()[sensor_id][sync_obs_id]));
+		}
+	};
+
+	/** The lines of an image built segment by segment, as segmentLines() did before it built them as a batch. */
+	std::vector<CLine> referenceLines(const cv::Mat &image, const utils::TRangeView &range, const TLineSegmentationParams &params,
+	                                  const mrpt::img::TCamera &camera_params)
+	{
+		std::vector<TLineSegment> segments;
+		CLineDetector::create(params.detector)->detect(image, params, segments);
+
+		std::vector<CLine> lines;
+		CLine line;
+
+		for(size_t n = 0; n < segments.size(); n++)
+		{
+			const std::array<Eigen::Vector2i, 2> &end_points = segments[n].end_points;
+
+			Eigen::Vector2i mean_point = Eigen::Vector2i((end_points[0][0] + end_points[1][0])/2, (end_points[0][1] + end_points[1][1])/2);
+
+			Eigen::Vector3f ray;
+			ray[0] = (mean_point[0] - camera_params.cx())/camera_params.fx();
+			ray[1] = (mean_point[1] - camera_params.cy())/camera_params.fy();
+			ray[2] = 1;
+
+			Eigen::Vector2i l_temp = (end_points[0] - end_points[1]);
+			Eigen::Vector3i l(l_temp[0], l_temp[1], 0);
+
+			Eigen::Vector3f normal;
+			mrpt::math::crossProduct3D(l, ray, normal);
+
+			Eigen::Vector3f p;
+			utils::backprojectTo3D(mean_point, range, camera_params, p);
+
+			std::array<Eigen::Vector3f, 2> end_points3D;
+			utils::backprojectTo3D(end_points[0], range, camera_params, end_points3D[0]);
+			utils::backprojectTo3D(end_points[1], range, camera_params, end_points3D[1]);
+
+			line.rho = segments[n].rho;
+			line.theta = segments[n].theta;
+			line.m = segments[n].m;
+			line.c = segments[n].c;
+			line.end_points = end_points;
+			line.end_points3D = end_points3D;
+			line.mean_point = mean_point;
+			line.ray = ray;
+			line.l = l;
+			line.normal = normal;
+			line.p = p;
+			line.v = end_points3D[1] - end_points3D[0];
+			lines.push_back(line);
+		}
+
+		return lines;
+	}
+
+	/** Whether two vectors agree to 1e-7, relative to their norm when it is over 1, as the batch rounds the intrinsics to float. */
+	bool close(const Eigen::Vector3f &a, const Eigen::Vector3f &b)
+	{
+		return (a - b).norm() <= 1e-7 * std::max(1.f, b.norm());
+	}
+
+	/** Checks that a line of a batch or of the store agrees with the one built segment by segment. */
+	void checkLine(const CLine &line, const CLine &expected)
+	{
+		BOOST_CHECK_EQUAL(line.rho, expected.rho);
+		BOOST_CHECK_EQUAL(line.theta, expected.theta);
+		BOOST_CHECK_EQUAL(line.m, expected.m);
+		BOOST_CHECK_EQUAL(line.c, expected.c);
+		BOOST_CHECK(line.end_points[0] == expected.end_points[0] && line.end_points[1] == expected.end_points[1]);
+		BOOST_CHECK(line.mean_point == expected.mean_point);
+		BOOST_CHECK(line.l == expected.l);
+
+		BOOST_CHECK(close(line.end_points3D[0], expected.end_points3D[0]));
+		BOOST_CHECK(close(line.end_points3D[1], expected.end_points3D[1]));
+		BOOST_CHECK(close(line.ray, expected.ray));
+		BOOST_CHECK(close(line.normal, expected.normal));
+		BOOST_CHECK(close(line.p, expected.p));
+		BOOST_CHECK(close(line.v, expected.v));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(batch_matches_per_segment_lines)
+{
+	TSyntheticModel synthetic;
+	CCalibFromLines calib(synthetic.model.get());
+	TLineSegmentationParams params = synthetic.params.seg;
+	const std::vector<std::vector<int>> &sync_indices = synthetic.model->getSyncIndices();
+	size_t num_lines = 0;
+
+	for(int type = 0; type < CLineDetector::NUM_TYPES; type++)
+	{
+		params.detector = type;
+
+		for(size_t sensor_id = 0; sensor_id < sync_indices.size(); sensor_id++)
+		{
+			for(size_t sync_obs_id = 0; sync_obs_id < sync_indices[sensor_id].size(); sync_obs_id++)
+			{
+				CObservation3DRangeScan::Ptr obs = synthetic.observation(sensor_id, sync_obs_id);
+				BOOST_REQUIRE(obs);
+
+				cv::Mat image = cv::cvarrToMat(obs->intensityImage.getAs<IplImage>());
+				utils::TRangeView range = utils::rangeView(obs->rangeImage);
+
+				TLineBatch batch;
+				calib.segmentLines(image, range, params, obs->cameraParamsIntensity, batch);
+				std::vector<CLine> expected = referenceLines(image, range, params, obs->cameraParamsIntensity);
+
+				BOOST_TEST_CONTEXT(CLineDetector::typeName(type) << ", sensor " << sensor_id << ", observation " << sync_obs_id)
+				{
+					BOOST_REQUIRE_EQUAL(batch.size(), expected.size());
+					for(size_t i = 0; i < batch.size(); i++)
+						checkLine(batch.line(i), expected[i]);
+				}
+
+				num_lines += batch.size();
+			}
+		}
+	}
+
+	// the edges between the surfaces of the room are found, so that the comparison is not vacuous
+	BOOST_CHECK_GT(num_lines, 0);
+}
+
+BOOST_AUTO_TEST_CASE(store_matches_per_segment_lines)
+{
+	TSyntheticModel synthetic;
+	CCalibFromLines calib(synthetic.model.get());
+	TLineSegmentationParams params = synthetic.params.seg;
+	const std::vector<std::vector<int>> &sync_indices = synthetic.model->getSyncIndices();
+	size_t num_lines = 0;
+
+	for(int type = 0; type < CLineDetector::NUM_TYPES; type++)
+	{
+		params.detector = type;
+		BOOST_REQUIRE(calib.extractLines(params));
+
+		// the batches of the observations are written to the store as they are, each at the offset of its observation
+		const CLineStore &store = calib.getLineStore();
+		BOOST_REQUIRE_EQUAL(store.getNumberOfSensors(), sync_indices.size());
+
+		for(size_t sensor_id = 0; sensor_id < sync_indices.size(); sensor_id++)
+		{
+			BOOST_REQUIRE_EQUAL(store.getNumberOfObservations(sensor_id), sync_indices[sensor_id].size());
+
+			for(size_t sync_obs_id = 0; sync_obs_id < sync_indices[sensor_id].size(); sync_obs_id++)
+			{
+				CObservation3DRangeScan::Ptr obs = synthetic.observation(sensor_id, sync_obs_id);
+				BOOST_REQUIRE(obs);
+
+				std::vector<CLine> expected = referenceLines(cv::cvarrToMat(obs->intensityImage.getAs<IplImage>()), utils::rangeView(obs->rangeImage),
+				                                             params, obs->cameraParamsIntensity);
+
+				BOOST_TEST_CONTEXT(CLineDetector::typeName(type) << ", sensor " << sensor_id << ", observation " << sync_obs_id)
+				{
+					BOOST_REQUIRE_EQUAL(store.count(sensor_id, sync_obs_id), expected.size());
+					for(size_t line_id = 0; line_id < expected.size(); line_id++)
+						checkLine(store.getLine(sensor_id, sync_obs_id, line_id), expected[line_id]);
+				}
+			}
+		}
+
+		num_lines += store.size();
+	}
+
+	BOOST_CHECK_GT(num_lines, 0);
+}
@@ -0,0 +1,138 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#define BOOST_TEST_MODULE test_log_sink
+#include <boost/test/unit_test.hpp>
+
+#include <CLogSink.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	/**
+	 * Publishes messages from several producers while a consumer drains them, then checks that every message queued was
+	 * drained once, intact, and in the order of its producer, and that the others were counted as dropped.
+	 */
+	void stress(const size_t &capacity, const int &num_producers, const int &messages_per_producer)
+	{
+		CLogSink sink(capacity, CLogSink::LOG_DEBUG);
+
+		std::vector<std::vector<bool>> queued(num_producers, std::vector<bool>(messages_per_producer, false));
+		std::atomic<int> producers_done(0);
+		std::atomic<bool> start(false);
+
+		std::vector<std::thread> producers;
+		for(int p = 0; p < num_producers; p++)
+		{
+			producers.emplace_back([&, p]()
+			{
+				while(!start)
+					std::this_thread::yield();
+
+				for(int i = 0; i < messages_per_producer; i++)
+				{
+					// long enough texts to be allocated, so that a torn copy would show
+					std::string text = std::to_string(p) + ":" + std::to_string(i) + ":" + std::string(32 + i % 17, 'a' + p % 26);
+					queued[p][i] = sink.log(text, static_cast<CLogSink::LogLevel>(i % 4));
+				}
+
+				producers_done++;
+			});
+		}
+
+		std::vector<CLogSink::TLogMessage> drained;
+		size_t dropped = 0;
+		start = true;
+
+		while(producers_done < num_producers)
+		{
+			sink.drain(drained, 64);
+			dropped += sink.takeDropped();
+		}
+
+		for(std::thread &producer : producers)
+			producer.join();
+
+		while(sink.drain(drained, 64) > 0)
+			continue;
+		dropped += sink.takeDropped();
+
+		std::vector<int> next(num_producers, 0);
+		size_t num_queued = 0;
+
+		for(const CLogSink::TLogMessage &message : drained)
+		{
+			size_t first = message.text.find(':');
+			size_t second = message.text.find(':', first + 1);
+			BOOST_REQUIRE(first != std::string::npos && second != std::string::npos);
+
+			int p = std::stoi(message.text.substr(0, first));
+			int i = std::stoi(message.text.substr(first + 1, second - first - 1));
+			BOOST_REQUIRE(p >= 0 && p < num_producers && i >= 0 && i < messages_per_producer);
+
+			// the messages of a producer come out in the order they were queued, once each
+			BOOST_REQUIRE_GE(i, next[p]);
+			next[p] = i + 1;
+			BOOST_REQUIRE(queued[p][i]);
+
+			BOOST_REQUIRE_EQUAL(message.level, static_cast<CLogSink::LogLevel>(i % 4));
+			BOOST_REQUIRE(message.text.substr(second + 1) == std::string(32 + i % 17, 'a' + p % 26));
+		}
+
+		for(int p = 0; p < num_producers; p++)
+			for(int i = 0; i < messages_per_producer; i++)
+				num_queued += queued[p][i];
+
+		BOOST_CHECK_EQUAL(drained.size(), num_queued);
+		BOOST_CHECK_EQUAL(num_queued + dropped, static_cast<size_t>(num_producers) * messages_per_producer);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_producers_large_ring)
+{
+	stress(1 << 16, 8, 5000);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_producers_full_ring)
+{
+	// a ring much smaller than the messages in flight, so that producers race for the cells freed by the consumer, and drop
+	stress(8, 8, 20000);
+}
+
+BOOST_AUTO_TEST_CASE(single_thread_order_and_levels)
+{
+	CLogSink sink(5, CLogSink::LOG_WARNING);
+	BOOST_CHECK_EQUAL(sink.getCapacity(), 8);
+
+	BOOST_CHECK(!sink.log("debug", CLogSink::LOG_DEBUG));
+	BOOST_CHECK(!sink.log("info", CLogSink::LOG_INFO));
+	BOOST_CHECK_EQUAL(sink.takeDropped(), 0);
+
+	for(int i = 0; i < 10; i++)
+		BOOST_CHECK_EQUAL(sink.log(std::to_string(i), CLogSink::LOG_ERROR), i < 8);
+	BOOST_CHECK_EQUAL(sink.takeDropped(), 2);
+
+	std::vector<CLogSink::TLogMessage> drained;
+	BOOST_CHECK_EQUAL(sink.drain(drained, 3), 3);
+	BOOST_CHECK_EQUAL(sink.drain(drained, 100), 5);
+	BOOST_CHECK_EQUAL(sink.drain(drained, 100), 0);
+
+	for(int i = 0; i < 8; i++)
+		BOOST_CHECK_EQUAL(drained[i].text, std::to_string(i));
+
+	// the cells drained are free for the next lap
+	BOOST_CHECK(sink.log("again", CLogSink::LOG_WARNING));
+	sink.setMinLevel(CLogSink::LOG_DEBUG);
+	BOOST_CHECK(sink.log("debug", CLogSink::LOG_DEBUG));
+	BOOST_CHECK_EQUAL(sink.drain(drained, 100), 2);
+}
@@ -0,0 +1,169 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#define BOOST_TEST_MODULE test_normal_index
+#include <boost/test/unit_test.hpp>
+
+#include <CNormalIndex.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+	/** The ids of the vectors whose dot product with a query exceeds a threshold, comparing the query with all of them as the matching did. */
+	std::vector<int> fullSearch(const Eigen::Matrix3Xf &vectors, const Eigen::Vector3f &query, const double &min_dot_prod)
+	{
+		std::vector<int> matches;
+		for(int id = 0; id < vectors.cols(); id++)
+			if(query.dot(vectors.col(id)) > min_dot_prod)
+				matches.push_back(id);
+
+		return matches;
+	}
+
+	/**
+	 * Queries the index with every vector and with random ones, and checks that the candidates are sorted valid ids, and that
+	 * keeping those over the threshold finds exactly the matches of the full search.
+	 */
+	void checkAgainstFullSearch(const Eigen::Matrix3Xf &vectors, const double &min_dot_prod, const double &cell_size, std::mt19937 &rng)
+	{
+		CNormalIndex index;
+		index.build(vectors, cell_size);
+		BOOST_REQUIRE_EQUAL(index.size(), vectors.cols());
+
+		std::normal_distribution<float> coordinate;
+		Eigen::Matrix3Xf queries(3, 2 * vectors.cols());
+		queries.leftCols(vectors.cols()) = vectors;
+		queries.rightCols(vectors.cols()) = Eigen::Matrix3Xf::NullaryExpr(3, vectors.cols(), [&](){ return coordinate(rng); });
+
+		std::vector<int> candidates, matches;
+
+		for(int q = 0; q < queries.cols(); q++)
+		{
+			const Eigen::Vector3f query = queries.col(q);
+			index.findCandidates(query, min_dot_prod, candidates);
+
+			BOOST_REQUIRE(std::adjacent_find(candidates.begin(), candidates.end(), std::greater_equal<int>()) == candidates.end());
+			BOOST_REQUIRE(candidates.empty() || (candidates.front() >= 0 && candidates.back() < vectors.cols()));
+
+			matches.clear();
+			for(const int &id : candidates)
+				if(query.dot(vectors.col(id)) > min_dot_prod)
+					matches.push_back(id);
+
+			BOOST_TEST_CONTEXT("query " << q << " (" << query.transpose() << "), threshold " << min_dot_prod)
+			{
+				BOOST_REQUIRE(matches == fullSearch(vectors, query, min_dot_prod));
+			}
+		}
+	}
+
+	/** Random unit vectors, some of them repeated, and some on the axes and on the diagonals, where the buckets meet. */
+	Eigen::Matrix3Xf randomNormals(const int &num_vectors, std::mt19937 &rng)
+	{
+		std::normal_distribution<float> coordinate;
+		Eigen::Matrix3Xf vectors(3, num_vectors);
+
+		for(int id = 0; id < num_vectors; id++)
+		{
+			switch(id > 0 ? rng() % 8 : 3)
+			{
+				case 0:
+					vectors.col(id) = Eigen::Vector3f::Unit(rng() % 3) * ((rng() % 2) ? 1.f : -1.f);
+					break;
+				case 1:
+					vectors.col(id) = Eigen::Vector3f((rng() % 2) ? 1.f : -1.f, (rng() % 2) ? 1.f : -1.f, (rng() % 3) - 1.f).normalized();
+					break;
+				case 2:
+					vectors.col(id) = vectors.col(rng() % id);
+					break;
+				default:
+					vectors.col(id) = Eigen::Vector3f(coordinate(rng), coordinate(rng), coordinate(rng)).normalized();
+			}
+
+			if(!vectors.col(id).allFinite())
+				vectors.col(id) = Eigen::Vector3f::UnitZ();
+		}
+
+		return vectors;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(unit_normals_match_full_search)
+{
+	std::mt19937 rng(1);
+	const double thresholds[] = {-0.5, 0, 0.5, 0.9, 0.95, 0.99, 0.999, 0.99999};
+
+	for(int trial = 0; trial < 200; trial++)
+	{
+		Eigen::Matrix3Xf vectors = randomNormals(1 + rng() % 300, rng);
+		const double min_dot_prod = thresholds[trial % 8];
+
+		// the index is built for the threshold of the matching, or for a lower one, with larger buckets, which must only change the candidates
+		const double cell_size = CNormalIndex::cellSize(trial % 3 == 0 ? thresholds[rng() % (trial % 8 + 1)] : min_dot_prod);
+		checkAgainstFullSearch(vectors, min_dot_prod, cell_size, rng);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(vectors_of_any_norm_match_full_search)
+{
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<double> threshold(-50, 100);
+	std::exponential_distribution<float> norm(0.1f);
+
+	for(int trial = 0; trial < 200; trial++)
+	{
+		Eigen::Matrix3Xf vectors = randomNormals(1 + rng() % 300, rng);
+
+		// unnormalized vectors, with some of zero norm and some not finite, which have no direction and are always candidates
+		for(int id = 0; id < vectors.cols(); id++)
+		{
+			switch(rng() % 12)
+			{
+				case 0:
+					vectors.col(id).setZero();
+					break;
+				case 1:
+					vectors.col(id)[rng() % 3] = std::numeric_limits<float>::quiet_NaN();
+					break;
+				default:
+					vectors.col(id) *= norm(rng);
+			}
+		}
+
+		checkAgainstFullSearch(vectors, threshold(rng), CNormalIndex::cellSize(0.9), rng);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(high_thresholds_prune_candidates)
+{
+	std::mt19937 rng(3);
+	std::normal_distribution<float> coordinate;
+	const int num_vectors = 2000;
+	Eigen::Matrix3Xf vectors = Eigen::Matrix3Xf::NullaryExpr(3, num_vectors, [&](){ return coordinate(rng); });
+	vectors.colwise().normalize();
+
+	CNormalIndex index;
+	index.build(vectors, CNormalIndex::cellSize(0.99));
+
+	// the matching thresholds of the planes and lines are close to 1, where the index must compare a normal with few others
+	std::vector<int> candidates;
+	size_t num_candidates = 0;
+	for(int id = 0; id < num_vectors; id++)
+	{
+		index.findCandidates(vectors.col(id), 0.99, candidates);
+		num_candidates += candidates.size();
+	}
+
+	BOOST_CHECK_LT(num_candidates, static_cast<size_t>(num_vectors) * num_vectors / 10);
+}
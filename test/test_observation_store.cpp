@@ -0,0 +1,222 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#define BOOST_TEST_MODULE test_observation_store
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "synthetic/CSyntheticScene.h"
+
+#include <CObservationStore.h>
+#include <CObservationTree.h>
+#include <CRawlogIndex.h>
+#include <CRawlogLoader.h>
+
+#include <mrpt/config/CConfigFile.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mrpt::obs;
+
+namespace
+{
+	/** A small synthetic rawlog of two sensors, with its config file, removed at the end of the test. */
+	struct TSyntheticRawlog
+	{
+		boost::filesystem::path dir;
+		std::string rawlog_path;
+		std::string config_path;
+
+		TSyntheticRawlog()
+		{
+			dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("observation-store-%%%%%%%%");
+			boost::filesystem::create_directories(dir);
+			rawlog_path = (dir / "synthetic.rawlog").string();
+			config_path = (dir / "synthetic.ini").string();
+
+			TSyntheticSceneParams params;
+			params.width = 80;
+			params.height = 60;
+			params.fx = params.fy = 65.6;
+			params.cx = 39.5;
+			params.cy = 29.5;
+			params.num_frames = 12;
+
+			CSyntheticScene scene(params, CSyntheticScene::defaultRig(2));
+			BOOST_REQUIRE(scene.writeRawlog(rawlog_path));
+			BOOST_REQUIRE(scene.writeConfig(config_path, rawlog_path, scene.getSensorPoses()));
+		}
+
+		~TSyntheticRawlog()
+		{
+			boost::filesystem::remove_all(dir);
+		}
+	};
+
+	/** Reads all the observations of a rawlog with the loader, by their offset. */
+	std::map<uint64_t, CObservation3DRangeScan::Ptr> loadAll(const std::string &rawlog_path)
+	{
+		std::map<uint64_t, CObservation3DRangeScan::Ptr> observations;
+
+		CRawlogLoader loader(rawlog_path, TRawlogLoadParams());
+		BOOST_REQUIRE(loader.run([&](TLoadedObservation &loaded)
+		{
+			observations[loaded.offset] = std::dynamic_pointer_cast<CObservation3DRangeScan>(loaded.obs);
+		}));
+
+		return observations;
+	}
+
+	void checkSame(const CObservation::Ptr &obs, const CObservation3DRangeScan::Ptr &expected)
+	{
+		CObservation3DRangeScan::Ptr scan = std::dynamic_pointer_cast<CObservation3DRangeScan>(obs);
+		BOOST_REQUIRE(scan);
+		BOOST_CHECK_EQUAL(scan->sensorLabel, expected->sensorLabel);
+		BOOST_CHECK(scan->timestamp == expected->timestamp);
+		BOOST_CHECK(scan->rangeImage == expected->rangeImage);
+	}
+
+	/** Writes the uncompressed content of a gzip-compressed file to a plain one. */
+	void inflateFile(const std::string &gz_path, const std::string &plain_path)
+	{
+		gzFile in = gzopen(gz_path.c_str(), "rb");
+		FILE *out = std::fopen(plain_path.c_str(), "wb");
+		BOOST_REQUIRE(in && out);
+
+		std::vector<char> buffer(1 << 16);
+		int n;
+		while((n = gzread(in, buffer.data(), static_cast<unsigned>(buffer.size()))) > 0)
+			std::fwrite(buffer.data(), 1, n, out);
+
+		gzclose(in);
+		std::fclose(out);
+	}
+
+	/** Reads every observation several times in random order through a store that only fits one payload, so that nearly every read evicts. */
+	void checkEvictAndReread(const std::string &rawlog_path, const std::map<uint64_t, CObservation3DRangeScan::Ptr> &expected)
+	{
+		std::vector<uint64_t> offsets;
+		for(const auto &entry : expected)
+			offsets.push_back(entry.first);
+
+		CObservationStore store(rawlog_path, CObservationStore::estimatePayloadBytes(*expected.begin()->second));
+		std::mt19937 rng(5);
+
+		for(int round = 0; round < 3; round++)
+		{
+			std::shuffle(offsets.begin(), offsets.end(), rng);
+			for(const uint64_t &offset : offsets)
+			{
+				checkSame(store.get(offset), expected.at(offset));
+				BOOST_CHECK_LE(store.getMemoryUsage(), store.getMemoryBudget());
+			}
+		}
+
+		// the payloads were read back from the rawlog after being evicted, rather than kept
+		BOOST_CHECK_GE(store.getMisses(), 3 * offsets.size() - 3);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(evicted_payloads_are_read_back)
+{
+	TSyntheticRawlog rawlog;
+	std::map<uint64_t, CObservation3DRangeScan::Ptr> expected = loadAll(rawlog.rawlog_path);
+	BOOST_REQUIRE_EQUAL(expected.size(), 24);
+
+	checkEvictAndReread(rawlog.rawlog_path, expected);
+
+	// the same offsets address the observations of an uncompressed rawlog
+	std::string plain_path = (rawlog.dir / "plain.rawlog").string();
+	inflateFile(rawlog.rawlog_path, plain_path);
+	checkEvictAndReread(plain_path, expected);
+}
+
+BOOST_AUTO_TEST_CASE(tree_from_index_reads_payloads)
+{
+	TSyntheticRawlog rawlog;
+	std::map<uint64_t, CObservation3DRangeScan::Ptr> expected = loadAll(rawlog.rawlog_path);
+	mrpt::config::CConfigFile config_file(rawlog.config_path);
+
+	// the first load writes the index, and the second builds the tree from it without reading any payload
+	{
+		CObservationTree model(rawlog.rawlog_path, config_file);
+		BOOST_REQUIRE(model.loadTree());
+	}
+
+	CObservationTree model(rawlog.rawlog_path, config_file);
+	BOOST_REQUIRE(model.loadTree());
+	BOOST_REQUIRE_EQUAL(model.getObsCount(), expected.size());
+
+	for(int record_id = static_cast<int>(expected.size()) - 1; record_id >= 0; record_id--)
+		checkSame(model.getObservation(record_id), expected.at(model.getObservationInfo(record_id).offset));
+}
+
+BOOST_AUTO_TEST_CASE(truncated_rawlog_is_an_error)
+{
+	TSyntheticRawlog rawlog;
+	mrpt::config::CConfigFile config_file(rawlog.config_path);
+	std::string plain_path = (rawlog.dir / "plain.rawlog").string();
+	inflateFile(rawlog.rawlog_path, plain_path);
+
+	// the last object is cut in the middle of its payload, in the inflated stream or in the gzip stream itself
+	const std::string paths[] = {plain_path, rawlog.rawlog_path};
+	for(const std::string &path : paths)
+	{
+		boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 100);
+
+		CRawlogLoader loader(path, TRawlogLoadParams());
+		BOOST_CHECK_THROW(loader.run([](TLoadedObservation &) {}), std::exception);
+
+		// the observations read before the cut are not taken for the whole rawlog, nor indexed as such
+		CObservationTree model(path, config_file);
+		BOOST_CHECK(!model.loadTree());
+		BOOST_CHECK(!boost::filesystem::exists(CRawlogIndex::indexPathFor(path)));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(damaged_index_falls_back_to_rawlog)
+{
+	TSyntheticRawlog rawlog;
+	mrpt::config::CConfigFile config_file(rawlog.config_path);
+	const std::string index_path = CRawlogIndex::indexPathFor(rawlog.rawlog_path);
+	int num_observations;
+
+	{
+		CObservationTree model(rawlog.rawlog_path, config_file);
+		BOOST_REQUIRE(model.loadTree());
+		num_observations = model.getObsCount();
+	}
+
+	// the count of sensor labels, after the magic, the version, and the size and time of the rawlog, is made far larger than the file
+	const uint32_t damaged_count = 0xffffffff;
+	{
+		std::fstream file(index_path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(8 + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(int64_t));
+		file.write(reinterpret_cast<const char*>(&damaged_count), sizeof(damaged_count));
+		BOOST_REQUIRE(file.good());
+	}
+
+	CRawlogIndex index;
+	BOOST_CHECK(!index.load(rawlog.rawlog_path));
+
+	CObservationTree model(rawlog.rawlog_path, config_file);
+	BOOST_REQUIRE(model.loadTree());
+	BOOST_CHECK_EQUAL(model.getObsCount(), num_observations);
+
+	// the index was written again from the rawlog
+	BOOST_CHECK(index.load(rawlog.rawlog_path));
+	BOOST_CHECK_EQUAL(index.size(), static_cast<size_t>(num_observations));
+}
@@ -0,0 +1,70 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#define BOOST_TEST_MODULE test_profiler
+#include <boost/test/unit_test.hpp>
+
+#include <CProfiler.h>
+
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	/** Returns the thread ids of the events of a Chrome trace, and counts the events. */
+	std::set<int> traceThreadIds(const std::string &trace, size_t &num_events)
+	{
+		std::set<int> ids;
+		num_events = 0;
+
+		const std::string key = "\"tid\": ";
+		for(size_t pos = trace.find(key); pos != std::string::npos; pos = trace.find(key, pos + 1))
+		{
+			ids.insert(std::stoi(trace.substr(pos + key.size())));
+			num_events++;
+		}
+
+		return ids;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(buffers_of_exited_threads_are_reused)
+{
+	CProfiler &profiler = CProfiler::instance();
+	profiler.clear();
+
+	// the main thread records too, so that its buffer is not released to the workers
+	{
+		CScopedTimer timer("main");
+	}
+
+	// rounds of four threads at once, many more threads than the rounds run at the same time
+	for(int round = 0; round < 50; round++)
+	{
+		std::vector<std::thread> threads;
+		for(int t = 0; t < 4; t++)
+			threads.emplace_back([]() { CScopedTimer timer("worker"); });
+
+		for(std::thread &thread : threads)
+			thread.join();
+	}
+
+	std::ostringstream trace;
+	profiler.writeChromeTrace(trace);
+
+	// the records of the threads that exited are kept, under at most the ids of the threads running at once
+	size_t num_events = 0;
+	std::set<int> ids = traceThreadIds(trace.str(), num_events);
+	BOOST_CHECK_EQUAL(num_events, 1 + 50 * 4);
+	BOOST_CHECK_LE(ids.size(), 1 + 4);
+	BOOST_CHECK_LE(*ids.rbegin(), 4);
+}
@@ -0,0 +1,151 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#define BOOST_TEST_MODULE test_seekable_gz_file
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <CSeekableGzFile.h>
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	/** Content that compresses somewhat, with back references across the deflate blocks. */
+	std::vector<uint8_t> makeContent(const size_t &size)
+	{
+		std::mt19937 rng(7);
+		std::vector<uint8_t> content(size);
+		for(size_t i = 0; i < size; i++)
+			content[i] = (i > 1000 && rng() % 4) ? content[i - 1 - rng() % 1000] : static_cast<uint8_t>(rng());
+
+		return content;
+	}
+
+	std::string tempPath(const std::string &name)
+	{
+		return (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path(name + "-%%%%%%%%")).string();
+	}
+
+	void writeGz(const std::string &path, const std::vector<uint8_t> &content)
+	{
+		gzFile file = gzopen(path.c_str(), "wb6");
+		BOOST_REQUIRE(file);
+		BOOST_REQUIRE_EQUAL(gzwrite(file, content.data(), static_cast<unsigned>(content.size())), static_cast<int>(content.size()));
+		gzclose(file);
+	}
+
+	void writePlain(const std::string &path, const std::vector<uint8_t> &content)
+	{
+		FILE *file = std::fopen(path.c_str(), "wb");
+		BOOST_REQUIRE(file);
+		BOOST_REQUIRE_EQUAL(std::fwrite(content.data(), 1, content.size(), file), content.size());
+		std::fclose(file);
+	}
+
+	/** Reads ranges at random offsets, backwards and forwards, and compares them with the content. */
+	void checkRandomReads(CSeekableGzFile &file, const std::vector<uint8_t> &content)
+	{
+		std::mt19937 rng(11);
+		std::vector<uint8_t> buffer;
+
+		for(int i = 0; i < 300; i++)
+		{
+			uint64_t offset = rng() % content.size();
+			size_t count = rng() % 200000;
+			size_t expected = std::min<size_t>(count, content.size() - offset);
+
+			BOOST_REQUIRE(file.seek(offset));
+			BOOST_REQUIRE_EQUAL(file.tell(), offset);
+
+			buffer.assign(count, 0);
+			BOOST_REQUIRE_EQUAL(file.read(buffer.data(), count), expected);
+			BOOST_REQUIRE(std::equal(buffer.begin(), buffer.begin() + expected, content.begin() + offset));
+			BOOST_REQUIRE_EQUAL(file.tell(), offset + expected);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(compressed_random_access)
+{
+	const std::vector<uint8_t> content = makeContent(12 << 20);
+	const std::string path = tempPath("seekable.gz");
+	writeGz(path, content);
+
+	CSeekableGzFile file(256 << 10);
+	BOOST_REQUIRE(file.open(path));
+	BOOST_CHECK(file.isCompressed());
+
+	checkRandomReads(file, content);
+
+	// the whole content was inflated at least once by the reads, so the access points cover it
+	BOOST_REQUIRE(file.seek(content.size()));
+	BOOST_CHECK_GE(file.getNumberOfAccessPoints(), content.size() / (512 << 10));
+	BOOST_CHECK(!file.seek(content.size() + 1));
+
+	// reading again after the access points are complete, with a fresh open discarding them
+	checkRandomReads(file, content);
+	BOOST_REQUIRE(file.open(path));
+	BOOST_CHECK_EQUAL(file.getNumberOfAccessPoints(), 0);
+	checkRandomReads(file, content);
+
+	file.close();
+	boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(compressed_sequential_read)
+{
+	const std::vector<uint8_t> content = makeContent(3 << 20);
+	const std::string path = tempPath("sequential.gz");
+	writeGz(path, content);
+
+	CSeekableGzFile file(64 << 10);
+	BOOST_REQUIRE(file.open(path));
+
+	std::vector<uint8_t> read(content.size() + 100);
+	size_t total = 0;
+	while(size_t n = file.read(read.data() + total, 4093))
+		total += n;
+
+	BOOST_CHECK_EQUAL(total, content.size());
+	BOOST_CHECK(std::equal(content.begin(), content.end(), read.begin()));
+
+	file.close();
+	boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(plain_random_access)
+{
+	const std::vector<uint8_t> content = makeContent(2 << 20);
+	const std::string path = tempPath("plain.rawlog");
+	writePlain(path, content);
+
+	CSeekableGzFile file;
+	BOOST_REQUIRE(file.open(path));
+	BOOST_CHECK(!file.isCompressed());
+
+	checkRandomReads(file, content);
+	BOOST_CHECK(!file.seek(content.size() + 1));
+
+	file.close();
+	boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(missing_file)
+{
+	CSeekableGzFile file;
+	BOOST_CHECK(!file.open(tempPath("missing")));
+	BOOST_CHECK(!file.isOpen());
+	BOOST_CHECK(!file.seek(0));
+}
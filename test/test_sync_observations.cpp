@@ -0,0 +1,196 @@
+/* +---------------------------------------------------------------------------+
+   |                     Mobile Robot Programming Toolkit (MRPT)               |
+   |                          http://www.mrpt.org/                             |
+   |                                                                           |
+   | Copyright (c) 2005-2018, Individual contributors, see AUTHORS file        |
+   | See: http://www.mrpt.org/Authors - All rights reserved.                   |
+   | Released under BSD License. See details in http://www.mrpt.org/License    |
+   +---------------------------------------------------------------------------+ */
+
+#define BOOST_TEST_MODULE test_sync_observations
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <CObservationTree.h>
+
+#include <mrpt/config/CConfigFile.h>
+#include <mrpt/io/CFileGZOutputStream.h>
+#include <mrpt/obs/CObservation3DRangeScan.h>
+#include <mrpt/serialization/CArchive.h>
+#include <mrpt/system/datetime.h>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	/** The sets and sync indices grouped from a list of observations. */
+	struct TSyncResult
+	{
+		/** The record ids of the observations of each set, in the order they were grouped. */
+		std::vector<std::vector<int>> sets;
+		std::vector<std::vector<int>> sync_indices;
+	};
+
+	/**
+	 * The grouping of syncObservations() before it was replaced by a sweep over the candidates: a walk over the whole tree that
+	 * restarts from the second observation of a set each time the set is closed, and removes the duplicate indices at the end.
+	 */
+	TSyncResult referenceSync(const std::vector<std::string> &labels, const std::vector<mrpt::system::TTimeStamp> &timestamps,
+	                          const std::vector<std::string> &selected_sensor_labels, const int &max_delay)
+	{
+		TSyncResult result;
+		std::vector<std::string> sensor_labels_in_set;
+		std::vector<int> obs_set;
+		mrpt::system::TTimeStamp set_ts = 0;
+		std::vector<std::vector<int>> sync_indices_tmp(selected_sensor_labels.size());
+
+		auto insertSet = [&]()
+		{
+			result.sets.push_back(obs_set);
+			for(size_t k = 0; k < obs_set.size(); k++)
+				sync_indices_tmp[utils::findItemIndexIn(selected_sensor_labels, sensor_labels_in_set[k])].push_back(obs_set[k]);
+		};
+
+		for(size_t i = 0; i < labels.size(); i++)
+		{
+			if(std::find(selected_sensor_labels.begin(), selected_sensor_labels.end(), labels[i]) == selected_sensor_labels.end())
+				continue;
+
+			if(obs_set.empty())
+			{
+				sensor_labels_in_set.push_back(labels[i]);
+				obs_set.push_back(i);
+				set_ts = timestamps[i];
+				continue;
+			}
+
+			double delay = mrpt::system::timeDifference(set_ts, timestamps[i]);
+			if(std::find(sensor_labels_in_set.begin(), sensor_labels_in_set.end(), labels[i]) == sensor_labels_in_set.end() && delay <= max_delay)
+			{
+				sensor_labels_in_set.push_back(labels[i]);
+				obs_set.push_back(i);
+				continue;
+			}
+
+			if(sensor_labels_in_set.size() == selected_sensor_labels.size())
+				insertSet();
+
+			i -= sensor_labels_in_set.size();
+			sensor_labels_in_set.clear();
+			obs_set.clear();
+		}
+
+		if(!obs_set.empty() && sensor_labels_in_set.size() == selected_sensor_labels.size())
+			insertSet();
+
+		result.sync_indices.resize(selected_sensor_labels.size());
+		for(size_t s = 0; s < sync_indices_tmp.size(); s++)
+			for(const int &id : sync_indices_tmp[s])
+				if(std::find(result.sync_indices[s].begin(), result.sync_indices[s].end(), id) == result.sync_indices[s].end())
+					result.sync_indices[s].push_back(id);
+
+		return result;
+	}
+
+	/** Writes a rawlog of empty observations with the given labels and timestamps, and a config file with a pose for each label. */
+	void writeRawlog(const std::string &rawlog_path, const std::string &config_path, const std::vector<std::string> &labels,
+	                 const std::vector<mrpt::system::TTimeStamp> &timestamps, const std::vector<std::string> &all_labels)
+	{
+		{
+			mrpt::io::CFileGZOutputStream file;
+			BOOST_REQUIRE(file.open(rawlog_path));
+			auto archive = mrpt::serialization::archiveFrom(file);
+
+			for(size_t i = 0; i < labels.size(); i++)
+			{
+				mrpt::obs::CObservation3DRangeScan obs;
+				obs.sensorLabel = labels[i];
+				obs.timestamp = timestamps[i];
+				archive << obs;
+			}
+		}
+
+		std::ofstream config(config_path);
+		config << "[initial_calibration]\n";
+		for(const std::string &label : all_labels)
+			config << label << "=[1 0 0 0; 0 1 0 0; 0 0 1 0; 0 0 0 1]\n";
+	}
+}
+
+BOOST_AUTO_TEST_CASE(sync_matches_reference_on_random_logs)
+{
+	boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sync-observations-%%%%%%%%");
+	boost::filesystem::create_directories(dir);
+	const std::string rawlog_path = (dir / "random.rawlog").string();
+	const std::string config_path = (dir / "random.ini").string();
+
+	// four sensors, and one that is never selected, whose observations still count in the restart positions of the reference
+	const std::vector<std::string> all_labels = {"sensor_a", "sensor_b", "sensor_c", "sensor_d", "imu"};
+	std::mt19937 rng(3);
+
+	TRawlogLoadParams load_params;
+	load_params.use_index = false;
+
+	for(int trial = 0; trial < 300; trial++)
+	{
+		size_t num_labels = 1 + rng() % all_labels.size();
+		size_t num_obs = rng() % 120;
+
+		// observations of random sensors at random intervals, sometimes out of order, against delays of 0 to 2 seconds
+		std::vector<std::string> labels(num_obs);
+		std::vector<mrpt::system::TTimeStamp> timestamps(num_obs);
+		double t = 1e9;
+		for(size_t i = 0; i < num_obs; i++)
+		{
+			labels[i] = all_labels[rng() % num_labels];
+			t += (rng() % 10 == 0) ? -0.5 : std::uniform_real_distribution<double>(0, 1.5)(rng);
+			timestamps[i] = mrpt::system::time_tToTimestamp(t);
+		}
+
+		writeRawlog(rawlog_path, config_path, labels, timestamps, all_labels);
+		mrpt::config::CConfigFile config_file(config_path);
+
+		CObservationTree model(rawlog_path, config_file);
+		BOOST_REQUIRE(model.loadTree(load_params));
+		BOOST_REQUIRE_EQUAL(model.getObsCount(), num_obs);
+
+		// a random selection of the sensors, in a random order
+		std::vector<std::string> selected(all_labels.begin(), all_labels.begin() + num_labels);
+		std::shuffle(selected.begin(), selected.end(), rng);
+		selected.resize(1 + rng() % num_labels);
+		int max_delay = rng() % 3;
+
+		TSyncResult expected = referenceSync(labels, timestamps, selected, max_delay);
+		model.syncObservations(selected, max_delay);
+
+		BOOST_TEST_CONTEXT("trial " << trial)
+		{
+			CObservationTreeItem *root = model.getRootItem();
+			BOOST_REQUIRE_EQUAL(root->childCount(), expected.sets.size());
+			BOOST_REQUIRE(model.getSyncIndices() == expected.sync_indices);
+
+			for(int set_id = 0; set_id < root->childCount(); set_id++)
+			{
+				CObservationTreeItem *set_item = root->child(set_id);
+				BOOST_REQUIRE_EQUAL(set_item->childCount(), expected.sets[set_id].size());
+
+				for(int k = 0; k < set_item->childCount(); k++)
+				{
+					int record_id = set_item->child(k)->getRecordId();
+					BOOST_REQUIRE_EQUAL(record_id, expected.sets[set_id][k]);
+
+					// the constant time lookup finds the observation of each sensor of the set
+					int sensor_id = utils::findItemIndexIn(selected, labels[record_id]);
+					int sync_index = model.getSyncIndex(set_id, sensor_id);
+					BOOST_REQUIRE_EQUAL(model.getSyncIndices()[sensor_id][sync_index], record_id);
+				}
+			}
+		}
+	}
+
+	boost::filesystem::remove_all(dir);
+}